@@ -0,0 +1,125 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Feeds chunked bodies through basic_chunked_content_parser::parse_some the
+// way the HTTP client does and reports the throughput of the framing. Bodies
+// of small chunks stress the size lines, the other cases large chunks, chunk
+// extensions and trailers. Input arrives in reads of 16KiB.
+//
+// usage: bench_chunked [megabytes=256]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <net/http/parser/content_parser.hpp>
+#include <net/http/response/basic_response.hpp>
+#include <net/detail/tags.hpp>
+
+#include <sys/time.h>
+
+typedef net::http::basic_chunked_content_parser<net::default_tag>   parser_type;
+typedef net::http::basic_response<net::default_tag>                 response_type;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    std::string make_body(std::size_t chunk, std::size_t total, char const * extension, char const * trailers)
+    {
+        std::string body;
+        std::string const data(chunk, 'x');
+        for(std::size_t sent = 0; sent < total; sent += chunk)
+        {
+            char line[64];
+            std::sprintf(line, "%lx", static_cast<unsigned long>(chunk));
+            body += line;
+            body += extension;
+            body += "\r\n";
+            body += data;
+            body += "\r\n";
+        }
+        body += "0\r\n";
+        body += trailers;
+        body += "\r\n";
+        return body;
+    }
+
+    void run(char const * name, std::string const & body, std::size_t megabytes)
+    {
+        enum { READ_SIZE = 0x4000 };
+        std::size_t const rounds = megabytes * 1024 * 1024 / body.size() + 1;
+        std::size_t payload = 0;
+        parser_type parser;
+        double const start = now();
+        for(std::size_t round = 0; round < rounds; ++round)
+        {
+            response_type response;
+            parser.clear();
+            char const * position = body.data();
+            char const * const last = body.data() + body.size();
+            boost::tribool result = boost::indeterminate;
+            while(position != last && boost::indeterminate(result))
+            {
+                char const * end = last - position > READ_SIZE ? position + READ_SIZE : last;
+                while(position != end && boost::indeterminate(result))
+                {
+                    char const * data = 0;
+                    std::size_t size = 0;
+                    result = parser.parse_some(position, end, data, size, response);
+                    payload += size;
+                }
+            }
+            if(!result)
+            {
+                std::printf("%-20s parse failed\n", name);
+                return;
+            }
+        }
+        double const seconds = now() - start;
+        std::printf("%-20s %8.1f MB/s wire  %8.1f MB/s payload\n",
+                    name,
+                    rounds * body.size() / seconds / (1024 * 1024),
+                    payload / seconds / (1024 * 1024));
+    }
+}
+
+int main(int argc, char const ** argv)
+{
+    std::size_t const megabytes = argc > 1 ? std::strtoul(argv[1], 0, 10) : 256;
+
+    run("16 byte chunks", make_body(16, 1 << 20, "", ""), megabytes / 8);
+    run("256 byte chunks", make_body(256, 1 << 20, "", ""), megabytes);
+    run("16KiB chunks", make_body(0x4000, 1 << 22, "", ""), megabytes);
+    run("extensions", make_body(256, 1 << 20, ";name=value;q=\"quoted \\\" text\"", ""), megabytes);
+    run("trailers", make_body(0x4000, 1 << 16, "", "X-Checksum: 0123456789abcdef\r\nX-Count: 4\r\n"), megabytes);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Encodes and decodes the response heads recorded in test/data as HPACK
+// header blocks on one core and reports blocks per second. The blocks
+// follow each other as on one connection, so the dynamic table carries
+// over; for comparison the heads are also encoded with a fresh encoder
+// each, which can only use the static table and Huffman coding.
+//
+// usage: bench_hpack [blocks=1000000] [data=test/data]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <net/http/hpack.hpp>
+#include <net/detail/tags.hpp>
+
+#include <sys/time.h>
+
+typedef net::http::basic_hpack_encoder<net::default_tag>    encoder_type;
+typedef net::http::basic_hpack_decoder<net::default_tag>    decoder_type;
+typedef encoder_type::field_type                            field_type;
+typedef encoder_type::field_list                            field_list;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    void report(char const * name, std::size_t blocks, std::size_t plain, double seconds)
+    {
+        std::printf("%-14s %10.0f blocks/s  %6.1f ns/block  %7.1f MB/s\n",
+                    name,
+                    blocks / seconds,
+                    seconds * 1e9 / blocks,
+                    plain / seconds / (1024 * 1024));
+    }
+
+    std::string trim(std::string const & text)
+    {
+        std::string::size_type const first = text.find_first_not_of(" \t\r");
+        if(first == std::string::npos)
+        {
+            return std::string();
+        }
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    // The head of a recording as HTTP/2 fields, connection specific
+    // headers are left out
+    bool load_fields(std::string const & path, field_list & fields)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        std::string line;
+        if(!file || !std::getline(file, line))
+        {
+            return false;
+        }
+        std::istringstream status_line(line);
+        std::string version, status;
+        status_line >> version >> status;
+        fields.push_back(field_type(":status", status));
+        while(std::getline(file, line) && !trim(line).empty())
+        {
+            std::string::size_type const colon = line.find(':');
+            if(colon == std::string::npos)
+            {
+                continue;
+            }
+            std::string name = trim(line.substr(0, colon));
+            for(std::string::iterator it = name.begin(); it != name.end(); ++it)
+            {
+                *it = static_cast<char>(std::tolower(*it));
+            }
+            if(name == "connection" || name == "transfer-encoding" || name == "keep-alive")
+            {
+                continue;
+            }
+            fields.push_back(field_type(name, trim(line.substr(colon + 1))));
+        }
+        return true;
+    }
+
+    // Size of the fields as an HTTP/1.1 head
+    std::size_t plain_size(field_list const & fields)
+    {
+        std::size_t size = 0;
+        for(field_list::const_iterator it = fields.begin(); it != fields.end(); ++it)
+        {
+            size += it->first.size() + it->second.size() + 4;
+        }
+        return size;
+    }
+}
+
+int main(int argc, char const ** argv)
+{
+    std::size_t const blocks = argc > 1 ? std::strtoul(argv[1], 0, 10) : 1000000;
+    std::string const data = argc > 2 ? argv[2] : "test/data";
+
+    std::vector<field_list> heads;
+    for(int i = 1; ; ++i)
+    {
+        char name[32];
+        std::sprintf(name, "/%d.dat", i);
+        field_list fields;
+        if(!load_fields(data + name, fields))
+        {
+            break;
+        }
+        heads.push_back(fields);
+    }
+    if(heads.empty() || !blocks)
+    {
+        std::cerr << "no recordings in " << data << std::endl;
+        return 1;
+    }
+
+    // One connection's worth of blocks, decoded over and over
+    std::size_t const stream_blocks = 1000;
+    std::vector<std::string> stream(stream_blocks);
+    std::size_t stream_plain = 0;
+    std::size_t stream_size = 0;
+    {
+        encoder_type encoder;
+        for(std::size_t i = 0; i < stream_blocks; ++i)
+        {
+            encoder.encode(heads[i % heads.size()], stream[i]);
+            stream_plain += plain_size(heads[i % heads.size()]);
+            stream_size  += stream[i].size();
+        }
+    }
+
+    std::size_t plain = 0;
+    std::size_t encoded = 0;
+    std::string block;
+    double start = now();
+    {
+        encoder_type encoder;
+        for(std::size_t i = 0; i < blocks; ++i)
+        {
+            field_list const & fields = heads[i % heads.size()];
+            block.clear();
+            encoder.encode(fields, block);
+            plain   += plain_size(fields);
+            encoded += block.size();
+        }
+    }
+    report("encode", blocks, plain, now() - start);
+
+    std::size_t fresh_encoded = 0;
+    start = now();
+    for(std::size_t i = 0; i < blocks; ++i)
+    {
+        encoder_type encoder;
+        block.clear();
+        encoder.encode(heads[i % heads.size()], block);
+        fresh_encoded += block.size();
+    }
+    report("encode fresh", blocks, plain, now() - start);
+
+    std::size_t decoded_fields = 0;
+    field_list fields;
+    start = now();
+    for(std::size_t done = 0; done < blocks;)
+    {
+        decoder_type decoder;
+        for(std::size_t i = 0; i < stream_blocks && done < blocks; ++i, ++done)
+        {
+            fields.clear();
+            if(!decoder.decode(stream[i].data(), stream[i].size(), fields))
+            {
+                std::cerr << "decoding failed" << std::endl;
+                return 1;
+            }
+            decoded_fields += fields.size();
+        }
+    }
+    report("decode", blocks, stream_plain / stream_blocks * blocks, now() - start);
+
+    std::printf("\n%lu heads, %.1f fields/block\n", static_cast<unsigned long>(heads.size()), double(decoded_fields) / blocks);
+    std::printf("compressed to %5.1f%% of HTTP/1.1 (%5.1f%% with a fresh table each)\n",
+                100.0 * encoded / plain,
+                100.0 * fresh_encoded / plain);
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Loopback TLS bulk upload with and without kernel TLS.
+// A forked child acts as the TLS server and discards everything it receives,
+// the parent uploads through basic_client and reports its own throughput and
+// CPU time per GB.
+//
+// usage: bench_ktls [megabytes=1024] [port=9443]
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <net/client/client.hpp>
+#include <net/detail/tags.hpp>
+
+#include <openssl/x509.h>
+#include <openssl/rsa.h>
+#include <openssl/evp.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef net::basic_client<net::default_tag> client;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    double cpu_time()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+             + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+
+    // Self signed throw away certificate for the stand-in server
+    void use_generated_certificate(SSL_CTX * ctx)
+    {
+        EVP_PKEY * key = EVP_PKEY_new();
+        RSA * rsa = RSA_generate_key(2048, RSA_F4, 0, 0);
+        EVP_PKEY_assign_RSA(key, rsa);
+
+        X509 * cert = X509_new();
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_get_notBefore(cert), 0);
+        X509_gmtime_adj(X509_get_notAfter(cert), 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME * name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<unsigned char const *>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_sign(cert, key, EVP_sha256());
+
+        SSL_CTX_use_certificate(ctx, cert);
+        SSL_CTX_use_PrivateKey(ctx, key);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+    }
+
+    void run_server(unsigned short port, int connections)
+    {
+        boost::asio::io_service service;
+        boost::asio::ssl::context ctx(service, boost::asio::ssl::context::sslv23);
+        use_generated_certificate(ctx.impl());
+
+        boost::asio::ip::tcp::acceptor acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+        std::cout << "ready" << std::endl;
+        boost::array<char, 0x10000> buffer;
+        for(int i = 0; i < connections; ++i)
+        {
+            boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream(service, ctx);
+            acceptor.accept(stream.lowest_layer());
+            boost::system::error_code ec;
+            stream.handshake(boost::asio::ssl::stream_base::server, ec);
+            while(!ec)
+            {
+                stream.read_some(boost::asio::buffer(buffer), ec);
+            }
+        }
+    }
+
+    void run_client(unsigned short port, std::size_t megabytes, bool kernel_tls)
+    {
+        boost::asio::io_service service;
+        boost::asio::ssl::context ctx(service, boost::asio::ssl::context::sslv23);
+        SSL_CTX_set_max_proto_version(ctx.impl(), TLS1_2_VERSION);
+        SSL_CTX_set_cipher_list(ctx.impl(), "ECDHE-RSA-AES128-GCM-SHA256");
+
+        client c(service, ctx);
+        c.set_kernel_tls(kernel_tls);
+
+        boost::system::error_code ec;
+        char port_str[8];
+        std::sprintf(port_str, "%u", port);
+        if(c.connect("127.0.0.1", port_str, ec))
+        {
+            std::cout << "connect failed: " << ec.message() << std::endl;
+            return;
+        }
+
+        std::vector<char> block(0x10000, 'x');
+        std::size_t const blocks = megabytes * 0x100000 / block.size();
+
+        double const cpu_start  = cpu_time();
+        double const wall_start = now();
+        for(std::size_t i = 0; i < blocks && !ec; ++i)
+        {
+            boost::asio::write(c.socket(), boost::asio::buffer(block), boost::asio::transfer_all(), ec);
+        }
+        double const wall = now() - wall_start;
+        double const cpu  = cpu_time() - cpu_start;
+        c.socket().socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+
+        double const gigabytes = megabytes / 1024.0;
+        std::cout << (kernel_tls ? "kTLS " : "user ")
+                  << (c.socket().secure() ? "(OpenSSL record layer)" : "(kernel record layer)")
+                  << ": " << megabytes / wall << " MB/s, "
+                  << cpu / gigabytes << " CPU s/GB"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char const ** argv)
+{
+    std::size_t const megabytes = argc > 1 ? std::atoi(argv[1]) : 1024;
+    unsigned short const port   = argc > 2 ? std::atoi(argv[2]) : 9443;
+
+    int ready[2];
+    if(pipe(ready) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    pid_t server = fork();
+    if(server == 0)
+    {
+        dup2(ready[1], STDOUT_FILENO);
+        run_server(port, 2);
+        return EXIT_SUCCESS;
+    }
+
+    char c = 0;
+    while(read(ready[0], &c, 1) == 1 && c != '\n')
+    {
+    }
+
+    run_client(port, megabytes, false);
+    run_client(port, megabytes, true);
+
+    int status = 0;
+    waitpid(server, &status, 0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,282 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fetches the same origin over one persistent connection with and without
+// pipelining and reports requests per second.
+// A forked child acts as the server and answers every request with one of
+// the recorded responses in test/data, in turn. The recordings use bare LF
+// line ends and their chunk sizes do not always match the data, so they are
+// served with CRLF heads and a Content-Length body instead.
+//
+// usage: bench_pipeline [requests=20000] [port=9480] [data=test/data]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <boost/array.hpp>
+#include <net/http/client.hpp>
+#include <net/detail/tags.hpp>
+
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef net::http::basic_http_client<net::default_tag>     http_client;
+typedef http_client::response_type                          response_type;
+
+namespace
+{
+    std::size_t const depths[] = { 1, 4, 16, 64 };
+    std::size_t const runs     = sizeof(depths) / sizeof(depths[0]);
+
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    bool starts_with_ignore_case(std::string const & line, char const * prefix)
+    {
+        std::size_t i = 0;
+        for(; prefix[i]; ++i)
+        {
+            if(i == line.size() || std::tolower(line[i]) != std::tolower(prefix[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Turns a recording into a response which can be sent as is
+    bool load_response(std::string const & path, std::string & response)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if(!file)
+        {
+            return false;
+        }
+        std::ostringstream content;
+        content << file.rdbuf();
+        std::string const data = content.str();
+
+        std::string::size_type const head_end = data.find("\n\n");
+        if(head_end == std::string::npos)
+        {
+            return false;
+        }
+
+        // The body starts behind the first chunk size line and ends in
+        // front of the last chunk
+        std::string body;
+        std::string::size_type const body_begin = data.find('\n', head_end + 2);
+        if(body_begin != std::string::npos)
+        {
+            std::string::size_type body_end = data.rfind("\n0\n");
+            if(body_end == std::string::npos || body_end < body_begin)
+            {
+                body_end = data.size();
+            }
+            body.assign(data, body_begin + 1, body_end - body_begin - 1);
+        }
+
+        std::istringstream head(data.substr(0, head_end));
+        std::string line;
+        response.clear();
+        while(std::getline(head, line))
+        {
+            if(!line.empty() && line[line.size() - 1] == '\r')
+            {
+                line.erase(line.size() - 1);
+            }
+            if(starts_with_ignore_case(line, "Transfer-Encoding:") || starts_with_ignore_case(line, "Content-Length:"))
+            {
+                continue;
+            }
+            response += line;
+            response += "\r\n";
+        }
+
+        char length[32];
+        std::sprintf(length, "%lu", static_cast<unsigned long>(body.size()));
+        response += "Content-Length: ";
+        response += length;
+        response += "\r\n\r\n";
+        response += body;
+        return true;
+    }
+
+    // One connection per run, every request head gets the next recording
+    void run_server(unsigned short port, std::vector<std::string> const & responses)
+    {
+        boost::asio::io_service service;
+        boost::asio::ip::tcp::acceptor acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+        std::cout << "ready" << std::endl;
+
+        boost::array<char, 0x10000> buffer;
+        std::size_t next = 0;
+        for(std::size_t i = 0; i < runs; ++i)
+        {
+            boost::asio::ip::tcp::socket socket(service);
+            acceptor.accept(socket);
+
+            // Requests have no body, so every empty line ends one. The last
+            // bytes of a read are kept for a terminator split across reads.
+            std::string window;
+            std::string output;
+            boost::system::error_code ec;
+            while(!ec)
+            {
+                std::size_t const bytes = socket.read_some(boost::asio::buffer(buffer), ec);
+                window.append(buffer.data(), bytes);
+                std::string::size_type position = 0;
+                while((position = window.find("\r\n\r\n", position)) != std::string::npos)
+                {
+                    output += responses[next++ % responses.size()];
+                    position += 4;
+                }
+                window.erase(0, window.size() > 3 ? window.size() - 3 : 0);
+                if(!output.empty())
+                {
+                    boost::asio::write(socket, boost::asio::buffer(output), boost::asio::transfer_all(), ec);
+                    output.clear();
+                }
+            }
+        }
+    }
+
+    struct run_state
+    {
+        http_client::self_ptr   client;
+        std::size_t             completed;
+        std::size_t             failed;
+        std::size_t             bytes;
+        std::size_t             requests;
+    };
+
+    void on_response(run_state & state, boost::system::error_code const & ec, response_type const & response)
+    {
+        if(ec)
+        {
+            ++state.failed;
+        }
+        state.bytes += response.body().size();
+        if(++state.completed == state.requests)
+        {
+            state.client->close();
+        }
+    }
+
+    void run_client(unsigned short port, std::size_t requests, std::size_t depth)
+    {
+        boost::asio::io_service service;
+        run_state state;
+        state.client.reset(new http_client(service));
+        state.client->set_max_connections(1);
+        state.client->set_pipeline_depth(depth);
+        state.completed = 0;
+        state.failed    = 0;
+        state.bytes     = 0;
+        state.requests  = requests;
+
+        char url[64];
+        std::sprintf(url, "http://127.0.0.1:%u/", port);
+
+        double const start = now();
+        for(std::size_t i = 0; i < requests; ++i)
+        {
+            state.client->async_get(url, boost::bind(&on_response, boost::ref(state), _1, _2));
+        }
+        service.run();
+        double const seconds = now() - start;
+        state.client.reset();
+
+        std::printf("depth %-3lu %10.0f requests/s  %7.1f MB/s  %lu failed\n",
+                    static_cast<unsigned long>(depth),
+                    requests / seconds,
+                    state.bytes / seconds / (1024 * 1024),
+                    static_cast<unsigned long>(state.failed));
+    }
+}
+
+int main(int argc, char const ** argv)
+{
+    std::size_t const requests  = argc > 1 ? std::strtoul(argv[1], 0, 10) : 20000;
+    unsigned short const port   = argc > 2 ? std::atoi(argv[2]) : 9480;
+    std::string const directory = argc > 3 ? argv[3] : "test/data";
+
+    std::vector<std::string> responses;
+    for(int i = 1; ; ++i)
+    {
+        char name[16];
+        std::sprintf(name, "/%d.dat", i);
+        std::string response;
+        if(!load_response(directory + name, response))
+        {
+            break;
+        }
+        responses.push_back(response);
+    }
+    if(responses.empty())
+    {
+        std::cout << "no recordings in " << directory << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int ready[2];
+    if(pipe(ready) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    pid_t server = fork();
+    if(server == 0)
+    {
+        dup2(ready[1], STDOUT_FILENO);
+        run_server(port, responses);
+        return EXIT_SUCCESS;
+    }
+
+    char c = 0;
+    while(read(ready[0], &c, 1) == 1 && c != '\n')
+    {
+    }
+
+    for(std::size_t i = 0; i < runs; ++i)
+    {
+        run_client(port, requests, depths[i]);
+    }
+
+    int status = 0;
+    waitpid(server, &status, 0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Serializes GET requests with the HTTP request writer on one core and
+// reports requests per second. The fixed Host, User-Agent and Accept
+// headers come from a shared header block; for comparison the same
+// requests are also formatted with std::ostringstream.
+//
+// usage: bench_request_writer [requests=1000000]
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <net/http/request/request_writer.hpp>
+#include <net/detail/tags.hpp>
+
+#include <sys/time.h>
+
+typedef net::http::basic_request<net::default_tag>          request_type;
+typedef net::http::basic_request_writer<net::default_tag>   writer_type;
+typedef net::http::basic_header_block<net::default_tag>     header_block;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    void report(char const * name, std::size_t requests, std::size_t bytes, double seconds)
+    {
+        std::printf("%-14s %10.0f requests/s  %6.1f ns/request  %7.1f MB/s\n",
+                    name,
+                    requests / seconds,
+                    seconds * 1e9 / requests,
+                    bytes / seconds / (1024 * 1024));
+    }
+}
+
+int main(int argc, char const ** argv)
+{
+    std::size_t const requests = argc > 1 ? std::strtoul(argv[1], 0, 10) : 1000000;
+
+    boost::shared_ptr<header_block> common(new header_block());
+    common->add("Host", "www.example.org")
+           .add("User-Agent", "libnetpp 0.0.9alpha")
+           .add("Accept", "*/*");
+    writer_type writer(common);
+
+    request_type request;
+    request.method() = "GET";
+    request.resource() = "/index.html";
+    request.query() = "page=1";
+
+    net::util::output_buffer out;
+    std::size_t bytes = 0;
+    double start = now();
+    for(std::size_t i = 0; i < requests; ++i)
+    {
+        out.clear();
+        writer.write(out, request);
+        bytes += out.size();
+    }
+    report("request_writer", requests, bytes, now() - start);
+
+    bytes = 0;
+    start = now();
+    for(std::size_t i = 0; i < requests; ++i)
+    {
+        std::ostringstream stream;
+        stream << request.method() << ' ' << request.resource() << '?' << request.query() << " HTTP/1.1\r\n"
+               << "Host: www.example.org\r\n"
+               << "User-Agent: libnetpp 0.0.9alpha\r\n"
+               << "Accept: */*\r\n\r\n";
+        bytes += stream.str().size();
+    }
+    report("ostringstream", requests, bytes, now() - start);
+
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,10 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/asio.hpp>
+#include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <iostream>
+#include <cstring>
 
 template<typename DumpPolicy>
 struct server
@@ -26,6 +28,7 @@ struct server
             , socket_(service_)
             , buffer_()
             , index_(0)
+            , received_(0)
         {
         }
 
@@ -39,7 +42,7 @@ struct server
         {
             boost::asio::async_read(
                 socket_,
-                boost::asio::buffer(buffer_),
+                boost::asio::buffer(buffer_.data() + received_, buffer_.size() - received_),
                 boost::asio::transfer_at_least(1),
                 boost::bind(&session::on_data_read, this, _1, _2, this->shared_from_this())
             );
@@ -47,29 +50,72 @@ struct server
 
         void on_data_read(error_code const & ec, size_t bytes_read, session_ptr)
         {
-            dump_policy::dump(id_, buffer_, bytes_read, ec);
+            dump_policy::dump(id_, buffer_.data() + received_, bytes_read, ec);
             if(!ec)
             {
-                boost::array<boost::uint8_t, 10> buffer;
-                buffer[0] = 0x05;
-                buffer[1] = 0x00;
-                buffer[2] = 0x00;
-                buffer[4] = 0x01;
-                switch(index_++)
+                // Clients may pipeline the greeting and the CONNECT request
+                received_ += bytes_read;
+                size_t consumed = 0;
+                while(size_t n = handle_message(buffer_.data() + consumed, received_ - consumed))
                 {
-                case 0:
-                    boost::asio::write(socket_, boost::asio::buffer(buffer.data(), 2));
-                    break;
-                case 1:
-                    boost::asio::write(socket_, boost::asio::buffer(buffer.data(), 10));
-                    break;
-                default:
-                    break;
+                    consumed += n;
                 }
+                std::memmove(buffer_.data(), buffer_.data() + consumed, received_ - consumed);
+                received_ -= consumed;
                 start();
             }
         }
 
+        // Returns the size of the handled message, 0 if it is incomplete
+        size_t handle_message(boost::uint8_t const * data, size_t size)
+        {
+            switch(index_)
+            {
+            case 0: // VER NMETHODS METHODS
+                {
+                    if(size < 2 || size < 2u + data[1])
+                    {
+                        return 0;
+                    }
+                    boost::uint8_t const reply[2] = { 0x05, 0x00 };
+                    boost::asio::write(socket_, boost::asio::buffer(reply));
+                    ++index_;
+                    return 2 + data[1];
+                }
+            case 1: // VER CMD RSV ATYP DST.ADDR DST.PORT
+                {
+                    if(size < 5)
+                    {
+                        return 0;
+                    }
+                    size_t length = size;
+                    switch(data[3])
+                    {
+                    case 0x01: length = 4 + 4 + 2; break;
+                    case 0x03: length = 4 + 1 + data[4] + 2; break;
+                    case 0x04: length = 4 + 16 + 2; break;
+                    default: break;
+                    }
+                    if(size < length)
+                    {
+                        return 0;
+                    }
+                    if(data[3] == 0x03)
+                    {
+                        std::cout << "[" << id_ << "] CONNECT to host name: "
+                                  << std::string(data + 5, data + 5 + data[4]) << ":"
+                                  << ((data[length - 2] << 8) | data[length - 1]) << "\n";
+                    }
+                    boost::uint8_t const reply[10] = { 0x05, 0x00, 0x00, 0x01, 0, 0, 0, 0, 0, 0 };
+                    boost::asio::write(socket_, boost::asio::buffer(reply));
+                    ++index_;
+                    return length;
+                }
+            default:
+                return size;
+            }
+        }
+
         protocol_type::socket & socket(){ return socket_; }
 
     protected:
@@ -78,6 +124,7 @@ struct server
         protocol_type::socket socket_;
         boost::array<boost::uint8_t, 0x10000> buffer_;
         int index_;
+        size_t received_;
     };
 
     server(service_type & service, boost::uint16_t port)
@@ -33,9 +33,11 @@ namespace net
     template<typename Tag>
     class basic_message
     {
+    public:
         typedef typename header_collection_traits<Tag>::type headers_type;
         typedef typename string_traits<Tag>::type string_type;
 
+    private:
         headers_type headers_;
         string_type body_;
         string_type source_;
@@ -66,7 +68,7 @@ namespace net
 
         basic_message & operator=(basic_message other)
         {
-            swap(*this);
+            swap(other);
             return *this;
         }
 
@@ -27,6 +27,7 @@
 #define GUARD_NET_CLIENT_CLIENT_HPP_INCLUDED
 
 #include <net/client/socket_adapter.hpp>
+#include <net/client/tunnel_pool.hpp>
 
 namespace net
 {
@@ -40,40 +41,230 @@ namespace net
         typedef typename connection_base<Tag>::service_type     service_type;
         typedef typename connection_base<Tag>::ssl_context_type ssl_context_type;
         typedef typename proxy_base<Tag>::self_ptr                proxy_base_ptr;
+        typedef typename tunnel_pool<Tag>::self_ptr             tunnel_pool_ptr;
+        typedef typename tunnel_pool<Tag>::key_type             tunnel_key_type;
+        typedef std::vector<string_type>                        protocol_list;
 
         basic_client(service_type & service)
-        : adapter_(connection_ptr(new connection<Tag>(service)), false)
+        : service_(service)
+        , context_(0)
+        , adapter_(connection_ptr(new connection<Tag>(service)), false)
+        , proxy_()
+        , pool_()
+        , tunnel_key_()
+        , kernel_tls_(false)
+        , alpn_()
+#ifdef NETPP_HAS_IO_URING
+        , engine_()
+#endif
         {}
 
         basic_client(service_type & service, ssl_context_type & context)
-        : adapter_(connection_ptr(new ssl_connection<Tag>(service, context)), true)
+        : service_(service)
+        , context_(&context)
+        , adapter_(connection_ptr(new ssl_connection<Tag>(service, context)), true)
+        , proxy_()
+        , pool_()
+        , tunnel_key_()
+        , kernel_tls_(false)
+        , alpn_()
+#ifdef NETPP_HAS_IO_URING
+        , engine_()
+#endif
         {}
 
+#ifdef NETPP_HAS_IO_URING
+        typedef typename io_uring_engine<Tag>::self_ptr         io_engine_ptr;
+
+        // Socket I/O is performed by the given io_uring engine, which can be
+        // shared by any number of clients to batch their submissions
+        basic_client(service_type & service, io_engine_ptr engine)
+        : service_(service)
+        , context_(0)
+        , adapter_(connection_ptr(new connection<Tag>(service)), false)
+        , proxy_()
+        , pool_()
+        , tunnel_key_()
+        , kernel_tls_(false)
+        , alpn_()
+        , engine_(engine)
+        {
+            adapter_.set_io_engine(engine);
+        }
+
+        basic_client(service_type & service, ssl_context_type & context, io_engine_ptr engine)
+        : service_(service)
+        , context_(&context)
+        , adapter_(connection_ptr(new ssl_connection<Tag>(service, context)), true)
+        , proxy_()
+        , pool_()
+        , tunnel_key_()
+        , kernel_tls_(false)
+        , alpn_()
+        , engine_(engine)
+        {
+            adapter_.set_io_engine(engine);
+        }
+#endif
+
         ~basic_client()
         {}
 
         void set_proxy(proxy_base_ptr ptr)
         {
+            proxy_ = ptr;
             adapter_.set_proxy(ptr);
         }
 
+        // Linux only, see ssl_connection::set_kernel_tls
+        void set_kernel_tls(bool enabled)
+        {
+            kernel_tls_ = enabled;
+            adapter_.set_kernel_tls(enabled);
+        }
+
+        // Application protocols offered in the TLS handshake, see
+        // ssl_connection::set_alpn_protocols
+        void set_alpn_protocols(protocol_list const & protocols)
+        {
+            alpn_ = protocols;
+            adapter_.set_alpn_protocols(protocols);
+        }
+
+        // Connections through the proxy are taken from and given back to pool,
+        // which can be shared by any number of clients
+        void set_tunnel_pool(tunnel_pool_ptr pool)
+        {
+            pool_ = pool;
+        }
+
         boost::system::error_code connect(string_type const & server, string_type const & port, boost::system::error_code & ec)
         {
+            tunnel_key_ = tunnel_key(server, port);
+            if(pooling())
+            {
+                connection_ptr reused = pool_->acquire(tunnel_key_);
+                if(reused)
+                {
+                    adapter_ = socket_type(reused, context_ != 0);
+                    return ec = boost::system::error_code();
+                }
+            }
             return adapter_.base().connect(server, port, ec);
         }
 
         void async_connect(string_type const & server, string_type const & port, callback cb)
         {
+            tunnel_key_ = tunnel_key(server, port);
+            if(pooling())
+            {
+                connection_ptr reused = pool_->acquire(tunnel_key_);
+                if(reused)
+                {
+                    adapter_ = socket_type(reused, context_ != 0);
+                    service_.post(boost::bind(cb, boost::system::error_code()));
+                    return;
+                }
+
+                // A warm proxy connection saves the connection setup
+                connection_ptr warm = pool_->acquire(tunnel_key(string_type(), string_type()));
+                if(warm)
+                {
+                    adapter_ = socket_type(warm, context_ != 0);
+                    warm->async_open_tunnel(server, port, cb);
+                    return;
+                }
+            }
             adapter_.base().async_connect(server, port, cb);
         }
 
+        // Hands the connection back to the tunnel pool for the next connect to
+        // the same server and port and starts over with a new connection.
+        // Only call this once the exchange on the connection is complete and
+        // nothing is pending on it.
+        void release()
+        {
+            if(pooling() && !tunnel_key_.host.empty())
+            {
+                pool_->release(tunnel_key_, adapter_.shared_connection());
+                adapter_ = socket_type(make_connection(), context_ != 0);
+            }
+            tunnel_key_ = tunnel_key_type();
+        }
+
+        // Opens count connections to the proxy in the background and parks
+        // them in the tunnel pool, see tunnel_pool
+        void prewarm(std::size_t count)
+        {
+            if(!pooling())
+            {
+                return;
+            }
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                connection_ptr warm = make_connection();
+                warm->async_connect_proxy(
+                    boost::bind(
+                        &tunnel_pool<Tag>::add_warm,
+                        pool_,
+                        tunnel_key(string_type(), string_type()),
+                        warm,
+                        boost::asio::placeholders::error
+                    )
+                );
+            }
+        }
+
         socket_adapter<Tag> & socket()
         {
             return adapter_;
         }
 
     protected:
+        bool pooling() const
+        {
+            return pool_ && proxy_ && proxy_->enabled();
+        }
+
+        tunnel_key_type tunnel_key(string_type const & server, string_type const & port) const
+        {
+            return tunnel_key_type(proxy_.get(), context_, server, port);
+        }
+
+        // A connection configured like the one the client was created with
+        connection_ptr make_connection()
+        {
+            connection_ptr result;
+            if(context_)
+            {
+                boost::shared_ptr< ssl_connection<Tag> > secure(new ssl_connection<Tag>(service_, *context_));
+                secure->set_kernel_tls(kernel_tls_);
+                secure->set_alpn_protocols(alpn_);
+                result = secure;
+            }
+            else
+            {
+                result.reset(new connection<Tag>(service_));
+            }
+            result->get_plain_socket().set_proxy(proxy_);
+#ifdef NETPP_HAS_IO_URING
+            result->get_plain_socket().set_io_engine(engine_);
+#endif
+            return result;
+        }
+
+    protected:
+        service_type &      service_;
+        ssl_context_type *  context_;
         socket_adapter<Tag> adapter_;
+        proxy_base_ptr      proxy_;
+        tunnel_pool_ptr     pool_;
+        tunnel_key_type     tunnel_key_;
+        bool                kernel_tls_;
+        protocol_list       alpn_;
+#ifdef NETPP_HAS_IO_URING
+        io_engine_ptr       engine_;
+#endif
     };
 }
 
@@ -33,6 +33,12 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <net/client/proxy_socket.hpp>
+#include <net/client/kernel_tls.hpp>
+#include <vector>
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L && !defined(OPENSSL_NO_TLSEXT)
+#    define NETPP_HAS_ALPN 1
+#endif
 
 namespace net
 {
@@ -46,6 +52,7 @@ namespace net
         typedef boost::asio::io_service                    service_type;
         typedef boost::asio::ssl::context                ssl_context_type;
         typedef typename string_traits<Tag>::type        string_type;
+        typedef typename socket::target_type            target_type;
 
         connection_base( service_type & service )
         : service_(service)
@@ -66,6 +73,15 @@ namespace net
 
         virtual void async_connect(string_type const & server, string_type const & port, callback cb)
         {
+            unsigned short port_number = 0;
+            if(get_plain_socket().resolves_remotely() && parse_port(port, port_number))
+            {
+                // The proxy resolves the name, no local lookup needed
+                async_connect(target_type(server, port_number), cb);
+                start_connect_timer();
+                return;
+            }
+
             resolver::query query(server, port);
             resolver_.async_resolve(
                 query,
@@ -81,31 +97,108 @@ namespace net
 
         virtual boost::system::error_code connect(string_type const & server, string_type const & port, boost::system::error_code & ec)
         {
+            unsigned short port_number = 0;
+            if(get_plain_socket().resolves_remotely() && parse_port(port, port_number))
+            {
+                return connect(target_type(server, port_number), ec);
+            }
+
             resolver::query query(server, port);
             return connect(resolver_.resolve(query, ec), ec);
         }
 
+        // Opens the TCP connection to the proxy without requesting a tunnel,
+        // async_open_tunnel completes the connection later on
+        virtual void async_connect_proxy(callback cb)
+        {
+            get_next_layer().close();
+            get_next_layer().async_connect_proxy(
+                boost::bind(
+                    &connection_base::handle_proxy_connect,
+                    this,
+                    boost::asio::placeholders::error,
+                    cb
+                )
+            );
+            start_connect_timer();
+        }
+
+        // Requests the tunnel to server:port on a connection opened by
+        // async_connect_proxy
+        virtual void async_open_tunnel(string_type const & server, string_type const & port, callback cb)
+        {
+            unsigned short port_number = 0;
+            if(get_plain_socket().resolves_remotely() && parse_port(port, port_number))
+            {
+                open_tunnel(target_type(server, port_number), cb);
+                return;
+            }
+
+            resolver::query query(server, port);
+            resolver_.async_resolve(
+                query,
+                boost::bind(
+                    &connection_base::on_tunnel_resolved,
+                    this,
+                    boost::asio::placeholders::iterator,
+                    boost::asio::placeholders::error,
+                    cb
+                )
+            );
+        }
+
         virtual socket & get_plain_socket() = 0;
     protected:
+        virtual void handle_proxy_connect(boost::system::error_code const & ec, callback cb)
+        {
+            if(ec ==  boost::asio::error::operation_aborted)
+            {
+                timer_.cancel();
+                cb(boost::asio::error::timed_out);
+            }
+            else
+            {
+                timer_.cancel();
+                cb(ec);
+            }
+        }
+
+        virtual void on_tunnel_resolved(resolver::iterator epiter, boost::system::error_code const & ec, callback cb)
+        {
+            if(ec)
+            {
+                cb(ec);
+                return;
+            }
+            endpoint ep = *epiter;
+            open_tunnel(target_type(ep), cb);
+        }
+
+        void open_tunnel(target_type const & target, callback cb)
+        {
+            get_next_layer().async_open_tunnel(
+                target,
+                boost::bind(
+                    &connection_base<Tag>::handle_connect,
+                    this,
+                    boost::asio::placeholders::error,
+                    resolver::iterator(),
+                    cb
+                )
+            );
+            start_connect_timer();
+        }
+
         virtual void async_connect_timeout(resolver::iterator epiter, boost::system::error_code const & ec, callback cb)
         {
             if(!ec)
             {
                 async_connect(epiter, cb);
-                if(connect_timeout_.total_milliseconds())
-                {
-                    timer_.expires_from_now(connect_timeout_);
-                    timer_.async_wait(
-                        boost::bind(
-                            &connection_base<Tag>::connect_timeout,
-                            this,
-                            boost::asio::placeholders::error
-                        )
-                    );
-                }
+                start_connect_timer();
             }
             else
             {
+                timer_.cancel();
                 if(ec ==  boost::asio::error::operation_aborted)
                 {
                     cb(boost::asio::error::timed_out);
@@ -119,10 +212,31 @@ namespace net
 
         virtual socket & get_next_layer() = 0;
 
+        void start_connect_timer()
+        {
+            if(connect_timeout_.total_milliseconds())
+            {
+                timer_.expires_from_now(connect_timeout_);
+                timer_.async_wait(
+                    boost::bind(
+                        &connection_base<Tag>::connect_timeout,
+                        this,
+                        boost::asio::placeholders::error
+                    )
+                );
+            }
+        }
+
+        static bool parse_port(string_type const & port, unsigned short & result)
+        {
+            return target_type::parse_port(port, result);
+        }
+
         virtual void handle_connect( boost::system::error_code const & ec, resolver::iterator epiter, callback cb)
         {
             if(ec ==  boost::asio::error::operation_aborted)
             {
+                timer_.cancel();
                 cb(boost::asio::error::timed_out);
             }
             else if(!ec || (ec && epiter == resolver::iterator()))
@@ -153,7 +267,30 @@ namespace net
             }
             return ec;
         }
+        virtual boost::system::error_code connect(target_type const & target, boost::system::error_code & ec)
+        {
+            get_next_layer().close();
+            return get_next_layer().connect(target, ec);
+        }
+
     protected:
+        virtual void async_connect(target_type const & target, callback cb)
+        {
+            get_next_layer().close();
+            get_next_layer().async_connect
+            (
+                target,
+                boost::bind
+                (
+                    &connection_base<Tag>::handle_connect,
+                    this,
+                    boost::asio::placeholders::error,
+                    resolver::iterator(),
+                    cb
+                )
+            );
+        }
+
         virtual void async_connect(typename resolver::iterator epiter, callback cb)
         {
             endpoint ep = *epiter;
@@ -200,10 +337,49 @@ namespace net
         ssl_connection(service_type & service, ssl_context_type & context)
         : base_type(service)
         , socket_(service, context)
+        , kernel_tls_requested_(false)
+        , kernel_tls_active_(false)
+        , alpn_()
+        , alpn_protocol_()
         {}
 
         socket_type & socket(){ return socket_; }
 
+        // Opt-in: hand the record layer to the kernel after the handshake.
+        // Falls back silently to OpenSSL if the session or the kernel doesn't support it.
+        void set_kernel_tls(bool enabled)
+        {
+            kernel_tls_requested_ = enabled;
+        }
+
+        // true if the established connection is encrypted by the kernel,
+        // the plain socket has to be used for I/O in this case
+        bool kernel_tls() const
+        {
+            return kernel_tls_active_;
+        }
+
+        // Protocols offered to the server in the handshake (ALPN), most
+        // preferred first. Ignored if OpenSSL lacks ALPN support.
+        void set_alpn_protocols(std::vector<typename base_type::string_type> const & protocols)
+        {
+            alpn_.clear();
+            for(std::size_t i = 0; i < protocols.size(); ++i)
+            {
+                if(!protocols[i].empty() && protocols[i].size() < 256)
+                {
+                    alpn_ += static_cast<char>(protocols[i].size());
+                    alpn_ += protocols[i];
+                }
+            }
+        }
+
+        // The protocol the server selected, empty if it selected none
+        typename base_type::string_type const & alpn_protocol() const
+        {
+            return alpn_protocol_;
+        }
+
         typename base_type::socket & get_plain_socket(){ return socket_.next_layer(); }
     protected:
         typename socket_type::next_layer_type &
@@ -216,14 +392,18 @@ namespace net
         {
             if(ec ==  boost::asio::error::operation_aborted)
             {
+                this->timer_.cancel();
                 cb(boost::asio::error::timed_out);
             }
             else if(ec && epiter == typename resolver::iterator())
             {
+                this->timer_.cancel();
                 cb(ec);
             }
             else if(!ec)
             {
+                kernel_tls_active_ = false;
+                offer_alpn();
                 socket_.async_handshake(
                     boost::asio::ssl::stream_base::client,
                     boost::bind(
@@ -242,20 +422,82 @@ namespace net
 
         virtual boost::system::error_code connect(typename resolver::iterator epiter, boost::system::error_code & ec)
         {
+            kernel_tls_active_ = false;
             if(!base_type::connect(epiter, ec))
             {
-                return socket_.handshake(boost::asio::ssl::stream_base::client, ec);
+                offer_alpn();
+                if(!socket_.handshake(boost::asio::ssl::stream_base::client, ec))
+                {
+                    on_established();
+                }
+            }
+            return ec;
+        }
+
+        virtual boost::system::error_code connect(typename base_type::target_type const & target, boost::system::error_code & ec)
+        {
+            kernel_tls_active_ = false;
+            if(!base_type::connect(target, ec))
+            {
+                offer_alpn();
+                if(!socket_.handshake(boost::asio::ssl::stream_base::client, ec))
+                {
+                    on_established();
+                }
             }
             return ec;
         }
 
         virtual void handle_handshake( boost::system::error_code const & ec, callback cb)
         {
+            // The connect timeout covers the handshake, it must not fire on
+            // the established connection
+            this->timer_.cancel();
+            if(!ec)
+            {
+                on_established();
+            }
             cb(ec);
         }
 
+        void offer_alpn()
+        {
+            alpn_protocol_.clear();
+#ifdef NETPP_HAS_ALPN
+            if(!alpn_.empty())
+            {
+                SSL_set_alpn_protos(socket_.impl()->ssl, reinterpret_cast<unsigned char const *>(alpn_.data()), static_cast<unsigned>(alpn_.size()));
+            }
+#endif
+        }
+
+        void on_established()
+        {
+#ifdef NETPP_HAS_ALPN
+            unsigned char const * selected = 0;
+            unsigned length = 0;
+            SSL_get0_alpn_selected(socket_.impl()->ssl, &selected, &length);
+            alpn_protocol_.assign(reinterpret_cast<char const *>(selected), length);
+#endif
+            enable_kernel_tls();
+        }
+
+        void enable_kernel_tls()
+        {
+            if(kernel_tls_requested_)
+            {
+                boost::system::error_code ec;
+                net::kernel_tls<Tag>::enable(socket_.impl()->ssl, socket_.next_layer().native(), ec);
+                kernel_tls_active_ = !ec;
+            }
+        }
+
     protected:
         socket_type socket_;
+        bool kernel_tls_requested_;
+        bool kernel_tls_active_;
+        typename base_type::string_type alpn_;            // wire format
+        typename base_type::string_type alpn_protocol_;
     };
 
     template <typename Tag>
@@ -0,0 +1,345 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_FILE_TRANSFER_HPP_INCLUDED
+#define GUARD_NET_CLIENT_FILE_TRANSFER_HPP_INCLUDED
+
+#if !defined(WIN32) && !defined(WIN64)
+
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/client/utils/file_sync_service.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#    include <sys/sendfile.h>
+#    define NETPP_HAS_SENDFILE 1
+#endif
+
+namespace net
+{
+    // Sends a range of a file over a stream.
+    // Plain sockets use sendfile(2) where available, so the file content
+    // never enters user space. Everything else (SSL streams, platforms
+    // without sendfile) goes through a double buffered pread/async_write loop
+    // which reads the next block from disk while the previous one is on the
+    // wire; the reads run on the thread of util::file_sync_service.
+    template<typename Tag>
+    struct file_transfer
+    {
+        typedef boost::system::error_code                                       error_code;
+        typedef boost::function< void(error_code const &, std::size_t) >        completion_handler;
+        typedef int                                                             native_file_type;
+
+        enum { READ_AHEAD_SIZE = 0x10000 };
+
+        struct session
+        {
+            session(native_file_type fd, off_t offset, std::size_t count, completion_handler const & handler)
+                : file(fd)
+                , read_offset(offset)
+                , to_read(count)
+                , to_send(count)
+                , transferred(0)
+                , handler(handler)
+                , error()
+                , failure()
+                , buffers()
+                , filled()
+                , read_index(0)
+                , write_index(0)
+                , reading(false)
+                , writing(false)
+            {
+                filled[0] = filled[1] = 0;
+            }
+
+            native_file_type                            file;
+            off_t                                       read_offset;
+            std::size_t                                 to_read;
+            std::size_t                                 to_send;
+            std::size_t                                 transferred;
+            completion_handler                          handler;
+            error_code                                  error;          // reading the file
+            error_code                                  failure;        // writing to the stream
+            boost::array<util::buffer_lease, 2>         buffers;
+            boost::array<std::size_t, 2>                filled;
+            std::size_t                                 read_index;
+            std::size_t                                 write_index;
+            bool                                        reading;
+            bool                                        writing;
+        };
+
+        typedef boost::shared_ptr<session> session_ptr;
+
+        // Zero copy path for plain TCP sockets
+        template<typename Socket>
+        static void async_send(
+            Socket & socket,
+            native_file_type file,
+            off_t offset,
+            std::size_t count,
+            completion_handler handler
+        )
+        {
+            session_ptr sess(new session(file, offset, count, handler));
+#ifdef NETPP_HAS_SENDFILE
+            error_code ec;
+            boost::asio::socket_base::non_blocking_io command(true);
+            socket.io_control(command, ec);
+            if(!ec)
+            {
+                socket.async_write_some(
+                    boost::asio::null_buffers(),
+                    boost::bind(
+                        &file_transfer::template do_sendfile<Socket>,
+                        boost::ref(socket),
+                        sess,
+                        boost::asio::placeholders::error
+                    )
+                );
+                return;
+            }
+#endif
+            start_copy(socket, sess);
+        }
+
+        // Buffered path for streams which have to see the payload (SSL)
+        template<typename Stream>
+        static void async_copy(
+            Stream & stream,
+            native_file_type file,
+            off_t offset,
+            std::size_t count,
+            completion_handler handler
+        )
+        {
+            start_copy(stream, session_ptr(new session(file, offset, count, handler)));
+        }
+
+    protected:
+#ifdef NETPP_HAS_SENDFILE
+        template<typename Socket>
+        static void do_sendfile(Socket & socket, session_ptr sess, error_code const & ec)
+        {
+            if(ec)
+            {
+                finish_sendfile(socket, sess, ec);
+                return;
+            }
+
+            while(sess->to_send)
+            {
+                ssize_t sent = ::sendfile(
+                    socket.native(),
+                    sess->file,
+                    &sess->read_offset,
+                    std::min<std::size_t>(sess->to_send, 0x7ffff000)
+                );
+
+                if(sent > 0)
+                {
+                    sess->to_send     -= sent;
+                    sess->transferred += sent;
+                }
+                else if(sent == 0)
+                {
+                    // The file is shorter than requested
+                    finish_sendfile(socket, sess, boost::asio::error::eof);
+                    return;
+                }
+                else if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    socket.async_write_some(
+                        boost::asio::null_buffers(),
+                        boost::bind(
+                            &file_transfer::template do_sendfile<Socket>,
+                            boost::ref(socket),
+                            sess,
+                            boost::asio::placeholders::error
+                        )
+                    );
+                    return;
+                }
+                else if(errno != EINTR)
+                {
+                    if((errno == EINVAL || errno == ENOSYS) && sess->transferred == 0)
+                    {
+                        // The file descriptor does not support sendfile (e.g. a pipe)
+                        error_code ignored;
+                        boost::asio::socket_base::non_blocking_io command(false);
+                        socket.io_control(command, ignored);
+                        sess->to_read = sess->to_send;
+                        start_copy(socket, sess);
+                        return;
+                    }
+                    finish_sendfile(socket, sess, error_code(errno, boost::asio::error::get_system_category()));
+                    return;
+                }
+            }
+            finish_sendfile(socket, sess, error_code());
+        }
+
+        template<typename Socket>
+        static void finish_sendfile(Socket & socket, session_ptr sess, error_code const & ec)
+        {
+            error_code ignored;
+            boost::asio::socket_base::non_blocking_io command(false);
+            socket.io_control(command, ignored);
+            sess->handler(ec, sess->transferred);
+        }
+#endif
+
+        template<typename Stream>
+        static void start_copy(Stream & stream, session_ptr sess)
+        {
+            // Only the buffered path needs memory, borrowed from the shared pool
+            sess->buffers[0] = util::lease_buffer(READ_AHEAD_SIZE);
+            sess->buffers[1] = util::lease_buffer(READ_AHEAD_SIZE);
+            if(!sess->to_read)
+            {
+                stream.get_io_service().post(boost::bind(sess->handler, error_code(), sess->transferred));
+                return;
+            }
+            pump(stream, sess);
+        }
+
+        // Keeps one disk read and one write in flight. Reads run on the
+        // file service's thread (see util::file_sync_service), a read
+        // failure is reported once the pending write completed.
+        template<typename Stream>
+        static void pump(Stream & stream, session_ptr sess)
+        {
+            if(!sess->writing && !sess->failure && sess->filled[sess->write_index])
+            {
+                std::size_t const index = sess->write_index;
+                sess->writing = true;
+                boost::asio::async_write(
+                    stream,
+                    boost::asio::buffer(sess->buffers[index].data(), sess->filled[index]),
+                    boost::bind(
+                        &file_transfer::template on_block_written<Stream>,
+                        boost::ref(stream),
+                        sess,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred
+                    )
+                );
+            }
+
+            std::size_t const index = sess->read_index;
+            bool const idle = !sess->filled[index] && !(sess->writing && sess->write_index == index);
+            if(!sess->reading && !sess->error && !sess->failure && sess->to_read && idle)
+            {
+                sess->reading = true;
+                boost::asio::use_service< util::file_sync_service<Tag> >(stream.get_io_service()).async_read(
+                    sess->file,
+                    sess->buffers[index].data(),
+                    std::min<std::size_t>(sess->to_read, READ_AHEAD_SIZE),
+                    sess->read_offset,
+                    boost::bind(
+                        &file_transfer::template on_block_read<Stream>,
+                        boost::ref(stream),
+                        sess,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred
+                    )
+                );
+            }
+
+            // The file stays in use by the service until its read returned
+            if(sess->writing || sess->reading)
+            {
+                return;
+            }
+            if(sess->failure)
+            {
+                sess->handler(sess->failure, sess->transferred);
+            }
+            else if(sess->error)
+            {
+                sess->handler(sess->error, sess->transferred);
+            }
+            else if(!sess->to_read)
+            {
+                sess->handler(sess->to_send ? error_code(boost::asio::error::eof) : error_code(), sess->transferred);
+            }
+        }
+
+        template<typename Stream>
+        static void on_block_read(
+            Stream & stream,
+            session_ptr sess,
+            error_code const & ec,
+            std::size_t bytes_read
+        )
+        {
+            sess->reading = false;
+            if(ec)
+            {
+                sess->error = ec;
+            }
+            else
+            {
+                sess->filled[sess->read_index]  = bytes_read;
+                sess->read_offset              += bytes_read;
+                sess->to_read                  -= bytes_read;
+                sess->read_index               ^= 1;
+            }
+            pump(stream, sess);
+        }
+
+        template<typename Stream>
+        static void on_block_written(
+            Stream & stream,
+            session_ptr sess,
+            error_code const & ec,
+            std::size_t bytes_written
+        )
+        {
+            sess->writing       = false;
+            sess->transferred  += bytes_written;
+            sess->to_send      -= std::min(sess->to_send, bytes_written);
+            sess->filled[sess->write_index] = 0;
+            sess->write_index  ^= 1;
+            if(ec)
+            {
+                sess->failure = ec;
+            }
+            pump(stream, sess);
+        }
+    };
+}
+
+#endif // !defined(WIN32) && !defined(WIN64)
+
+#endif //GUARD_NET_CLIENT_FILE_TRANSFER_HPP_INCLUDED
@@ -0,0 +1,756 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_IO_URING_ENGINE_HPP_INCLUDED
+#define GUARD_NET_CLIENT_IO_URING_ENGINE_HPP_INCLUDED
+
+// The io_uring engine is opt-in, build with NETPP_ENABLE_IO_URING on Linux >= 5.5
+#if defined(__linux__) && defined(NETPP_ENABLE_IO_URING)
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define NETPP_HAS_IO_URING 1
+
+namespace net
+{
+    // Alternative I/O engine for proxy_socket reads and writes.
+    //
+    // Operations of all sockets sharing an engine are collected in one
+    // submission queue and handed to the kernel with a single io_uring_enter
+    // call per io_service round. Completions are signalled through an eventfd
+    // which is watched by the io_service, so handlers keep running on the
+    // io_service threads like for the reactor based sockets.
+    //
+    // Optionally sockets are registered as fixed files and buffers can be
+    // registered for READ_FIXED/WRITE_FIXED operations.
+    //
+    // The engine is not thread safe, run the io_service on one thread.
+    template<typename Tag>
+    struct io_uring_engine
+        : boost::enable_shared_from_this< io_uring_engine<Tag> >
+        , boost::noncopyable
+    {
+        typedef boost::shared_ptr<io_uring_engine>                          self_ptr;
+        typedef boost::asio::io_service                                     service_type;
+        typedef boost::system::error_code                                   error_code;
+        typedef boost::function< void(error_code const &, std::size_t) >    handler_type;
+
+        enum
+        {
+            MAX_BUFFERS     = 16,
+            DEFAULT_ENTRIES = 4096,
+            FIXED_FILES     = 4096
+        };
+
+        io_uring_engine(service_type & service, unsigned entries = DEFAULT_ENTRIES, bool fixed_files = true)
+            : service_(service)
+            , event_(service)
+            , ring_fd_(-1)
+            , event_fd_(-1)
+            , sq_ptr_(0)
+            , cq_ptr_(0)
+            , sqes_(0)
+            , sq_size_(0)
+            , cq_size_(0)
+            , queued_(0)
+            , flush_pending_(false)
+            , waiting_(false)
+            , closing_(false)
+            , files_()
+            , file_slots_()
+            , operations_()
+        {
+            std::memset(&params_, 0, sizeof(params_));
+            params_.flags = IORING_SETUP_CQSIZE;
+            params_.cq_entries = entries * 2;
+
+            ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params_));
+            if(ring_fd_ < 0)
+            {
+                boost::asio::detail::throw_error(last_error());
+            }
+
+            map_rings();
+
+            event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if(event_fd_ < 0 || ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_, 1) < 0)
+            {
+                error_code ec = last_error();
+                if(event_fd_ >= 0)
+                {
+                    ::close(event_fd_);
+                }
+                close_ring();
+                boost::asio::detail::throw_error(ec);
+            }
+            event_.assign(event_fd_);
+
+            if(fixed_files)
+            {
+                // Sparse table, slots are filled as sockets are registered
+                files_.assign(FIXED_FILES, -1);
+                if(::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES, &files_[0], files_.size()) < 0)
+                {
+                    files_.clear();
+                }
+            }
+        }
+
+        ~io_uring_engine()
+        {
+            error_code ignored;
+            event_.close(ignored);
+            drain();
+            close_ring();
+        }
+
+        service_type & get_io_service()
+        {
+            return service_;
+        }
+
+        bool fixed_files() const
+        {
+            return !files_.empty();
+        }
+
+        // Makes the kernel keep a reference to the socket's file, saving the
+        // fd lookup on every operation. Must be undone with unregister_file
+        // before the descriptor is closed.
+        bool register_file(int fd)
+        {
+            if(files_.empty() || file_slots_.count(fd))
+            {
+                return file_slots_.count(fd) != 0;
+            }
+
+            for(std::size_t slot = 0; slot < files_.size(); ++slot)
+            {
+                if(files_[slot] == -1 && update_file(slot, fd))
+                {
+                    files_[slot] = fd;
+                    file_slots_[fd] = slot;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void unregister_file(int fd)
+        {
+            typename std::map<int, std::size_t>::iterator iter = file_slots_.find(fd);
+            if(iter != file_slots_.end())
+            {
+                update_file(iter->second, -1);
+                files_[iter->second] = -1;
+                file_slots_.erase(iter);
+            }
+        }
+
+        // Registers buffers for async_read_fixed/async_write_fixed, replaces
+        // previously registered buffers. The memory has to stay valid until
+        // unregister_buffers or the engine is destroyed.
+        error_code register_buffers(std::vector<boost::asio::mutable_buffer> const & buffers, error_code & ec)
+        {
+            ec = error_code();
+            ::syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS, 0, 0);
+            std::vector<iovec> iov(buffers.size());
+            for(std::size_t i = 0; i < buffers.size(); ++i)
+            {
+                iov[i].iov_base = boost::asio::buffer_cast<void*>(buffers[i]);
+                iov[i].iov_len  = boost::asio::buffer_size(buffers[i]);
+            }
+            if(!iov.empty() && ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, &iov[0], iov.size()) < 0)
+            {
+                ec = last_error();
+            }
+            return ec;
+        }
+
+        void unregister_buffers()
+        {
+            ::syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS, 0, 0);
+        }
+
+        template<typename MutableBufferSequence, typename Handler>
+        void async_read_some(int fd, MutableBufferSequence const & buffers, Handler handler)
+        {
+            operation * op = new operation(fd, handler, true);
+            fill_iovecs(*op, buffers.begin(), buffers.end());
+            submit(op, IORING_OP_READV, 0, 0);
+        }
+
+        template<typename ConstBufferSequence, typename Handler>
+        void async_write_some(int fd, ConstBufferSequence const & buffers, Handler handler)
+        {
+            operation * op = new operation(fd, handler, false);
+            fill_iovecs(*op, buffers.begin(), buffers.end());
+            submit(op, IORING_OP_WRITEV, 0, 0);
+        }
+
+        // Readiness waits like with the reactor, complete with 0 bytes once
+        // fd is readable or writable
+        template<typename Handler>
+        void async_read_some(int fd, boost::asio::null_buffers const &, Handler handler)
+        {
+            submit_poll(new operation(fd, handler, true), POLLIN);
+        }
+
+        template<typename Handler>
+        void async_write_some(int fd, boost::asio::null_buffers const &, Handler handler)
+        {
+            submit_poll(new operation(fd, handler, false), POLLOUT);
+        }
+
+        // buffer has to lie inside the registered buffer with the given index
+        template<typename Handler>
+        void async_read_fixed(int fd, boost::asio::mutable_buffer const & buffer, unsigned index, Handler handler)
+        {
+            operation * op = new operation(fd, handler, true);
+            op->iov[0].iov_base = boost::asio::buffer_cast<void*>(buffer);
+            op->iov[0].iov_len  = boost::asio::buffer_size(buffer);
+            op->count = 1;
+            submit(op, IORING_OP_READ_FIXED, index, true);
+        }
+
+        template<typename Handler>
+        void async_write_fixed(int fd, boost::asio::const_buffer const & buffer, unsigned index, Handler handler)
+        {
+            operation * op = new operation(fd, handler, false);
+            op->iov[0].iov_base = const_cast<void*>(boost::asio::buffer_cast<void const*>(buffer));
+            op->iov[0].iov_len  = boost::asio::buffer_size(buffer);
+            op->count = 1;
+            submit(op, IORING_OP_WRITE_FIXED, index, true);
+        }
+
+        // Aborts all outstanding operations on fd, their handlers receive operation_aborted
+        void cancel(int fd)
+        {
+            // Queueing may flush, which changes operations_
+            std::vector<operation*> outstanding;
+            typedef typename std::multimap<int, operation*>::const_iterator iterator;
+            std::pair<iterator, iterator> range = operations_.equal_range(fd);
+            for(iterator iter = range.first; iter != range.second; ++iter)
+            {
+                if(!iter->second->done)
+                {
+                    outstanding.push_back(iter->second);
+                }
+            }
+            if(outstanding.empty())
+            {
+                return;
+            }
+            for(std::size_t i = 0; i < outstanding.size(); ++i)
+            {
+                queue_cancel(outstanding[i]);
+            }
+            schedule_flush();
+        }
+
+    protected:
+        struct operation
+        {
+            template<typename Handler>
+            operation(int fd, Handler const & h, bool read)
+                : fd(fd)
+                , handler(h)
+                , is_read(read)
+                , is_poll(false)
+                , done(false)
+                , count(0)
+            {}
+
+            int             fd;
+            handler_type    handler;
+            bool            is_read;
+            bool            is_poll;
+            bool            done;       // completion posted, the kernel is done with it
+            std::size_t     count;
+            iovec           iov[MAX_BUFFERS];
+        };
+
+        template<typename Iterator>
+        static void fill_iovecs(operation & op, Iterator begin, Iterator end)
+        {
+            for(; begin != end && op.count < MAX_BUFFERS; ++begin)
+            {
+                std::size_t size = boost::asio::buffer_size(*begin);
+                if(size)
+                {
+                    op.iov[op.count].iov_base = const_cast<void*>(boost::asio::buffer_cast<void const*>(*begin));
+                    op.iov[op.count].iov_len  = size;
+                    ++op.count;
+                }
+            }
+        }
+
+        static error_code last_error()
+        {
+            return error_code(errno, boost::asio::error::get_system_category());
+        }
+
+        void map_rings()
+        {
+            sq_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+            cq_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+            if(params_.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+            }
+
+            sq_ptr_ = ::mmap(0, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+            cq_ptr_ = (params_.features & IORING_FEAT_SINGLE_MMAP)
+                    ? sq_ptr_
+                    : ::mmap(0, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            void * sqes = ::mmap(0, params_.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+
+            if(sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED)
+            {
+                error_code ec = last_error();
+                if(sq_ptr_ == MAP_FAILED) sq_ptr_ = 0;
+                if(cq_ptr_ == MAP_FAILED) cq_ptr_ = 0;
+                if(sqes != MAP_FAILED) sqes_ = static_cast<io_uring_sqe*>(sqes);
+                close_ring();
+                boost::asio::detail::throw_error(ec);
+            }
+            sqes_ = static_cast<io_uring_sqe*>(sqes);
+        }
+
+        void close_ring()
+        {
+            if(sqes_)
+            {
+                ::munmap(sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+                sqes_ = 0;
+            }
+            if(cq_ptr_ && cq_ptr_ != sq_ptr_)
+            {
+                ::munmap(cq_ptr_, cq_size_);
+            }
+            if(sq_ptr_)
+            {
+                ::munmap(sq_ptr_, sq_size_);
+            }
+            sq_ptr_ = cq_ptr_ = 0;
+            if(ring_fd_ >= 0)
+            {
+                ::close(ring_fd_);
+            }
+            ring_fd_ = -1;
+        }
+
+        unsigned * sq_field(unsigned offset)
+        {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(sq_ptr_) + offset);
+        }
+
+        unsigned * cq_field(unsigned offset)
+        {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(cq_ptr_) + offset);
+        }
+
+        bool update_file(std::size_t slot, int fd)
+        {
+            io_uring_files_update update;
+            std::memset(&update, 0, sizeof(update));
+            update.offset = slot;
+            update.fds    = reinterpret_cast<__u64>(&fd);
+            return ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+        }
+
+        io_uring_sqe * next_sqe()
+        {
+            unsigned const head = __atomic_load_n(sq_field(params_.sq_off.head), __ATOMIC_ACQUIRE);
+            unsigned const tail = *sq_field(params_.sq_off.tail) + queued_;
+            if(tail - head >= params_.sq_entries)
+            {
+                // Queue full, hand the batch over right away
+                flush();
+                return next_sqe();
+            }
+
+            unsigned const index = tail & *sq_field(params_.sq_off.ring_mask);
+            sq_field(params_.sq_off.array)[index] = index;
+            ++queued_;
+
+            io_uring_sqe * sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            return sqe;
+        }
+
+        void submit(operation * op, unsigned char opcode, unsigned buffer_index, bool fixed_buffer)
+        {
+            io_uring_sqe * sqe = prepare(op, opcode);
+            sqe->addr      = fixed_buffer ? reinterpret_cast<__u64>(op->iov[0].iov_base)
+                                          : reinterpret_cast<__u64>(op->iov);
+            sqe->len       = fixed_buffer ? op->iov[0].iov_len : op->count;
+            if(fixed_buffer)
+            {
+                sqe->buf_index = buffer_index;
+            }
+            schedule_flush();
+        }
+
+        void submit_poll(operation * op, short events)
+        {
+            op->is_poll = true;
+            io_uring_sqe * sqe = prepare(op, IORING_OP_POLL_ADD);
+            sqe->poll_events = events;
+            schedule_flush();
+        }
+
+        // Queues an entry for op and tracks it as outstanding
+        io_uring_sqe * prepare(operation * op, unsigned char opcode)
+        {
+            io_uring_sqe * sqe = next_sqe();
+            sqe->opcode    = opcode;
+            sqe->fd        = op->fd;
+            sqe->user_data = reinterpret_cast<__u64>(op);
+
+            typename std::map<int, std::size_t>::const_iterator slot = file_slots_.find(op->fd);
+            if(slot != file_slots_.end())
+            {
+                sqe->fd     = slot->second;
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+
+            operations_.insert(std::make_pair(op->fd, op));
+            return sqe;
+        }
+
+        void queue_cancel(operation * op)
+        {
+            io_uring_sqe * sqe = next_sqe();
+            sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+            sqe->fd        = -1;
+            sqe->addr      = reinterpret_cast<__u64>(op);
+            sqe->user_data = 0;
+        }
+
+        void schedule_flush()
+        {
+            if(!waiting_)
+            {
+                waiting_ = true;
+                wait_for_completions();
+            }
+
+            // All operations queued until the io_service gets to this handler
+            // are submitted with one system call
+            if(!flush_pending_)
+            {
+                flush_pending_ = true;
+                service_.post(boost::bind(&io_uring_engine::on_flush, this->shared_from_this()));
+            }
+        }
+
+        void on_flush()
+        {
+            flush_pending_ = false;
+            flush();
+        }
+
+        void flush()
+        {
+            if(queued_)
+            {
+                __atomic_store_n(sq_field(params_.sq_off.tail), *sq_field(params_.sq_off.tail) + queued_, __ATOMIC_RELEASE);
+                queued_ = 0;
+            }
+
+            // The kernel may take fewer entries than offered, the rest stays
+            // in the queue and is offered again
+            for(unsigned pending = unsubmitted(); pending; pending = unsubmitted())
+            {
+                long const result = ::syscall(__NR_io_uring_enter, ring_fd_, pending, 0, 0, 0, 0);
+                if(result > 0)
+                {
+                    continue;
+                }
+                if(result < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+                {
+                    // Completion queue is backed up, make room and try again.
+                    // flush runs inside initiating functions, the handlers
+                    // are posted.
+                    reap(true);
+                    continue;
+                }
+                fail_unsubmitted(result < 0 ? errno : EIO);
+                return;
+            }
+        }
+
+        unsigned unsubmitted()
+        {
+            return *sq_field(params_.sq_off.tail) - __atomic_load_n(sq_field(params_.sq_off.head), __ATOMIC_ACQUIRE);
+        }
+
+        // The ring refuses to take entries, their operations fail with error
+        void fail_unsubmitted(int error)
+        {
+            unsigned * tail = sq_field(params_.sq_off.tail);
+            unsigned const head = __atomic_load_n(sq_field(params_.sq_off.head), __ATOMIC_ACQUIRE);
+            unsigned const mask = *sq_field(params_.sq_off.ring_mask);
+            unsigned const * array = sq_field(params_.sq_off.array);
+            std::vector<operation*> failed;
+            for(unsigned i = head; i != *tail; ++i)
+            {
+                if(sqes_[array[i & mask]].user_data)
+                {
+                    failed.push_back(reinterpret_cast<operation*>(sqes_[array[i & mask]].user_data));
+                }
+            }
+            __atomic_store_n(tail, head, __ATOMIC_RELEASE);
+
+            for(std::size_t i = 0; i < failed.size(); ++i)
+            {
+                defer_complete(failed[i], -error);
+            }
+        }
+
+        // flush runs inside initiating functions, handlers must not
+        void defer_complete(operation * op, int result)
+        {
+            if(closing_)
+            {
+                complete(op, result);
+                return;
+            }
+            op->done = true;
+            service_.post(boost::bind(&io_uring_engine::complete, this->shared_from_this(), op, result));
+        }
+
+        // Nothing refers to the engine anymore, but the kernel may still
+        // write to the buffers of outstanding operations. They are cancelled
+        // and waited for; like on io_service shutdown their handlers are
+        // destroyed without being called.
+        void drain()
+        {
+            if(ring_fd_ < 0)
+            {
+                return;
+            }
+            closing_ = true;
+
+            // Posted completions were destroyed with their handlers, the
+            // kernel is done with those operations
+            typedef typename std::multimap<int, operation*>::iterator iterator;
+            std::vector<operation*> outstanding;
+            for(iterator iter = operations_.begin(); iter != operations_.end();)
+            {
+                if(iter->second->done)
+                {
+                    delete iter->second;
+                    operations_.erase(iter++);
+                }
+                else
+                {
+                    outstanding.push_back(iter->second);
+                    ++iter;
+                }
+            }
+            for(std::size_t i = 0; i < outstanding.size(); ++i)
+            {
+                queue_cancel(outstanding[i]);
+            }
+            flush();
+
+            while(!operations_.empty())
+            {
+                reap();
+                if(operations_.empty()
+                || (::syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR))
+                {
+                    break;
+                }
+            }
+
+            // Only if waiting failed, closing the ring cancels them
+            for(iterator iter = operations_.begin(); iter != operations_.end(); ++iter)
+            {
+                delete iter->second;
+            }
+            operations_.clear();
+        }
+
+        void wait_for_completions()
+        {
+            event_.async_read_some(
+                boost::asio::null_buffers(),
+                boost::bind(
+                    &io_uring_engine::on_completions,
+                    this->shared_from_this(),
+                    boost::asio::placeholders::error
+                )
+            );
+        }
+
+        void on_completions(error_code const & ec)
+        {
+            if(ec)
+            {
+                waiting_ = false;
+                return;
+            }
+
+            eventfd_t value = 0;
+            ::eventfd_read(event_fd_, &value);
+            reap();
+            flush();
+
+            // Only keep the io_service busy while operations are outstanding
+            waiting_ = !operations_.empty();
+            if(waiting_)
+            {
+                wait_for_completions();
+            }
+        }
+
+        // deferred posts the handlers instead of calling them
+        void reap(bool deferred = false)
+        {
+            unsigned * head_ptr = cq_field(params_.cq_off.head);
+            unsigned const mask = *cq_field(params_.cq_off.ring_mask);
+            io_uring_cqe * cqes = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ptr_) + params_.cq_off.cqes);
+
+            // Handlers may submit and therefore reap recursively,
+            // the head is re-read for every entry
+            for(;;)
+            {
+                unsigned const head = *head_ptr;
+                if(head == __atomic_load_n(cq_field(params_.cq_off.tail), __ATOMIC_ACQUIRE))
+                {
+                    // Completions which did not fit are kept back by the
+                    // kernel until it is asked for events
+                    if(!(__atomic_load_n(sq_field(params_.sq_off.flags), __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+                    || (::syscall(__NR_io_uring_enter, ring_fd_, 0, 0, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR))
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                io_uring_cqe const cqe = cqes[head & mask];
+                __atomic_store_n(head_ptr, head + 1, __ATOMIC_RELEASE);
+
+                if(cqe.user_data && deferred)
+                {
+                    defer_complete(reinterpret_cast<operation*>(cqe.user_data), cqe.res);
+                }
+                else if(cqe.user_data)
+                {
+                    complete(reinterpret_cast<operation*>(cqe.user_data), cqe.res);
+                }
+            }
+        }
+
+        void complete(operation * op, int result)
+        {
+            typedef typename std::multimap<int, operation*>::iterator iterator;
+            std::pair<iterator, iterator> range = operations_.equal_range(op->fd);
+            for(iterator iter = range.first; iter != range.second; ++iter)
+            {
+                if(iter->second == op)
+                {
+                    operations_.erase(iter);
+                    break;
+                }
+            }
+
+            error_code ec;
+            std::size_t bytes = 0;
+            if(result == -ECANCELED)
+            {
+                ec = boost::asio::error::operation_aborted;
+            }
+            else if(result < 0)
+            {
+                ec = error_code(-result, boost::asio::error::get_system_category());
+            }
+            else if(op->is_poll)
+            {
+                // result holds the ready events
+            }
+            else if(result == 0 && op->is_read && op->count && op->iov[0].iov_len)
+            {
+                ec = boost::asio::error::eof;
+            }
+            else
+            {
+                bytes = result;
+            }
+
+            handler_type handler;
+            handler.swap(op->handler);
+            delete op;
+            if(!closing_)
+            {
+                handler(ec, bytes);
+            }
+        }
+
+    protected:
+        service_type &                              service_;
+        boost::asio::posix::stream_descriptor       event_;
+        io_uring_params                             params_;
+        int                                         ring_fd_;
+        int                                         event_fd_;
+        void *                                      sq_ptr_;
+        void *                                      cq_ptr_;
+        io_uring_sqe *                              sqes_;
+        std::size_t                                 sq_size_;
+        std::size_t                                 cq_size_;
+        unsigned                                    queued_;
+        bool                                        flush_pending_;
+        bool                                        waiting_;
+        bool                                        closing_;       // in the destructor
+        std::vector<int>                            files_;
+        std::map<int, std::size_t>                  file_slots_;
+        std::multimap<int, operation*>              operations_;
+    };
+}
+
+#endif // defined(__linux__) && defined(NETPP_ENABLE_IO_URING)
+
+#endif //GUARD_NET_CLIENT_IO_URING_ENGINE_HPP_INCLUDED
@@ -0,0 +1,279 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_KERNEL_TLS_HPP_INCLUDED
+#define GUARD_NET_CLIENT_KERNEL_TLS_HPP_INCLUDED
+
+#include <net/error.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/cstdint.hpp>
+#include <openssl/ssl.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && !defined(NETPP_NO_KTLS) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+#    include <sys/socket.h>
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <linux/tls.h>
+#    define NETPP_HAS_KTLS 1
+#    ifndef TCP_ULP
+#        define TCP_ULP 31
+#    endif
+#    ifndef SOL_TLS
+#        define SOL_TLS 282
+#    endif
+#    ifndef TLS_GET_RECORD_TYPE
+#        define TLS_GET_RECORD_TYPE 2
+#    endif
+#endif
+
+namespace net
+{
+    // Moves the record layer of an established TLS 1.2 AES-GCM session into
+    // the kernel (Linux kTLS). Afterwards the socket carries plain text for
+    // send/recv/sendfile and the OpenSSL stream must not be used for I/O anymore.
+    //
+    // Only call this directly after the handshake, before any application
+    // data was exchanged: both directions are expected to be at record sequence
+    // number 1 (the Finished messages used 0).
+    //
+    // The kernel only hands out application data by recv, any other record
+    // fails it with EIO. translate_error picks up such a record, a
+    // close_notify alert becomes eof. Other alerts and handshake messages
+    // (renegotiation, TLS 1.3 key updates) can't be processed with the
+    // record layer in the kernel, they end the connection with
+    // net::error::tls_alert_received or tls_unexpected_record.
+    template<typename Tag>
+    struct kernel_tls
+    {
+        typedef boost::system::error_code error_code;
+
+#ifdef NETPP_HAS_KTLS
+        static error_code enable(SSL * ssl, int fd, error_code & ec)
+        {
+            ec = error_code();
+            if(!ssl || SSL_version(ssl) != TLS1_2_VERSION)
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+
+            // Data the library has already pulled off the socket would be lost
+            if(SSL_pending(ssl) || BIO_ctrl_pending(SSL_get_rbio(ssl)) || BIO_ctrl_pending(SSL_get_wbio(ssl)))
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+
+            SSL_CIPHER const * cipher = SSL_get_current_cipher(ssl);
+            int nid = cipher ? SSL_CIPHER_get_cipher_nid(cipher) : NID_undef;
+            std::size_t key_size = 0;
+            if(nid == NID_aes_128_gcm)
+            {
+                key_size = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+            }
+            else if(nid == NID_aes_256_gcm)
+            {
+                key_size = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+            }
+            else
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+
+            // key_block = client_key | server_key | client_salt | server_salt
+            boost::uint8_t key_block[2 * 32 + 2 * 4];
+            std::size_t const block_size = 2 * key_size + 2 * 4;
+            if(!derive_key_block(ssl, cipher, key_block, block_size))
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+
+            boost::uint8_t const * client_key  = key_block;
+            boost::uint8_t const * server_key  = key_block + key_size;
+            boost::uint8_t const * client_salt = key_block + 2 * key_size;
+            boost::uint8_t const * server_salt = client_salt + 4;
+
+            if(::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+            {
+                ec = error_code(errno, boost::asio::error::get_system_category());
+            }
+            else if(nid == NID_aes_128_gcm)
+            {
+                tls12_crypto_info_aes_gcm_128 tx, rx;
+                fill_crypto_info(tx, TLS_CIPHER_AES_GCM_128, client_key, client_salt);
+                fill_crypto_info(rx, TLS_CIPHER_AES_GCM_128, server_key, server_salt);
+                install(fd, tx, rx, ec);
+            }
+            else
+            {
+                tls12_crypto_info_aes_gcm_256 tx, rx;
+                fill_crypto_info(tx, TLS_CIPHER_AES_GCM_256, client_key, client_salt);
+                fill_crypto_info(rx, TLS_CIPHER_AES_GCM_256, server_key, server_salt);
+                install(fd, tx, rx, ec);
+            }
+
+            OPENSSL_cleanse(key_block, sizeof(key_block));
+            return ec;
+        }
+
+        // Call with the error of a failed read on a socket set up by enable.
+        // Reads the record which made recv fail and replaces EIO by what it
+        // means, see above. Any other error is left untouched.
+        static error_code & translate_error(int fd, error_code & ec)
+        {
+            if(ec != error_code(EIO, boost::asio::error::get_system_category()))
+            {
+                return ec;
+            }
+
+            unsigned char record[64];
+            char control[CMSG_SPACE(sizeof(unsigned char))];
+            iovec io;
+            io.iov_base = record;
+            io.iov_len  = sizeof(record);
+            msghdr message;
+            std::memset(&message, 0, sizeof(message));
+            message.msg_iov        = &io;
+            message.msg_iovlen     = 1;
+            message.msg_control    = control;
+            message.msg_controllen = sizeof(control);
+
+            ssize_t const size = ::recvmsg(fd, &message, MSG_DONTWAIT);
+            cmsghdr * header = size > 0 ? CMSG_FIRSTHDR(&message) : 0;
+            if(!header || header->cmsg_level != SOL_TLS || header->cmsg_type != TLS_GET_RECORD_TYPE)
+            {
+                return ec;
+            }
+
+            // Alert: level, description; close_notify is description 0
+            unsigned char const type = *CMSG_DATA(header);
+            if(type == RECORD_ALERT && size >= 2 && record[1] == 0)
+            {
+                ec = boost::asio::error::eof;
+            }
+            else if(type == RECORD_ALERT)
+            {
+                ec = net::error::tls_alert_received;
+            }
+            else
+            {
+                ec = net::error::tls_unexpected_record;
+            }
+            return ec;
+        }
+
+    protected:
+        enum { RECORD_ALERT = 21 };
+
+        template<typename CryptoInfo>
+        static void fill_crypto_info(CryptoInfo & info, boost::uint16_t cipher, boost::uint8_t const * key, boost::uint8_t const * salt)
+        {
+            std::memset(&info, 0, sizeof(info));
+            info.info.version     = TLS_1_2_VERSION;
+            info.info.cipher_type = cipher;
+            std::memcpy(info.key, key, sizeof(info.key));
+            std::memcpy(info.salt, salt, sizeof(info.salt));
+            // Sequence number 1 in network byte order, also used as first explicit nonce
+            info.rec_seq[sizeof(info.rec_seq) - 1] = 1;
+            std::memcpy(info.iv, info.rec_seq, sizeof(info.iv));
+        }
+
+        template<typename CryptoInfo>
+        static void install(int fd, CryptoInfo & tx, CryptoInfo & rx, error_code & ec)
+        {
+            if(::setsockopt(fd, SOL_TLS, TLS_TX, &tx, sizeof(tx)) != 0
+            || ::setsockopt(fd, SOL_TLS, TLS_RX, &rx, sizeof(rx)) != 0)
+            {
+                ec = error_code(errno, boost::asio::error::get_system_category());
+            }
+            OPENSSL_cleanse(&tx, sizeof(tx));
+            OPENSSL_cleanse(&rx, sizeof(rx));
+        }
+
+        // TLS 1.2 PRF (RFC 5246, 5): key_block = PRF(master, "key expansion", server_random + client_random)
+        static bool derive_key_block(SSL * ssl, SSL_CIPHER const * cipher, boost::uint8_t * out, std::size_t out_size)
+        {
+            EVP_MD const * md = SSL_CIPHER_get_handshake_digest(cipher);
+            SSL_SESSION * session = SSL_get_session(ssl);
+            if(!md || !session)
+            {
+                return false;
+            }
+
+            boost::uint8_t master[SSL_MAX_MASTER_KEY_LENGTH];
+            std::size_t master_size = SSL_SESSION_get_master_key(session, master, sizeof(master));
+
+            static char const label[] = "key expansion";
+            boost::uint8_t seed[sizeof(label) - 1 + 2 * SSL3_RANDOM_SIZE];
+            std::memcpy(seed, label, sizeof(label) - 1);
+            SSL_get_server_random(ssl, seed + sizeof(label) - 1, SSL3_RANDOM_SIZE);
+            SSL_get_client_random(ssl, seed + sizeof(label) - 1 + SSL3_RANDOM_SIZE, SSL3_RANDOM_SIZE);
+
+            // a_seed = A(i) | seed, A(0) = seed
+            boost::uint8_t a_seed[EVP_MAX_MD_SIZE + sizeof(seed)];
+            boost::uint8_t chunk[EVP_MAX_MD_SIZE];
+            unsigned int a_size = 0;
+            unsigned int chunk_size = 0;
+            bool result = HMAC(md, master, master_size, seed, sizeof(seed), a_seed, &a_size) != 0;
+
+            std::size_t produced = 0;
+            while(result && produced < out_size)
+            {
+                std::memcpy(a_seed + a_size, seed, sizeof(seed));
+                result = HMAC(md, master, master_size, a_seed, a_size + sizeof(seed), chunk, &chunk_size) != 0;
+                if(result)
+                {
+                    std::size_t n = std::min<std::size_t>(chunk_size, out_size - produced);
+                    std::memcpy(out + produced, chunk, n);
+                    produced += n;
+                    result = HMAC(md, master, master_size, a_seed, a_size, chunk, &a_size) != 0;
+                    std::memcpy(a_seed, chunk, a_size);
+                }
+            }
+
+            OPENSSL_cleanse(master, sizeof(master));
+            OPENSSL_cleanse(a_seed, sizeof(a_seed));
+            OPENSSL_cleanse(chunk, sizeof(chunk));
+            return result;
+        }
+#else
+        static error_code enable(SSL *, int, error_code & ec)
+        {
+            return ec = error_code(boost::asio::error::operation_not_supported);
+        }
+
+        static error_code & translate_error(int, error_code & ec)
+        {
+            return ec;
+        }
+#endif
+    };
+}
+
+#endif //GUARD_NET_CLIENT_KERNEL_TLS_HPP_INCLUDED
@@ -27,34 +27,139 @@
 #define GUARD_NET_CLIENT_PROXY_BASE_HPP_INCLUDED
 
 #include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <net/detail/traits.hpp>
+#include <net/detail/log.hpp>
+#include <net/client/utils/handshake_arena.hpp>
 
 namespace net
 {
     template<typename Tag>
     struct proxy_socket;
 
+    // Destination of a proxied connection: either a resolved endpoint or a
+    // host name the proxy resolves itself (see proxy_base::resolves_remotely)
+    template<typename Tag>
+    struct proxy_target
+    {
+        typedef boost::asio::ip::tcp::endpoint                  endpoint_type;
+        typedef typename net::string_traits<Tag>::type          string_type;
+
+        proxy_target()
+            : host()
+            , port(0)
+            , endpoint()
+        {}
+
+        proxy_target(endpoint_type const & ep)
+            : host()
+            , port(ep.port())
+            , endpoint(ep)
+        {}
+
+        proxy_target(string_type const & host, unsigned short port)
+            : host(host)
+            , port(port)
+            , endpoint()
+        {}
+
+        bool has_host() const
+        {
+            return !host.empty();
+        }
+
+        // A default constructed target stands for the proxy itself,
+        // see proxy_base::async_connect_proxy
+        bool empty() const
+        {
+            return !has_host() && port == 0;
+        }
+
+        // Only numeric ports can be passed on to a proxy, service names
+        // need a local lookup
+        static bool parse_port(string_type const & port, unsigned short & result)
+        {
+            unsigned long value = 0;
+            if(port.empty() || port.size() > 5)
+            {
+                return false;
+            }
+            for(typename string_type::const_iterator it = port.begin(); it != port.end(); ++it)
+            {
+                if(*it < '0' || *it > '9')
+                {
+                    return false;
+                }
+                value = value * 10 + (*it - '0');
+            }
+            if(value == 0 || value > 0xFFFF)
+            {
+                return false;
+            }
+            result = static_cast<unsigned short>(value);
+            return true;
+        }
+
+        string_type     host;
+        unsigned short  port;
+        endpoint_type   endpoint;
+    };
+
     template<typename Tag>
     struct proxy_base
     {
         typedef boost::shared_ptr<proxy_base<Tag> >             self_ptr;
         typedef boost::asio::ip::tcp::resolver                  resolver;
         typedef boost::asio::ip::tcp::endpoint                  endpoint_type;
+        typedef proxy_target<Tag>                               target_type;
         typedef boost::asio::ip::tcp::resolver::iterator        endpoint_iterator;
         typedef boost::asio::io_service                         service_type;
         typedef boost::system::error_code                       error_code;
         typedef boost::function< void(error_code const & ec) >  connected_handler;
         typedef typename net::string_traits<Tag>::type          string_type;
+        typedef util::handshake_arena<Tag>                      arena_type;
 
         proxy_base(service_type & service)
             : resolver_(service)
+            , arena_(boost::asio::use_service<arena_type>(service))
+            , resolved_mutex_()
+            , resolved_()
+            , resolved_until_()
+            , resolve_ttl_(boost::posix_time::minutes(5))
         {}
 
         void set_server(string_type const & server, string_type const & port)
         {
             server_ = server;
             port_    = port;
+            flush_resolved();
+        }
+
+        string_type const & server() const
+        {
+            return server_;
+        }
+
+        string_type const & port() const
+        {
+            return port_;
+        }
+
+        // The proxy's addresses are looked up once and reused for ttl,
+        // a zero duration looks them up again for every connection
+        void set_resolve_ttl(boost::posix_time::time_duration const & ttl)
+        {
+            resolve_ttl_ = ttl;
+            flush_resolved();
+        }
+
+        void flush_resolved()
+        {
+            boost::asio::detail::mutex::scoped_lock lock(resolved_mutex_);
+            resolved_ = endpoint_iterator();
         }
 
         virtual ~proxy_base()
@@ -75,16 +180,66 @@ namespace net
         }
 #endif //#ifndef BOOST_NO_EXCEPTIONS
 
-        virtual error_code connect(proxy_socket<Tag> & socket, endpoint_type const & endpoint, error_code & ec)
+        // false for the empty proxy, which connects directly to the target
+        virtual bool enabled() const
+        {
+            return false;
+        }
+
+        // true if the proxy accepts host name targets
+        virtual bool resolves_remotely() const
+        {
+            return false;
+        }
+
+        // Only opens the TCP connection to the proxy. The tunnel is requested
+        // later with async_open_tunnel, which saves the connection setup for
+        // connections kept warm in advance (see tunnel_pool).
+        void async_connect_proxy(proxy_socket<Tag> & socket, connected_handler connected)
+        {
+            if(!enabled())
+            {
+                socket.get_io_service().post(boost::bind(connected, error_code(boost::asio::error::operation_not_supported)));
+                return;
+            }
+            socket.reset_connection();
+            internal_async_connect(socket, target_type(), connected);
+        }
+
+        // Requests the tunnel to target on a socket connected by async_connect_proxy
+        void async_open_tunnel(proxy_socket<Tag> & socket, target_type const & target, connected_handler connected)
+        {
+            if(!enabled() || target.empty())
+            {
+                socket.get_io_service().post(boost::bind(connected, error_code(boost::asio::error::operation_not_supported)));
+                return;
+            }
+            on_async_connected(socket, target, connected);
+        }
+
+        error_code open_tunnel(proxy_socket<Tag> & socket, target_type const & target, error_code & ec)
+        {
+            if(!enabled() || target.empty())
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+            return on_connected(socket, target, ec);
+        }
+
+        virtual error_code connect(proxy_socket<Tag> & socket, target_type const & target, error_code & ec)
         {
             // Dummy implementations for the empty proxy
-            socket.lowest_layer().close();
-            return socket.lowest_layer().connect(endpoint, ec);
+            if(target.has_host())
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+            socket.reset_connection();
+            return socket.lowest_layer().connect(target.endpoint, ec);
         }
 
         virtual void async_connect(
             proxy_socket<Tag> & socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
@@ -96,9 +251,14 @@ namespace net
             }
 
             // Dummy implementations for the empty proxy
-            socket.lowest_layer().close();
+            if(target.has_host())
+            {
+                socket.get_io_service().post(boost::bind(connected, error_code(boost::asio::error::operation_not_supported)));
+                return;
+            }
+            socket.reset_connection();
             socket.lowest_layer().async_connect(
-                endpoint,
+                target.endpoint,
                 connected
             );
         }
@@ -106,27 +266,38 @@ namespace net
     protected:
         virtual error_code internal_connect(
             proxy_socket<Tag> & socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             error_code & ec
         )
         {
-            resolver::query query(server_, port_);
-            endpoint_iterator iter = resolver_.resolve(query, ec);
+            endpoint_iterator iter = cached_endpoints();
+            if(iter == endpoint_iterator())
+            {
+                resolver::query query(server_, port_);
+                iter = resolver_.resolve(query, ec);
+                if(ec)
+                {
+                    return ec;
+                }
+                remember_endpoints(iter);
+            }
             while(iter != endpoint_iterator())
             {
                 endpoint_type ep = *iter;
+                socket.reset_connection();
                 if(!socket.lowest_layer().connect(ep, ec))
                 {
-                    return on_connected(socket, endpoint, ec);
+                    return target.empty() ? ec : on_connected(socket, target, ec);
                 }
                 ++iter;
             }
+            flush_resolved();
             return ec;
         }
 
         virtual error_code on_connected(
             proxy_socket<Tag> &,
-            endpoint_type const &,
+            target_type const &,
             error_code & ec)
         {
             return ec;
@@ -134,21 +305,30 @@ namespace net
 
         virtual void internal_async_connect(
             proxy_socket<Tag> &        socket,
-            endpoint_type const &   endpoint,
+            target_type const &     target,
             connected_handler        connected
         )
         {
+            endpoint_iterator cached = cached_endpoints();
+            if(cached != endpoint_iterator())
+            {
+                do_async_connect(cached, socket, target, connected);
+                return;
+            }
+
             resolver::query query(server_, port_);
             resolver_.async_resolve(
                 query,
-                boost::bind(
-                    &proxy_base::on_resolved,
-                    this,
-                    boost::asio::placeholders::iterator,
-                    boost::asio::placeholders::error,
-                    boost::ref(socket),
-                    endpoint,
-                    connected
+                arena_.wrap(
+                    boost::bind(
+                        &proxy_base::on_resolved,
+                        this,
+                        boost::asio::placeholders::iterator,
+                        boost::asio::placeholders::error,
+                        boost::ref(socket),
+                        target,
+                        connected
+                    )
                 )
             );
         }
@@ -156,22 +336,24 @@ namespace net
         virtual void do_async_connect(
             endpoint_iterator ep_iter,
             proxy_socket<Tag> &    socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
             endpoint_type ep = *ep_iter;
-            std::cout << "Trying to connect to proxy: " << ep.address().to_string() << ":" << ep.port() << std::endl;
+            NETPP_LOG_DEBUG("proxy", "connecting to " << ep);
             socket.next_layer().async_connect(
-            ep,
-                boost::bind(
-                    &proxy_base::on_async_connection_result,
-                    this,
-                    boost::asio::placeholders::error,
-                    ++ep_iter,
-                    boost::ref(socket),
-                    endpoint,
-                    connected
+                ep,
+                arena_.wrap(
+                    boost::bind(
+                        &proxy_base::on_async_connection_result,
+                        this,
+                        boost::asio::placeholders::error,
+                        ++ep_iter,
+                        boost::ref(socket),
+                        target,
+                        connected
+                    )
                 )
             );
         }
@@ -180,13 +362,14 @@ namespace net
             endpoint_iterator ep_iter,
             error_code const &    ec,
             proxy_socket<Tag> &    socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
             if(!ec)
             {
-                do_async_connect(ep_iter, socket, endpoint, connected);
+                remember_endpoints(ep_iter);
+                do_async_connect(ep_iter, socket, target, connected);
             }
             else
             {
@@ -198,36 +381,76 @@ namespace net
             error_code const & ec,
             endpoint_iterator epiter,
             proxy_socket<Tag> &    socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
             if(!ec)
             {
-                on_async_connected(socket, endpoint, connected);
+                if(target.empty())
+                {
+                    connected(ec);
+                }
+                else
+                {
+                    on_async_connected(socket, target, connected);
+                }
             }
             else if(ec && epiter != endpoint_iterator())
             {
-                do_async_connect(epiter, socket, endpoint, connected);
+                do_async_connect(epiter, socket, target, connected);
             }
             else if(ec && epiter == endpoint_iterator())
             {
+                if(ec != boost::asio::error::operation_aborted)
+                {
+                    // None of the addresses worked, look them up again next time
+                    flush_resolved();
+                }
                 connected(ec);
             }
         }
 
         virtual void on_async_connected(
             proxy_socket<Tag> &,
-            endpoint_type const &,
+            target_type const &,
             connected_handler
         )
         {
 
         }
+
+        endpoint_iterator cached_endpoints() const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(resolved_mutex_);
+            if(resolved_ != endpoint_iterator() && boost::posix_time::microsec_clock::universal_time() < resolved_until_)
+            {
+                return resolved_;
+            }
+            return endpoint_iterator();
+        }
+
+        void remember_endpoints(endpoint_iterator iter)
+        {
+            if(resolve_ttl_.total_milliseconds() > 0)
+            {
+                boost::asio::detail::mutex::scoped_lock lock(resolved_mutex_);
+                resolved_       = iter;
+                resolved_until_ = boost::posix_time::microsec_clock::universal_time() + resolve_ttl_;
+            }
+        }
+
     protected:
         resolver    resolver_;
         string_type server_;
         string_type port_;
+        // Handshake state and handler memory of all proxies on the io_service
+        arena_type & arena_;
+        // Resolved proxy addresses, shared by all connections using the proxy
+        mutable boost::asio::detail::mutex  resolved_mutex_;
+        endpoint_iterator                   resolved_;
+        boost::posix_time::ptime            resolved_until_;
+        boost::posix_time::time_duration    resolve_ttl_;
     };
 
     template<typename Tag>
@@ -236,6 +459,7 @@ namespace net
         typedef proxy_base<Tag>                         base_type;
         typedef typename base_type::service_type        service_type;
         typedef typename base_type::endpoint_type       endpoint_type;
+        typedef typename base_type::target_type         target_type;
         typedef typename base_type::connected_handler   connected_handler;
         typedef typename base_type::error_code          error_code;
 
@@ -243,20 +467,25 @@ namespace net
             : base_type(service)
         {}
 
-        virtual error_code connect(proxy_socket<Tag> & socket, endpoint_type const & endpoint, error_code & ec)
+        virtual bool enabled() const
+        {
+            return true;
+        }
+
+        virtual error_code connect(proxy_socket<Tag> & socket, target_type const & target, error_code & ec)
         {
             // Ensure the socket is closed before we're going to do anything
-            socket.lowest_layer().close(ec);
+            socket.reset_connection(ec);
             if(!ec)
             {
-                return this->internal_connect(socket, endpoint, ec);
+                return this->internal_connect(socket, target, ec);
             }
             return ec;
         }
 
         virtual void async_connect(
             proxy_socket<Tag> & socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
             )
         {
@@ -267,8 +496,8 @@ namespace net
                 throw boost::system::system_error(boost::asio::error::invalid_argument);
             }
 
-            socket.lowest_layer().close();
-            this->internal_async_connect(socket, endpoint, connected);
+            socket.reset_connection();
+            this->internal_async_connect(socket, target, connected);
         }
     };
 }
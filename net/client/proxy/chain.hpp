@@ -0,0 +1,262 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_PROXY_CHAIN_HPP_INCLUDED
+#define GUARD_NET_CLIENT_PROXY_CHAIN_HPP_INCLUDED
+
+#include <net/client/proxy_socket.hpp>
+#include <net/detail/log.hpp>
+#include <vector>
+
+namespace net
+{
+    // Multi-hop proxy: the socket connects to the first hop, every hop then
+    // opens the tunnel to the next one and the last hop to the target, e.g.
+    // SOCKS5 -> HTTP CONNECT -> target.
+    // Hops are regular proxies, their handshakes run unchanged on the tunnel
+    // of the previous hop. Add all hops before the first connect.
+    template<typename Tag>
+    struct chain_proxy
+        : implements_proxy<Tag>
+    {
+        typedef implements_proxy<Tag>                       base_type;
+        typedef typename base_type::error_code              error_code;
+        typedef typename base_type::service_type            service_type;
+        typedef typename base_type::endpoint_type           endpoint_type;
+        typedef typename base_type::endpoint_iterator       endpoint_iterator;
+        typedef typename base_type::target_type             target_type;
+        typedef typename base_type::connected_handler       connected_handler;
+        typedef typename base_type::resolver                resolver;
+        typedef typename base_type::self_ptr                proxy_ptr;
+
+        struct session
+        {
+            session(proxy_socket<Tag> & socket,
+                    target_type const & tgt,
+                    connected_handler const & connected)
+                : socket_ref(boost::ref(socket))
+                , target(tgt)
+                , handler(connected)
+                , hop(0)
+            {}
+
+            boost::reference_wrapper< proxy_socket<Tag> >  socket_ref;
+            target_type         target;
+            connected_handler   handler;
+            std::size_t         hop;        // the hop the socket currently talks to
+        };
+        typedef boost::shared_ptr<session> session_ptr;
+
+        chain_proxy(service_type & service)
+            : base_type(service)
+            , hops_()
+        {}
+
+        void add(proxy_ptr hop)
+        {
+            hops_.push_back(hop);
+        }
+
+        std::size_t size() const
+        {
+            return hops_.size();
+        }
+
+        virtual bool resolves_remotely() const
+        {
+            return !hops_.empty() && hops_.back()->resolves_remotely();
+        }
+
+    protected:
+        virtual void internal_async_connect(
+            proxy_socket<Tag> &     socket,
+            target_type const &     target,
+            connected_handler       connected
+        )
+        {
+            if(hops_.empty())
+            {
+                socket.get_io_service().post(boost::bind(connected, error_code(boost::asio::error::invalid_argument)));
+                return;
+            }
+
+            session_ptr sess(this->arena_.template create<session>(socket, target, connected));
+            hops_.front()->async_connect_proxy(
+                socket,
+                this->arena_.wrap(
+                    boost::bind(
+                        &chain_proxy::on_hop_ready,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess
+                    )
+                )
+            );
+        }
+
+        virtual void on_async_connected(
+            proxy_socket<Tag> &     socket,
+            target_type const &     target,
+            connected_handler       connected
+        )
+        {
+            hops_.back()->async_open_tunnel(socket, target, connected);
+        }
+
+        virtual error_code internal_connect(
+            proxy_socket<Tag> &     socket,
+            target_type const &     target,
+            error_code &            ec
+        )
+        {
+            if(hops_.empty())
+            {
+                return ec = error_code(boost::asio::error::invalid_argument);
+            }
+
+            // The empty target only opens the connection to the first hop
+            hops_.front()->connect(socket, target_type(), ec);
+            for(std::size_t hop = 0; !ec && hop + 1 < hops_.size(); ++hop)
+            {
+                target_type next;
+                if(hop_target(hop, next, ec))
+                {
+                    hops_[hop]->open_tunnel(socket, next, ec);
+                }
+            }
+            return (ec || target.empty()) ? ec : on_connected(socket, target, ec);
+        }
+
+        virtual error_code on_connected(
+            proxy_socket<Tag> &     socket,
+            target_type const &     target,
+            error_code &            ec
+        )
+        {
+            return hops_.back()->open_tunnel(socket, target, ec);
+        }
+
+        void on_hop_ready(error_code const & ec, session_ptr sess)
+        {
+            if(ec)
+            {
+                NETPP_LOG_DEBUG("chain_proxy", "hop " << sess->hop << " failed: " << ec.message());
+                sess->handler(ec);
+                return;
+            }
+
+            if(sess->hop + 1 == hops_.size())
+            {
+                if(sess->target.empty())
+                {
+                    sess->handler(ec);
+                }
+                else
+                {
+                    hops_.back()->async_open_tunnel(sess->socket_ref.get(), sess->target, sess->handler);
+                }
+                return;
+            }
+
+            proxy_base<Tag> & next = *hops_[sess->hop + 1];
+            unsigned short port = 0;
+            if(hops_[sess->hop]->resolves_remotely() && target_type::parse_port(next.port(), port))
+            {
+                open_hop(sess, target_type(next.server(), port));
+                return;
+            }
+
+            // This hop needs the address of the next one
+            typename resolver::query query(next.server(), next.port());
+            this->resolver_.async_resolve(
+                query,
+                this->arena_.wrap(
+                    boost::bind(
+                        &chain_proxy::on_hop_resolved,
+                        this,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::iterator,
+                        sess
+                    )
+                )
+            );
+        }
+
+        void on_hop_resolved(error_code const & ec, endpoint_iterator iter, session_ptr sess)
+        {
+            if(ec)
+            {
+                sess->handler(ec);
+                return;
+            }
+            endpoint_type ep = *iter;
+            open_hop(sess, target_type(ep));
+        }
+
+        void open_hop(session_ptr sess, target_type const & next)
+        {
+            std::size_t const hop = sess->hop++;
+            hops_[hop]->async_open_tunnel(
+                sess->socket_ref.get(),
+                next,
+                this->arena_.wrap(
+                    boost::bind(
+                        &chain_proxy::on_hop_ready,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess
+                    )
+                )
+            );
+        }
+
+        // The address hops_[hop] has to open the tunnel to
+        bool hop_target(std::size_t hop, target_type & result, error_code & ec)
+        {
+            proxy_base<Tag> & next = *hops_[hop + 1];
+            unsigned short port = 0;
+            if(hops_[hop]->resolves_remotely() && target_type::parse_port(next.port(), port))
+            {
+                result = target_type(next.server(), port);
+                return true;
+            }
+
+            typename resolver::query query(next.server(), next.port());
+            endpoint_iterator iter = this->resolver_.resolve(query, ec);
+            if(ec)
+            {
+                return false;
+            }
+            endpoint_type ep = *iter;
+            result = target_type(ep);
+            return true;
+        }
+
+    protected:
+        std::vector<proxy_ptr> hops_;
+    };
+}
+
+#endif //GUARD_NET_CLIENT_PROXY_CHAIN_HPP_INCLUDED
@@ -0,0 +1,466 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_PROXY_FAILOVER_HPP_INCLUDED
+#define GUARD_NET_CLIENT_PROXY_FAILOVER_HPP_INCLUDED
+
+#include <net/client/proxy_socket.hpp>
+#include <net/error.hpp>
+#include <net/detail/log.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <vector>
+
+namespace net
+{
+    // Ordered list of equivalent proxies. Every connection goes through the
+    // healthiest one and fails over to the next on errors or timeouts.
+    //
+    // Health is shared by all connections using the list: a moving average
+    // of the connect latency, the number of connects in flight, and a circuit
+    // breaker which takes a proxy out of rotation after failure_threshold
+    // consecutive failures. After the cooldown a single probe connection is
+    // let through; a failed probe doubles the cooldown (up to max_cooldown).
+    // Add all proxies before the first connect.
+    template<typename Tag>
+    struct failover_proxy
+        : implements_proxy<Tag>
+    {
+        typedef implements_proxy<Tag>                       base_type;
+        typedef typename base_type::error_code              error_code;
+        typedef typename base_type::service_type            service_type;
+        typedef typename base_type::target_type             target_type;
+        typedef typename base_type::connected_handler       connected_handler;
+        typedef typename base_type::self_ptr                proxy_ptr;
+        typedef boost::posix_time::time_duration            duration_type;
+        typedef boost::posix_time::ptime                    time_type;
+
+        enum breaker_state
+        {
+            CLOSED,
+            OPEN,
+            HALF_OPEN
+        };
+
+        struct health
+        {
+            health()
+                : latency()
+                , samples(0)
+                , in_flight(0)
+                , failures(0)
+                , state(CLOSED)
+                , retry_at()
+                , cooldown()
+            {}
+
+            duration_type   latency;        // moving average of the connect time
+            std::size_t     samples;
+            std::size_t     in_flight;
+            std::size_t     failures;       // consecutive
+            breaker_state   state;
+            time_type       retry_at;       // end of the cooldown of an open breaker
+            duration_type   cooldown;
+        };
+
+        struct session
+        {
+            session(proxy_socket<Tag> & socket,
+                    target_type const & tgt,
+                    connected_handler const & connected)
+                : socket_ref(boost::ref(socket))
+                , target(tgt)
+                , handler(connected)
+                , timer(socket.get_io_service())
+                , tried()
+                , current(0)
+                , attempt(0)
+                , started()
+                , timed_out(false)
+                , last_error()
+            {}
+
+            boost::reference_wrapper< proxy_socket<Tag> >  socket_ref;
+            target_type                 target;
+            connected_handler           handler;
+            boost::asio::deadline_timer timer;
+            std::vector<bool>           tried;
+            std::size_t                 current;
+            std::size_t                 attempt;
+            time_type                   started;
+            bool                        timed_out;
+            error_code                  last_error;
+        };
+        typedef boost::shared_ptr<session> session_ptr;
+
+        static std::size_t const npos = std::size_t(-1);
+
+        failover_proxy(service_type & service)
+            : base_type(service)
+            , mutex_()
+            , entries_()
+            , attempt_timeout_(boost::posix_time::seconds(5))
+            , failure_threshold_(3)
+            , cooldown_(boost::posix_time::seconds(30))
+            , max_cooldown_(boost::posix_time::minutes(10))
+        {}
+
+        void add(proxy_ptr proxy)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            entries_.push_back(entry(proxy));
+        }
+
+        std::size_t size() const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            return entries_.size();
+        }
+
+        health stats(std::size_t index) const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            return entries_.at(index).stats;
+        }
+
+        // Time a single proxy gets to establish the tunnel (async only)
+        void set_attempt_timeout(duration_type const & timeout)
+        {
+            attempt_timeout_ = timeout;
+        }
+
+        void set_failure_threshold(std::size_t failures)
+        {
+            failure_threshold_ = failures ? failures : 1;
+        }
+
+        void set_cooldown(duration_type const & cooldown, duration_type const & max_cooldown)
+        {
+            cooldown_       = cooldown;
+            max_cooldown_   = max_cooldown < cooldown ? cooldown : max_cooldown;
+        }
+
+        virtual bool resolves_remotely() const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            for(std::size_t i = 0; i < entries_.size(); ++i)
+            {
+                if(!entries_[i].proxy->resolves_remotely())
+                {
+                    return false;
+                }
+            }
+            return !entries_.empty();
+        }
+
+    protected:
+        struct entry
+        {
+            explicit entry(proxy_ptr p)
+                : proxy(p)
+                , stats()
+            {}
+
+            proxy_ptr   proxy;
+            health      stats;
+        };
+
+        // The chosen proxy is only known to the connection, opening
+        // tunnels on connections made in advance is not supported
+        virtual void internal_async_connect(
+            proxy_socket<Tag> &     socket,
+            target_type const &     target,
+            connected_handler       connected
+        )
+        {
+            if(target.empty())
+            {
+                socket.get_io_service().post(boost::bind(connected, error_code(boost::asio::error::operation_not_supported)));
+                return;
+            }
+
+            session_ptr sess(this->arena_.template create<session>(socket, target, connected));
+            sess->tried.resize(size(), false);
+            if(!next_attempt(sess))
+            {
+                socket.get_io_service().post(boost::bind(connected, error_code(error::proxy_unavailable)));
+            }
+        }
+
+        virtual void on_async_connected(
+            proxy_socket<Tag> &     socket,
+            target_type const &,
+            connected_handler       connected
+        )
+        {
+            socket.get_io_service().post(boost::bind(connected, error_code(boost::asio::error::operation_not_supported)));
+        }
+
+        virtual error_code internal_connect(
+            proxy_socket<Tag> &     socket,
+            target_type const &     target,
+            error_code &            ec
+        )
+        {
+            if(target.empty())
+            {
+                return ec = error_code(boost::asio::error::operation_not_supported);
+            }
+
+            std::vector<bool> tried(size(), false);
+            error_code last_error;
+            for(;;)
+            {
+                std::size_t const index = select(tried);
+                if(index == npos)
+                {
+                    return ec = last_error ? last_error : error_code(error::proxy_unavailable);
+                }
+
+                time_type const started = now();
+                entries_[index].proxy->connect(socket, target, ec);
+                if(!ec || is_target_error(ec))
+                {
+                    record(index, true, now() - started);
+                    return ec;
+                }
+                record(index, false, duration_type());
+                NETPP_LOG_INFO("failover_proxy", "proxy " << index << " failed: " << ec.message());
+                last_error = ec;
+            }
+        }
+
+        virtual error_code on_connected(
+            proxy_socket<Tag> &,
+            target_type const &,
+            error_code &            ec
+        )
+        {
+            return ec = error_code(boost::asio::error::operation_not_supported);
+        }
+
+        // false if no proxy is left to try
+        bool next_attempt(session_ptr sess)
+        {
+            std::size_t const index = select(sess->tried);
+            if(index == npos)
+            {
+                return false;
+            }
+
+            sess->current   = index;
+            sess->started   = now();
+            sess->timed_out = false;
+            ++sess->attempt;
+
+            sess->timer.expires_from_now(attempt_timeout_);
+            sess->timer.async_wait(
+                this->arena_.wrap(
+                    boost::bind(
+                        &failover_proxy::on_attempt_timeout,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess,
+                        sess->attempt
+                    )
+                )
+            );
+
+            entries_[index].proxy->async_connect(
+                sess->socket_ref.get(),
+                sess->target,
+                this->arena_.wrap(
+                    boost::bind(
+                        &failover_proxy::on_attempt_done,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess
+                    )
+                )
+            );
+            return true;
+        }
+
+        void on_attempt_timeout(error_code const & ec, session_ptr sess, std::size_t attempt)
+        {
+            if(ec || attempt != sess->attempt)
+            {
+                return;
+            }
+            // Aborts the handshake, on_attempt_done moves on to the next proxy
+            NETPP_LOG_INFO("failover_proxy", "proxy " << sess->current << " timed out");
+            sess->timed_out = true;
+            error_code ignored;
+            sess->socket_ref.get().reset_connection(ignored);
+        }
+
+        void on_attempt_done(error_code const & ec, session_ptr sess)
+        {
+            ++sess->attempt;
+            error_code ignored;
+            sess->timer.cancel(ignored);
+
+            std::size_t const index = sess->current;
+            if(!sess->timed_out && ec == boost::asio::error::operation_aborted)
+            {
+                // Cancelled by the user, says nothing about the proxy
+                release(index);
+                sess->handler(ec);
+                return;
+            }
+
+            if(!sess->timed_out && (!ec || is_target_error(ec)))
+            {
+                record(index, true, now() - sess->started);
+                sess->handler(ec);
+                return;
+            }
+
+            sess->last_error = sess->timed_out ? error_code(boost::asio::error::timed_out) : ec;
+            NETPP_LOG_INFO("failover_proxy", "proxy " << index << " failed: " << sess->last_error.message());
+            record(index, false, duration_type());
+            if(!next_attempt(sess))
+            {
+                sess->handler(sess->last_error);
+            }
+        }
+
+        // Picks the untried proxy with the lowest expected latency, proxies
+        // without samples first, ties go to the earlier entry
+        std::size_t select(std::vector<bool> & tried)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            time_type const current = now();
+            std::size_t best = npos;
+            boost::int64_t best_score = 0;
+            for(std::size_t i = 0; i < entries_.size() && i < tried.size(); ++i)
+            {
+                health const & h = entries_[i].stats;
+                if(tried[i])
+                {
+                    continue;
+                }
+                if(h.state == HALF_OPEN || (h.state == OPEN && current < h.retry_at))
+                {
+                    // Out of rotation, or its probe is still running
+                    continue;
+                }
+
+                boost::int64_t const score = h.samples
+                    ? (h.latency.total_microseconds() + 1) * boost::int64_t(h.in_flight + 1)
+                    : 0;
+                if(best == npos || score < best_score)
+                {
+                    best        = i;
+                    best_score  = score;
+                }
+            }
+
+            if(best != npos)
+            {
+                health & h = entries_[best].stats;
+                if(h.state == OPEN)
+                {
+                    h.state = HALF_OPEN;
+                }
+                ++h.in_flight;
+                tried[best] = true;
+            }
+            return best;
+        }
+
+        void record(std::size_t index, bool success, duration_type const & elapsed)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            health & h = entries_[index].stats;
+            --h.in_flight;
+            if(success)
+            {
+                h.latency   = h.samples ? (h.latency * 3 + elapsed) / 4 : elapsed;
+                ++h.samples;
+                h.failures  = 0;
+                h.state     = CLOSED;
+                h.cooldown  = duration_type();
+                return;
+            }
+
+            ++h.failures;
+            if(h.state == HALF_OPEN)
+            {
+                h.cooldown = h.cooldown * 2 > max_cooldown_ ? max_cooldown_ : h.cooldown * 2;
+            }
+            else if(h.failures >= failure_threshold_)
+            {
+                h.cooldown = cooldown_;
+            }
+            else
+            {
+                return;
+            }
+            h.state     = OPEN;
+            h.retry_at  = now() + h.cooldown;
+            NETPP_LOG_WARNING("failover_proxy", "proxy " << index << " out of rotation for " << h.cooldown);
+        }
+
+        void release(std::size_t index)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            health & h = entries_[index].stats;
+            --h.in_flight;
+            if(h.state == HALF_OPEN)
+            {
+                // The probe never finished, allow the next one
+                h.state = OPEN;
+            }
+        }
+
+        // The proxy works, the target does not; another proxy won't help
+        static bool is_target_error(error_code const & ec)
+        {
+            return ec.category() == error::get_proxy_category()
+                && (ec.value() == error::proxy_forbidden
+                 || ec.value() == error::proxy_bad_gateway
+                 || ec.value() == error::proxy_gateway_timeout);
+        }
+
+        static time_type now()
+        {
+            return boost::posix_time::microsec_clock::universal_time();
+        }
+
+    protected:
+        mutable boost::asio::detail::mutex  mutex_;
+        std::vector<entry>                  entries_;
+        duration_type                       attempt_timeout_;
+        std::size_t                         failure_threshold_;
+        duration_type                       cooldown_;
+        duration_type                       max_cooldown_;
+    };
+
+    template<typename Tag>
+    std::size_t const failover_proxy<Tag>::npos;
+}
+
+#endif //GUARD_NET_CLIENT_PROXY_FAILOVER_HPP_INCLUDED
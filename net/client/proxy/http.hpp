@@ -27,16 +27,21 @@
 #define GUARD_NET_CLIENT_PROXY_HTTP_HPP_INCLUDED
 
 #include <net/client/proxy_socket.hpp>
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/client/utils/output_buffer.hpp>
 #include <net/http/parser/header_parser.hpp>
+#include <net/http/detail/header_utils.hpp>
+#include <net/error.hpp>
+#include <net/detail/log.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <cstring>
 
 namespace net
 {
     // CONNECT %SERVER%:%PORT% HTTP/1.1
     // Host: %SERVER%:%PORT%
-    // Proxy-Authorization: %AUTH%
-    // User-Agent: %UA%
-    // Proxy-Connection: %PROXY_CONNECTION%
-    // Connection: %PROXY_CONNECTION%
+    // Proxy-Authorization: Basic %CREDENTIALS%
+    // Proxy-Connection: Keep-Alive
 
     template<typename Tag>
     struct http_proxy
@@ -46,199 +51,492 @@ namespace net
         typedef typename base_type::error_code            error_code;
         typedef typename base_type::service_type        service_type;
         typedef typename base_type::endpoint_type        endpoint_type;
+        typedef typename base_type::target_type          target_type;
         typedef typename base_type::connected_handler    connected_handler;
+        typedef typename base_type::string_type          string_type;
+
+        typedef net::http::basic_header_parser<Tag, false>  parser_t;
+        typedef net::http::basic_response<Tag>              message_type;
+
+        // Reply header buffer and the limit for the request
+        enum
+        {
+            BUFFER_SIZE         = 0x1000,
+            MAX_REQUEST_SIZE    = 0x2000
+        };
+
+        struct session
+        {
+            session(proxy_socket<Tag> & socket,
+                    target_type const & tgt,
+                    connected_handler const & connected = connected_handler())
+                : socket_ref(boost::ref(socket))
+                , target(tgt)
+                , handler(connected)
+                , buffer(util::lease_buffer(BUFFER_SIZE))
+                , request()
+                , filled(0)
+                , discard(0)
+                , authenticated(false)
+            {}
+
+            proxy_socket<Tag> & socket()
+            {
+                return socket_ref.get();
+            }
+
+            boost::reference_wrapper< proxy_socket<Tag> >  socket_ref;
+            target_type         target;
+            connected_handler   handler;
+            util::buffer_lease  buffer;
+            util::output_buffer request;
+            std::size_t         filled;         // reply bytes in buffer
+            std::size_t         discard;        // body of a 407 still to skip
+            bool                authenticated;  // credentials were sent
+        };
+        typedef boost::shared_ptr<session> session_ptr;
 
         http_proxy(service_type & service)
             : base_type(service)
+            , authorization_()
+            , auth_required_(false)
+            , mutex_()
         {}
 
+        // Credentials for Basic proxy authentication. They are sent once the
+        // proxy asked for them (407) and right away from then on.
+        // An empty username disables authentication again.
+        void set_credentials(string_type const & username, string_type const & password)
+        {
+            string_type authorization;
+            if(!username.empty())
+            {
+                authorization = "Basic " + encode_base64(username + ":" + password);
+            }
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            authorization_ = authorization;
+        }
+
+        virtual bool resolves_remotely() const
+        {
+            return true;
+        }
+
         virtual void on_async_connected(
             proxy_socket<Tag> &    socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
-            boost::shared_ptr<std::string> string_ptr(new std::string(build_request(endpoint)));
-               boost::asio::async_write(
-                socket,
-                boost::asio::buffer(
-                    *string_ptr
-                ),
-                boost::bind(
-                    &http_proxy::start_read_response,
-                    this,
-                    boost::asio::placeholders::error,
-                    boost::ref(socket),
-                    connected,
-                    string_ptr
-                )
-            );
+            session_ptr sess(this->arena_.template create<session>(socket, target, connected));
+            if(!build_request(*sess, auth_required()))
+            {
+                finish(sess, error_code(net::error::proxy_request_too_large));
+                return;
+            }
+            send_request(sess);
         }
 
-        std::string build_request(endpoint_type const & ep)
+        virtual error_code on_connected(
+            proxy_socket<Tag> & socket,
+            target_type const & target,
+            error_code & ec
+        )
         {
-            std::ostringstream request;
-            request << "CONNECT " << ep.address().to_string() << ":" << ep.port() << " HTTP/1.0\r\n"
-                    << "Proxy-Connection: Close\r\n"
-                    << "\r\n"
-                    ;
-            std::cout << "\n---------------------------------------\n"
-                      << "Generated request:\n"
-                      << request.str()    << "\n"
-                      <<   "---------------------------------------\n\n";
-            return request.str();
+            if(ec)
+            {
+                return ec;
+            }
+
+            session sess(socket, target);
+            reply_action action = SEND_REQUEST;
+            if(!build_request(sess, auth_required()))
+            {
+                ec = net::error::proxy_request_too_large;
+            }
+
+            while(!ec && action == SEND_REQUEST)
+            {
+                boost::asio::write(
+                    socket,
+                    sess.request.data(),
+                    boost::asio::transfer_all(),
+                    ec
+                );
+
+                action = READ_MORE;
+                while(!ec && action == READ_MORE)
+                {
+                    std::size_t bytes_read = socket.read_some(
+                        boost::asio::buffer(
+                            sess.buffer.data() + sess.filled,
+                            sess.buffer.size() - sess.filled
+                        ),
+                        ec
+                    );
+                    if(!ec)
+                    {
+                        sess.filled += bytes_read;
+                        action = process_reply(sess, ec);
+                    }
+                }
+            }
+
+            if(!ec && action == RECONNECT)
+            {
+                return this->internal_connect(socket, target, ec);
+            }
+
+            if(ec)
+            {
+                error_code ignored;
+                socket.reset_connection(ignored);
+            }
+            return ec;
         }
 
-        typedef boost::array<char, 0x1000>     buffer_t;
-        typedef boost::shared_ptr<buffer_t> buffer_ptr_t;
+    protected:
+        enum reply_action
+        {
+            READ_MORE,      // the reply is incomplete
+            SEND_REQUEST,   // request again on the same connection
+            RECONNECT,      // request again on a new connection
+            TUNNEL_OPEN,
+            FAILED
+        };
 
-        typedef net::http::basic_header_parser<Tag, false>  parser_t;
-        typedef net::http::basic_response<Tag>              message_type;
-        typedef boost::shared_ptr<parser_t>                 parser_ptr_t;
+        void send_request(session_ptr sess)
+        {
+            boost::asio::async_write(
+                sess->socket(),
+                sess->request.data(),
+                this->arena_.wrap(
+                    boost::bind(
+                        &http_proxy::on_request_sent,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess
+                    )
+                )
+            );
+        }
 
-        virtual void start_read_response(
-            error_code const & ec,
-            proxy_socket<Tag> &    socket,
-            connected_handler connected,
-            boost::shared_ptr<std::string>
-        )
+        void on_request_sent(error_code const & ec, session_ptr sess)
         {
-            buffer_ptr_t buf(new buffer_t());
-            parser_ptr_t parser(new parser_t());
-            setup_async_read(buf, parser, socket, connected);
+            if(ec)
+            {
+                finish(sess, ec);
+                return;
+            }
+            read_reply(sess);
         }
 
-        void setup_async_read(
-            buffer_ptr_t buf_ptr,
-            parser_ptr_t parser_ptr,
-            proxy_socket<Tag> &    socket,
-            connected_handler connected
-        )
+        void read_reply(session_ptr sess)
         {
-            boost::asio::async_read(
-                socket,
-                boost::asio::buffer(*buf_ptr),
-                boost::asio::transfer_at_least(1),
-                boost::bind(
-                    &http_proxy::response_read,
-                    this,
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred,
-                    buf_ptr,
-                    parser_ptr,
-                    boost::ref(socket),
-                    connected
+            sess->socket().async_read_some(
+                boost::asio::buffer(
+                    sess->buffer.data() + sess->filled,
+                    sess->buffer.size() - sess->filled
+                ),
+                this->arena_.wrap(
+                    boost::bind(
+                        &http_proxy::on_reply_read,
+                        this,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred,
+                        sess
+                    )
                 )
             );
         }
 
-        virtual void response_read(
-            error_code const & ec,
-            size_t bytes_read,
-            buffer_ptr_t buf_ptr,
-            parser_ptr_t parser_ptr,
-            proxy_socket<Tag> &    socket,
-            connected_handler connected
-        )
+        void on_reply_read(error_code const & ec, std::size_t bytes_read, session_ptr sess)
         {
-            std::cout << std::string(buf_ptr->begin(), buf_ptr->begin() + bytes_read);
-            if(!ec)
+            if(ec)
+            {
+                finish(sess, ec);
+                return;
+            }
+
+            sess->filled += bytes_read;
+            error_code result;
+            switch(process_reply(*sess, result))
             {
-                message_type msg;
-                char * begin = buf_ptr->begin();
-                boost::tribool state = parser_ptr->parse( begin, begin + bytes_read, msg );
-                if(state == boost::logic::indeterminate)
+            case READ_MORE:
+                read_reply(sess);
+                break;
+            case SEND_REQUEST:
+                send_request(sess);
+                break;
+            case RECONNECT:
+                sess->socket().reset_connection(result);
+                this->internal_async_connect(sess->socket(), sess->target, sess->handler);
+                break;
+            case TUNNEL_OPEN:
+            case FAILED:
+                finish(sess, result);
+                break;
+            }
+        }
+
+        void finish(session_ptr sess, error_code const & ec)
+        {
+            if(ec)
+            {
+                NETPP_LOG_DEBUG("http_proxy", "CONNECT failed: " << ec.message());
+                error_code ignored;
+                sess->socket().reset_connection(ignored);
+            }
+            sess->handler(ec);
+        }
+
+        // Evaluates the reply bytes received so far
+        reply_action process_reply(session & sess, error_code & ec)
+        {
+            for(;;)
+            {
+                if(sess.discard)
                 {
-                    setup_async_read(buf_ptr, parser_ptr, socket, connected);
+                    std::size_t const skipped = (std::min)(sess.discard, sess.filled);
+                    consume(sess, skipped);
+                    sess.discard -= skipped;
+                    if(sess.discard)
+                    {
+                        return READ_MORE;
+                    }
                 }
-                else if(state == true)
+
+                std::size_t const header_size = http::detail::find_header_end(sess.buffer.data(), sess.filled);
+                if(!header_size)
                 {
-                    // Parsing succeeded, but it doesn't mean everything is ok
-                    // it just means the protocol is valid as we know it
-                    // We've to check for the error code
-                    if(msg.status_code() == 200)
+                    if(sess.filled == sess.buffer.size())
                     {
-                        // We're now connected - Go ahead and send your request :-)
-                        // => calling callback
-                        std::cout << "Connection succeeded!" << std::endl;
-                        connected(error_code());
+                        ec = net::error::proxy_reply_too_large;
+                        return FAILED;
                     }
-                    else
+                    return READ_MORE;
+                }
+
+                message_type reply;
+                parser_t parser;
+                char const * begin = sess.buffer.data();
+                boost::tribool const parsed = parser.parse(begin, begin + header_size, reply);
+                if(!parsed || boost::logic::indeterminate(parsed) || reply.status_code() < 100)
+                {
+                    ec = net::error::proxy_protocol_error;
+                    return FAILED;
+                }
+
+                unsigned const status = reply.status_code();
+                if(status < 200)
+                {
+                    // Interim reply, the final one follows
+                    consume(sess, header_size);
+                    continue;
+                }
+
+                if(status < 300)
+                {
+                    // Whatever follows the header is already tunnel data
+                    if(sess.filled > header_size)
                     {
-                        std::cout << "Connection failed!" << std::endl;
-                        //TODO: handle failures
+                        sess.socket().set_pending(sess.buffer, header_size, sess.filled);
                     }
+                    ec = error_code();
+                    return TUNNEL_OPEN;
                 }
-                else if(state == false)
+
+                if(status == 407)
                 {
-                    std::cout << "Parsing failed!" << std::endl;
-                    //      Parsing failed
-                    //TODO: handle failures
+                    return authentication_required(sess, reply, header_size, ec);
                 }
+
+                ec = status_error(status);
+                return FAILED;
             }
-            else
+        }
+
+        reply_action authentication_required(session & sess, message_type const & reply, std::size_t header_size, error_code & ec)
+        {
+            if(sess.authenticated)
             {
-                std::cout << "Whatever failed! ec = " << ec << " Message: " << ec.message() << std::endl;
+                ec = net::error::proxy_authentication_failed;
+                return FAILED;
             }
+
+            remember_auth_required();
+            if(!build_request(sess, true) || !sess.authenticated)
+            {
+                ec = sess.authenticated ? error_code(net::error::proxy_request_too_large)
+                                        : error_code(net::error::proxy_authentication_required);
+                return FAILED;
+            }
+            ec = error_code();
+
+            unsigned long content_length = 0;
+            if(!persistent(reply, content_length))
+            {
+                return RECONNECT;
+            }
+
+            std::size_t const body_read = (std::min<std::size_t>)(sess.filled - header_size, content_length);
+            sess.discard = content_length - body_read;
+            sess.filled  = 0;
+            return SEND_REQUEST;
         }
 
-        virtual error_code on_connected(
-            proxy_socket<Tag> & socket,
-            endpoint_type const & endpoint,
-            error_code & ec
-        )
+        // Serializes the CONNECT request into the session's output buffer
+        bool build_request(session & sess, bool authenticate)
         {
-            if(!ec)
-            {
-                boost::asio::write(
-                    socket,
-                    boost::asio::buffer(
-                        build_request( endpoint )
-                    ),
-                    boost::asio::transfer_all(),
-                    ec
-                );
+            util::output_buffer & out = sess.request;
+            out.clear();
+            out << "CONNECT ";
+            write_authority(out, sess.target);
+            out << " HTTP/1.1\r\nHost: ";
+            write_authority(out, sess.target);
+            out << "\r\n";
 
-                buffer_t buffer;
-                parser_t parser;
-                message_type response;
-                while(!ec)
+            sess.authenticated = false;
+            if(authenticate)
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                if(!authorization_.empty())
                 {
-                    size_t read_bytes = boost::asio::read(
-                        socket,
-                        boost::asio::buffer(
-                            buffer
-                        ),
-                        boost::asio::transfer_at_least(1),
-                        ec
-                    );
+                    out << "Proxy-Authorization: " << authorization_ << "\r\n";
+                    sess.authenticated = true;
+                }
+            }
+            out << "Proxy-Connection: Keep-Alive\r\n\r\n";
+            return out.size() <= MAX_REQUEST_SIZE;
+        }
+
+        static void write_authority(util::output_buffer & out, target_type const & target)
+        {
+            if(target.has_host())
+            {
+                out << target.host;
+            }
+            else if(target.endpoint.address().is_v6())
+            {
+                out << '[' << target.endpoint.address() << ']';
+            }
+            else
+            {
+                out << target.endpoint.address();
+            }
+            out << ':' << target.port;
+        }
 
-                    std::cout << std::string(buffer.begin(), buffer.begin() + read_bytes);
-                    char * begin = buffer.begin();
-                    boost::tribool result = parser.parse( begin, begin + read_bytes, response );
+        // Drops count bytes from the front of the reply
+        static void consume(session & sess, std::size_t count)
+        {
+            std::memmove(sess.buffer.data(), sess.buffer.data() + count, sess.filled - count);
+            sess.filled -= count;
+        }
 
-                    if(result == boost::logic::indeterminate)
-                    {
-                        // Not finished parsing yet
-                        continue;
-                    }
-                    else
+        // true if the proxy keeps the connection open after the reply and
+        // its body is delimited by Content-Length
+        static bool persistent(message_type const & reply, unsigned long & content_length)
+        {
+            string_type value;
+            if(reply.version().first < 1 || (reply.version().first == 1 && reply.version().second < 1))
+            {
+                return false;
+            }
+            if(http::detail::find_header(reply, "Connection", value) && http::detail::contains_token(value, "close"))
+            {
+                return false;
+            }
+            if(http::detail::find_header(reply, "Proxy-Connection", value) && http::detail::contains_token(value, "close"))
+            {
+                return false;
+            }
+            if(http::detail::find_header(reply, "Transfer-Encoding", value))
+            {
+                return false;
+            }
+
+            content_length = 0;
+            if(http::detail::find_header(reply, "Content-Length", value))
+            {
+                if(value.empty() || value.size() > 9)
+                {
+                    return false;
+                }
+                for(typename string_type::const_iterator it = value.begin(); it != value.end(); ++it)
+                {
+                    if(*it < '0' || *it > '9')
                     {
-                        if(result == true)
-                        {
-                            if(response.status_code() == 200)
-                            {
-                                return (ec = error_code());
-                            }
-                            // TODO: Not 200 response => e.g. Proxy authorization required
-                        }
-                        // Parsing failure
-                        break;
+                        return false;
                     }
+                    content_length = content_length * 10 + (*it - '0');
                 }
             }
-            return ec;
+            return true;
+        }
+
+        static error_code status_error(unsigned status)
+        {
+            switch(status)
+            {
+            case 403:
+                return net::error::proxy_forbidden;
+            case 502:
+                return net::error::proxy_bad_gateway;
+            case 504:
+                return net::error::proxy_gateway_timeout;
+            default:
+                return net::error::proxy_connect_refused;
+            }
         }
+
+        static string_type encode_base64(string_type const & input)
+        {
+            static char const alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            string_type output;
+            output.reserve((input.size() + 2) / 3 * 4);
+            std::size_t i = 0;
+            for(; i + 2 < input.size(); i += 3)
+            {
+                unsigned long const triple = (static_cast<unsigned char>(input[i]) << 16)
+                                           | (static_cast<unsigned char>(input[i + 1]) << 8)
+                                           |  static_cast<unsigned char>(input[i + 2]);
+                output += alphabet[(triple >> 18) & 0x3F];
+                output += alphabet[(triple >> 12) & 0x3F];
+                output += alphabet[(triple >> 6) & 0x3F];
+                output += alphabet[triple & 0x3F];
+            }
+            if(i < input.size())
+            {
+                unsigned long triple = static_cast<unsigned char>(input[i]) << 16;
+                if(i + 1 < input.size())
+                {
+                    triple |= static_cast<unsigned char>(input[i + 1]) << 8;
+                }
+                output += alphabet[(triple >> 18) & 0x3F];
+                output += alphabet[(triple >> 12) & 0x3F];
+                output += i + 1 < input.size() ? alphabet[(triple >> 6) & 0x3F] : '=';
+                output += '=';
+            }
+            return output;
+        }
+
+        bool auth_required() const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            return auth_required_;
+        }
+
+        void remember_auth_required()
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            auth_required_ = true;
+        }
+
+    protected:
+        string_type authorization_;
+        bool auth_required_;
+        mutable boost::asio::detail::mutex mutex_;
     };
 }
 
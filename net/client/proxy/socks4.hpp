@@ -33,6 +33,10 @@
 #endif
 
 #include <net/client/proxy_socket.hpp>
+#include <net/client/utils/buffer.hpp>
+#include <net/error.hpp>
+#include <net/detail/log.hpp>
+#include <boost/asio/detail/mutex.hpp>
 #include <algorithm>
 
 namespace net
@@ -44,49 +48,39 @@ namespace net
         typedef implements_proxy<Tag>                    base_type;
         typedef typename base_type::service_type        service_type;
         typedef typename base_type::endpoint_type        endpoint_type;
+        typedef typename base_type::target_type          target_type;
         typedef typename base_type::connected_handler    connected_handler;
         typedef typename base_type::error_code           error_code;
+        typedef typename base_type::string_type          string_type;
 
-        union request_t
+        enum
         {
-            struct
-            {
-                boost::uint8_t    version;
-                boost::uint8_t    command;
-                boost::uint16_t    destination_port;
-                boost::array<boost::uint8_t, 4> destination_address;
-                boost::uint8_t    end_marker;
-            }
-            detail;
-            boost::array<boost::uint8_t, 9> bytes;
+            REPLY_SIZE          = 8,
+            MAX_HOST_LENGTH     = 255,
+            MAX_USER_ID_LENGTH  = 255,
+            // VN CD DSTPORT DSTIP USERID NUL HOST NUL
+            REQUEST_MAX_SIZE    = 8 + MAX_USER_ID_LENGTH + 1 + MAX_HOST_LENGTH + 1
         };
 
+        typedef boost::array<boost::uint8_t, REQUEST_MAX_SIZE> request_buffer;
+
         struct session
         {
             session(proxy_socket<Tag> & socket)
                 : data_buffer()
-                , request(reinterpret_cast<request_t*>(&data_buffer[0]))
+                , request_size(0)
                 , handler()
-                , endpoint()
+                , target()
                 , socket(boost::ref(socket))
             {
             }
 
-            boost::array<boost::uint8_t, 0x1000>            data_buffer;
-            request_t                                    *    request;
+            // Holds the request and afterwards the reply
+            request_buffer                                  data_buffer;
+            std::size_t                                     request_size;
             connected_handler                                handler;
-            endpoint_type                                    endpoint;
+            target_type                                      target;
             boost::reference_wrapper<proxy_socket<Tag> >    socket;
-
-            void dump_buffer(size_t size)
-            {
-                static char const hex_chars[17] = "0123456789ABCDEF";
-                for(size_t i = 0; i < std::min(size, data_buffer.size()); ++i)
-                {
-                    boost::uint8_t b = data_buffer[i];
-                    std::cout << " " << hex_chars[(b&0xF0)>>4] << hex_chars[b&0x0F];
-                }
-            }
         };
 
         typedef boost::shared_ptr<session> session_ptr;
@@ -94,42 +88,70 @@ namespace net
 
         socks4_proxy(service_type & service)
             : base_type(service)
+            , socks4a_(false)
+            , user_id_()
+            , mutex_()
         {}
 
+        // SOCKS4a: host names are sent to the proxy and resolved there.
+        // Off by default, plain SOCKS4 servers reject such requests.
+        void set_socks4a(bool enabled)
+        {
+            socks4a_ = enabled;
+        }
 
+        virtual bool resolves_remotely() const
+        {
+            return socks4a_;
+        }
+
+        // USERID field sent with every request
+        void set_user_id(string_type const & user_id)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            user_id_ = user_id;
+        }
+
+        string_type user_id() const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            return user_id_;
+        }
 
         virtual void on_async_connected(
             proxy_socket<Tag> &    socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
-            std::cout << "Connected to proxy..." << std::endl;
             boost::system::error_code ec;
-            session_ptr sess(new session(socket));
+            session_ptr sess(this->arena_.template create<session>(socket));
 
-            *(sess->request) = build_request(endpoint, ec);
+            sess->request_size = build_request(target, sess->data_buffer, ec);
             if(ec) // Something went wrong with build_request
             {
-                std::cout << "Something went wrong with build_request: " << ec << " Message: " << ec.message() << std::endl;
+                NETPP_LOG_WARNING("socks4", "can't build the request: " << ec.message());
+                error_code ignored;
+                socket.reset_connection(ignored);
                 connected(ec);
+                return;
             }
 
             sess->handler = connected;
-            sess->endpoint = endpoint;
+            sess->target = target;
 
-            std::cout << "Attempt to write: " << sess->request->bytes.size() << " bytes: ";
-            sess->dump_buffer(sess->request->bytes.size());
-            std::cout << std::endl;
+            NETPP_LOG_TRACE("socks4", "request" << net::log::hex(sess->data_buffer.data(), sess->request_size));
 
             boost::asio::async_write(
                 sess->socket.get(),
-                boost::asio::buffer(sess->request->bytes),
-                boost::bind(
-                    &socks4_proxy::on_async_request_sent,
-                    this,
-                    boost::asio::placeholders::error,
-                    sess
+                boost::asio::buffer(sess->data_buffer.data(), sess->request_size),
+                this->arena_.wrap(
+                    boost::bind(
+                        &socks4_proxy::on_async_request_sent,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess
+                    )
                 )
             );
         }
@@ -141,21 +163,25 @@ namespace net
         {
             if(!ec)
             {
+                // Exactly the reply, anything after it belongs to the tunnel
                 boost::asio::async_read(
                     sess->socket.get(),
-                    boost::asio::buffer(sess->data_buffer),
-                    boost::asio::transfer_at_least(8),
-                    boost::bind(
-                        &socks4_proxy::on_async_response_received,
-                        this,
-                        boost::asio::placeholders::error,
-                        boost::asio::placeholders::bytes_transferred,
-                        sess
+                    boost::asio::buffer(sess->data_buffer.data(), REPLY_SIZE),
+                    this->arena_.wrap(
+                        boost::bind(
+                            &socks4_proxy::on_async_response_received,
+                            this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::bytes_transferred,
+                            sess
+                        )
                     )
                 );
             }
             else
             {
+                error_code ignored;
+                sess->socket.get().reset_connection(ignored);
                 sess->handler(ec);
             }
         }
@@ -167,79 +193,116 @@ namespace net
             session_ptr sess
         )
         {
-            std::cout << ec << " Response received: (" << bytes_transferred << ") ";
-            sess->dump_buffer(bytes_transferred);
-            std::cout << std::endl;
+            NETPP_LOG_TRACE("socks4", "reply" << net::log::hex(sess->data_buffer.data(), bytes_transferred));
 
-            if(!ec)
+            error_code result = ec ? ec : check_reply(sess->data_buffer.data());
+            if(result)
             {
-                if(sess->data_buffer[1] == 0x5a)
-                {
-                    sess->handler(error_code());
-                }
-                else
-                {
-                    sess->handler(error_code(boost::asio::error::connection_refused));
-                }
-            }
-            else
-            {
-                sess->handler(ec);
+                NETPP_LOG_DEBUG("socks4", "request rejected: " << result.message());
+                error_code ignored;
+                sess->socket.get().reset_connection(ignored);
             }
+            sess->handler(result);
         }
 
         virtual error_code on_connected(
             proxy_socket<Tag> & socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             error_code & ec
         )
         {
-            std::cout << "Connected to proxy..." << std::endl;
-
-            request_t request = build_request(endpoint, ec);
+            request_buffer request;
+            std::size_t request_size = build_request(target, request, ec);
             if(!ec)
             {
-                std::cout << "Sending connection request to proxy..." << std::endl;
-                socket.send( boost::asio::buffer(request.bytes), 0,  ec);
+                boost::asio::write(socket, boost::asio::buffer(request.data(), request_size), boost::asio::transfer_all(), ec);
                 if(!ec)
                 {
-                    std::cout << "Reading response from  proxy..." << std::endl;
-                    boost::array<boost::uint8_t, 8> buffer;
-                    size_t bytes_read = socket.read_some(boost::asio::buffer(buffer), ec);
+                    boost::array<boost::uint8_t, REPLY_SIZE> buffer;
+                    boost::asio::read(socket, boost::asio::buffer(buffer), boost::asio::transfer_all(), ec);
                     if(!ec)
                     {
-                        if(bytes_read == 8)
-                        {
-                            if(buffer[1] == 0x5a)
-                            {
-                                std::cout << "Connection to remote endpoint granted and established" << std::endl;
-                                return (ec = error_code());
-                            }
-                        }
-                        std::cout << "Connection to remote endpoint denied or invalid response" << std::endl;
-                        return (ec = error_code(boost::asio::error::connection_refused));
+                        NETPP_LOG_TRACE("socks4", "reply" << net::log::hex(buffer.data(), buffer.size()));
+                        ec = check_reply(buffer.data());
                     }
                 }
             }
+            if(ec)
+            {
+                NETPP_LOG_DEBUG("socks4", "request failed: " << ec.message());
+                error_code ignored;
+                socket.reset_connection(ignored);
+            }
             return ec;
         }
 
-        virtual request_t build_request(endpoint_type ep, error_code & ec)
+        error_code check_reply(boost::uint8_t const * reply)
+        {
+            if(reply[0] != 0x00)
+            {
+                return error_code(boost::asio::error::connection_aborted);
+            }
+            switch(reply[1])
+            {
+            case 0x5a:
+                return error_code();
+            case 0x5b:
+                // Rejected or failed, mostly the target can't be reached
+                return error_code(net::error::proxy_bad_gateway);
+            case 0x5c:
+                // identd of the client not reachable
+            case 0x5d:
+                // identd does not confirm the user id
+                return error_code(net::error::proxy_authentication_failed);
+            default:
+                return error_code(net::error::proxy_protocol_error);
+            }
+        }
+
+        // Writes the CONNECT request into buffer and returns its size
+        virtual std::size_t build_request(target_type const & target, request_buffer & buffer, error_code & ec)
         {
-            request_t rc = request_t();
-            if(!ep.address().is_v4())
+            string_type const user_id = this->user_id();
+            if(user_id.size() > MAX_USER_ID_LENGTH || target.host.size() > MAX_HOST_LENGTH)
+            {
+                ec = error_code(boost::asio::error::invalid_argument);
+                return 0;
+            }
+
+            endpoint_type const & ep = target.endpoint;
+            if(target.has_host() ? !socks4a_ : !ep.address().is_v4())
             {
                 ec = error_code(boost::asio::error::address_family_not_supported);
-                return rc;
+                return 0;
+            }
+
+            util::unchecked_buffer_stream_adapter request(buffer);
+            request.write_fields(boost::make_tuple(boost::uint8_t(0x04), boost::uint8_t(0x01), target.port));
+            if(target.has_host())
+            {
+                // 0.0.0.x with x != 0 marks a SOCKS4a request
+                request.writeu32(0x00000001);
+            }
+            else
+            {
+                request.write(ep.address());
+            }
+            request
+                .write(user_id.begin(), user_id.end())
+                .writeu8(0x00);
+            if(target.has_host())
+            {
+                request
+                    .write(target.host.begin(), target.host.end())
+                    .writeu8(0x00);
             }
-            rc.detail.version = 4;
-            rc.detail.command = 1;
-            rc.detail.destination_port = ::htons(ep.port());
-            rc.detail.destination_address = ep.address().to_v4().to_bytes();
-            rc.detail.end_marker = 0;
-            return rc;
+            return request.position();
         }
 
+    protected:
+        bool                                socks4a_;
+        string_type                         user_id_;
+        mutable boost::asio::detail::mutex  mutex_;
     };
 }
 
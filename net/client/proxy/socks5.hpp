@@ -28,6 +28,10 @@
 
 #include <net/client/proxy_socket.hpp>
 #include <net/client/utils/buffer.hpp>
+#include <net/client/utils/output_buffer.hpp>
+#include <net/error.hpp>
+#include <net/detail/log.hpp>
+#include <boost/asio/detail/mutex.hpp>
 
 namespace net
 {
@@ -39,54 +43,171 @@ namespace net
         typedef typename base_type::error_code            error_code;
         typedef typename base_type::service_type        service_type;
         typedef typename base_type::endpoint_type        endpoint_type;
+        typedef typename base_type::target_type          target_type;
+        typedef typename base_type::string_type          string_type;
         typedef typename base_type::connected_handler    connected_handler;
 
+        enum
+        {
+            METHOD_NONE             = 0x00,
+            METHOD_PASSWORD         = 0x02,     // RFC 1929
+            METHOD_UNKNOWN          = 0xFE,     // Not negotiated yet
+            METHOD_REJECTED         = 0xFF,
+            GREETING_REPLY_SIZE     = 2,
+            LOGIN_REPLY_SIZE        = 2,
+            REPLY_MIN_SIZE          = 10,       // VER REP RSV ATYP + IPv4 + port
+            REPLY_MAX_SIZE          = 262,      // VER REP RSV ATYP + LEN + 255 + port
+            REQUEST_MAX_SIZE        = 262,
+            LOGIN_MAX_SIZE          = 513,      // VER ULEN UNAME PLEN PASSWD
+            MAX_HOST_LENGTH         = 255,
+            MAX_CREDENTIAL_LENGTH   = 255
+        };
+
+        struct credentials
+        {
+            string_type username;
+            string_type password;
+        };
+
+        typedef util::buffer_stream< util::unchecked_buffer_stream_base<boost::uint8_t *> > octet_stream;
+
         struct session
         {
             session(proxy_socket<Tag> & socket,
-                    endpoint_type const & ep,
+                    target_type const & tgt,
                     connected_handler const & connected = connected_handler())
                 : socket_ref(boost::ref(socket))
-                , endpoint(ep)
+                , target(tgt)
                 , handler(connected)
-                , auth_buffer()
-                , connection_buffer()
+                , method(METHOD_UNKNOWN)
+                , request()
+                , greeting_end(0)
+                , login_end(0)
                 , response_buffer()
-                , auth(boost::asio::buffer(auth_buffer))
-                , connection(boost::asio::buffer(connection_buffer))
+                , reply_offset(0)
+                , received(0)
             {
-                memset(auth_buffer.data(),0, auth_buffer.size());
-                memset(connection_buffer.data(), 0, connection_buffer.size());
                 memset(response_buffer.data(), 0, response_buffer.size());
-                build_requests();
             }
 
             boost::reference_wrapper< proxy_socket<Tag> > socket_ref;
-            endpoint_type endpoint;
+            target_type target;
             connected_handler handler;
+            // METHOD_UNKNOWN: offer every usable method and wait for the choice,
+            // otherwise only this method is offered and everything is pipelined
+            boost::uint8_t method;
+
+            // Greeting, login and CONNECT request back to back
+            util::output_buffer request;
+            std::size_t greeting_end;
+            std::size_t login_end;
+            // Method and login replies (pipelined mode only) followed by the CONNECT reply
+            boost::array< boost::uint8_t, GREETING_REPLY_SIZE + LOGIN_REPLY_SIZE + REPLY_MAX_SIZE> response_buffer;
+            std::size_t reply_offset;
+            std::size_t received;
+
+            bool pipelined() const
+            {
+                return method != METHOD_UNKNOWN;
+            }
 
-            boost::array<boost::uint8_t, 3>      auth_buffer;
-            boost::array<boost::uint8_t, 22>  connection_buffer;
-            boost::array< boost::uint8_t, 22> response_buffer;
-            boost::asio::mutable_buffer auth;
-            boost::asio::mutable_buffer connection;
-
-            void build_requests()
-            {
-                util::adapt_unchecked(auth_buffer)
-                    .writeu8(0x05)
-                    .writeu8(0x01)
-                    .writeu8(0x00);
-                auth = boost::asio::buffer(auth_buffer);
-
-                util::adapt_unchecked(connection_buffer)
-                    .writeu8(0x05)
-                    .writeu8(0x01)
-                    .writeu8(0x00)
-                    .writeu8(endpoint.address().is_v4() ? 0x01 : 0x04 )
-                    .write(endpoint.address())
-                    .writeu16(endpoint.port());
-                connection = boost::asio::buffer(connection_buffer.data(), endpoint.address().is_v4() ? 10 : 22);
+            util::output_buffer::const_buffers_type greeting() const
+            {
+                return request.data(0, greeting_end);
+            }
+
+            util::output_buffer::const_buffers_type login() const
+            {
+                return request.data(greeting_end, login_end);
+            }
+
+            util::output_buffer::const_buffers_type connection() const
+            {
+                return request.data(login_end, request.size());
+            }
+
+            bool has_login() const
+            {
+                return login_end != greeting_end;
+            }
+
+            void build_requests(boost::uint8_t use_method, credentials const & creds)
+            {
+                method = use_method;
+                request.clear();
+                // A pipelined request without authentication has no use for the login
+                bool const use_login = !creds.username.empty() && method != METHOD_NONE;
+
+                octet_stream greeting_stream = prepare(4);
+                greeting_stream.writeu8(0x05);
+                if(method == METHOD_UNKNOWN)
+                {
+                    greeting_stream
+                        .writeu8(use_login ? 0x02 : 0x01)
+                        .writeu8(METHOD_NONE);
+                    if(use_login)
+                    {
+                        greeting_stream.writeu8(METHOD_PASSWORD);
+                    }
+                }
+                else
+                {
+                    greeting_stream
+                        .writeu8(0x01)
+                        .writeu8(method);
+                }
+                request.commit(greeting_stream.position());
+                greeting_end = request.size();
+
+                if(use_login)
+                {
+                    octet_stream login_stream = prepare(LOGIN_MAX_SIZE);
+                    login_stream
+                        .writeu8(0x01)
+                        .writeu8(static_cast<boost::uint8_t>(creds.username.size()))
+                        .write(creds.username.begin(), creds.username.end())
+                        .writeu8(static_cast<boost::uint8_t>(creds.password.size()))
+                        .write(creds.password.begin(), creds.password.end());
+                    request.commit(login_stream.position());
+                }
+                login_end = request.size();
+
+                octet_stream connection_stream = prepare(REQUEST_MAX_SIZE);
+                connection_stream.write_fields(boost::make_tuple(boost::uint8_t(0x05), boost::uint8_t(0x01), boost::uint8_t(0x00)));
+                if(target.has_host())
+                {
+                    // ATYP domain name, resolved by the proxy
+                    connection_stream
+                        .writeu8(0x03)
+                        .writeu8(static_cast<boost::uint8_t>(target.host.size()))
+                        .write(target.host.begin(), target.host.end());
+                }
+                else
+                {
+                    connection_stream
+                        .writeu8(target.endpoint.address().is_v4() ? 0x01 : 0x04 )
+                        .write(target.endpoint.address());
+                }
+                connection_stream.writeu16(target.port);
+                request.commit(connection_stream.position());
+            }
+
+            // Greeting, login (if the password method is used) and CONNECT in one write
+            util::output_buffer::const_buffers_type pipelined_request() const
+            {
+                return request.data();
+            }
+
+            octet_stream prepare(std::size_t size)
+            {
+                boost::uint8_t * out = reinterpret_cast<boost::uint8_t *>(request.prepare(size));
+                return octet_stream(out, out + size);
+            }
+
+            // Offset of the CONNECT reply in a pipelined response
+            std::size_t pipelined_reply_offset() const
+            {
+                return GREETING_REPLY_SIZE + (method == METHOD_PASSWORD ? LOGIN_REPLY_SIZE : 0);
             }
         };
 
@@ -94,29 +215,170 @@ namespace net
 
         socks5_proxy(service_type & service)
             : base_type(service)
+            , pipelined_(false)
+            , credentials_()
+            , method_(METHOD_UNKNOWN)
+            , mutex_()
         {}
 
+        // Sends the method greeting and the CONNECT request in one write
+        // instead of waiting for the method reply first, which saves a round
+        // trip to the proxy. Without credentials this is used right away,
+        // otherwise once a connection negotiated the method; proxies which
+        // reject the method drop the CONNECT request.
+        void set_pipelined(bool enabled)
+        {
+            pipelined_ = enabled;
+        }
+
+        bool pipelined() const
+        {
+            return pipelined_;
+        }
+
+        // Offers username/password authentication (RFC 1929) in addition to
+        // no authentication. An empty username disables it again.
+        void set_credentials(string_type const & username, string_type const & password)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            credentials_.username = username;
+            credentials_.password = password;
+            method_ = METHOD_UNKNOWN;
+        }
+
+        // The method the proxy chose for the last successful handshake,
+        // METHOD_UNKNOWN before that
+        boost::uint8_t negotiated_method() const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            return method_;
+        }
+
+        virtual bool resolves_remotely() const
+        {
+            return true;
+        }
+
+        static bool valid_target(target_type const & target)
+        {
+            return target.host.size() <= MAX_HOST_LENGTH;
+        }
+
         virtual void on_async_connected(
             proxy_socket<Tag> &    socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             connected_handler connected
         )
         {
-            session_ptr sess(new session(socket, endpoint, connected));
+            if(!valid_target(target))
+            {
+                NETPP_LOG_WARNING("socks5", "host name too long: " << target.host.size());
+                error_code ignored;
+                socket.reset_connection(ignored);
+                connected(error_code(boost::asio::error::invalid_argument));
+                return;
+            }
+
+            session_ptr sess(this->arena_.template create<session>(socket, target, connected));
+            if(!prepare(*sess))
+            {
+                finish(sess, error_code(boost::asio::error::invalid_argument));
+                return;
+            }
+
+            if(sess->pipelined())
+            {
+                boost::asio::async_write
+                (
+                    sess->socket_ref.get(),
+                    sess->pipelined_request(),
+                    this->arena_.wrap(
+                        boost::bind
+                        (
+                            &socks5_proxy::on_async_pipelined_request_sent,
+                            this,
+                            boost::asio::placeholders::error,
+                            sess
+                        )
+                    )
+                );
+                return;
+            }
+
             boost::asio::async_write
             (
                 sess->socket_ref.get(),
-                boost::asio::buffer(sess->auth),
-                boost::bind
-                (
-                    &socks5_proxy::on_async_auth_request_sent,
-                    this,
-                    boost::asio::placeholders::error,
-                    sess
+                sess->greeting(),
+                this->arena_.wrap(
+                    boost::bind
+                    (
+                        &socks5_proxy::on_async_auth_request_sent,
+                        this,
+                        boost::asio::placeholders::error,
+                        sess
+                    )
                 )
             );
         }
 
+        void on_async_pipelined_request_sent(
+            error_code const & ec,
+            session_ptr sess
+        )
+        {
+            if(!ec)
+            {
+                // All replies at once; reading exactly the shortest possible
+                // size never consumes data beyond the CONNECT reply
+                boost::asio::async_read(
+                    sess->socket_ref.get(),
+                    boost::asio::buffer(sess->response_buffer.data(), sess->pipelined_reply_offset() + REPLY_MIN_SIZE),
+                    this->arena_.wrap(
+                        boost::bind
+                        (
+                            &socks5_proxy::on_async_pipelined_response,
+                            this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::bytes_transferred,
+                            sess
+                        )
+                    )
+                );
+            }
+            else
+            {
+                finish(sess, ec);
+            }
+        }
+
+        void on_async_pipelined_response(
+            error_code const & ec,
+            size_t bytes_read,
+            session_ptr sess
+        )
+        {
+            // A proxy refusing the method closes the connection after its
+            // 2 byte reply, so check the greeting before the read result
+            boost::uint8_t const * response = sess->response_buffer.data();
+            if(bytes_read >= GREETING_REPLY_SIZE
+            && !(response[0] == 0x05 && response[1] == sess->method))
+            {
+                forget_method(sess->method);
+                finish(sess, error_code(boost::asio::error::access_denied));
+                return;
+            }
+            if(sess->method == METHOD_PASSWORD
+            && bytes_read >= GREETING_REPLY_SIZE + LOGIN_REPLY_SIZE
+            && !login_accepted(response + GREETING_REPLY_SIZE))
+            {
+                forget_method(sess->method);
+                finish(sess, error_code(boost::asio::error::access_denied));
+                return;
+            }
+            sess->reply_offset = sess->pipelined_reply_offset();
+            on_async_reply_read(ec, bytes_read, sess);
+        }
+
         void on_async_auth_request_sent(
             error_code const & ec,
             session_ptr sess
@@ -126,20 +388,22 @@ namespace net
             {
                 boost::asio::async_read(
                     sess->socket_ref.get(),
-                    boost::asio::buffer(sess->auth_buffer.data(), 2),
-                    boost::bind
-                    (
-                        &socks5_proxy<Tag>::on_async_auth_response_received,
-                        this,
-                        boost::asio::placeholders::error,
-                        boost::asio::placeholders::bytes_transferred,
-                        sess
+                    boost::asio::buffer(sess->response_buffer.data(), GREETING_REPLY_SIZE),
+                    this->arena_.wrap(
+                        boost::bind
+                        (
+                            &socks5_proxy<Tag>::on_async_auth_response_received,
+                            this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::bytes_transferred,
+                            sess
+                        )
                     )
                 );
             }
             else
             {
-                sess->handler(ec);
+                finish(sess, ec);
             }
         }
 
@@ -149,87 +413,160 @@ namespace net
             session_ptr sess
         )
         {
-            if(!ec)
+            if(ec)
             {
-                if(sess->auth_buffer[0] == 0x05 && sess->auth_buffer[1] == 0x00)
-                {
-                    boost::asio::async_write
-                    (
-                        sess->socket_ref.get(),
-                        boost::asio::buffer(sess->connection),
+                finish(sess, ec);
+                return;
+            }
+
+            boost::uint8_t const version = sess->response_buffer[0];
+            boost::uint8_t const method  = sess->response_buffer[1];
+            if(version == 0x05 && method == METHOD_NONE)
+            {
+                remember_method(method);
+                send_connection_request(sess);
+            }
+            else if(version == 0x05 && method == METHOD_PASSWORD && sess->has_login())
+            {
+                boost::asio::async_write
+                (
+                    sess->socket_ref.get(),
+                    sess->login(),
+                    this->arena_.wrap(
                         boost::bind
                         (
-                            &socks5_proxy::on_async_connection_request_sent,
+                            &socks5_proxy::on_async_login_sent,
                             this,
                             boost::asio::placeholders::error,
                             sess
                         )
-                    );
-                }
-                else
-                {
-                    sess->handler(error_code(boost::asio::error::access_denied));
-                }
+                    )
+                );
             }
             else
             {
-                sess->handler(ec);
+                finish(sess, error_code(boost::asio::error::access_denied));
             }
         }
 
-        void on_async_connection_request_sent(
+        void on_async_login_sent(
             error_code const & ec,
             session_ptr sess
         )
         {
             if(!ec)
             {
-                boost::asio::async_read
-                (
+                boost::asio::async_read(
                     sess->socket_ref.get(),
-                    boost::asio::buffer(sess->connection),
-                    boost::asio::transfer_at_least(10),
+                    boost::asio::buffer(sess->response_buffer.data(), LOGIN_REPLY_SIZE),
+                    this->arena_.wrap(
+                        boost::bind
+                        (
+                            &socks5_proxy::on_async_login_response,
+                            this,
+                            boost::asio::placeholders::error,
+                            sess
+                        )
+                    )
+                );
+            }
+            else
+            {
+                finish(sess, ec);
+            }
+        }
+
+        void on_async_login_response(
+            error_code const & ec,
+            session_ptr sess
+        )
+        {
+            if(ec)
+            {
+                finish(sess, ec);
+            }
+            else if(login_accepted(sess->response_buffer.data()))
+            {
+                remember_method(METHOD_PASSWORD);
+                send_connection_request(sess);
+            }
+            else
+            {
+                finish(sess, error_code(boost::asio::error::access_denied));
+            }
+        }
+
+        void send_connection_request(session_ptr sess)
+        {
+            boost::asio::async_write
+            (
+                sess->socket_ref.get(),
+                sess->connection(),
+                this->arena_.wrap(
                     boost::bind
                     (
-                        &socks5_proxy::on_async_response,
+                        &socks5_proxy::on_async_connection_request_sent,
                         this,
                         boost::asio::placeholders::error,
-                        boost::asio::placeholders::bytes_transferred,
                         sess
                     )
+                )
+            );
+        }
+
+        void on_async_connection_request_sent(
+            error_code const & ec,
+            session_ptr sess
+        )
+        {
+            if(!ec)
+            {
+                boost::asio::async_read
+                (
+                    sess->socket_ref.get(),
+                    boost::asio::buffer(sess->response_buffer.data(), REPLY_MIN_SIZE),
+                    this->arena_.wrap(
+                        boost::bind
+                        (
+                            &socks5_proxy::on_async_reply_read,
+                            this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::bytes_transferred,
+                            sess
+                        )
+                    )
                 );
             }
             else
             {
-                sess->handler(ec);
+                finish(sess, ec);
             }
         }
 
+        // Failures to reach the target map to the proxy errors a failover
+        // proxy does not hold against the proxy
         error_code translate_socks5_reply(boost::uint8_t reply)
         {
             switch(reply)
             {
             case 0:
-                std::cout << "Connection via proxy established\n\n";
                 return error_code(); // Success
             case 1:
                 // SOCKS failure
-                return error_code(boost::asio::error::fault);
+                return error_code(net::error::proxy_connect_refused);
             case 2:
                 // connection not allowed by rule set
-                return error_code(boost::asio::error::access_denied);
+                return error_code(net::error::proxy_forbidden);
             case 3:
                 // Network unreachable
-                return error_code(boost::asio::error::network_unreachable);
             case 4:
                 // Host unreachable
-                return error_code(boost::asio::error::host_unreachable);
             case 5:
                 // Connection refused
-                return error_code(boost::asio::error::connection_refused);
+                return error_code(net::error::proxy_bad_gateway);
             case 6:
                 // TTL expired
-                return error_code(boost::asio::error::timed_out);
+                return error_code(net::error::proxy_gateway_timeout);
             case 7:
                 // Command not supported
                 return error_code(boost::asio::error::operation_not_supported);
@@ -242,125 +579,280 @@ namespace net
             return error_code(boost::asio::error::service_not_found);
         }
 
-        void on_async_response(
+        // Total size of the CONNECT reply, known once the address type
+        // (and for domain names the length octet) has been received
+        static std::size_t reply_size(boost::uint8_t const * reply, std::size_t available)
+        {
+            if(available < 5)
+            {
+                return REPLY_MIN_SIZE;
+            }
+
+            switch(reply[3])
+            {
+            case 0x03:
+                return 4 + 1 + reply[4] + 2;
+            case 0x04:
+                return 4 + 16 + 2;
+            default:
+                return REPLY_MIN_SIZE;
+            }
+        }
+
+        void on_async_reply_read(
             error_code const & ec,
             size_t bytes_read,
             session_ptr sess
         )
         {
-            error_code res = ec;
-            if(!res)
+            sess->received += bytes_read;
+            if(ec)
+            {
+                finish(sess, ec);
+                return;
+            }
+
+            boost::uint8_t const * reply = sess->response_buffer.data() + sess->reply_offset;
+            std::size_t const available = sess->received - sess->reply_offset;
+            std::size_t const required  = reply_size(reply, available);
+            if(available < required)
             {
-                res = check_response(*sess, bytes_read);
+                boost::asio::async_read
+                (
+                    sess->socket_ref.get(),
+                    boost::asio::buffer(sess->response_buffer.data() + sess->received, required - available),
+                    this->arena_.wrap(
+                        boost::bind
+                        (
+                            &socks5_proxy::on_async_reply_read,
+                            this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::bytes_transferred,
+                            sess
+                        )
+                    )
+                );
+                return;
             }
+            finish(sess, check_reply(reply, available));
+        }
 
-            if(res)
+        void finish(session_ptr sess, error_code const & ec)
+        {
+            if(ec)
             {
-                sess->socket_ref.get().close();
+                NETPP_LOG_DEBUG("socks5", "handshake failed: " << ec.message());
+                error_code ignored;
+                sess->socket_ref.get().reset_connection(ignored);
             }
-            sess->handler(res);
+            sess->handler(ec);
         }
 
-        error_code check_response(session & sess, size_t bytes_read)
+        error_code check_reply(boost::uint8_t const * reply, size_t size)
         {
-            error_code ec;
-            if(bytes_read > 1)
+            if(size < REPLY_MIN_SIZE || reply[0] != 0x05 || reply_size(reply, size) != size)
             {
-                return translate_socks5_reply(sess.response_buffer[3]);
+                // Most likely because of invalid protocol
+                return error_code(boost::asio::error::connection_aborted);
             }
-            else
+            if(reply[3] != 0x01 && reply[3] != 0x03 && reply[3] != 0x04)
             {
-                return error_code(boost::asio::error::connection_reset);
+                return error_code(boost::asio::error::connection_aborted);
             }
-            return ec;
+            return translate_socks5_reply(reply[1]);
+        }
+
+
+        static bool login_accepted(boost::uint8_t const * reply)
+        {
+            return reply[0] == 0x01 && reply[1] == 0x00;
         }
 
         virtual error_code on_connected(
             proxy_socket<Tag> & socket,
-            endpoint_type const & endpoint,
+            target_type const & target,
             error_code & ec
         )
         {
-            if(!ec)
+            if(!ec && !valid_target(target))
             {
-                session sess(socket, endpoint);
+                ec = error_code(boost::asio::error::invalid_argument);
+            }
 
-                boost::asio::write
-                (
-                    socket,
-                    boost::asio::buffer(sess.auth),
-                    boost::asio::transfer_all(),
-                    ec
-                );
+            session sess(socket, target);
+            if(!ec && !prepare(sess))
+            {
+                ec = error_code(boost::asio::error::invalid_argument);
+            }
+
+            if(!ec)
+            {
+                if(sess.pipelined())
+                {
+                    boost::asio::write
+                    (
+                        socket,
+                        sess.pipelined_request(),
+                        boost::asio::transfer_all(),
+                        ec
+                    );
+                }
+                else
+                {
+                    boost::asio::write
+                    (
+                        socket,
+                        sess.greeting(),
+                        boost::asio::transfer_all(),
+                        ec
+                    );
+                }
+            }
 
-                size_t read = boost::asio::read
+            boost::uint8_t * response = sess.response_buffer.data();
+            if(!ec)
+            {
+                boost::asio::read
                 (
                     socket,
-                    boost::asio::buffer
-                    (
-                        sess.auth_buffer.data(),
-                        2
-                    ),
+                    boost::asio::buffer(response, GREETING_REPLY_SIZE),
                     boost::asio::transfer_all(),
                     ec
                 );
+            }
 
-                if(read == 2)
-                {
-                    boost::uint8_t version = 0;
-                    boost::uint8_t method  = 0;
+            if(!ec)
+            {
+                boost::uint8_t version = 0;
+                boost::uint8_t method  = 0;
 
-                    util::adapt_unchecked(sess.auth_buffer)
-                        .readu8(version)
-                        .readu8(method);
+                util::adapt_unchecked(sess.response_buffer).read_fields(boost::tie(version, method));
 
-                    if(version == 5 && method == 0)
+                bool const acceptable = version == 0x05
+                    && (sess.pipelined() ? method == sess.method
+                                         : method == METHOD_NONE || (method == METHOD_PASSWORD && sess.has_login()));
+                if(!acceptable)
+                {
+                    forget_method(sess.method);
+                    ec = error_code(boost::asio::error::access_denied);
+                }
+                else if(method == METHOD_PASSWORD)
+                {
+                    if(!sess.pipelined())
+                    {
+                        boost::asio::write(socket, sess.login(), boost::asio::transfer_all(), ec);
+                    }
+                    if(!ec)
+                    {
+                        boost::asio::read(socket, boost::asio::buffer(response, LOGIN_REPLY_SIZE), boost::asio::transfer_all(), ec);
+                    }
+                    if(!ec && !login_accepted(response))
                     {
+                        forget_method(sess.method);
+                        ec = error_code(boost::asio::error::access_denied);
+                    }
+                }
 
+                if(!ec)
+                {
+                    remember_method(method);
+                    if(!sess.pipelined())
+                    {
                         boost::asio::write
                         (
                             socket,
-                            boost::asio::buffer(sess.connection),
+                            sess.connection(),
                             boost::asio::transfer_all(),
                             ec
                         );
-
-                        size_t cnt = boost::asio::read
-                        (
-                            socket,
-                            boost::asio::buffer(sess.response_buffer),
-                            boost::asio::transfer_at_least(1),
-                            ec
-                        );
-
-                        // Check:
-                        // - We have version 5
-                        // - the read size = 10 if addr type = 0x01 (ipv4)
-                        // - the read size = 22 if addr type = 0x04 (ipv6)
-                        if( sess.response_buffer[0] == 5
-                        &&  ( (cnt == 10 &&    sess.response_buffer[3] == 0x01)
-                            ||(cnt == 22 &&    sess.response_buffer[3] == 0x04)
-                        ))
-                        {
-                            // Translate the repsonse
-                            return translate_socks5_reply(sess.response_buffer[1]);
-                        }
-
-                        // Most likely because of invalid protocol
-                        ec = error_code(boost::asio::error::connection_aborted);
                     }
                 }
             }
 
             if(!ec)
             {
-                socket.close();
+                size_t cnt = 0;
+                size_t required = REPLY_MIN_SIZE;
+                while(!ec && cnt < required)
+                {
+                    cnt += boost::asio::read
+                    (
+                        socket,
+                        boost::asio::buffer(response + cnt, required - cnt),
+                        boost::asio::transfer_all(),
+                        ec
+                    );
+                    required = reply_size(response, cnt);
+                }
+
+                if(!ec)
+                {
+                    ec = check_reply(response, cnt);
+                }
+            }
+
+            if(ec)
+            {
+                error_code ignored;
+                socket.reset_connection(ignored);
             }
             return ec;
         }
+
+    protected:
+        // Builds the requests of a new session from the cached method and
+        // credentials; false if the credentials can't be encoded
+        bool prepare(session & sess)
+        {
+            credentials creds;
+            boost::uint8_t method = METHOD_UNKNOWN;
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                creds  = credentials_;
+                method = method_;
+            }
+
+            if(creds.username.size() > MAX_CREDENTIAL_LENGTH || creds.password.size() > MAX_CREDENTIAL_LENGTH)
+            {
+                return false;
+            }
+
+            if(!pipelined_)
+            {
+                // A known method would pipeline the handshake
+                method = METHOD_UNKNOWN;
+            }
+            else if(method == METHOD_UNKNOWN && creds.username.empty())
+            {
+                // Nothing to negotiate, optimistically pipeline right away
+                method = METHOD_NONE;
+            }
+            sess.build_requests(method, creds);
+            return true;
+        }
+
+        void remember_method(boost::uint8_t method)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            method_ = method;
+        }
+
+        // A pipelined handshake failed, negotiate again next time
+        void forget_method(boost::uint8_t method)
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            if(method_ == method)
+            {
+                method_ = METHOD_UNKNOWN;
+            }
+        }
+
+    protected:
+        bool pipelined_;
+        credentials credentials_;
+        boost::uint8_t method_;
+        mutable boost::asio::detail::mutex mutex_;
     };
 }
 
 #endif //GUARD_NET_CLIENT_PROXY_SOCKS5_HPP_INCLUDED
-
-
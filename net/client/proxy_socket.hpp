@@ -27,7 +27,12 @@
 #define GUARD_NET_CLIENT_PROXY_SOCKET_HPP_INCLUDED
 
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/detail/bind_handler.hpp>
 #include <net/client/proxy/base.hpp>
+#include <net/client/io_uring_engine.hpp>
+#include <net/client/utils/buffer_pool.hpp>
+#include <algorithm>
+#include <cstring>
 
 namespace net
 {
@@ -40,13 +45,178 @@ namespace net
         typedef boost::asio::io_service                    service_type;
         typedef boost::asio::ip::tcp::endpoint            endpoint_type;
         typedef boost::system::error_code                error_code;
+        typedef boost::asio::socket_base                socket_base;
         typedef typename proxy_base<Tag>::self_ptr        proxy_base_ptr;
+        typedef typename proxy_base<Tag>::target_type     target_type;
+        typedef typename target_type::string_type         string_type;
+#ifdef NETPP_HAS_IO_URING
+        typedef typename io_uring_engine<Tag>::self_ptr     io_engine_ptr;
+#endif
 
         explicit proxy_socket(service_type & service)
             : base_type(service)
             , proxy_ptr_(new proxy_base<Tag>(service))
+#ifdef NETPP_HAS_IO_URING
+            , engine_()
+#endif
+            , pending_()
+            , pending_begin_(0)
+            , pending_end_(0)
         {}
 
+        // A registered file keeps the connection open in the kernel
+        ~proxy_socket()
+        {
+            release_engine();
+        }
+
+#ifdef NETPP_HAS_IO_URING
+        // Routes async_read_some/async_write_some through engine instead of
+        // the io_service reactor, an empty pointer switches back.
+        // Connecting, cancelling and closing still use the reactor socket.
+        void set_io_engine(io_engine_ptr engine)
+        {
+            release_engine();
+            engine_ = engine;
+        }
+
+        template <typename ConstBufferSequence, typename WriteHandler>
+        void async_write_some(ConstBufferSequence const & buffers, WriteHandler handler)
+        {
+            if(engine_ && this->is_open())
+            {
+                engine_->register_file(this->native());
+                engine_->async_write_some(this->native(), buffers, handler);
+            }
+            else
+            {
+                base_type::async_write_some(buffers, handler);
+            }
+        }
+#endif
+
+        template <typename MutableBufferSequence, typename ReadHandler>
+        void async_read_some(MutableBufferSequence const & buffers, ReadHandler handler)
+        {
+            if(pending())
+            {
+                std::size_t bytes = take_pending(buffers);
+                this->get_io_service().post(boost::asio::detail::bind_handler(handler, error_code(), bytes));
+                return;
+            }
+#ifdef NETPP_HAS_IO_URING
+            if(engine_ && this->is_open())
+            {
+                engine_->register_file(this->native());
+                engine_->async_read_some(this->native(), buffers, handler);
+                return;
+            }
+#endif
+            base_type::async_read_some(buffers, handler);
+        }
+
+        template <typename MutableBufferSequence>
+        std::size_t read_some(MutableBufferSequence const & buffers, error_code & ec)
+        {
+            if(pending())
+            {
+                ec = error_code();
+                return take_pending(buffers);
+            }
+            return base_type::read_some(buffers, ec);
+        }
+
+#ifndef BOOST_NO_EXCEPTIONS
+        template <typename MutableBufferSequence>
+        std::size_t read_some(MutableBufferSequence const & buffers)
+        {
+            if(pending())
+            {
+                return take_pending(buffers);
+            }
+            return base_type::read_some(buffers);
+        }
+#endif //#ifndef BOOST_NO_EXCEPTIONS
+
+        // Receives without flags are reads, see async_read_some. Flags need
+        // the reactor socket, bytes left from the proxy handshake are still
+        // returned first.
+        template <typename MutableBufferSequence, typename ReadHandler>
+        void async_receive(MutableBufferSequence const & buffers, ReadHandler handler)
+        {
+            async_read_some(buffers, handler);
+        }
+
+        template <typename MutableBufferSequence, typename ReadHandler>
+        void async_receive(MutableBufferSequence const & buffers, socket_base::message_flags flags, ReadHandler handler)
+        {
+            if(pending())
+            {
+                std::size_t bytes = take_pending(buffers, (flags & socket_base::message_peek) != 0);
+                this->get_io_service().post(boost::asio::detail::bind_handler(handler, error_code(), bytes));
+            }
+            else if(!flags)
+            {
+                async_read_some(buffers, handler);
+            }
+            else
+            {
+                base_type::async_receive(buffers, flags, handler);
+            }
+        }
+
+        template <typename MutableBufferSequence>
+        std::size_t receive(MutableBufferSequence const & buffers, socket_base::message_flags flags, error_code & ec)
+        {
+            if(pending())
+            {
+                ec = error_code();
+                return take_pending(buffers, (flags & socket_base::message_peek) != 0);
+            }
+            return base_type::receive(buffers, flags, ec);
+        }
+
+#ifndef BOOST_NO_EXCEPTIONS
+        template <typename MutableBufferSequence>
+        std::size_t receive(MutableBufferSequence const & buffers)
+        {
+            return read_some(buffers);
+        }
+
+        template <typename MutableBufferSequence>
+        std::size_t receive(MutableBufferSequence const & buffers, socket_base::message_flags flags)
+        {
+            error_code ec;
+            std::size_t bytes = receive(buffers, flags, ec);
+            boost::asio::detail::throw_error(ec);
+            return bytes;
+        }
+#endif //#ifndef BOOST_NO_EXCEPTIONS
+
+        // Tunnel data the proxy handshake received together with the proxy's
+        // reply, [begin, end) of buffer. Reads return it before anything else.
+        void set_pending(util::buffer_lease const & buffer, std::size_t begin, std::size_t end)
+        {
+            pending_       = buffer;
+            pending_begin_ = begin;
+            pending_end_   = end;
+        }
+
+        std::size_t pending() const
+        {
+            return pending_end_ - pending_begin_;
+        }
+
+        // true if reads are completed by an io engine instead of the reactor
+        bool uses_io_engine() const
+        {
+#ifdef NETPP_HAS_IO_URING
+            return engine_.get() != 0;
+#else
+            return false;
+#endif
+        }
+
         void set_proxy(proxy_base_ptr proxy)
         {
             if(proxy)
@@ -59,37 +229,82 @@ namespace net
             }
         }
 
-        boost::system::error_code connect(endpoint_type const & peer_endpoint, boost::system::error_code & ec)
+        proxy_base_ptr proxy() const
+        {
+            return proxy_ptr_;
+        }
+
+        // true if connect/async_connect accept a host name, which is then
+        // resolved by the proxy instead of locally
+        bool resolves_remotely() const
+        {
+            return proxy_ptr_->resolves_remotely();
+        }
+
+        boost::system::error_code connect(target_type const & target, boost::system::error_code & ec)
         {
+            clear_pending();
             if(!ec)
             {
-                proxy_ptr_->connect(*this, peer_endpoint, ec);
+                proxy_ptr_->connect(*this, target, ec);
             }
             return ec;
         }
 
+        boost::system::error_code connect(string_type const & host, unsigned short port, boost::system::error_code & ec)
+        {
+            return connect(target_type(host, port), ec);
+        }
+
 #ifndef BOOST_NO_EXCEPTIONS
-        void connect(endpoint_type const & peer_endpoint)
+        void connect(target_type const & target)
         {
             error_code ec;
-            connect(peer_endpoint, ec);
+            connect(target, ec);
             boost::asio::detail::throw_error(ec);
         }
+
+        void connect(string_type const & host, unsigned short port)
+        {
+            connect(target_type(host, port));
+        }
 #endif //#ifndef BOOST_NO_EXCEPTIONS
 
         template <class Handler>
-        void async_connect(endpoint_type const & endpoint, Handler const & handler)
+        void async_connect(target_type const & target, Handler const & handler)
         {
+            clear_pending();
             proxy_ptr_->async_connect(
                 *this,
-                endpoint,
+                target,
                 handler
             );
         }
 
+        template <class Handler>
+        void async_connect(string_type const & host, unsigned short port, Handler const & handler)
+        {
+            async_connect(target_type(host, port), handler);
+        }
+
+        // Connects to the proxy only, see proxy_base::async_connect_proxy
+        template <class Handler>
+        void async_connect_proxy(Handler const & handler)
+        {
+            clear_pending();
+            proxy_ptr_->async_connect_proxy(*this, handler);
+        }
+
+        template <class Handler>
+        void async_open_tunnel(target_type const & target, Handler const & handler)
+        {
+            proxy_ptr_->async_open_tunnel(*this, target, handler);
+        }
+
         void cancel(error_code & ec)
         {
             proxy_ptr_->cancel();
+            cancel_engine();
             base_type::cancel(ec);
         }
 
@@ -97,6 +312,7 @@ namespace net
         void cancel()
         {
             proxy_ptr_->cancel();
+            cancel_engine();
             base_type::cancel();
         }
 #endif //#ifndef BOOST_NO_EXCEPTIONS
@@ -104,13 +320,33 @@ namespace net
         void close(error_code & ec)
         {
             proxy_ptr_->cancel();
-            base_type::cancel(ec);
+            reset_connection(ec);
         }
 
 #ifndef BOOST_NO_EXCEPTIONS
         void close()
         {
             proxy_ptr_->cancel();
+            reset_connection();
+        }
+#endif //#ifndef BOOST_NO_EXCEPTIONS
+
+        // Closes the TCP connection, drops pending bytes and the io engine
+        // binding, but unlike close leaves the proxy's resolver alone. For
+        // the proxies, which start over on the socket or give up on it
+        // while other connections may be resolving through them.
+        error_code reset_connection(error_code & ec)
+        {
+            release_engine();
+            clear_pending();
+            return base_type::close(ec);
+        }
+
+#ifndef BOOST_NO_EXCEPTIONS
+        void reset_connection()
+        {
+            release_engine();
+            clear_pending();
             base_type::close();
         }
 #endif //#ifndef BOOST_NO_EXCEPTIONS
@@ -124,8 +360,74 @@ namespace net
         {
             return *static_cast<next_layer_type const*>(this);
         }
+    protected:
+        // Copies pending bytes into buffers, peek leaves them pending
+        template <typename MutableBufferSequence>
+        std::size_t take_pending(MutableBufferSequence const & buffers, bool peek = false)
+        {
+            std::size_t copied = 0;
+            typename MutableBufferSequence::const_iterator it = buffers.begin();
+            typename MutableBufferSequence::const_iterator end = buffers.end();
+            for(; it != end && copied < pending(); ++it)
+            {
+                boost::asio::mutable_buffer buffer(*it);
+                std::size_t const count = (std::min)(boost::asio::buffer_size(buffer), pending() - copied);
+                std::memcpy(boost::asio::buffer_cast<char*>(buffer), pending_.data() + pending_begin_ + copied, count);
+                copied += count;
+            }
+            if(!peek)
+            {
+                pending_begin_ += copied;
+                if(!pending())
+                {
+                    clear_pending();
+                }
+            }
+            return copied;
+        }
+
+        std::size_t take_pending(boost::asio::mutable_buffer const & buffer, bool peek = false)
+        {
+            return take_pending(boost::asio::mutable_buffers_1(buffer), peek);
+        }
+
+        void clear_pending()
+        {
+            pending_.reset();
+            pending_begin_ = pending_end_ = 0;
+        }
+
+        void cancel_engine()
+        {
+#ifdef NETPP_HAS_IO_URING
+            if(engine_ && this->is_open())
+            {
+                engine_->cancel(this->native());
+            }
+#endif
+        }
+
+        // The engine holds a reference to registered files, which has to be
+        // dropped before the descriptor number can be reused
+        void release_engine()
+        {
+#ifdef NETPP_HAS_IO_URING
+            if(engine_ && this->is_open())
+            {
+                engine_->cancel(this->native());
+                engine_->unregister_file(this->native());
+            }
+#endif
+        }
+
     protected:
         proxy_base_ptr proxy_ptr_;
+#ifdef NETPP_HAS_IO_URING
+        io_engine_ptr engine_;
+#endif
+        util::buffer_lease pending_;
+        std::size_t pending_begin_;
+        std::size_t pending_end_;
     };
 }
 
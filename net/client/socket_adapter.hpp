@@ -2,6 +2,8 @@
 #define GUARD_NET_CLIENT_SOCKET_ADAPTER_HPP_INCLUDED
 
 #include <net/client/connection.hpp>
+#include <net/client/file_transfer.hpp>
+#include <net/client/utils/buffer_pool.hpp>
 
 namespace net
 {
@@ -11,6 +13,7 @@ namespace net
         typedef boost::shared_ptr< connection_base<Tag> >   connection_ptr;
         typedef boost::asio::socket_base                    socket_base;
         typedef typename connection_base<Tag>::service_type service_type;
+        typedef typename connection_base<Tag>::string_type  string_type;
 
         typedef connection<Tag>                             connection_type;
         typedef ssl_connection<Tag>                         ssl_connection_type;
@@ -18,6 +21,10 @@ namespace net
         typedef typename ssl_connection_type::socket_type   ssl_socket_type;
         typedef typename connection_type::socket_type       socket_type;
 
+        typedef boost::system::error_code                   error_code;
+        typedef boost::function< void(error_code const &, std::size_t) >                      read_handler;
+        typedef boost::function< void(error_code const &, util::buffer_lease, std::size_t) > leased_read_handler;
+
         socket_adapter(connection_ptr connection, bool ssl)
         : connection_(connection)
         , ssl_(ssl)
@@ -48,129 +55,252 @@ namespace net
         template <typename ConstBufferSequence>
         std::size_t send(const ConstBufferSequence& buffers)
         {
-            return ssl_ ? ssl_socket().send(buffers)
-                        : socket().send(buffers);
+            return secure() ? ssl_socket().send(buffers)
+                            : socket().send(buffers);
         }
 
         template <typename ConstBufferSequence>
         std::size_t send(const ConstBufferSequence& buffers, socket_base::message_flags flags)
         {
-            return ssl_ ? ssl_socket().send(buffers, flags)
-                        : socket().send(buffers, flags);
+            return secure() ? ssl_socket().send(buffers, flags)
+                            : socket().send(buffers, flags);
         }
 
         template <typename ConstBufferSequence>
         std::size_t send(const ConstBufferSequence& buffers, socket_base::message_flags flags, boost::system::error_code& ec)
         {
-            return ssl_ ? ssl_socket().send(buffers, flags, ec)
-                        : socket().send(buffers, flags, ec);
+            return secure() ? ssl_socket().send(buffers, flags, ec)
+                            : socket().send(buffers, flags, ec);
         }
 
         template <typename ConstBufferSequence, typename WriteHandler>
         void async_send(const ConstBufferSequence& buffers, WriteHandler handler)
         {
-            ssl_ ? ssl_socket().async_send(buffers, handler)
-                 : socket().async_send(buffers, handler);
+            secure() ? ssl_socket().async_send(buffers, handler)
+                     : socket().async_send(buffers, handler);
         }
 
         template <typename ConstBufferSequence, typename WriteHandler>
         void async_send(const ConstBufferSequence& buffers, socket_base::message_flags flags, WriteHandler handler)
         {
-            ssl_ ? ssl_socket().async_send(buffers, flags, handler)
-                 : socket().async_send(buffers, flags, handler);
+            secure() ? ssl_socket().async_send(buffers, flags, handler)
+                     : socket().async_send(buffers, flags, handler);
         }
 
         template <typename MutableBufferSequence>
         std::size_t receive(const MutableBufferSequence& buffers)
         {
-            return ssl_ ? ssl_socket().receive(buffers)
-                        : socket().receive(buffers);
+            return read_some(buffers);
         }
 
         template <typename MutableBufferSequence>
         std::size_t receive(const MutableBufferSequence& buffers,socket_base::message_flags flags)
         {
-            return ssl_ ? ssl_socket().receive(buffers, flags)
-                        : socket().receive(buffers, flags);
+            error_code ec;
+            std::size_t bytes = receive(buffers, flags, ec);
+            boost::asio::detail::throw_error(ec);
+            return bytes;
         }
 
         template <typename MutableBufferSequence>
         std::size_t receive(const MutableBufferSequence& buffers, socket_base::message_flags flags, boost::system::error_code& ec)
         {
-            return ssl_ ? ssl_socket().receive(buffers, flags, ec)
-                        : socket().receive(buffers, flags, ec);
+            if(!flags)
+            {
+                return read_some(buffers, ec);
+            }
+            return secure() ? ssl_socket().receive(buffers, flags, ec)
+                            : socket().receive(buffers, flags, ec);
         }
 
         template <typename MutableBufferSequence, typename ReadHandler>
         void async_receive(const MutableBufferSequence& buffers, socket_base::message_flags flags, ReadHandler handler)
         {
-            return ssl_ ? ssl_socket().async_receive(buffers, flags, handler)
-                        : socket().async_receive(buffers, flags, handler);
+            if(!flags)
+            {
+                async_read_some(buffers, handler);
+            }
+            else if(secure())
+            {
+                ssl_socket().async_receive(buffers, flags, handler);
+            }
+            else
+            {
+                socket().async_receive(buffers, flags, handler);
+            }
         }
 
 
         template <typename MutableBufferSequence, typename ReadHandler>
         void async_receive(const MutableBufferSequence& buffers, ReadHandler handler)
         {
-            return ssl_ ? ssl_socket().async_receive(buffers, handler)
-                        : socket().async_receive(buffers, handler);
+            async_read_some(buffers, handler);
         }
 
 
         template <typename ConstBufferSequence, typename WriteHandler>
         void async_write_some(const ConstBufferSequence& buffers, WriteHandler handler)
         {
-            return ssl_ ? ssl_socket().async_write_some(buffers, handler)
-                        : socket().async_write_some(buffers, handler);
+            return secure() ? ssl_socket().async_write_some(buffers, handler)
+                            : socket().async_write_some(buffers, handler);
         }
 
 
         template <typename ConstBufferSequence>
         std::size_t write_some(const ConstBufferSequence& buffers)
         {
-            return ssl_ ? ssl_socket().write_some(buffers)
-                        : socket().write_some(buffers);
+            return secure() ? ssl_socket().write_some(buffers)
+                            : socket().write_some(buffers);
         }
 
         template <typename ConstBufferSequence>
         std::size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec)
         {
-            return ssl_ ? ssl_socket().write_some(buffers, ec)
-                        : socket().write_some(buffers, ec);
+            return secure() ? ssl_socket().write_some(buffers, ec)
+                            : socket().write_some(buffers, ec);
         }
 
 
         template <typename MutableBufferSequence>
         std::size_t read_some(const MutableBufferSequence& buffers)
         {
-            return ssl_ ? ssl_socket().read_some(buffers)
-                        : socket().read_some(buffers);
+            error_code ec;
+            std::size_t bytes = read_some(buffers, ec);
+            boost::asio::detail::throw_error(ec);
+            return bytes;
         }
 
 
         template <typename MutableBufferSequence>
         std::size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec)
         {
-            return ssl_ ? ssl_socket().read_some(buffers, ec)
-                        : socket().read_some(buffers, ec);
+            if(secure())
+            {
+                return ssl_socket().read_some(buffers, ec);
+            }
+            std::size_t bytes = socket().read_some(buffers, ec);
+            if(ec && kernel_tls())
+            {
+                net::kernel_tls<Tag>::translate_error(socket().native(), ec);
+            }
+            return bytes;
         }
 
         template <typename MutableBufferSequence, typename ReadHandler>
         void async_read_some(const MutableBufferSequence& buffers, ReadHandler handler)
         {
-            return ssl_ ? ssl_socket().async_read_some(buffers, handler)
-                        : socket().async_read_some(buffers, handler);
+            if(secure())
+            {
+                ssl_socket().async_read_some(buffers, handler);
+            }
+            else if(kernel_tls())
+            {
+                socket().async_read_some(
+                    buffers,
+                    boost::bind(
+                        &socket_adapter::on_kernel_tls_read,
+                        connection_,
+                        read_handler(handler),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred
+                    )
+                );
+            }
+            else
+            {
+                socket().async_read_some(buffers, handler);
+            }
+        }
+
+        // Reads into a buffer of at least size bytes borrowed from the shared
+        // pool; handler(ec, lease, bytes_transferred). On plain sockets the
+        // buffer is only taken once data has arrived, so idle connections
+        // don't hold any receive memory.
+        template <typename ReadHandler>
+        void async_read_leased(std::size_t size, ReadHandler handler)
+        {
+            if(secure() || socket().uses_io_engine() || socket().pending())
+            {
+                // The SSL stream and the io engine need the buffer up front,
+                // bytes left over from the proxy handshake are copied right away
+                util::buffer_lease lease = util::lease_buffer(size);
+                async_read_some(
+                    lease.buffer(),
+                    boost::bind(
+                        &socket_adapter::on_leased_read,
+                        lease,
+                        leased_read_handler(handler),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred
+                    )
+                );
+            }
+            else
+            {
+                wait_readable(connection_, kernel_tls(), size, leased_read_handler(handler));
+            }
+        }
+
+#if !defined(WIN32) && !defined(WIN64)
+        // Sends count bytes of file starting at offset; handler(ec, bytes_transferred)
+        template <typename Handler>
+        void async_send_file(int file, off_t offset, std::size_t count, Handler handler)
+        {
+            return secure() ? file_transfer<Tag>::async_copy(ssl_socket(), file, offset, count, handler)
+                            : file_transfer<Tag>::async_send(socket(), file, offset, count, handler);
+        }
+#endif
+
+#ifdef NETPP_HAS_IO_URING
+        void set_io_engine(typename io_uring_engine<Tag>::self_ptr engine)
+        {
+            socket().set_io_engine(engine);
         }
+#endif
 
         void set_proxy(typename proxy_base<Tag>::self_ptr ptr)
         {
-            ssl_ ? ssl_socket().next_layer().set_proxy(ptr)
-                :  socket().set_proxy(ptr);
+            socket().set_proxy(ptr);
+        }
+
+        // true if reads and writes have to go through the OpenSSL stream
+        bool secure()
+        {
+            return ssl_ && !get_ssl_connection().kernel_tls();
+        }
+
+        // true if the record layer of the SSL connection is in the kernel
+        bool kernel_tls()
+        {
+            return ssl_ && get_ssl_connection().kernel_tls();
+        }
+
+        void set_kernel_tls(bool enabled)
+        {
+            if(ssl_)
+            {
+                get_ssl_connection().set_kernel_tls(enabled);
+            }
+        }
+
+        void set_alpn_protocols(std::vector<string_type> const & protocols)
+        {
+            if(ssl_)
+            {
+                get_ssl_connection().set_alpn_protocols(protocols);
+            }
         }
 
+        // Protocol selected by ALPN, empty for plain connections
+        string_type alpn_protocol()
+        {
+            return ssl_ ? get_ssl_connection().alpn_protocol() : string_type();
+        }
+
+        // The TCP level socket, also valid for SSL connections
         socket_type & socket()
         {
-            return get_connection().socket();
+            return base().get_plain_socket();
         }
 
         ssl_socket_type & ssl_socket()
@@ -183,6 +313,16 @@ namespace net
             return *connection_;
         }
 
+        connection_ptr shared_connection() const
+        {
+            return connection_;
+        }
+
+        bool ssl() const
+        {
+            return ssl_;
+        }
+
         connection_type & get_connection()
         {
             return static_cast<connection_type&>(base());
@@ -193,6 +333,72 @@ namespace net
             return static_cast<ssl_connection_type&>(base());
         }
 
+    protected:
+        static void wait_readable(connection_ptr connection, bool ktls, std::size_t size, leased_read_handler handler)
+        {
+            connection->get_plain_socket().async_read_some(
+                boost::asio::null_buffers(),
+                boost::bind(
+                    &socket_adapter::on_readable,
+                    connection,
+                    ktls,
+                    size,
+                    handler,
+                    boost::asio::placeholders::error
+                )
+            );
+        }
+
+        static void on_readable(connection_ptr connection, bool ktls, std::size_t size, leased_read_handler handler, error_code const & ec)
+        {
+            if(ec)
+            {
+                handler(ec, util::buffer_lease(), 0);
+                return;
+            }
+
+            // Data is there, so the read completes right away. A synchronous
+            // MSG_DONTWAIT receive can't be used instead, on a socket not in
+            // user non-blocking mode the socket service waits for data rather
+            // than failing with would_block after a spurious wakeup.
+            util::buffer_lease lease = util::lease_buffer(size);
+            connection->get_plain_socket().async_read_some(
+                lease.buffer(),
+                boost::bind(
+                    &socket_adapter::on_readable_read,
+                    connection,
+                    ktls,
+                    lease,
+                    handler,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred
+                )
+            );
+        }
+
+        static void on_readable_read(connection_ptr connection, bool ktls, util::buffer_lease lease, leased_read_handler handler, error_code ec, std::size_t bytes)
+        {
+            if(ec && ktls)
+            {
+                net::kernel_tls<Tag>::translate_error(connection->get_plain_socket().native(), ec);
+            }
+            handler(ec, ec ? util::buffer_lease() : lease, bytes);
+        }
+
+        static void on_kernel_tls_read(connection_ptr connection, read_handler handler, error_code ec, std::size_t bytes)
+        {
+            if(ec)
+            {
+                net::kernel_tls<Tag>::translate_error(connection->get_plain_socket().native(), ec);
+            }
+            handler(ec, bytes);
+        }
+
+        static void on_leased_read(util::buffer_lease lease, leased_read_handler handler, error_code const & ec, std::size_t bytes)
+        {
+            handler(ec, lease, bytes);
+        }
+
     protected:
         connection_ptr connection_;
         bool ssl_;
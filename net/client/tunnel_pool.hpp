@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+ * All rights reserved.
+ *
+ * - Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+ *   of its contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef GUARD_NET_CLIENT_TUNNEL_POOL_HPP_INCLUDED
+#define GUARD_NET_CLIENT_TUNNEL_POOL_HPP_INCLUDED
+
+#include <net/client/connection.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <deque>
+#include <map>
+
+#if !defined(WIN32) && !defined(WIN64)
+#    include <cerrno>
+#    include <sys/types.h>
+#    include <sys/socket.h>
+#endif
+
+namespace net
+{
+    // Idle proxied connections, kept for reuse.
+    //
+    // Two kinds of connections are pooled, both keyed by the proxy (and the
+    // SSL context for secure connections):
+    //  - established tunnels, additionally keyed by the target host and port,
+    //    which are handed back by basic_client::release once a request is done
+    //  - warm connections to the proxy itself (empty host and port), opened in
+    //    advance by basic_client::prewarm, which only need the CONNECT.
+    // Connections idle for longer than max_idle_time, closed by the peer or
+    // with unread data are dropped when they are found.
+    template<typename Tag>
+    struct tunnel_pool
+        : boost::noncopyable
+    {
+        typedef boost::shared_ptr<tunnel_pool>                  self_ptr;
+        typedef boost::shared_ptr< connection_base<Tag> >       connection_ptr;
+        typedef typename connection_base<Tag>::string_type      string_type;
+        typedef boost::system::error_code                       error_code;
+        typedef boost::posix_time::ptime                        time_type;
+        typedef boost::posix_time::time_duration                duration_type;
+
+        struct key_type
+        {
+            key_type()
+                : proxy(0)
+                , context(0)
+                , host()
+                , port()
+            {}
+
+            key_type(void const * proxy, void const * context, string_type const & host, string_type const & port)
+                : proxy(proxy)
+                , context(context)
+                , host(host)
+                , port(port)
+            {}
+
+            bool operator<(key_type const & other) const
+            {
+                if(proxy != other.proxy)
+                {
+                    return proxy < other.proxy;
+                }
+                if(context != other.context)
+                {
+                    return context < other.context;
+                }
+                if(host != other.host)
+                {
+                    return host < other.host;
+                }
+                return port < other.port;
+            }
+
+            void const *    proxy;
+            void const *    context;
+            string_type     host;
+            string_type     port;
+        };
+
+        explicit tunnel_pool(
+            std::size_t max_idle_per_key = 4,
+            duration_type const & max_idle_time = boost::posix_time::seconds(30)
+        )
+            : mutex_()
+            , entries_()
+            , max_idle_per_key_(max_idle_per_key)
+            , max_idle_time_(max_idle_time)
+        {}
+
+        // Parks connection under key. The caller must not have any operation
+        // pending on it. The oldest connection is closed if key is full.
+        void release(key_type const & key, connection_ptr connection)
+        {
+            if(!connection || !connection->get_plain_socket().is_open())
+            {
+                return;
+            }
+
+            entry added;
+            added.connection = connection;
+            added.since      = now();
+
+            connection_ptr dropped;
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                entry_list & list = entries_[key];
+                list.push_back(added);
+                if(list.size() > max_idle_per_key_)
+                {
+                    dropped = list.front().connection;
+                    list.pop_front();
+                }
+            }
+            // Closed outside of the lock
+            dropped.reset();
+        }
+
+        // The most recently parked usable connection for key, or an empty pointer
+        connection_ptr acquire(key_type const & key)
+        {
+            time_type const oldest = now() - max_idle_time_;
+            std::deque<connection_ptr> dropped;
+            connection_ptr result;
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                typename entry_map::iterator found = entries_.find(key);
+                if(found == entries_.end())
+                {
+                    return result;
+                }
+
+                entry_list & list = found->second;
+                while(!list.empty() && !result)
+                {
+                    entry candidate = list.back();
+                    list.pop_back();
+                    if(candidate.since >= oldest && usable(*candidate.connection))
+                    {
+                        result = candidate.connection;
+                    }
+                    else
+                    {
+                        dropped.push_back(candidate.connection);
+                    }
+                }
+                if(list.empty())
+                {
+                    entries_.erase(found);
+                }
+            }
+            return result;
+        }
+
+        // Completion handler for connections opened in advance
+        void add_warm(key_type const & key, connection_ptr connection, error_code const & ec)
+        {
+            if(!ec)
+            {
+                release(key, connection);
+            }
+        }
+
+        std::size_t idle(key_type const & key) const
+        {
+            boost::asio::detail::mutex::scoped_lock lock(mutex_);
+            typename entry_map::const_iterator found = entries_.find(key);
+            return found != entries_.end() ? found->second.size() : 0;
+        }
+
+        // Closes the connections which have been idle for too long
+        void purge()
+        {
+            time_type const oldest = now() - max_idle_time_;
+            std::deque<connection_ptr> dropped;
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                typename entry_map::iterator it = entries_.begin();
+                while(it != entries_.end())
+                {
+                    entry_list & list = it->second;
+                    while(!list.empty() && list.front().since < oldest)
+                    {
+                        dropped.push_back(list.front().connection);
+                        list.pop_front();
+                    }
+                    if(list.empty())
+                    {
+                        entries_.erase(it++);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            }
+        }
+
+        void clear()
+        {
+            entry_map dropped;
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                dropped.swap(entries_);
+            }
+        }
+
+        // An idle connection must neither be closed by the peer nor have
+        // anything to read, otherwise its state is unknown
+        static bool usable(connection_base<Tag> & connection)
+        {
+            typename connection_base<Tag>::socket & socket = connection.get_plain_socket();
+            if(!socket.is_open())
+            {
+                return false;
+            }
+
+            error_code ec;
+            if(socket.pending() || socket.available(ec) != 0 || ec)
+            {
+                return false;
+            }
+
+#if !defined(WIN32) && !defined(WIN64)
+            char probe = 0;
+            ssize_t result = ::recv(socket.native(), &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+            if(result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                return false;
+            }
+#endif
+            return true;
+        }
+
+    protected:
+        struct entry
+        {
+            connection_ptr  connection;
+            time_type       since;
+        };
+
+        // Oldest entries first
+        typedef std::deque<entry>                   entry_list;
+        typedef std::map<key_type, entry_list>      entry_map;
+
+        static time_type now()
+        {
+            return boost::posix_time::microsec_clock::universal_time();
+        }
+
+    protected:
+        mutable boost::asio::detail::mutex  mutex_;
+        entry_map                           entries_;
+        std::size_t                         max_idle_per_key_;
+        duration_type                       max_idle_time_;
+    };
+}
+
+#endif //GUARD_NET_CLIENT_TUNNEL_POOL_HPP_INCLUDED
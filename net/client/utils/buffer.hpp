@@ -26,13 +26,16 @@
 #ifndef GUARD_NET_CLIENT_UTILS_BUFFER_HPP_INCLUDED
 #define GUARD_NET_CLIENT_UTILS_BUFFER_HPP_INCLUDED
 
+#include <net/detail/byte_order.hpp>
 #include <boost/type_traits/is_pod.hpp>
-#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/remove_reference.hpp>
 #include <boost/asio/ip/address.hpp>
-#include <boost/detail/endian.hpp>
 #include <boost/static_assert.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/array.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <algorithm>
+#include <iterator>
 #include <vector>
 #include <stdexcept>
 
@@ -40,11 +43,31 @@ namespace net
 {
     namespace util
     {
+        // Number of octets a boost::tuple of fields occupies on the wire,
+        // e.g. encoded_size< boost::tuple<boost::uint8_t, boost::uint16_t> >::value == 3
+        template<typename Fields>
+        struct encoded_size
+        {
+            enum
+            {
+                value = sizeof(typename boost::remove_reference<typename Fields::head_type>::type)
+                      + encoded_size<typename Fields::tail_type>::value
+            };
+        };
+
+        template<>
+        struct encoded_size<boost::tuples::null_type>
+        {
+            enum { value = 0 };
+        };
+
         struct buffer_stream_base
         {
             virtual ~buffer_stream_base()
             {}
         };
+
+        // Integers are written in network byte order, other POD types as they are
         template<typename OctetIterator>
         struct unchecked_buffer_stream_base
             : buffer_stream_base
@@ -72,64 +95,56 @@ namespace net
             template<typename T>
             unchecked_buffer_stream_base & write(T const & t)
             {
-                BOOST_STATIC_ASSERT( boost::is_pod<T>::value == true );
-                boost::uint8_t const * p = reinterpret_cast<boost::uint8_t const*>(&t);
-                if(boost::is_integral<T>::value)
-                {
-#ifdef BOOST_LITTLE_ENDIAN
-                    pos_ = std::reverse_copy(p, p + sizeof(t), pos_);
-#elif defined(BOOST_BIG_ENDIAN)
-                    pos_ = std::copy(p, p + sizeof(t), pos_);
-#else
-#    error Platform not supported
-#endif
-                }
-                else
-                {
-                    pos_ = std::copy(p, p + sizeof(t), pos_);
-                }
+                put(t);
                 return *this;
             }
 
             template<typename T>
             unchecked_buffer_stream_base & read(T & t)
             {
-                t = read<T>();
+                get(t);
                 return *this;
             }
 
             template<typename T>
             T read()
             {
-                BOOST_STATIC_ASSERT( boost::is_pod<T>::value == true );
-                union conv
-                {
-                    T value;
-                    boost::array<boost::uint8_t, sizeof(T)> bytes;
-                };
-                conv c;
+                T t;
+                get(t);
+                return t;
+            }
 
-                boost::uint8_t * p = c.bytes.data();
-                if(boost::is_integral<T>::value)
-                {
-#ifdef BOOST_LITTLE_ENDIAN
-                    std::reverse_copy(pos_, pos_ + sizeof(T), p);
-#elif defined(BOOST_BIG_ENDIAN)
-                    std::copy(pos_, pos_ + sizeof(T), p);
-#else
-#    error Platform not supported
-#endif
-                    pos_ += sizeof(T);
-                }
-                else
-                {
-                    std::copy(pos_, pos_ + sizeof(T), p);
-                    pos_ += sizeof(T);
-                }
-                return c.value;
+            // Octets left between the position and the end
+            std::size_t remaining() const
+            {
+                return this->end_ - this->pos_;
             }
 
+            // Nothing to check here, see checked_buffer_stream_base::require
+            void require(std::size_t)
+            {}
+
         protected:
+            template<typename T>
+            void put(T const & t)
+            {
+                BOOST_STATIC_ASSERT( boost::is_pod<T>::value == true );
+                T const value = net::detail::network_order(t);
+                boost::uint8_t const * p = reinterpret_cast<boost::uint8_t const*>(&value);
+                pos_ = std::copy(p, p + sizeof(T), pos_);
+            }
+
+            template<typename T>
+            void get(T & t)
+            {
+                BOOST_STATIC_ASSERT( boost::is_pod<T>::value == true );
+                T value;
+                boost::uint8_t * p = reinterpret_cast<boost::uint8_t*>(&value);
+                std::copy(pos_, pos_ + sizeof(T), p);
+                pos_ += sizeof(T);
+                t = net::detail::network_order(value);
+            }
+
             void reset(iterator begin, iterator end)
             {
                 begin_ = pos_ = begin;
@@ -140,6 +155,8 @@ namespace net
             iterator begin_, end_, pos_;
         };
 
+        // Throws std::out_of_range instead of running past the end. A failed
+        // access leaves the stream unchanged.
         template<typename OctetIterator>
         struct checked_buffer_stream_base
             : unchecked_buffer_stream_base<OctetIterator>
@@ -158,35 +175,34 @@ namespace net
             template<typename T>
             checked_buffer_stream_base & write(T const & t)
             {
-                buffer_check<T>();
-                base_type::template write<T>(t);
+                require(sizeof(T));
+                this->put(t);
                 return *this;
             }
 
             template<typename T>
             checked_buffer_stream_base & read(T & t)
             {
-
+                require(sizeof(T));
+                this->get(t);
                 return *this;
             }
 
             template<typename T>
             T read()
             {
-                buffer_check<T>();
-                return base_type::template read<T>();
+                T t;
+                read(t);
+                return t;
             }
 
-        protected:
-            template<typename T>
-            void buffer_check()
+            // Checks room for a batch of size octets at once
+            void require(std::size_t size)
             {
-                if( !(this->begin_ < this->end_)
-                || (this->pos_ + 4 > this->end_))
+                if(this->remaining() < size)
                 {
                     throw std::out_of_range("Trying to access buffers outside their range");
                 }
-
             }
         };
 
@@ -313,6 +329,61 @@ namespace net
                 }
                 return *this;
             }
+
+            // Raw octets, e.g. the characters of a host name
+            template<typename ForwardIterator>
+            buffer_stream & write(ForwardIterator first, ForwardIterator last)
+            {
+                this->require(std::distance(first, last));
+                this->pos_ = std::copy(first, last, this->pos_);
+                return *this;
+            }
+
+            // Writes all fields of a boost::tuple with a single range check:
+            // stream.write_fields(boost::make_tuple(boost::uint8_t(0x05), port))
+            template<typename Fields>
+            buffer_stream & write_fields(Fields const & fields)
+            {
+                this->require(encoded_size<Fields>::value);
+                put_fields(fields);
+                return *this;
+            }
+
+            // Counterpart to write_fields: stream.read_fields(boost::tie(version, status))
+            template<typename Fields>
+            buffer_stream & read_fields(Fields const & fields)
+            {
+                this->require(encoded_size<Fields>::value);
+                get_fields(fields);
+                return *this;
+            }
+
+            // Number of octets read or written so far
+            std::size_t position() const
+            {
+                return this->pos_ - this->begin_;
+            }
+
+        protected:
+            template<typename Head, typename Tail>
+            void put_fields(boost::tuples::cons<Head, Tail> const & fields)
+            {
+                this->put(fields.get_head());
+                put_fields(fields.get_tail());
+            }
+
+            void put_fields(boost::tuples::null_type const &)
+            {}
+
+            template<typename Head, typename Tail>
+            void get_fields(boost::tuples::cons<Head, Tail> const & fields)
+            {
+                this->get(fields.get_head());
+                get_fields(fields.get_tail());
+            }
+
+            void get_fields(boost::tuples::null_type const &)
+            {}
         };
 
         struct unchecked_buffer_stream_adapter
@@ -322,8 +393,13 @@ namespace net
 
             template<typename T>
             unchecked_buffer_stream_adapter(std::vector<T> & v)
-                : base_type(&v[0], &v[0] + v.size())
-            {}
+                : base_type()
+            {
+                if(!v.empty())
+                {
+                    this->reset(&v[0], &v[0] + v.size());
+                }
+            }
 
             template<typename T, size_t N>
             unchecked_buffer_stream_adapter(boost::array<T,N> & a)
@@ -359,7 +435,7 @@ namespace net
 
         template<typename T>
         buffer_stream_adapter adapt_checked(T & buffer){
-            return unchecked_buffer_stream_adapter(buffer);
+            return buffer_stream_adapter(buffer);
         }
     }
 }
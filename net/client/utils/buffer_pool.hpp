@@ -0,0 +1,445 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_UTILS_BUFFER_POOL_HPP_INCLUDED
+#define GUARD_NET_CLIENT_UTILS_BUFFER_POOL_HPP_INCLUDED
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/asio/detail/tss_ptr.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+#if !defined(WIN32) && !defined(WIN64)
+#    include <pthread.h>
+#endif
+
+namespace net
+{
+    namespace util
+    {
+        class buffer_pool;
+
+        // Header in front of every pooled block, the payload follows directly
+        struct pooled_block
+        {
+            explicit pooled_block(std::size_t cls, std::size_t capacity)
+                : refs(0)
+                , size_class(cls)
+                , capacity(capacity)
+                , next(0)
+            {}
+
+            boost::detail::atomic_count refs;
+            std::size_t                 size_class;
+            std::size_t                 capacity;
+            pooled_block *              next;
+
+            char * data()
+            {
+                return reinterpret_cast<char*>(this + 1);
+            }
+        };
+
+        // Reference counted loan of a pooled block. The block returns to the
+        // pool when the last copy of the lease is destroyed, so leases can be
+        // bound into completion handlers by value.
+        class buffer_lease
+        {
+        public:
+            buffer_lease()
+                : block_(0)
+            {}
+
+            explicit buffer_lease(pooled_block * block)
+                : block_(block)
+            {
+                acquire();
+            }
+
+            buffer_lease(buffer_lease const & other)
+                : block_(other.block_)
+            {
+                acquire();
+            }
+
+            ~buffer_lease()
+            {
+                release();
+            }
+
+            buffer_lease & operator=(buffer_lease other)
+            {
+                swap(other);
+                return *this;
+            }
+
+            void swap(buffer_lease & other)
+            {
+                std::swap(block_, other.block_);
+            }
+
+            void reset()
+            {
+                buffer_lease().swap(*this);
+            }
+
+            char * data() const
+            {
+                return block_ ? block_->data() : 0;
+            }
+
+            std::size_t size() const
+            {
+                return block_ ? block_->capacity : 0;
+            }
+
+            bool empty() const
+            {
+                return block_ == 0;
+            }
+
+            boost::asio::mutable_buffers_1 buffer() const
+            {
+                return boost::asio::buffer(data(), size());
+            }
+
+            boost::asio::mutable_buffers_1 buffer(std::size_t size) const
+            {
+                return boost::asio::buffer(data(), size < this->size() ? size : this->size());
+            }
+
+        private:
+            inline void acquire();
+            inline void release();
+
+        private:
+            pooled_block * block_;
+        };
+
+        // Process wide pool of receive and scratch buffers.
+        //
+        // Blocks come in size classes of 256 bytes to 64KiB, bigger requests are
+        // served from the heap and not retained. Every thread keeps a few blocks
+        // per class for itself, they move to the shared free lists when the
+        // thread exits. The shared lists are bounded, everything above the
+        // bound goes back to the heap.
+        class buffer_pool
+            : boost::noncopyable
+        {
+        public:
+            enum
+            {
+                SIZE_CLASSES        = 5,
+                MIN_BLOCK_SHIFT     = 8,   // 256 bytes
+                MAX_BLOCK_SIZE      = 1 << (MIN_BLOCK_SHIFT + 2 * (SIZE_CLASSES - 1)),
+                THREAD_CACHE_BLOCKS = 8,
+                SHARED_CACHE_BLOCKS = 256,
+                UNPOOLED            = SIZE_CLASSES
+            };
+
+            static buffer_pool & instance()
+            {
+                static buffer_pool pool;
+                return pool;
+            }
+
+            buffer_lease lease(std::size_t size)
+            {
+                std::size_t const cls = size_class(size);
+                if(cls == UNPOOLED)
+                {
+                    return buffer_lease(create(UNPOOLED, size));
+                }
+
+                thread_cache * cache = local_cache();
+                if(cache && cache->count[cls])
+                {
+                    pooled_block * block = cache->blocks[cls];
+                    cache->blocks[cls] = block->next;
+                    --cache->count[cls];
+                    block->next = 0;
+                    return buffer_lease(block);
+                }
+
+                {
+                    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                    if(shared_[cls].count)
+                    {
+                        pooled_block * block = shared_[cls].head;
+                        shared_[cls].head = block->next;
+                        --shared_[cls].count;
+                        block->next = 0;
+                        return buffer_lease(block);
+                    }
+                }
+                return buffer_lease(create(cls, class_size(cls)));
+            }
+
+            void recycle(pooled_block * block)
+            {
+                std::size_t const cls = block->size_class;
+                if(cls == UNPOOLED)
+                {
+                    destroy(block);
+                    return;
+                }
+
+                thread_cache * cache = local_cache();
+                if(cache && cache->count[cls] < THREAD_CACHE_BLOCKS)
+                {
+                    block->next = cache->blocks[cls];
+                    cache->blocks[cls] = block;
+                    ++cache->count[cls];
+                    return;
+                }
+
+                give_back(block);
+            }
+
+            static std::size_t class_size(std::size_t cls)
+            {
+                return std::size_t(1) << (MIN_BLOCK_SHIFT + 2 * cls);
+            }
+
+            static std::size_t size_class(std::size_t size)
+            {
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    if(size <= class_size(cls))
+                    {
+                        return cls;
+                    }
+                }
+                return UNPOOLED;
+            }
+
+        private:
+            struct free_list
+            {
+                pooled_block *  head;
+                std::size_t     count;
+            };
+
+            struct thread_cache
+            {
+                pooled_block *  blocks[SIZE_CLASSES];
+                std::size_t     count[SIZE_CLASSES];
+            };
+
+#if !defined(WIN32) && !defined(WIN64)
+            // Thread local pointer to the thread's cache, which goes back to
+            // the pool when the thread exits
+            class cache_slot
+                : boost::noncopyable
+            {
+            public:
+                cache_slot()
+                    : valid_(::pthread_key_create(&key_, &buffer_pool::on_thread_exit) == 0)
+                {}
+
+                ~cache_slot()
+                {
+                    if(valid_)
+                    {
+                        ::pthread_key_delete(key_);
+                    }
+                }
+
+                thread_cache * get() const
+                {
+                    return valid_ ? static_cast<thread_cache *>(::pthread_getspecific(key_)) : 0;
+                }
+
+                bool reset(thread_cache * cache)
+                {
+                    return valid_ && ::pthread_setspecific(key_, cache) == 0;
+                }
+
+            private:
+                pthread_key_t   key_;
+                bool            valid_;
+            };
+#else
+            // Caches of finished threads (at most THREAD_CACHE_BLOCKS per
+            // class) are not reclaimed here
+            class cache_slot
+                : boost::noncopyable
+            {
+            public:
+                thread_cache * get() const
+                {
+                    return slot_;
+                }
+
+                bool reset(thread_cache * cache)
+                {
+                    slot_ = cache;
+                    return true;
+                }
+
+            private:
+                boost::asio::detail::tss_ptr<thread_cache>  slot_;
+            };
+#endif
+
+            buffer_pool()
+                : mutex_()
+                , cache_()
+            {
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    shared_[cls].head  = 0;
+                    shared_[cls].count = 0;
+                }
+            }
+
+            // The pool lives until exit, threads still running keep their
+            // caches
+            ~buffer_pool()
+            {
+                release_cache(cache_.get());
+                cache_.reset(0);
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    while(shared_[cls].head)
+                    {
+                        pooled_block * block = shared_[cls].head;
+                        shared_[cls].head = block->next;
+                        destroy(block);
+                    }
+                }
+            }
+
+            thread_cache * local_cache()
+            {
+                thread_cache * cache = cache_.get();
+                if(!cache)
+                {
+                    cache = new (std::nothrow) thread_cache();
+                    if(cache)
+                    {
+                        for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                        {
+                            cache->blocks[cls] = 0;
+                            cache->count[cls]  = 0;
+                        }
+                        if(!cache_.reset(cache))
+                        {
+                            delete cache;
+                            cache = 0;
+                        }
+                    }
+                }
+                return cache;
+            }
+
+            // Past the thread cache, into the shared free list if there is
+            // room
+            void give_back(pooled_block * block)
+            {
+                std::size_t const cls = block->size_class;
+                {
+                    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                    if(shared_[cls].count < SHARED_CACHE_BLOCKS)
+                    {
+                        block->next = shared_[cls].head;
+                        shared_[cls].head = block;
+                        ++shared_[cls].count;
+                        return;
+                    }
+                }
+                destroy(block);
+            }
+
+            void release_cache(thread_cache * cache)
+            {
+                if(!cache)
+                {
+                    return;
+                }
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    while(cache->blocks[cls])
+                    {
+                        pooled_block * block = cache->blocks[cls];
+                        cache->blocks[cls] = block->next;
+                        give_back(block);
+                    }
+                }
+                delete cache;
+            }
+
+            static void on_thread_exit(void * cache)
+            {
+                instance().release_cache(static_cast<thread_cache *>(cache));
+            }
+
+            static pooled_block * create(std::size_t cls, std::size_t capacity)
+            {
+                void * memory = ::operator new(sizeof(pooled_block) + capacity);
+                return new (memory) pooled_block(cls, capacity);
+            }
+
+            static void destroy(pooled_block * block)
+            {
+                block->~pooled_block();
+                ::operator delete(block);
+            }
+
+        private:
+            boost::asio::detail::mutex                      mutex_;
+            cache_slot                                      cache_;
+            free_list                                       shared_[SIZE_CLASSES];
+        };
+
+        inline void buffer_lease::acquire()
+        {
+            if(block_)
+            {
+                ++block_->refs;
+            }
+        }
+
+        inline void buffer_lease::release()
+        {
+            if(block_ && --block_->refs == 0)
+            {
+                buffer_pool::instance().recycle(block_);
+            }
+            block_ = 0;
+        }
+
+        inline buffer_lease lease_buffer(std::size_t size)
+        {
+            return buffer_pool::instance().lease(size);
+        }
+    }
+}
+
+#endif //GUARD_NET_CLIENT_UTILS_BUFFER_POOL_HPP_INCLUDED
@@ -0,0 +1,214 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_UTILS_FILE_SYNC_SERVICE_HPP_INCLUDED
+#define GUARD_NET_CLIENT_UTILS_FILE_SYNC_SERVICE_HPP_INCLUDED
+
+#if !defined(WIN32) && !defined(WIN64)
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/asio/detail/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <cerrno>
+#include <cstddef>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace net
+{
+    namespace util
+    {
+        // Runs fsync(2) and pread(2) on a thread of its own, so flushing a
+        // large file or reading one from a cold cache does not hold up the
+        // io_service. One thread per io_service, started with the first
+        // request; requests run one after the other.
+        // Obtain it with boost::asio::use_service< file_sync_service<Tag> >(service).
+        template<typename Tag>
+        class file_sync_service
+            : public boost::asio::io_service::service
+        {
+        public:
+            typedef boost::system::error_code error_code;
+
+            static boost::asio::io_service::id id;
+
+            explicit file_sync_service(boost::asio::io_service & service)
+                : boost::asio::io_service::service(service)
+                , owner_(service)
+                , mutex_()
+                , work_service_(new boost::asio::io_service())
+                , work_(new boost::asio::io_service::work(*work_service_))
+                , thread_()
+            {}
+
+            ~file_sync_service()
+            {
+                shutdown_service();
+            }
+
+            void shutdown_service()
+            {
+                work_.reset();
+                if(thread_)
+                {
+                    work_service_->stop();
+                    thread_->join();
+                    thread_.reset();
+                }
+            }
+
+            // The handler gets the result of fsync on the file and runs on
+            // the owning io_service, which counts it as outstanding work
+            template<typename Handler>
+            void async_sync(int file, Handler handler)
+            {
+                start();
+                work_service_->post(operation<Handler>(owner_, file, handler));
+            }
+
+            // Reads up to size bytes at offset, the handler gets the error
+            // and the bytes read like async_read_some, eof past the end.
+            // data has to stay valid until the handler is called.
+            template<typename Handler>
+            void async_read(int file, void * data, std::size_t size, off_t offset, Handler handler)
+            {
+                start();
+                work_service_->post(read_operation<Handler>(owner_, file, data, size, offset, handler));
+            }
+
+        private:
+            template<typename Handler>
+            struct operation
+            {
+                operation(boost::asio::io_service & owner, int file, Handler handler)
+                    : owner(owner)
+                    , work(owner)
+                    , file(file)
+                    , handler(handler)
+                {}
+
+                void operator()()
+                {
+                    int result = 0;
+                    do
+                    {
+                        result = ::fsync(file);
+                    }
+                    while(result < 0 && errno == EINTR);
+                    error_code const ec = result < 0 ? error_code(errno, boost::asio::error::get_system_category()) : error_code();
+                    owner.post(boost::bind(handler, ec));
+                }
+
+                boost::asio::io_service &       owner;
+                boost::asio::io_service::work   work;
+                int                             file;
+                Handler                         handler;
+            };
+
+            template<typename Handler>
+            struct read_operation
+            {
+                read_operation(boost::asio::io_service & owner, int file, void * data, std::size_t size, off_t offset, Handler handler)
+                    : owner(owner)
+                    , work(owner)
+                    , file(file)
+                    , data(data)
+                    , size(size)
+                    , offset(offset)
+                    , handler(handler)
+                {}
+
+                void operator()()
+                {
+                    ssize_t result = 0;
+                    do
+                    {
+                        result = ::pread(file, data, size, offset);
+                    }
+                    while(result < 0 && errno == EINTR);
+                    error_code ec;
+                    if(result < 0)
+                    {
+                        ec = error_code(errno, boost::asio::error::get_system_category());
+                    }
+                    else if(result == 0 && size)
+                    {
+                        ec = boost::asio::error::eof;
+                    }
+                    owner.post(boost::bind(handler, ec, static_cast<std::size_t>(result < 0 ? 0 : result)));
+                }
+
+                boost::asio::io_service &       owner;
+                boost::asio::io_service::work   work;
+                int                             file;
+                void *                          data;
+                std::size_t                     size;
+                off_t                           offset;
+                Handler                         handler;
+            };
+
+            struct runner
+            {
+                explicit runner(boost::asio::io_service & service)
+                    : service(&service)
+                {}
+
+                void operator()()
+                {
+                    service->run();
+                }
+
+                boost::asio::io_service * service;
+            };
+
+            void start()
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                if(!thread_)
+                {
+                    thread_.reset(new boost::asio::detail::thread(runner(*work_service_)));
+                }
+            }
+
+        private:
+            boost::asio::io_service &                           owner_;
+            boost::asio::detail::mutex                          mutex_;
+            boost::scoped_ptr<boost::asio::io_service>          work_service_;
+            boost::scoped_ptr<boost::asio::io_service::work>    work_;
+            boost::scoped_ptr<boost::asio::detail::thread>      thread_;
+        };
+
+        template<typename Tag>
+        boost::asio::io_service::id file_sync_service<Tag>::id;
+    }
+}
+
+#endif
+
+#endif //GUARD_NET_CLIENT_UTILS_FILE_SYNC_SERVICE_HPP_INCLUDED
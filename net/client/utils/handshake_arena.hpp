@@ -0,0 +1,428 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_UTILS_HANDSHAKE_ARENA_HPP_INCLUDED
+#define GUARD_NET_CLIENT_UTILS_HANDSHAKE_ARENA_HPP_INCLUDED
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/asio/handler_invoke_hook.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/addressof.hpp>
+#include <cstddef>
+#include <new>
+
+namespace net
+{
+    namespace util
+    {
+        // Free list allocator for small, short lived blocks. Released blocks
+        // are kept for reuse (bounded per size class), so a steady stream of
+        // allocations of similar sizes stops hitting the global heap.
+        class arena_pool
+            : boost::noncopyable
+        {
+        public:
+            enum
+            {
+                SIZE_CLASSES    = 8,
+                MIN_BLOCK_SHIFT = 6,   // 64 bytes up to 8KiB
+                RETAIN_BLOCKS   = 128,
+                UNPOOLED        = SIZE_CLASSES
+            };
+
+            arena_pool()
+                : mutex_()
+            {
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    free_[cls]  = 0;
+                    count_[cls] = 0;
+                }
+            }
+
+            ~arena_pool()
+            {
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    while(free_[cls])
+                    {
+                        node * block = free_[cls];
+                        free_[cls] = block->next;
+                        ::operator delete(reinterpret_cast<header*>(block) - 1);
+                    }
+                }
+            }
+
+            void * allocate(std::size_t size)
+            {
+                std::size_t const cls = size_class(size);
+                if(cls != UNPOOLED)
+                {
+                    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                    if(free_[cls])
+                    {
+                        node * block = free_[cls];
+                        free_[cls] = block->next;
+                        --count_[cls];
+                        return block;
+                    }
+                }
+
+                header * h = static_cast<header*>(::operator new(sizeof(header) + (cls != UNPOOLED ? class_size(cls) : size)));
+                h->size_class = cls;
+                return h + 1;
+            }
+
+            void deallocate(void * pointer)
+            {
+                if(!pointer)
+                {
+                    return;
+                }
+
+                header * h = static_cast<header*>(pointer) - 1;
+                std::size_t const cls = h->size_class;
+                if(cls != UNPOOLED)
+                {
+                    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                    if(count_[cls] < RETAIN_BLOCKS)
+                    {
+                        node * block = static_cast<node*>(pointer);
+                        block->next = free_[cls];
+                        free_[cls] = block;
+                        ++count_[cls];
+                        return;
+                    }
+                }
+                ::operator delete(h);
+            }
+
+            static std::size_t class_size(std::size_t cls)
+            {
+                return std::size_t(1) << (MIN_BLOCK_SHIFT + cls);
+            }
+
+            static std::size_t size_class(std::size_t size)
+            {
+                for(std::size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+                {
+                    if(size <= class_size(cls))
+                    {
+                        return cls;
+                    }
+                }
+                return UNPOOLED;
+            }
+
+        private:
+            // Keeps the payload aligned like operator new would
+            union header
+            {
+                std::size_t size_class;
+                long double align_value;
+                void *      align_pointer;
+            };
+
+            struct node
+            {
+                node * next;
+            };
+
+        private:
+            boost::asio::detail::mutex  mutex_;
+            node *                      free_[SIZE_CLASSES];
+            std::size_t                 count_[SIZE_CLASSES];
+        };
+
+        typedef boost::shared_ptr<arena_pool> arena_pool_ptr;
+
+        // Standard allocator on top of an arena_pool, used for the control
+        // blocks of arena owned shared_ptrs. Keeps the pool alive.
+        template<typename T>
+        struct arena_allocator
+        {
+            typedef T                   value_type;
+            typedef T *                 pointer;
+            typedef T const *           const_pointer;
+            typedef T &                 reference;
+            typedef T const &           const_reference;
+            typedef std::size_t         size_type;
+            typedef std::ptrdiff_t      difference_type;
+
+            template<typename U>
+            struct rebind
+            {
+                typedef arena_allocator<U> other;
+            };
+
+            explicit arena_allocator(arena_pool_ptr pool)
+                : pool_(pool)
+            {}
+
+            template<typename U>
+            arena_allocator(arena_allocator<U> const & other)
+                : pool_(other.pool())
+            {}
+
+            pointer allocate(size_type n, void const * = 0)
+            {
+                return static_cast<pointer>(pool_->allocate(n * sizeof(T)));
+            }
+
+            void deallocate(pointer p, size_type)
+            {
+                pool_->deallocate(p);
+            }
+
+            void construct(pointer p, T const & value)
+            {
+                new (p) T(value);
+            }
+
+            void destroy(pointer p)
+            {
+                p->~T();
+            }
+
+            pointer address(reference r) const
+            {
+                return &r;
+            }
+
+            const_pointer address(const_reference r) const
+            {
+                return &r;
+            }
+
+            size_type max_size() const
+            {
+                return size_type(-1) / sizeof(T);
+            }
+
+            arena_pool_ptr pool() const
+            {
+                return pool_;
+            }
+
+            template<typename U>
+            bool operator==(arena_allocator<U> const & other) const
+            {
+                return pool_ == other.pool();
+            }
+
+            template<typename U>
+            bool operator!=(arena_allocator<U> const & other) const
+            {
+                return pool_ != other.pool();
+            }
+
+        private:
+            arena_pool_ptr pool_;
+        };
+
+        template<typename T>
+        struct arena_deleter
+        {
+            explicit arena_deleter(arena_pool_ptr pool)
+                : pool_(pool)
+            {}
+
+            void operator()(T * object) const
+            {
+                object->~T();
+                pool_->deallocate(object);
+            }
+
+        private:
+            arena_pool_ptr pool_;
+        };
+
+        // Routes asio's handler allocation hooks (the memory for pending
+        // operations) into an arena_pool.
+        // Handlers never outlive the io_service which owns the pool, so a plain
+        // pointer is enough here.
+        template<typename Handler>
+        struct arena_handler
+        {
+            arena_handler(arena_pool & pool, Handler const & handler)
+                : pool_(&pool)
+                , handler_(handler)
+            {}
+
+            void operator()()
+            {
+                handler_();
+            }
+
+            template<typename Arg1>
+            void operator()(Arg1 const & arg1)
+            {
+                handler_(arg1);
+            }
+
+            template<typename Arg1, typename Arg2>
+            void operator()(Arg1 const & arg1, Arg2 const & arg2)
+            {
+                handler_(arg1, arg2);
+            }
+
+            friend void * asio_handler_allocate(std::size_t size, arena_handler * this_handler)
+            {
+                return this_handler->pool_->allocate(size);
+            }
+
+            friend void asio_handler_deallocate(void * pointer, std::size_t, arena_handler * this_handler)
+            {
+                this_handler->pool_->deallocate(pointer);
+            }
+
+            // Keeps the invocation context of the wrapped handler, e.g. its strand
+            template<typename Function>
+            friend void asio_handler_invoke(Function const & function, arena_handler * this_handler)
+            {
+                using boost::asio::asio_handler_invoke;
+                asio_handler_invoke(function, boost::addressof(this_handler->handler_));
+            }
+
+        private:
+            arena_pool *    pool_;
+            Handler         handler_;
+        };
+
+        // One arena per io_service, shared by all proxies running on it.
+        // Obtain it with boost::asio::use_service< handshake_arena<Tag> >(service).
+        template<typename Tag>
+        class handshake_arena
+            : public boost::asio::io_service::service
+        {
+        public:
+            static boost::asio::io_service::id id;
+
+            explicit handshake_arena(boost::asio::io_service & service)
+                : boost::asio::io_service::service(service)
+                , pool_(new arena_pool())
+            {}
+
+            void shutdown_service()
+            {}
+
+            arena_pool_ptr pool() const
+            {
+                return pool_;
+            }
+
+            template<typename Handler>
+            arena_handler<Handler> wrap(Handler const & handler)
+            {
+                return arena_handler<Handler>(*pool_, handler);
+            }
+
+            template<typename T>
+            boost::shared_ptr<T> create()
+            {
+                void * memory = pool_->allocate(sizeof(T));
+                T * object = 0;
+                try
+                {
+                    object = new (memory) T();
+                }
+                catch(...)
+                {
+                    pool_->deallocate(memory);
+                    throw;
+                }
+                return adopt(object);
+            }
+
+            template<typename T, typename A1>
+            boost::shared_ptr<T> create(A1 & a1)
+            {
+                void * memory = pool_->allocate(sizeof(T));
+                T * object = 0;
+                try
+                {
+                    object = new (memory) T(a1);
+                }
+                catch(...)
+                {
+                    pool_->deallocate(memory);
+                    throw;
+                }
+                return adopt(object);
+            }
+
+            template<typename T, typename A1, typename A2>
+            boost::shared_ptr<T> create(A1 & a1, A2 & a2)
+            {
+                void * memory = pool_->allocate(sizeof(T));
+                T * object = 0;
+                try
+                {
+                    object = new (memory) T(a1, a2);
+                }
+                catch(...)
+                {
+                    pool_->deallocate(memory);
+                    throw;
+                }
+                return adopt(object);
+            }
+
+            template<typename T, typename A1, typename A2, typename A3>
+            boost::shared_ptr<T> create(A1 & a1, A2 & a2, A3 & a3)
+            {
+                void * memory = pool_->allocate(sizeof(T));
+                T * object = 0;
+                try
+                {
+                    object = new (memory) T(a1, a2, a3);
+                }
+                catch(...)
+                {
+                    pool_->deallocate(memory);
+                    throw;
+                }
+                return adopt(object);
+            }
+
+        protected:
+            template<typename T>
+            boost::shared_ptr<T> adopt(T * object)
+            {
+                return boost::shared_ptr<T>(object, arena_deleter<T>(pool_), arena_allocator<T>(pool_));
+            }
+
+        private:
+            arena_pool_ptr pool_;
+        };
+
+        template<typename Tag>
+        boost::asio::io_service::id handshake_arena<Tag>::id;
+    }
+}
+
+#endif //GUARD_NET_CLIENT_UTILS_HANDSHAKE_ARENA_HPP_INCLUDED
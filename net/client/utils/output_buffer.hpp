@@ -0,0 +1,397 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_CLIENT_UTILS_OUTPUT_BUFFER_HPP_INCLUDED
+#define GUARD_NET_CLIENT_UTILS_OUTPUT_BUFFER_HPP_INCLUDED
+
+#include <net/client/utils/buffer_pool.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/detail/socket_ops.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/array.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace net
+{
+    namespace util
+    {
+        // Append only output buffer for serializing protocol messages.
+        //
+        // The first InlineSize octets live inside the object, everything
+        // beyond goes into segments leased from the buffer_pool. The content
+        // is never moved or copied again: data() hands the segments to a
+        // gather write as a ConstBufferSequence.
+        // The sequences returned by data() are invalidated by clear().
+        template<std::size_t InlineSize>
+        class basic_output_buffer
+            : boost::noncopyable
+        {
+        public:
+            enum { SEGMENT_SIZE = 0x1000 };
+
+            // ConstBufferSequence over the octets [first, last) of the buffer
+            class const_buffers_type
+            {
+            public:
+                typedef boost::asio::const_buffer value_type;
+
+                class const_iterator
+                    : public boost::iterator_facade<
+                        const_iterator,
+                        boost::asio::const_buffer const,
+                        boost::bidirectional_traversal_tag,
+                        boost::asio::const_buffer
+                    >
+                {
+                public:
+                    const_iterator()
+                        : owner_(0)
+                        , first_(0)
+                        , last_(0)
+                        , index_(0)
+                        , offset_(0)
+                    {}
+
+                    const_iterator(basic_output_buffer const * owner, std::size_t first, std::size_t last, std::size_t index, std::size_t offset)
+                        : owner_(owner)
+                        , first_(first)
+                        , last_(last)
+                        , index_(index)
+                        , offset_(offset)
+                    {}
+
+                private:
+                    friend class boost::iterator_core_access;
+
+                    boost::asio::const_buffer dereference() const
+                    {
+                        std::size_t const begin = (std::max)(offset_, first_);
+                        std::size_t const end   = (std::min)(offset_ + owner_->segment_size(index_), last_);
+                        if(begin >= end)
+                        {
+                            return boost::asio::const_buffer();
+                        }
+                        return boost::asio::const_buffer(owner_->segment_data(index_) + (begin - offset_), end - begin);
+                    }
+
+                    bool equal(const_iterator const & other) const
+                    {
+                        return index_ == other.index_;
+                    }
+
+                    void increment()
+                    {
+                        offset_ += owner_->segment_size(index_);
+                        ++index_;
+                    }
+
+                    void decrement()
+                    {
+                        --index_;
+                        offset_ -= owner_->segment_size(index_);
+                    }
+
+                private:
+                    basic_output_buffer const * owner_;
+                    std::size_t first_;
+                    std::size_t last_;
+                    std::size_t index_;     // segment
+                    std::size_t offset_;    // of the segment within the buffer
+                };
+
+                const_buffers_type(basic_output_buffer const & owner, std::size_t first, std::size_t last)
+                    : owner_(&owner)
+                    , first_(first)
+                    , last_(last)
+                    , begin_index_(0)
+                    , begin_offset_(0)
+                    , end_index_(0)
+                    , end_offset_(0)
+                {
+                    if(first_ < last_)
+                    {
+                        owner_->locate(first_, begin_index_, begin_offset_);
+                        owner_->locate(last_ - 1, end_index_, end_offset_);
+                        end_offset_ += owner_->segment_size(end_index_);
+                        ++end_index_;
+                    }
+                    else
+                    {
+                        end_index_  = begin_index_;
+                        end_offset_ = begin_offset_;
+                    }
+                }
+
+                const_iterator begin() const
+                {
+                    return const_iterator(owner_, first_, last_, begin_index_, begin_offset_);
+                }
+
+                const_iterator end() const
+                {
+                    return const_iterator(owner_, first_, last_, end_index_, end_offset_);
+                }
+
+                std::size_t size() const
+                {
+                    return last_ - first_;
+                }
+
+            private:
+                basic_output_buffer const * owner_;
+                std::size_t first_;
+                std::size_t last_;
+                std::size_t begin_index_;
+                std::size_t begin_offset_;
+                std::size_t end_index_;
+                std::size_t end_offset_;
+            };
+
+            basic_output_buffer()
+                : inline_size_(0)
+                , size_(0)
+                , segments_()
+            {}
+
+            std::size_t size() const
+            {
+                return size_;
+            }
+
+            bool empty() const
+            {
+                return size_ == 0;
+            }
+
+            // Drops the content and returns the overflow segments to the pool
+            void clear()
+            {
+                inline_size_ = 0;
+                size_        = 0;
+                segments_.clear();
+            }
+
+            const_buffers_type data() const
+            {
+                return const_buffers_type(*this, 0, size_);
+            }
+
+            const_buffers_type data(std::size_t first, std::size_t last) const
+            {
+                return const_buffers_type(*this, first, (std::min)(last, size_));
+            }
+
+            // Contiguous room for size octets at the end, made part of the
+            // content by commit()
+            char * prepare(std::size_t size)
+            {
+                if(segments_.empty())
+                {
+                    if(InlineSize - inline_size_ >= size)
+                    {
+                        return inline_.data() + inline_size_;
+                    }
+                }
+                else
+                {
+                    segment & tail = segments_.back();
+                    if(tail.lease.size() - tail.size >= size)
+                    {
+                        return tail.lease.data() + tail.size;
+                    }
+                }
+
+                // The rest of the current segment stays unused
+                segments_.push_back(segment());
+                segments_.back().lease = lease_buffer((std::max)(size, std::size_t(SEGMENT_SIZE)));
+                return segments_.back().lease.data();
+            }
+
+            void commit(std::size_t size)
+            {
+                if(segments_.empty())
+                {
+                    inline_size_ += size;
+                }
+                else
+                {
+                    segments_.back().size += size;
+                }
+                size_ += size;
+            }
+
+            // Fills the current segment before starting the next one
+            basic_output_buffer & append(char const * data, std::size_t size)
+            {
+                while(size)
+                {
+                    std::size_t room = tail_room();
+                    char * out = 0;
+                    if(room)
+                    {
+                        out = prepare(room);
+                    }
+                    else
+                    {
+                        out  = prepare(SEGMENT_SIZE);
+                        room = tail_room();
+                    }
+                    std::size_t const chunk = (std::min)(room, size);
+                    std::memcpy(out, data, chunk);
+                    commit(chunk);
+                    data += chunk;
+                    size -= chunk;
+                }
+                return *this;
+            }
+
+            basic_output_buffer & operator<<(char const * text)
+            {
+                return append(text, std::strlen(text));
+            }
+
+            template<typename Char, typename Traits, typename Allocator>
+            basic_output_buffer & operator<<(std::basic_string<Char, Traits, Allocator> const & text)
+            {
+                return append(text.data(), text.size());
+            }
+
+            basic_output_buffer & operator<<(char c)
+            {
+                *prepare(1) = c;
+                commit(1);
+                return *this;
+            }
+
+            // Decimal
+            basic_output_buffer & operator<<(unsigned long value)
+            {
+                char digits[20];
+                std::size_t count = 0;
+                do
+                {
+                    digits[count++] = static_cast<char>('0' + value % 10);
+                    value /= 10;
+                }
+                while(value);
+
+                char * out = prepare(count);
+                std::reverse_copy(digits, digits + count, out);
+                commit(count);
+                return *this;
+            }
+
+            basic_output_buffer & operator<<(unsigned int value)
+            {
+                return *this << static_cast<unsigned long>(value);
+            }
+
+            basic_output_buffer & operator<<(unsigned short value)
+            {
+                return *this << static_cast<unsigned long>(value);
+            }
+
+            // Textual form of the address, formatted in place
+            basic_output_buffer & operator<<(boost::asio::ip::address const & address)
+            {
+                enum { MAX_ADDRESS_LENGTH = 64 };
+                char * out = prepare(MAX_ADDRESS_LENGTH);
+                boost::system::error_code ec;
+                if(address.is_v4())
+                {
+                    boost::asio::ip::address_v4::bytes_type const bytes = address.to_v4().to_bytes();
+                    boost::asio::detail::socket_ops::inet_ntop(AF_INET, bytes.data(), out, MAX_ADDRESS_LENGTH, 0, ec);
+                }
+                else
+                {
+                    boost::asio::ip::address_v6 const v6 = address.to_v6();
+                    boost::asio::ip::address_v6::bytes_type const bytes = v6.to_bytes();
+                    boost::asio::detail::socket_ops::inet_ntop(AF_INET6, bytes.data(), out, MAX_ADDRESS_LENGTH, v6.scope_id(), ec);
+                }
+                commit(ec ? 0 : std::strlen(out));
+                return *this;
+            }
+
+        private:
+            friend class const_buffers_type;
+            friend class const_buffers_type::const_iterator;
+
+            struct segment
+            {
+                segment()
+                    : lease()
+                    , size(0)
+                {}
+
+                buffer_lease    lease;
+                std::size_t     size;
+            };
+
+            // Segment 0 is the inline storage
+            char const * segment_data(std::size_t index) const
+            {
+                return index ? segments_[index - 1].lease.data() : inline_.data();
+            }
+
+            std::size_t segment_size(std::size_t index) const
+            {
+                return index ? segments_[index - 1].size : inline_size_;
+            }
+
+            std::size_t tail_room() const
+            {
+                return segments_.empty()
+                    ? InlineSize - inline_size_
+                    : segments_.back().lease.size() - segments_.back().size;
+            }
+
+            // Segment holding the octet at offset and where that segment starts
+            void locate(std::size_t offset, std::size_t & index, std::size_t & segment_offset) const
+            {
+                index           = 0;
+                segment_offset  = 0;
+                while(index < segments_.size() && offset >= segment_offset + segment_size(index))
+                {
+                    segment_offset += segment_size(index);
+                    ++index;
+                }
+            }
+
+        private:
+            boost::array<char, InlineSize>  inline_;
+            std::size_t                     inline_size_;
+            std::size_t                     size_;
+            std::vector<segment>            segments_;
+        };
+
+        typedef basic_output_buffer<256> output_buffer;
+    }
+}
+
+#endif //GUARD_NET_CLIENT_UTILS_OUTPUT_BUFFER_HPP_INCLUDED
@@ -0,0 +1,132 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_DETAIL_BYTE_ORDER_HPP_INCLUDED
+#define GUARD_NET_DETAIL_BYTE_ORDER_HPP_INCLUDED
+
+#include <boost/detail/endian.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <cstddef>
+
+#if defined(_MSC_VER)
+#    include <stdlib.h>
+#endif
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+#    define NETPP_HAS_BUILTIN_BSWAP 1
+#endif
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#    define NETPP_HAS_BUILTIN_BSWAP16 1
+#endif
+
+#if !defined(BOOST_LITTLE_ENDIAN) && !defined(BOOST_BIG_ENDIAN)
+#    error Platform not supported
+#endif
+
+namespace net
+{
+    namespace detail
+    {
+        inline boost::uint16_t byteswap(boost::uint16_t v)
+        {
+#if defined(NETPP_HAS_BUILTIN_BSWAP16)
+            return __builtin_bswap16(v);
+#elif defined(_MSC_VER)
+            return _byteswap_ushort(v);
+#else
+            return static_cast<boost::uint16_t>((v << 8) | (v >> 8));
+#endif
+        }
+
+        inline boost::uint32_t byteswap(boost::uint32_t v)
+        {
+#if defined(NETPP_HAS_BUILTIN_BSWAP)
+            return __builtin_bswap32(v);
+#elif defined(_MSC_VER)
+            return _byteswap_ulong(v);
+#else
+            return (v << 24)
+                | ((v << 8) & 0x00FF0000U)
+                | ((v >> 8) & 0x0000FF00U)
+                |  (v >> 24);
+#endif
+        }
+
+        inline boost::uint64_t byteswap(boost::uint64_t v)
+        {
+#if defined(NETPP_HAS_BUILTIN_BSWAP)
+            return __builtin_bswap64(v);
+#elif defined(_MSC_VER)
+            return _byteswap_uint64(v);
+#else
+            return (boost::uint64_t(byteswap(boost::uint32_t(v))) << 32)
+                | byteswap(boost::uint32_t(v >> 32));
+#endif
+        }
+
+        // Unsigned integer of the same width, the swap works on those
+        template<std::size_t Size>
+        struct uint_of_size;
+
+        template<> struct uint_of_size<1> { typedef boost::uint8_t  type; };
+        template<> struct uint_of_size<2> { typedef boost::uint16_t type; };
+        template<> struct uint_of_size<4> { typedef boost::uint32_t type; };
+        template<> struct uint_of_size<8> { typedef boost::uint64_t type; };
+
+        inline boost::uint8_t byteswap(boost::uint8_t v)
+        {
+            return v;
+        }
+
+        // Converts integers between host and network (big endian) order,
+        // anything else is left alone. The conversion is its own inverse.
+        template<typename T>
+        inline T network_order(T value, boost::true_type)
+        {
+#ifdef BOOST_LITTLE_ENDIAN
+            typedef typename uint_of_size<sizeof(T)>::type unsigned_type;
+            return static_cast<T>(byteswap(static_cast<unsigned_type>(value)));
+#else
+            return value;
+#endif
+        }
+
+        template<typename T>
+        inline T const & network_order(T const & value, boost::false_type)
+        {
+            return value;
+        }
+
+        template<typename T>
+        inline T network_order(T value)
+        {
+            return network_order(value, boost::is_integral<T>());
+        }
+    }
+}
+
+#endif //GUARD_NET_DETAIL_BYTE_ORDER_HPP_INCLUDED
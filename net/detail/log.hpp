@@ -0,0 +1,447 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_DETAIL_LOG_HPP_INCLUDED
+#define GUARD_NET_DETAIL_LOG_HPP_INCLUDED
+
+#include <boost/asio/detail/event.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/asio/detail/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Library diagnostics.
+//
+// Log statements below NETPP_LOG_LEVEL are removed by the preprocessor, the
+// remaining ones cost a load and a compare unless a sink is installed with
+// net::log::set_sink. Nothing is logged by default.
+//
+//   NETPP_LOG_DEBUG("socks5", "reply " << net::log::hex(data, size));
+
+#define NETPP_LOG_LEVEL_TRACE   0
+#define NETPP_LOG_LEVEL_DEBUG   1
+#define NETPP_LOG_LEVEL_INFO    2
+#define NETPP_LOG_LEVEL_WARNING 3
+#define NETPP_LOG_LEVEL_ERROR   4
+#define NETPP_LOG_LEVEL_NONE    5
+
+#ifndef NETPP_LOG_LEVEL
+#    ifdef NDEBUG
+#        define NETPP_LOG_LEVEL NETPP_LOG_LEVEL_WARNING
+#    else
+#        define NETPP_LOG_LEVEL NETPP_LOG_LEVEL_DEBUG
+#    endif
+#endif
+
+namespace net
+{
+    namespace log
+    {
+        enum level
+        {
+            trace   = NETPP_LOG_LEVEL_TRACE,
+            debug   = NETPP_LOG_LEVEL_DEBUG,
+            info    = NETPP_LOG_LEVEL_INFO,
+            warning = NETPP_LOG_LEVEL_WARNING,
+            error   = NETPP_LOG_LEVEL_ERROR,
+            none    = NETPP_LOG_LEVEL_NONE
+        };
+
+        inline char const * level_name(level severity)
+        {
+            switch(severity)
+            {
+            case trace:     return "trace";
+            case debug:     return "debug";
+            case info:      return "info";
+            case warning:   return "warning";
+            case error:     return "error";
+            default:        return "none";
+            }
+        }
+
+        struct record
+        {
+            record()
+                : severity(none)
+                , component("")
+                , file("")
+                , line(0)
+                , time()
+                , message()
+            {}
+
+            record(level severity, char const * component, char const * file, int line)
+                : severity(severity)
+                , component(component)
+                , file(file)
+                , line(line)
+                , time(boost::posix_time::microsec_clock::universal_time())
+                , message()
+            {}
+
+            void swap(record & other)
+            {
+                std::swap(severity, other.severity);
+                std::swap(component, other.component);
+                std::swap(file, other.file);
+                std::swap(line, other.line);
+                std::swap(time, other.time);
+                message.swap(other.message);
+            }
+
+            level                       severity;
+            char const *                component;  // string literals only
+            char const *                file;
+            int                         line;
+            boost::posix_time::ptime    time;
+            std::string                 message;
+        };
+
+        struct sink
+        {
+            virtual ~sink()
+            {}
+
+            // Called concurrently from any thread writing a log record
+            virtual void write(record const & rec) = 0;
+        };
+
+        typedef boost::shared_ptr<sink> sink_ptr;
+
+        // One line per record on a std::ostream
+        class ostream_sink
+            : public sink
+            , boost::noncopyable
+        {
+        public:
+            explicit ostream_sink(std::ostream & out)
+                : out_(out)
+                , mutex_()
+            {}
+
+            virtual void write(record const & rec)
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                out_ << boost::posix_time::to_iso_extended_string(rec.time)
+                     << " [" << level_name(rec.severity) << "] "
+                     << rec.component << ": " << rec.message << '\n';
+                out_.flush();
+            }
+
+        private:
+            std::ostream &              out_;
+            boost::asio::detail::mutex  mutex_;
+        };
+
+        // Hands records over to a background thread which writes them to the
+        // target sink, so the logging thread never waits for the output.
+        // The ring holds capacity records; records arriving while it is full
+        // are dropped and counted. Slots are reused, so their message storage
+        // is only allocated while the ring fills up for the first time.
+        class async_sink
+            : public sink
+            , boost::noncopyable
+        {
+        public:
+            explicit async_sink(sink_ptr target, std::size_t capacity = 1024)
+                : target_(target)
+                , ring_(capacity ? capacity : 1)
+                , head_(0)
+                , count_(0)
+                , dropped_(0)
+                , stopped_(false)
+                , mutex_()
+                , event_()
+                , thread_(0)
+            {
+                thread_ = new boost::asio::detail::thread(runner(this));
+            }
+
+            ~async_sink()
+            {
+                stop();
+            }
+
+            virtual void write(record const & rec)
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                if(stopped_ || count_ == ring_.size())
+                {
+                    ++dropped_;
+                    return;
+                }
+
+                record & slot = ring_[(head_ + count_) % ring_.size()];
+                slot.severity  = rec.severity;
+                slot.component = rec.component;
+                slot.file      = rec.file;
+                slot.line      = rec.line;
+                slot.time      = rec.time;
+                slot.message.assign(rec.message);
+                ++count_;
+                event_.signal(lock);
+            }
+
+            std::size_t dropped() const
+            {
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                return dropped_;
+            }
+
+            // Writes the queued records and ends the background thread,
+            // later records are dropped
+            void stop()
+            {
+                {
+                    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                    if(!thread_)
+                    {
+                        return;
+                    }
+                    stopped_ = true;
+                    event_.signal(lock);
+                }
+                thread_->join();
+                delete thread_;
+                thread_ = 0;
+            }
+
+        private:
+            struct runner
+            {
+                explicit runner(async_sink * self)
+                    : self(self)
+                {}
+
+                void operator()()
+                {
+                    self->run();
+                }
+
+                async_sink * self;
+            };
+
+            void run()
+            {
+                record current;
+                boost::asio::detail::mutex::scoped_lock lock(mutex_);
+                for(;;)
+                {
+                    if(count_ == 0)
+                    {
+                        if(stopped_)
+                        {
+                            break;
+                        }
+                        event_.clear(lock);
+                        event_.wait(lock);
+                        continue;
+                    }
+
+                    // Swapping keeps the message buffers in circulation
+                    current.swap(ring_[head_]);
+                    head_ = (head_ + 1) % ring_.size();
+                    --count_;
+
+                    lock.unlock();
+                    target_->write(current);
+                    lock.lock();
+                }
+            }
+
+        private:
+            sink_ptr                            target_;
+            std::vector<record>                 ring_;
+            std::size_t                         head_;
+            std::size_t                         count_;
+            std::size_t                         dropped_;
+            bool                                stopped_;
+            mutable boost::asio::detail::mutex  mutex_;
+            boost::asio::detail::event          event_;
+            boost::asio::detail::thread *       thread_;
+        };
+
+        namespace detail
+        {
+            struct logger
+            {
+                logger()
+                    : mutex_()
+                    , sink_()
+                    , threshold_(none)
+                {}
+
+                // atomic_count only steps by one, callers hold mutex_ so the
+                // stores don't interleave
+                void set_threshold(level threshold)
+                {
+                    while(threshold_ < threshold)
+                    {
+                        ++threshold_;
+                    }
+                    while(threshold_ > threshold)
+                    {
+                        --threshold_;
+                    }
+                }
+
+                boost::asio::detail::mutex  mutex_;
+                sink_ptr                    sink_;
+                boost::detail::atomic_count threshold_;
+            };
+
+            inline logger & instance()
+            {
+                static logger state;
+                return state;
+            }
+        }
+
+        // Installs the sink for all library diagnostics, an empty pointer
+        // turns logging off. threshold is the lowest runtime level passed on,
+        // NETPP_LOG_LEVEL still limits what is compiled in.
+        inline void set_sink(sink_ptr target, level threshold = trace)
+        {
+            detail::logger & state = detail::instance();
+            boost::asio::detail::mutex::scoped_lock lock(state.mutex_);
+            state.sink_ = target;
+            state.set_threshold(target ? threshold : none);
+        }
+
+        inline sink_ptr get_sink()
+        {
+            detail::logger & state = detail::instance();
+            boost::asio::detail::mutex::scoped_lock lock(state.mutex_);
+            return state.sink_;
+        }
+
+        inline bool enabled(level severity)
+        {
+            return severity >= detail::instance().threshold_;
+        }
+
+        inline void write(record const & rec)
+        {
+            if(!enabled(rec.severity))
+            {
+                return;
+            }
+            sink_ptr target = get_sink();
+            if(target)
+            {
+                target->write(rec);
+            }
+        }
+
+        // Streams a byte range as hex pairs
+        struct hex
+        {
+            hex(void const * data, std::size_t size)
+                : data(static_cast<unsigned char const *>(data))
+                , size(size)
+            {}
+
+            unsigned char const *   data;
+            std::size_t             size;
+        };
+
+        inline std::ostream & operator<<(std::ostream & out, hex const & bytes)
+        {
+            static char const digits[] = "0123456789ABCDEF";
+            for(std::size_t i = 0; i < bytes.size; ++i)
+            {
+                char pair[3] = { ' ', digits[bytes.data[i] >> 4], digits[bytes.data[i] & 0x0F] };
+                out.write(pair, 3);
+            }
+            return out;
+        }
+    }
+}
+
+#define NETPP_LOG(severity_, component_, message_)                                      \
+    do                                                                                  \
+    {                                                                                   \
+        if(::net::log::enabled(severity_))                                              \
+        {                                                                               \
+            ::net::log::record netpp_log_record_(severity_, component_, __FILE__, __LINE__);\
+            std::ostringstream netpp_log_stream_;                                       \
+            netpp_log_stream_ << message_;                                              \
+            netpp_log_record_.message = netpp_log_stream_.str();                        \
+            ::net::log::write(netpp_log_record_);                                       \
+        }                                                                               \
+    }                                                                                   \
+    while(false)
+
+// Compiled but never run, so the arguments still count as used
+#define NETPP_LOG_DISABLED(component_, message_)                                        \
+    do                                                                                  \
+    {                                                                                   \
+        if(false)                                                                       \
+        {                                                                               \
+            std::ostringstream netpp_log_stream_;                                       \
+            netpp_log_stream_ << component_ << message_;                                \
+        }                                                                               \
+    }                                                                                   \
+    while(false)
+
+#if NETPP_LOG_LEVEL <= NETPP_LOG_LEVEL_TRACE
+#    define NETPP_LOG_TRACE(component_, message_) NETPP_LOG(::net::log::trace, component_, message_)
+#else
+#    define NETPP_LOG_TRACE(component_, message_) NETPP_LOG_DISABLED(component_, message_)
+#endif
+
+#if NETPP_LOG_LEVEL <= NETPP_LOG_LEVEL_DEBUG
+#    define NETPP_LOG_DEBUG(component_, message_) NETPP_LOG(::net::log::debug, component_, message_)
+#else
+#    define NETPP_LOG_DEBUG(component_, message_) NETPP_LOG_DISABLED(component_, message_)
+#endif
+
+#if NETPP_LOG_LEVEL <= NETPP_LOG_LEVEL_INFO
+#    define NETPP_LOG_INFO(component_, message_) NETPP_LOG(::net::log::info, component_, message_)
+#else
+#    define NETPP_LOG_INFO(component_, message_) NETPP_LOG_DISABLED(component_, message_)
+#endif
+
+#if NETPP_LOG_LEVEL <= NETPP_LOG_LEVEL_WARNING
+#    define NETPP_LOG_WARNING(component_, message_) NETPP_LOG(::net::log::warning, component_, message_)
+#else
+#    define NETPP_LOG_WARNING(component_, message_) NETPP_LOG_DISABLED(component_, message_)
+#endif
+
+#if NETPP_LOG_LEVEL <= NETPP_LOG_LEVEL_ERROR
+#    define NETPP_LOG_ERROR(component_, message_) NETPP_LOG(::net::log::error, component_, message_)
+#else
+#    define NETPP_LOG_ERROR(component_, message_) NETPP_LOG_DISABLED(component_, message_)
+#endif
+
+#endif //GUARD_NET_DETAIL_LOG_HPP_INCLUDED
@@ -23,18 +23,347 @@
 * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 * POSSIBILITY OF SUCH DAMAGE.
 */
-#ifndef GUARD_NET_CLIENT_PROXY_SOCKS4_HPP_INCLUDED
-#define GUARD_NET_CLIENT_PROXY_SOCKS4_HPP_INCLUDED
+#ifndef GUARD_NET_ERROR_HPP_INCLUDED
+#define GUARD_NET_ERROR_HPP_INCLUDED
 
 #include <boost/system/error_code.hpp>
+#include <string>
+
+// error_category's virtuals became noexcept in later Boost versions
+#ifdef BOOST_SYSTEM_NOEXCEPT
+#    define NETPP_ERROR_NOEXCEPT BOOST_SYSTEM_NOEXCEPT
+#else
+#    define NETPP_ERROR_NOEXCEPT
+#endif
 
 namespace net
 {
     namespace error
     {
-        namespace code
+        enum proxy_errors
+        {
+            // The proxy's reply could not be parsed
+            proxy_protocol_error = 1,
+
+            // The reply header doesn't fit into the handshake buffer
+            proxy_reply_too_large,
+
+            // The request for the target can't be encoded
+            proxy_request_too_large,
+
+            // The proxy requires credentials, none are configured
+            proxy_authentication_required,
+
+            // The proxy rejected the configured credentials
+            proxy_authentication_failed,
+
+            // The proxy does not allow connections to the target
+            proxy_forbidden,
+
+            // The proxy failed to connect to the target
+            proxy_bad_gateway,
+
+            // The proxy timed out connecting to the target
+            proxy_gateway_timeout,
+
+            // Any other refusal of the proxy
+            proxy_connect_refused,
+
+            // Every proxy of a failover list is failing
+            proxy_unavailable
+        };
+
+        namespace detail
+        {
+            class proxy_category
+                : public boost::system::error_category
+            {
+            public:
+                const char * name() const NETPP_ERROR_NOEXCEPT
+                {
+                    return "net.proxy";
+                }
+
+                std::string message(int value) const
+                {
+                    switch(value)
+                    {
+                    case proxy_protocol_error:
+                        return "Invalid reply from the proxy";
+                    case proxy_reply_too_large:
+                        return "Proxy reply too large";
+                    case proxy_request_too_large:
+                        return "Proxy request too large";
+                    case proxy_authentication_required:
+                        return "Proxy authentication required";
+                    case proxy_authentication_failed:
+                        return "Proxy authentication failed";
+                    case proxy_forbidden:
+                        return "Connection forbidden by the proxy";
+                    case proxy_bad_gateway:
+                        return "Proxy failed to connect to the target";
+                    case proxy_gateway_timeout:
+                        return "Proxy timed out connecting to the target";
+                    case proxy_connect_refused:
+                        return "Connection refused by the proxy";
+                    case proxy_unavailable:
+                        return "No proxy available";
+                    default:
+                        return "net.proxy error";
+                    }
+                }
+            };
+        }
+
+        inline boost::system::error_category const & get_proxy_category()
         {
+            static detail::proxy_category instance;
+            return instance;
+        }
 
+        inline boost::system::error_code make_error_code(proxy_errors e)
+        {
+            return boost::system::error_code(static_cast<int>(e), get_proxy_category());
+        }
+
+        enum http_errors
+        {
+            // The response could not be parsed
+            http_protocol_error = 1,
+
+            // The response header exceeds the parser's limit
+            http_header_too_large,
+
+            // The URL is malformed or its scheme is not supported
+            http_invalid_url,
+
+            // A redirect was received after the configured number of redirects
+            http_too_many_redirects,
+
+            // The connection was closed before the response was complete
+            http_connection_closed,
+
+            // The body could not be decoded as its Content-Encoding says
+            http_content_encoding_error,
+
+            // The decoded body grew beyond the allowed ratio to its encoded size
+            http_content_ratio_exceeded,
+
+            // A request body source delivered more or less than its size
+            http_body_size_mismatch,
+
+            // A download could not be continued where it broke off
+            http_resume_failed
+        };
+
+        namespace detail
+        {
+            class http_category
+                : public boost::system::error_category
+            {
+            public:
+                const char * name() const NETPP_ERROR_NOEXCEPT
+                {
+                    return "net.http";
+                }
+
+                std::string message(int value) const
+                {
+                    switch(value)
+                    {
+                    case http_protocol_error:
+                        return "Invalid HTTP response";
+                    case http_header_too_large:
+                        return "HTTP response header too large";
+                    case http_invalid_url:
+                        return "Invalid or unsupported URL";
+                    case http_too_many_redirects:
+                        return "Too many redirects";
+                    case http_connection_closed:
+                        return "Connection closed before the response was complete";
+                    case http_content_encoding_error:
+                        return "Malformed or truncated content encoding";
+                    case http_content_ratio_exceeded:
+                        return "Content expands beyond the allowed compression ratio";
+                    case http_body_size_mismatch:
+                        return "Request body differs from its announced size";
+                    case http_resume_failed:
+                        return "Download could not be resumed";
+                    default:
+                        return "net.http error";
+                    }
+                }
+            };
+        }
+
+        inline boost::system::error_category const & get_http_category()
+        {
+            static detail::http_category instance;
+            return instance;
+        }
+
+        inline boost::system::error_code make_error_code(http_errors e)
+        {
+            return boost::system::error_code(static_cast<int>(e), get_http_category());
+        }
+
+        enum tls_errors
+        {
+            // The peer sent a fatal alert on a kernel TLS connection
+            tls_alert_received = 1,
+
+            // A record the kernel TLS record layer can't process, e.g. a
+            // renegotiation request
+            tls_unexpected_record
+        };
+
+        namespace detail
+        {
+            class tls_category
+                : public boost::system::error_category
+            {
+            public:
+                const char * name() const NETPP_ERROR_NOEXCEPT
+                {
+                    return "net.tls";
+                }
+
+                std::string message(int value) const
+                {
+                    switch(value)
+                    {
+                    case tls_alert_received:
+                        return "TLS alert received";
+                    case tls_unexpected_record:
+                        return "Unexpected TLS record on a kernel TLS connection";
+                    default:
+                        return "net.tls error";
+                    }
+                }
+            };
+        }
+
+        inline boost::system::error_category const & get_tls_category()
+        {
+            static detail::tls_category instance;
+            return instance;
+        }
+
+        inline boost::system::error_code make_error_code(tls_errors e)
+        {
+            return boost::system::error_code(static_cast<int>(e), get_tls_category());
+        }
+
+        // HTTP/2 error codes (RFC 7540, 7), the values are the ones on the
+        // wire. NO_ERROR has no counterpart, it is not an error.
+        enum http2_errors
+        {
+            http2_protocol_error = 1,
+            http2_internal_error,
+            http2_flow_control_error,
+            http2_settings_timeout,
+            http2_stream_closed,
+            http2_frame_size_error,
+
+            // The stream was not processed, it can be sent again
+            http2_refused_stream,
+            http2_cancel,
+            http2_compression_error,
+            http2_connect_error,
+            http2_enhance_your_calm,
+            http2_inadequate_security,
+            http2_http_1_1_required
+        };
+
+        namespace detail
+        {
+            class http2_category
+                : public boost::system::error_category
+            {
+            public:
+                const char * name() const NETPP_ERROR_NOEXCEPT
+                {
+                    return "net.http2";
+                }
+
+                std::string message(int value) const
+                {
+                    switch(value)
+                    {
+                    case http2_protocol_error:
+                        return "HTTP/2 protocol error";
+                    case http2_internal_error:
+                        return "HTTP/2 internal error";
+                    case http2_flow_control_error:
+                        return "HTTP/2 flow control error";
+                    case http2_settings_timeout:
+                        return "HTTP/2 settings not acknowledged";
+                    case http2_stream_closed:
+                        return "HTTP/2 frame received on a closed stream";
+                    case http2_frame_size_error:
+                        return "HTTP/2 frame size error";
+                    case http2_refused_stream:
+                        return "HTTP/2 stream refused";
+                    case http2_cancel:
+                        return "HTTP/2 stream cancelled";
+                    case http2_compression_error:
+                        return "HTTP/2 header compression error";
+                    case http2_connect_error:
+                        return "HTTP/2 CONNECT tunnel failed";
+                    case http2_enhance_your_calm:
+                        return "HTTP/2 peer reports excessive load";
+                    case http2_inadequate_security:
+                        return "HTTP/2 inadequate transport security";
+                    case http2_http_1_1_required:
+                        return "HTTP/1.1 required";
+                    default:
+                        return "net.http2 error";
+                    }
+                }
+            };
+        }
+
+        inline boost::system::error_category const & get_http2_category()
+        {
+            static detail::http2_category instance;
+            return instance;
+        }
+
+        inline boost::system::error_code make_error_code(http2_errors e)
+        {
+            return boost::system::error_code(static_cast<int>(e), get_http2_category());
         }
     }
 }
+
+namespace boost
+{
+    namespace system
+    {
+        template<>
+        struct is_error_code_enum<net::error::proxy_errors>
+        {
+            static const bool value = true;
+        };
+
+        template<>
+        struct is_error_code_enum<net::error::http_errors>
+        {
+            static const bool value = true;
+        };
+
+        template<>
+        struct is_error_code_enum<net::error::http2_errors>
+        {
+            static const bool value = true;
+        };
+
+        template<>
+        struct is_error_code_enum<net::error::tls_errors>
+        {
+            static const bool value = true;
+        };
+    }
+}
+
+#endif //GUARD_NET_ERROR_HPP_INCLUDED
@@ -38,10 +38,12 @@ namespace net
         class basic_message : public net::basic_message<Tag>
         {
             typedef net::basic_message<Tag> base_type;
+        public:
             typedef typename string_traits<Tag>::type string_type;
             typedef std::pair<boost::uint8_t, boost::uint8_t> version_type;
             typedef boost::uint16_t status_code_type;
 
+        private:
             boost::uint16_t status_code_;
             version_type version_;
             string_type status_msg_;
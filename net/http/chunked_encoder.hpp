@@ -0,0 +1,308 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_CHUNKED_ENCODER_HPP_INCLUDED
+#define GUARD_NET_HTTP_CHUNKED_ENCODER_HPP_INCLUDED
+
+#include <net/http/detail/traits.hpp>
+#include <boost/asio/buffer.hpp>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+namespace net
+{
+    namespace http
+    {
+        // The size line in front of a chunk: hex size and CRLF
+        class chunk_head
+        {
+        public:
+            enum { MAX_SIZE = 2 * sizeof(std::size_t) + 2 };
+
+            chunk_head()
+                : size_(0)
+            {}
+
+            explicit chunk_head(std::size_t chunk_size)
+                : size_(0)
+            {
+                assign(chunk_size);
+            }
+
+            void assign(std::size_t chunk_size)
+            {
+                static char const digits[] = "0123456789abcdef";
+                char line[MAX_SIZE];
+                std::size_t begin = MAX_SIZE - 2;
+                line[begin]     = '\r';
+                line[begin + 1] = '\n';
+                do
+                {
+                    line[--begin] = digits[chunk_size & 0xf];
+                    chunk_size >>= 4;
+                }
+                while(chunk_size);
+                size_ = MAX_SIZE - begin;
+                std::memcpy(text_, line + begin, size_);
+            }
+
+            boost::asio::const_buffer buffer() const
+            {
+                return boost::asio::const_buffer(text_, size_);
+            }
+
+        private:
+            char        text_[MAX_SIZE];
+            std::size_t size_;
+        };
+
+        // One chunk of a chunked body (RFC 7230, 4.1) over the caller's data,
+        // as a buffer sequence of the size line, the data's own buffers and
+        // the closing CRLF. Nothing is copied: like the data, the head the
+        // size line is formatted into has to stay valid until the chunk was
+        // written. Empty data gives an empty sequence, as a chunk of size 0
+        // would end the body; see basic_last_chunk for that.
+        template<typename ConstBufferSequence>
+        class chunk_buffers
+        {
+        public:
+            typedef boost::asio::const_buffer value_type;
+
+            class const_iterator
+            {
+            public:
+                typedef std::bidirectional_iterator_tag     iterator_category;
+                typedef boost::asio::const_buffer           value_type;
+                typedef std::ptrdiff_t                      difference_type;
+                typedef value_type const *                  pointer;
+                typedef value_type                          reference;
+
+                const_iterator()
+                    : owner_(0)
+                    , part_(END)
+                    , data_()
+                {}
+
+                reference operator*() const
+                {
+                    switch(part_)
+                    {
+                    case HEAD:
+                        return owner_->head_;
+                    case DATA:
+                        return boost::asio::const_buffer(*data_);
+                    default:
+                        return boost::asio::const_buffer("\r\n", 2);
+                    }
+                }
+
+                const_iterator & operator++()
+                {
+                    switch(part_)
+                    {
+                    case HEAD:
+                        data_ = owner_->data_.begin();
+                        part_ = data_ != owner_->data_.end() ? DATA : TAIL;
+                        break;
+                    case DATA:
+                        if(++data_ == owner_->data_.end())
+                        {
+                            part_ = TAIL;
+                        }
+                        break;
+                    default:
+                        part_ = END;
+                        break;
+                    }
+                    return *this;
+                }
+
+                const_iterator operator++(int)
+                {
+                    const_iterator previous(*this);
+                    ++*this;
+                    return previous;
+                }
+
+                const_iterator & operator--()
+                {
+                    switch(part_)
+                    {
+                    case END:
+                        part_ = TAIL;
+                        break;
+                    case TAIL:
+                        data_ = owner_->data_.end();
+                        if(data_ != owner_->data_.begin())
+                        {
+                            --data_;
+                            part_ = DATA;
+                        }
+                        else
+                        {
+                            part_ = HEAD;
+                        }
+                        break;
+                    default:
+                        if(data_ == owner_->data_.begin())
+                        {
+                            part_ = HEAD;
+                        }
+                        else
+                        {
+                            --data_;
+                        }
+                        break;
+                    }
+                    return *this;
+                }
+
+                const_iterator operator--(int)
+                {
+                    const_iterator previous(*this);
+                    --*this;
+                    return previous;
+                }
+
+                bool operator==(const_iterator const & other) const
+                {
+                    return owner_ == other.owner_ && part_ == other.part_ && (part_ != DATA || data_ == other.data_);
+                }
+
+                bool operator!=(const_iterator const & other) const
+                {
+                    return !(*this == other);
+                }
+
+            private:
+                friend class chunk_buffers;
+
+                enum part
+                {
+                    HEAD,
+                    DATA,
+                    TAIL,
+                    END
+                };
+
+                typedef typename ConstBufferSequence::const_iterator data_iterator;
+
+                const_iterator(chunk_buffers const * owner, part at)
+                    : owner_(owner)
+                    , part_(at)
+                    , data_()
+                {}
+
+            private:
+                chunk_buffers const *   owner_;
+                part                    part_;
+                data_iterator           data_;
+            };
+
+            chunk_buffers(chunk_head & head, ConstBufferSequence const & data)
+                : data_(data)
+                , size_(0)
+                , head_()
+            {
+                typename ConstBufferSequence::const_iterator it = data_.begin();
+                for(; it != data_.end(); ++it)
+                {
+                    size_ += boost::asio::buffer_size(boost::asio::const_buffer(*it));
+                }
+                head.assign(size_);
+                head_ = head.buffer();
+            }
+
+            // Bytes of data, without the framing
+            std::size_t size() const
+            {
+                return size_;
+            }
+
+            const_iterator begin() const
+            {
+                return const_iterator(this, size_ ? const_iterator::HEAD : const_iterator::END);
+            }
+
+            const_iterator end() const
+            {
+                return const_iterator(this, const_iterator::END);
+            }
+
+        private:
+            friend class const_iterator;
+
+            ConstBufferSequence         data_;
+            std::size_t                 size_;
+            boost::asio::const_buffer   head_;
+        };
+
+        template<typename ConstBufferSequence>
+        chunk_buffers<ConstBufferSequence> make_chunk(chunk_head & head, ConstBufferSequence const & data)
+        {
+            return chunk_buffers<ConstBufferSequence>(head, data);
+        }
+
+        // The chunk of size 0 which ends a chunked body, with trailer fields
+        //   0 CRLF *(name: value CRLF) CRLF
+        template<typename Tag>
+        class basic_last_chunk
+        {
+        public:
+            typedef typename string_traits<Tag>::type               string_type;
+            typedef typename header_collection_traits<Tag>::type    headers_type;
+
+            basic_last_chunk()
+                : text_("0\r\n\r\n")
+            {}
+
+            // Fields are pairs of name and value, like headers_type
+            template<typename Fields>
+            explicit basic_last_chunk(Fields const & trailers)
+                : text_("0\r\n")
+            {
+                for(typename Fields::const_iterator it = trailers.begin(); it != trailers.end(); ++it)
+                {
+                    text_ += it->first;
+                    text_ += ": ";
+                    text_ += it->second;
+                    text_ += "\r\n";
+                }
+                text_ += "\r\n";
+            }
+
+            boost::asio::const_buffers_1 buffers() const
+            {
+                return boost::asio::buffer(text_.data(), text_.size());
+            }
+
+        private:
+            string_type text_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_CHUNKED_ENCODER_HPP_INCLUDED
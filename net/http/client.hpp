@@ -0,0 +1,1680 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_CLIENT_HPP_INCLUDED
+#define GUARD_NET_HTTP_CLIENT_HPP_INCLUDED
+
+#include <net/client/client.hpp>
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/client/utils/output_buffer.hpp>
+#include <net/http/parser/response_parser.hpp>
+#include <net/http/content_decoder.hpp>
+#include <net/http/request/body_upload.hpp>
+#include <net/http/request/request_writer.hpp>
+#include <net/http/url.hpp>
+#include <net/http/v2/session.hpp>
+#include <net/error.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace net
+{
+    namespace http
+    {
+        // Asynchronous HTTP/1.1 client on top of basic_client.
+        //
+        // Connections are kept per origin (scheme, host and port) and reused
+        // for later requests as long as the server allows it, at most
+        // max_connections per origin are opened, further requests queue up.
+        // With a pipeline depth above 1 idempotent requests are also written
+        // onto busy connections which already proved to be persistent, the
+        // responses are matched to the requests in order.
+        // Idempotent requests which got no response because the connection
+        // closed early (a reused connection the server just timed out, the
+        // rest of a pipeline after the server gave up) are sent again, up
+        // to max_replays times.
+        // With set_http2 the client offers HTTP/2 to https origins, if the
+        // server accepts it all requests to the origin share that one
+        // connection as concurrent streams (see basic_http2_session).
+        // Redirects are followed up to max_redirects times, 303 (and 301/302
+        // for POST) turn the request into a GET. Authorization and Cookie
+        // headers are dropped when a redirect leaves the origin.
+        //
+        // async_upload sends a body read from a body source (memory, a file,
+        // a generator, gzip compressed on the way), see body_upload. Bodies
+        // which can not be produced again are not replayed and 307/308
+        // redirects are handed to the caller for them.
+        //
+        // Unless a request asks for codings itself (an Accept-Encoding
+        // header), gzip and deflate are accepted and bodies are decoded as
+        // they arrive, see basic_content_decoder. The Content-Encoding header
+        // stays in the response.
+        //
+        // The response is handed to the completion handler with its body,
+        // or the body is streamed to a body handler as it arrives, in which
+        // case the response passed to the completion handler has none.
+        // async_stream paces the connection by the consumer: nothing more is
+        // read from it until the consumer resumes after each piece.
+        // basic_response_stream puts a pull interface on top of that.
+        //
+        // Create the client with new and hold it in a self_ptr, pending
+        // operations keep it alive. The client is not thread safe, run the
+        // io_service on one thread.
+        template<typename Tag>
+        class basic_http_client
+            : public boost::enable_shared_from_this< basic_http_client<Tag> >
+            , boost::noncopyable
+        {
+        public:
+            typedef boost::shared_ptr<basic_http_client>                    self_ptr;
+            typedef net::basic_client<Tag>                                  client_type;
+            typedef typename client_type::service_type                      service_type;
+            typedef typename client_type::ssl_context_type                  ssl_context_type;
+            typedef typename client_type::proxy_base_ptr                    proxy_base_ptr;
+            typedef basic_request<Tag>                                      request_type;
+            typedef basic_response<Tag>                                     response_type;
+            typedef basic_url<Tag>                                          url_type;
+            typedef basic_body_source<Tag>                                  body_source;
+            typedef boost::shared_ptr<body_source>                          body_source_ptr;
+            typedef typename string_traits<Tag>::type                       string_type;
+            typedef boost::system::error_code                               error_code;
+            typedef boost::posix_time::time_duration                        duration_type;
+
+            // Completion of a request, the final response after redirects
+            typedef boost::function< void(error_code const &, response_type const &) >              response_handler;
+
+            // Receives the body piece by piece together with the response head
+            typedef boost::function< void(response_type const &, char const *, std::size_t) >      body_handler;
+
+            // Called by a paced body handler once it is done with a piece
+            typedef boost::function< void() >                                                       resume_handler;
+
+            // Like body_handler, but the data stays valid and the connection
+            // is not read from until resume was called, from a handler running
+            // on the io_service or from within the body handler itself
+            typedef boost::function< void(response_type const &, char const *, std::size_t, resume_handler const &) >  paced_body_handler;
+
+            // Gets the head of the final response as soon as it is parsed,
+            // before any of the body
+            typedef boost::function< void(response_type const &) >                                 head_handler;
+
+            // Refers to a request for cancel, see async_request
+            typedef boost::weak_ptr<void>                                                           request_handle;
+
+            enum { READ_BUFFER_SIZE = 0x4000 };
+
+            explicit basic_http_client(service_type & service)
+                : service_(service)
+                , context_(0)
+                , proxy_()
+                , origins_()
+                , defaults_()
+                , max_connections_(6)
+                , pipeline_depth_(1)
+                , max_redirects_(5)
+                , max_replays_(3)
+                , idle_timeout_(boost::posix_time::seconds(30))
+                , sweeper_(service)
+                , sweeping_(false)
+                , http2_(false)
+                , decode_content_(true)
+                , max_ratio_(decoder_type::DEFAULT_MAX_RATIO)
+            {
+                defaults_.push_back(header_type("User-Agent", "libnetpp"));
+            }
+
+            basic_http_client(service_type & service, ssl_context_type & context)
+                : service_(service)
+                , context_(&context)
+                , proxy_()
+                , origins_()
+                , defaults_()
+                , max_connections_(6)
+                , pipeline_depth_(1)
+                , max_redirects_(5)
+                , max_replays_(3)
+                , idle_timeout_(boost::posix_time::seconds(30))
+                , sweeper_(service)
+                , sweeping_(false)
+                , http2_(false)
+                , decode_content_(true)
+                , max_ratio_(decoder_type::DEFAULT_MAX_RATIO)
+            {
+                defaults_.push_back(header_type("User-Agent", "libnetpp"));
+            }
+
+            service_type & get_io_service()
+            {
+                return service_;
+            }
+
+            // Used for connections opened from now on
+            void set_proxy(proxy_base_ptr proxy)
+            {
+                proxy_ = proxy;
+            }
+
+            // Connections per origin, default 6
+            void set_max_connections(std::size_t count)
+            {
+                max_connections_ = count ? count : 1;
+            }
+
+            // Requests in flight per connection, default 1 (no pipelining)
+            void set_pipeline_depth(std::size_t depth)
+            {
+                pipeline_depth_ = depth ? depth : 1;
+            }
+
+            // Redirects followed per request, 0 hands 3xx responses to the caller
+            void set_max_redirects(std::size_t count)
+            {
+                max_redirects_ = count;
+            }
+
+            // Times an idempotent request is sent again after the connection
+            // closed before its response started, default 3
+            void set_max_replays(std::size_t count)
+            {
+                max_replays_ = count;
+            }
+
+            // Offers HTTP/2 when connecting to https origins, default off
+            void set_http2(bool enabled)
+            {
+                http2_ = enabled;
+            }
+
+            // Idle connections are closed after this time, default 30 seconds
+            void set_idle_timeout(duration_type const & timeout)
+            {
+                idle_timeout_ = timeout;
+            }
+
+            // Sent with every request unless the request has a header of the
+            // same name. Replaces a default header of the same name.
+            void set_default_header(string_type const & name, string_type const & value)
+            {
+                typename std::vector<header_type>::iterator it = defaults_.begin();
+                for(; it != defaults_.end(); ++it)
+                {
+                    if(it->first.size() == name.size() && detail::equals_ignore_case(it->first.data(), name.data(), name.size()))
+                    {
+                        it->second = value;
+                        break;
+                    }
+                }
+                if(it == defaults_.end())
+                {
+                    defaults_.push_back(header_type(name, value));
+                }
+                invalidate_headers();
+            }
+
+            // Accept-Encoding with the codings basic_content_decoder supports
+            // and decoded bodies, default on
+            void set_decode_content(bool enabled)
+            {
+                decode_content_ = enabled;
+                invalidate_headers();
+            }
+
+            // Decoded bodies may grow to ratio times their encoded size,
+            // default 100, 0 removes the limit
+            void set_max_compression_ratio(std::size_t ratio)
+            {
+                max_ratio_ = ratio;
+            }
+
+            request_handle async_get(string_type const & url, response_handler handler, body_handler body = body_handler())
+            {
+                return async_request(url, request_type(), handler, body);
+            }
+
+            // Resource and query of request are taken from url. The handle
+            // may be passed to cancel while the request is in progress.
+            request_handle async_request(string_type const & url, request_type const & request, response_handler handler, body_handler body = body_handler())
+            {
+                exchange_ptr ex(new exchange(request, handler, max_redirects_, max_replays_));
+                ex->body = body;
+                start(url, ex);
+                return ex;
+            }
+
+            // Sends the body read from source instead of the request's body
+            request_handle async_upload(string_type const & url, request_type const & request, body_source_ptr source, response_handler handler, body_handler body = body_handler())
+            {
+                exchange_ptr ex(new exchange(request, handler, max_redirects_, max_replays_));
+                ex->body   = body;
+                ex->upload = source;
+                start(url, ex);
+                return ex;
+            }
+
+            // Streams the body to a paced body handler, see paced_body_handler
+            request_handle async_stream(string_type const & url, request_type const & request, response_handler handler, paced_body_handler body, head_handler head = head_handler())
+            {
+                exchange_ptr ex(new exchange(request, handler, max_redirects_, max_replays_));
+                ex->paced = body;
+                ex->head  = head;
+                start(url, ex);
+                return ex;
+            }
+
+            // Gives up on a request, its handler completes with
+            // operation_aborted unless it completed before. A request sent
+            // on an HTTP/1.x connection takes the connection down with it,
+            // other requests on it are sent again where possible. Safe to
+            // call from any handler, the request is cancelled afterwards.
+            void cancel(request_handle const & handle)
+            {
+                boost::shared_ptr<void> const ex = handle.lock();
+                if(ex)
+                {
+                    service_.post(boost::bind(&basic_http_client::on_cancel, this->shared_from_this(), boost::static_pointer_cast<exchange>(ex)));
+                }
+            }
+
+            // Closes all connections, pending requests complete with
+            // operation_aborted
+            void close()
+            {
+                error_code ignored;
+                sweeper_.cancel(ignored);
+
+                origin_map origins;
+                origins.swap(origins_);
+                for(typename origin_map::iterator o = origins.begin(); o != origins.end(); ++o)
+                {
+                    origin & target = *o->second;
+                    if(target.session)
+                    {
+                        target.session->close();
+                    }
+                    while(!target.links.empty())
+                    {
+                        link_ptr l = target.links.front();
+                        shutdown(l);
+                        abort(l->pending);
+                    }
+                    abort(target.waiting);
+                }
+            }
+
+        protected:
+            typedef std::pair<string_type, string_type>     header_type;
+            typedef basic_header_block<Tag>                 header_block;
+            typedef boost::shared_ptr<header_block const>   header_block_ptr;
+            typedef basic_request_writer<Tag>               writer_type;
+            typedef basic_response_parser<Tag>              parser_type;
+            typedef boost::posix_time::ptime                time_type;
+            typedef basic_http2_session<Tag>                session_type;
+            typedef typename session_type::self_ptr         session_ptr;
+            typedef basic_content_decoder<Tag>              decoder_type;
+            typedef boost::shared_ptr<decoder_type>         decoder_ptr;
+
+            struct exchange
+            {
+                exchange(request_type const & request, response_handler const & handler, std::size_t redirects, std::size_t replays)
+                    : url()
+                    , request(request)
+                    , response()
+                    , handler(handler)
+                    , body()
+                    , paced()
+                    , head()
+                    , upload()
+                    , redirects(redirects)
+                    , replays(replays)
+                    , redirecting(false)
+                    , started(false)
+                    , decode(false)
+                    , decoder()
+                    , decode_error()
+                    , resume()
+                    , holding(false)
+                    , delivering(false)
+                    , completing(false)
+                    , session()
+                    , stream_id(0)
+                    , previous()
+                    , redirect()
+                {}
+
+                url_type            url;
+                request_type        request;
+                response_type       response;
+                response_handler    handler;
+                body_handler        body;
+                paced_body_handler  paced;
+                head_handler        head;           // not called yet
+                body_source_ptr     upload;         // the body, instead of request.body()
+                std::size_t         redirects;      // still allowed
+                std::size_t         replays;        // still allowed
+                bool                redirecting;    // the body is dropped
+                bool                started;        // response data arrived
+                bool                decode;         // Accept-Encoding was added
+                decoder_ptr         decoder;
+                error_code          decode_error;
+                resume_handler      resume;         // the source of decoded data, paced
+                bool                holding;        // the paced consumer has a decoded piece
+                bool                delivering;     // inside the paced body handler
+                bool                completing;     // complete once the pieces are consumed
+                boost::weak_ptr<session_type>   session;    // HTTP/2, carries the request
+                boost::uint32_t                 stream_id;
+                boost::shared_ptr<exchange>     previous;   // the redirected request, handles refer to the first
+                boost::weak_ptr<exchange>       redirect;   // the request following this one
+            };
+
+            typedef boost::shared_ptr<exchange>     exchange_ptr;
+            typedef std::deque<exchange_ptr>        exchange_queue;
+
+            struct origin;
+            typedef boost::shared_ptr<origin>       origin_ptr;
+
+            // A connection to an origin and the requests sent on it, in the
+            // order of their responses
+            struct link
+            {
+                link(service_type & service, ssl_context_type * context, origin_ptr owner)
+                    : client(context ? client_type(service, *context) : client_type(service))
+                    , owner(owner)
+                    , pending()
+                    , filling(0)
+                    , input()
+                    , parser()
+                    , idle_since()
+                    , upload()
+                    , connected(false)
+                    , writing(false)
+                    , uploading(false)
+                    , reading(false)
+                    , reusable(false)
+                    , closed(false)
+                    , suspended(false)
+                    , delivering(false)
+                    , cursor(0)
+                    , limit(0)
+                {}
+
+                client_type                 client;
+                origin_ptr                  owner;
+                exchange_queue              pending;
+                util::output_buffer         output[2];      // one on the wire, one collecting
+                std::size_t                 filling;
+                util::buffer_lease          input;
+                parser_type                 parser;
+                time_type                   idle_since;
+                exchange_ptr                upload;         // its body follows the head in the output
+                bool                        connected;
+                bool                        writing;
+                bool                        uploading;      // body_upload owns the socket's writes
+                bool                        reading;
+                bool                        reusable;       // a response kept it open
+                bool                        closed;
+                bool                        suspended;      // waits for a paced consumer
+                bool                        delivering;     // inside a paced body handler
+                char const *                cursor;         // unparsed input while suspended
+                char const *                limit;
+            };
+
+            typedef boost::shared_ptr<link>         link_ptr;
+            typedef std::list<link_ptr>             link_list;
+
+            struct origin
+            {
+                explicit origin(url_type const & url)
+                    : url(url)
+                    , writer()
+                    , links()
+                    , waiting()
+                    , session()
+                    , negotiated(false)
+                {}
+
+                url_type        url;
+                writer_type     writer;
+                link_list       links;
+                exchange_queue  waiting;        // for a connection
+                session_ptr     session;        // HTTP/2, replaces the links
+                bool            negotiated;     // a connection told if HTTP/2 is spoken
+            };
+
+            typedef std::map<string_type, origin_ptr> origin_map;
+
+            void start(string_type const & url, exchange_ptr ex)
+            {
+                error_code ec;
+                string_type ignored;
+                if(!ex->url.parse(url))
+                {
+                    ec = net::error::http_invalid_url;
+                }
+                else if(ex->url.secure() && !context_)
+                {
+                    ec = boost::asio::error::operation_not_supported;
+                }
+                if(ec)
+                {
+                    service_.post(boost::bind(ex->handler, ec, response_type()));
+                    return;
+                }
+                ex->request.resource() = ex->url.resource;
+                ex->request.query()    = ex->url.query;
+                ex->decode = decode_content_ && !has_default("Accept-Encoding") && !detail::find_header(ex->request, "Accept-Encoding", ignored);
+                submit(ex);
+            }
+
+            bool has_default(char const * name) const
+            {
+                std::size_t const length = std::strlen(name);
+                for(typename std::vector<header_type>::const_iterator it = defaults_.begin(); it != defaults_.end(); ++it)
+                {
+                    if(it->first.size() == length && detail::equals_ignore_case(it->first.data(), name, length))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Header blocks are rebuilt on their next use
+            void invalidate_headers()
+            {
+                for(typename origin_map::iterator o = origins_.begin(); o != origins_.end(); ++o)
+                {
+                    o->second->writer.set_common_headers(header_block_ptr());
+                }
+            }
+
+            void submit(exchange_ptr ex)
+            {
+                string_type const key = ex->url.origin();
+                origin_ptr & target = origins_[key];
+                if(!target)
+                {
+                    target.reset(new origin(ex->url));
+                }
+                target->waiting.push_back(ex);
+                dispatch(target);
+            }
+
+            // Moves waiting requests onto connections
+            void dispatch(origin_ptr target)
+            {
+                if(target->session && target->session->closed())
+                {
+                    target->session.reset();
+                    target->negotiated = false;
+                }
+                if(target->session)
+                {
+                    while(!target->waiting.empty() && target->session->available())
+                    {
+                        exchange_ptr ex = target->waiting.front();
+                        target->waiting.pop_front();
+                        stream(target, ex);
+                    }
+                    return;
+                }
+                if(offers_http2(*target) && !target->negotiated && !target->links.empty())
+                {
+                    // The first connection tells whether more are needed
+                    return;
+                }
+                while(!target->waiting.empty())
+                {
+                    exchange_ptr ex = target->waiting.front();
+                    link_ptr l = select(*target, idempotent(ex->request) && !ex->upload);
+                    if(!l)
+                    {
+                        if(target->links.size() >= max_connections_)
+                        {
+                            return;
+                        }
+                        l = open(target);
+                    }
+                    target->waiting.pop_front();
+                    send(l, ex);
+                }
+            }
+
+            // An idle connection, else the least loaded one with room in its
+            // pipeline if the request may be pipelined
+            link_ptr select(origin & target, bool pipeline)
+            {
+                time_type const oldest = now() - idle_timeout_;
+                std::vector<link_ptr> stale;
+                link_ptr result;
+                for(typename link_list::iterator it = target.links.begin(); it != target.links.end(); ++it)
+                {
+                    link_ptr const & l = *it;
+                    if(l->upload)
+                    {
+                        // Still sending a body, answered early or not
+                        continue;
+                    }
+                    if(l->pending.empty())
+                    {
+                        if(l->idle_since < oldest || !tunnel_pool<Tag>::usable(l->client.socket().base()))
+                        {
+                            stale.push_back(l);
+                            continue;
+                        }
+                        result = l;
+                        break;
+                    }
+                    if(pipeline && l->reusable && l->pending.size() < pipeline_depth_
+                        && (!result || l->pending.size() < result->pending.size()))
+                    {
+                        result = l;
+                    }
+                }
+                for(typename std::vector<link_ptr>::iterator it = stale.begin(); it != stale.end(); ++it)
+                {
+                    shutdown(*it);
+                }
+                return result;
+            }
+
+            link_ptr open(origin_ptr target)
+            {
+                link_ptr l(new link(service_, target->url.secure() ? context_ : 0, target));
+                if(proxy_)
+                {
+                    l->client.set_proxy(proxy_);
+                }
+                if(offers_http2(*target))
+                {
+                    typename client_type::protocol_list protocols;
+                    protocols.push_back("h2");
+                    protocols.push_back("http/1.1");
+                    l->client.set_alpn_protocols(protocols);
+                }
+                target->links.push_back(l);
+                l->client.async_connect(
+                    target->url.host,
+                    target->url.port,
+                    boost::bind(
+                        &basic_http_client::on_connected,
+                        this->shared_from_this(),
+                        l,
+                        boost::asio::placeholders::error
+                    )
+                );
+                return l;
+            }
+
+            void on_connected(link_ptr l, error_code const & ec)
+            {
+                if(l->closed)
+                {
+                    // Closed while connecting, see shutdown
+                    service_.post(boost::bind(&basic_http_client::release, l));
+                    return;
+                }
+                if(ec)
+                {
+                    fail(l, ec);
+                    return;
+                }
+                l->connected = true;
+                bool const offered = offers_http2(*l->owner);
+                if(offered)
+                {
+                    l->owner->negotiated = true;
+                    if(l->client.socket().alpn_protocol() == "h2")
+                    {
+                        upgrade(l);
+                        return;
+                    }
+                }
+                start_write(l);
+                start_read(l);
+                if(offered)
+                {
+                    dispatch(l->owner);
+                }
+            }
+
+            bool offers_http2(origin const & target) const
+            {
+                return http2_ && target.url.secure();
+            }
+
+            // The server chose HTTP/2, the connection is handed to a session
+            // and the requests written for HTTP/1.1 are submitted to it
+            void upgrade(link_ptr l)
+            {
+                origin_ptr target = l->owner;
+                exchange_queue & waiting = target->waiting;
+                waiting.insert(waiting.begin(), l->pending.begin(), l->pending.end());
+                l->pending.clear();
+
+                if(target->session && !target->session->closed())
+                {
+                    // Only one session per origin
+                    shutdown(l);
+                }
+                else
+                {
+                    l->closed = true;
+                    target->links.remove(l);
+                    target->session.reset(new session_type(l->client.socket(), "https", target->url.authority()));
+                    target->session->start();
+                }
+                dispatch(target);
+            }
+
+            void stream(origin_ptr target, exchange_ptr ex)
+            {
+                request_type request(ex->request);
+                string_type ignored;
+                for(typename std::vector<header_type>::const_iterator it = defaults_.begin(); it != defaults_.end(); ++it)
+                {
+                    if(!detail::find_header(request, it->first.c_str(), ignored))
+                    {
+                        request.headers().insert(typename request_type::headers_type::value_type(it->first, it->second));
+                    }
+                }
+                if(ex->decode)
+                {
+                    request.headers().insert(typename request_type::headers_type::value_type("Accept-Encoding", decoder_type::accepted()));
+                }
+
+                typename session_type::response_handler handler(
+                    boost::bind(&basic_http_client::on_stream_complete, this->shared_from_this(), target, ex, _1, _2)
+                );
+                ex->session = target->session;
+                if(ex->paced)
+                {
+                    ex->stream_id = target->session->submit_paced(
+                        request,
+                        handler,
+                        boost::bind(&basic_http_client::on_stream_paced, this->shared_from_this(), ex, _1, _2, _3, _4),
+                        boost::bind(&basic_http_client::on_stream_final_head, this->shared_from_this(), ex, _1)
+                    );
+                }
+                else if(ex->upload)
+                {
+                    ex->stream_id = target->session->submit_upload(
+                        request,
+                        ex->upload,
+                        handler,
+                        boost::bind(&basic_http_client::on_stream_body, this->shared_from_this(), ex, _1, _2, _3)
+                    );
+                }
+                else
+                {
+                    ex->stream_id = target->session->submit(
+                        request,
+                        handler,
+                        boost::bind(&basic_http_client::on_stream_body, this->shared_from_this(), ex, _1, _2, _3)
+                    );
+                }
+            }
+
+            // The response head arrived with the first piece of the body
+            void on_stream_head(exchange & ex, response_type const & response)
+            {
+                if(!ex.started)
+                {
+                    ex.started     = true;
+                    ex.response    = response;
+                    ex.redirecting = follows(ex);
+                    prepare_decoding(ex);
+                }
+            }
+
+            void on_stream_final_head(exchange_ptr ex, response_type const & response)
+            {
+                on_stream_head(*ex, response);
+                notify_head(*ex);
+            }
+
+            void on_stream_body(exchange_ptr ex, response_type const & response, char const * data, std::size_t size)
+            {
+                on_stream_head(*ex, response);
+                if(!ex->redirecting)
+                {
+                    deliver(ex, data, size);
+                }
+            }
+
+            void on_stream_paced(exchange_ptr ex, response_type const & response, char const * data, std::size_t size, resume_handler const & resume)
+            {
+                on_stream_head(*ex, response);
+                if(ex->redirecting)
+                {
+                    resume();
+                    return;
+                }
+                deliver_paced(ex, data, size, resume);
+            }
+
+            void on_stream_complete(origin_ptr target, exchange_ptr ex, error_code const & ec, response_type const & response)
+            {
+                if(ec == boost::asio::error::operation_aborted)
+                {
+                    abandon(*ex);
+                    ex->handler(ec, response_type());
+                    return;
+                }
+                if(target->session && !target->session->active())
+                {
+                    schedule_sweep();
+                }
+                if(!ec)
+                {
+                    // Keeps the body, the headers may have grown by trailers
+                    string_type body;
+                    body.swap(ex->response.body());
+                    ex->response = response;
+                    ex->response.body().swap(body);
+                    if(!ex->started)
+                    {
+                        ex->started     = true;
+                        ex->redirecting = follows(*ex);
+                    }
+                    complete(ex);
+                }
+                else if(!ex->started && ex->replays && (!ex->upload || ex->upload->repeatable())
+                    && (ec == net::error::http2_refused_stream || replayable(*ex, ec)))
+                {
+                    // Refused streams were not processed, whatever the method
+                    --ex->replays;
+                    target->waiting.push_front(ex);
+                }
+                else
+                {
+                    abandon(*ex);
+                    ex->handler(ec, ex->response);
+                }
+                dispatch(target);
+            }
+
+            void send(link_ptr l, exchange_ptr ex)
+            {
+                if(l->pending.empty())
+                {
+                    l->parser.reset(is_head(ex->request));
+                }
+                l->pending.push_back(ex);
+                if(ex->upload)
+                {
+                    if(ex->upload->repeatable())
+                    {
+                        ex->upload->rewind();
+                    }
+                    writer(*l->owner).write_head(l->output[l->filling], ex->request, *ex->upload);
+                    l->upload = ex;
+                }
+                else
+                {
+                    writer(*l->owner).write(l->output[l->filling], ex->request);
+                }
+                if(l->connected)
+                {
+                    start_write(l);
+                    start_read(l);
+                }
+            }
+
+            writer_type & writer(origin & target)
+            {
+                if(!target.writer.common_headers())
+                {
+                    boost::shared_ptr<header_block> block(new header_block());
+                    block->add("Host", target.url.authority());
+                    for(typename std::vector<header_type>::const_iterator it = defaults_.begin(); it != defaults_.end(); ++it)
+                    {
+                        block->add(it->first, it->second);
+                    }
+                    if(decode_content_ && !has_default("Accept-Encoding"))
+                    {
+                        block->add("Accept-Encoding", decoder_type::accepted());
+                    }
+                    target.writer.set_common_headers(block);
+                }
+                return target.writer;
+            }
+
+            // Requests are collected in one buffer while the other one is
+            // being written, so pipelined requests go out in batches
+            void start_write(link_ptr l)
+            {
+                if(l->writing || l->uploading || l->closed)
+                {
+                    return;
+                }
+                if(l->output[l->filling].empty())
+                {
+                    if(l->upload)
+                    {
+                        // The head is out
+                        start_upload(l);
+                    }
+                    return;
+                }
+                std::size_t const sending = l->filling;
+                l->filling ^= 1;
+                l->writing = true;
+                boost::asio::async_write(
+                    l->client.socket(),
+                    l->output[sending].data(),
+                    boost::bind(
+                        &basic_http_client::on_written,
+                        this->shared_from_this(),
+                        l,
+                        sending,
+                        boost::asio::placeholders::error
+                    )
+                );
+            }
+
+            void on_written(link_ptr l, std::size_t index, error_code const & ec)
+            {
+                l->writing = false;
+                l->output[index].clear();
+                if(l->closed)
+                {
+                    return;
+                }
+                if(ec)
+                {
+                    fail(l, ec);
+                    return;
+                }
+                start_write(l);
+            }
+
+            void start_upload(link_ptr l)
+            {
+                l->uploading = true;
+                body_upload<Tag>::async_send(
+                    l->client.socket(),
+                    l->upload->upload,
+                    boost::bind(
+                        &basic_http_client::on_uploaded,
+                        this->shared_from_this(),
+                        l,
+                        _1
+                    )
+                );
+            }
+
+            void on_uploaded(link_ptr l, error_code const & ec)
+            {
+                l->uploading = false;
+                l->upload.reset();
+                if(l->closed)
+                {
+                    return;
+                }
+                if(ec)
+                {
+                    // The rest of the body is missing, the connection is unusable
+                    fail(l, ec);
+                    return;
+                }
+                start_write(l);
+            }
+
+            void start_read(link_ptr l)
+            {
+                if(l->reading || l->closed || l->suspended || l->pending.empty())
+                {
+                    return;
+                }
+                if(l->input.empty())
+                {
+                    l->input = util::lease_buffer(READ_BUFFER_SIZE);
+                }
+                l->reading = true;
+                l->client.socket().async_read_some(
+                    l->input.buffer(),
+                    boost::bind(
+                        &basic_http_client::on_read,
+                        this->shared_from_this(),
+                        l,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred
+                    )
+                );
+            }
+
+            void on_read(link_ptr l, error_code const & ec, std::size_t bytes)
+            {
+                if(l->closed)
+                {
+                    l->reading = false;
+                    return;
+                }
+                if(ec)
+                {
+                    l->reading = false;
+                    if(ec == boost::asio::error::eof && !l->pending.empty() && l->parser.finish())
+                    {
+                        // The body was delimited by the end of the connection
+                        exchange_ptr ex = l->pending.front();
+                        l->pending.pop_front();
+                        shutdown(l);
+                        complete(ex);
+                        fail(l, net::error::http_connection_closed);
+                        return;
+                    }
+                    fail(l, ec == boost::asio::error::eof ? error_code(net::error::http_connection_closed) : ec);
+                    return;
+                }
+
+                parse(l, l->input.data(), l->input.data() + bytes);
+            }
+
+            void parse(link_ptr l, char const * iter, char const * end)
+            {
+                // reading stays set, handlers called from consume must not
+                // start another read into the buffer being parsed
+                l->reading = true;
+                bool const alive = consume(l, iter, end);
+                l->reading = false;
+                if(!alive || l->suspended)
+                {
+                    return;
+                }
+                if(l->pending.empty())
+                {
+                    l->input.reset();
+                }
+                start_read(l);
+            }
+
+            // The paced consumer is done with the last piece
+            void resume(link_ptr l)
+            {
+                if(!l->suspended)
+                {
+                    return;
+                }
+                l->suspended = false;
+                if(!l->delivering && !l->closed)
+                {
+                    parse(l, l->cursor, l->limit);
+                }
+            }
+
+            // Feeds received data to the parser, false once the connection
+            // was given up
+            bool consume(link_ptr l, char const * iter, char const * end)
+            {
+                for(;;)
+                {
+                    if(l->closed)
+                    {
+                        return false;
+                    }
+                    if(l->pending.empty())
+                    {
+                        if(iter != end)
+                        {
+                            // Nothing was asked for
+                            fail(l, net::error::http_protocol_error);
+                            return false;
+                        }
+                        return true;
+                    }
+
+                    exchange_ptr current = l->pending.front();
+                    exchange & ex = *current;
+                    if(!l->parser.head_complete())
+                    {
+                        if(iter == end)
+                        {
+                            return true;
+                        }
+                        ex.started = true;
+                        boost::tribool result = l->parser.parse_head(iter, end, ex.response);
+                        if(!result)
+                        {
+                            fail(l, l->parser.error());
+                            return false;
+                        }
+                        if(boost::indeterminate(result))
+                        {
+                            return true;
+                        }
+                        ex.redirecting = follows(ex);
+                        prepare_decoding(ex);
+                        notify_head(ex);
+                    }
+
+                    char const * data = 0;
+                    std::size_t size = 0;
+                    boost::tribool result = l->parser.parse_body(iter, end, data, size, ex.response);
+                    if(size && !ex.redirecting)
+                    {
+                        if(ex.paced && !boost::indeterminate(result))
+                        {
+                            // The last piece, nothing left to hold back
+                            deliver_paced(current, data, size, resume_handler(&basic_http_client::ignore));
+                        }
+                        else if(ex.paced)
+                        {
+                            l->suspended  = true;
+                            l->delivering = true;
+                            deliver_paced(
+                                current,
+                                data,
+                                size,
+                                resume_handler(boost::bind(&basic_http_client::resume, this->shared_from_this(), l))
+                            );
+                            l->delivering = false;
+                            if(l->suspended && !l->closed)
+                            {
+                                l->cursor = iter;
+                                l->limit  = end;
+                                return true;
+                            }
+                        }
+                        else
+                        {
+                            deliver(current, data, size);
+                        }
+                    }
+                    if(l->closed)
+                    {
+                        return false;
+                    }
+                    if(!result)
+                    {
+                        fail(l, l->parser.error());
+                        return false;
+                    }
+                    if(boost::indeterminate(result))
+                    {
+                        if(iter == end)
+                        {
+                            return true;
+                        }
+                        continue;
+                    }
+
+                    // Response complete, if it came before the whole body was
+                    // sent the rest is not wanted
+                    l->pending.pop_front();
+                    bool const keep_alive = l->parser.keep_alive() && l->upload != current;
+                    if(keep_alive)
+                    {
+                        l->reusable = true;
+                        if(!l->pending.empty())
+                        {
+                            l->parser.reset(is_head(l->pending.front()->request));
+                        }
+                        else
+                        {
+                            l->idle_since = now();
+                            schedule_sweep();
+                        }
+                    }
+                    else
+                    {
+                        shutdown(l);
+                    }
+                    complete(current);
+
+                    if(!keep_alive)
+                    {
+                        fail(l, net::error::http_connection_closed);
+                        return false;
+                    }
+                    if(l->pending.empty() && !l->closed)
+                    {
+                        dispatch(l->owner);
+                    }
+                }
+            }
+
+            // Sets up decoding of the body if the client asked for a coding
+            void prepare_decoding(exchange & ex)
+            {
+                string_type coding;
+                if(!ex.decode || ex.redirecting || !detail::find_header(ex.response, "Content-Encoding", coding))
+                {
+                    if(ex.decoder)
+                    {
+                        ex.decoder->reset(string_type());
+                    }
+                    return;
+                }
+                if(!ex.decoder)
+                {
+                    ex.decoder.reset(new decoder_type());
+                }
+                ex.decoder->reset(coding);
+                ex.decoder->set_max_ratio(max_ratio_);
+                ex.decode_error = error_code();
+            }
+
+            static bool decoding(exchange const & ex)
+            {
+                return ex.decoder && ex.decoder->active();
+            }
+
+            // Hands body data to the consumer, decoded if need be
+            void deliver(exchange_ptr ex, char const * data, std::size_t size)
+            {
+                if(!decoding(*ex))
+                {
+                    consume_body(*ex, data, size);
+                    return;
+                }
+                if(ex->decode_error)
+                {
+                    return;
+                }
+                ex->decoder->feed(data, size);
+                while(ex->decoder->pending())
+                {
+                    char const * piece = 0;
+                    std::size_t length = 0;
+                    ex->decode_error = ex->decoder->read_some(piece, length);
+                    if(ex->decode_error)
+                    {
+                        return;
+                    }
+                    if(length)
+                    {
+                        consume_body(*ex, piece, length);
+                    }
+                }
+            }
+
+            static void consume_body(exchange & ex, char const * data, std::size_t size)
+            {
+                if(ex.body)
+                {
+                    ex.body(ex.response, data, size);
+                }
+                else
+                {
+                    ex.response.body().append(data, size);
+                }
+            }
+
+            // Passes the head on unless the response is a redirect
+            static void notify_head(exchange & ex)
+            {
+                if(ex.head && !ex.redirecting)
+                {
+                    head_handler head;
+                    head.swap(ex.head);
+                    head(ex.response);
+                }
+            }
+
+            // The paced variant, resume is called once data was decoded and
+            // the consumer is done with all of it
+            void deliver_paced(exchange_ptr ex, char const * data, std::size_t size, resume_handler const & resume)
+            {
+                if(!decoding(*ex))
+                {
+                    ex->paced(ex->response, data, size, resume);
+                    return;
+                }
+                ex->decoder->feed(data, size);
+                ex->resume = resume;
+                drain(ex);
+            }
+
+            // Hands decoded pieces to the paced consumer one at a time
+            void drain(exchange_ptr ex)
+            {
+                while(!ex->holding)
+                {
+                    char const * data = 0;
+                    std::size_t size = 0;
+                    if(!ex->decode_error && ex->decoder->pending())
+                    {
+                        ex->decode_error = ex->decoder->read_some(data, size);
+                        if(!size && !ex->decode_error)
+                        {
+                            continue;
+                        }
+                    }
+                    if(!size)
+                    {
+                        // The input is used up, or dropped after an error
+                        if(ex->completing)
+                        {
+                            ex->completing = false;
+                            complete(ex);
+                            return;
+                        }
+                        resume_handler resume;
+                        resume.swap(ex->resume);
+                        if(resume)
+                        {
+                            resume();
+                        }
+                        return;
+                    }
+                    ex->holding    = true;
+                    ex->delivering = true;
+                    ex->paced(
+                        ex->response,
+                        data,
+                        size,
+                        resume_handler(boost::bind(&basic_http_client::resume_decoded, this->shared_from_this(), ex))
+                    );
+                    ex->delivering = false;
+                }
+            }
+
+            void resume_decoded(exchange_ptr ex)
+            {
+                if(!ex->holding)
+                {
+                    return;
+                }
+                ex->holding = false;
+                if(!ex->delivering)
+                {
+                    drain(ex);
+                }
+            }
+
+            // The request failed, decoded data still held by a paced
+            // consumer leads nowhere any more
+            static void abandon(exchange & ex)
+            {
+                if(ex.decoder)
+                {
+                    ex.decoder->reset(string_type());
+                }
+                ex.resume     = resume_handler();
+                ex.completing = false;
+            }
+
+            // Hands the response to the caller or follows the redirect
+            void complete(exchange_ptr ex)
+            {
+                if(decoding(*ex) && !ex->decode_error)
+                {
+                    if(ex->holding || ex->decoder->pending())
+                    {
+                        // A paced consumer still works through the body
+                        ex->decoder->detach_input();
+                        ex->completing = true;
+                        return;
+                    }
+                    if(!ex->decoder->finish())
+                    {
+                        ex->decode_error = net::error::http_content_encoding_error;
+                    }
+                }
+                if(ex->decode_error)
+                {
+                    ex->handler(ex->decode_error, ex->response);
+                    return;
+                }
+                if(!ex->redirecting)
+                {
+                    ex->handler(error_code(), ex->response);
+                    return;
+                }
+                if(!ex->redirects)
+                {
+                    ex->handler(net::error::http_too_many_redirects, ex->response);
+                    return;
+                }
+
+                string_type location;
+                detail::find_header(ex->response, "Location", location);
+                url_type target;
+                if(!ex->url.resolve(location, target) || (target.secure() && !context_))
+                {
+                    ex->handler(net::error::http_invalid_url, ex->response);
+                    return;
+                }
+
+                exchange_ptr next(new exchange(ex->request, ex->handler, ex->redirects - 1, max_replays_));
+                next->body   = ex->body;
+                next->paced  = ex->paced;
+                next->head   = ex->head;
+                next->decode = ex->decode;
+                if(!drops_body(*ex))
+                {
+                    next->upload = ex->upload;
+                }
+                else
+                {
+                    next->request.method() = is_head(ex->request) ? "HEAD" : "GET";
+                    next->request.body().clear();
+                    detail::remove_header(next->request, "Content-Length");
+                    detail::remove_header(next->request, "Content-Type");
+                }
+                if(target.origin() != ex->url.origin())
+                {
+                    // Credentials of the old origin are not for the new one
+                    detail::remove_header(next->request, "Authorization");
+                    detail::remove_header(next->request, "Cookie");
+                }
+                next->previous = ex;
+                ex->redirect   = next;
+                next->url = target;
+                next->request.resource() = target.resource;
+                next->request.query()    = target.query;
+                submit(next);
+            }
+
+            // 303, and 301/302 for POST, turn the request into a GET
+            static bool drops_body(exchange const & ex)
+            {
+                unsigned const status = ex.response.status_code();
+                return status == 303 || ((status == 301 || status == 302) && ex.request.method() == "POST");
+            }
+
+            bool follows(exchange const & ex) const
+            {
+                if(!max_redirects_)
+                {
+                    return false;
+                }
+                unsigned const status = ex.response.status_code();
+                if(status != 301 && status != 302 && status != 303 && status != 307 && status != 308)
+                {
+                    return false;
+                }
+                if(ex.upload && !ex.upload->repeatable() && !drops_body(ex))
+                {
+                    // The body can not be sent again
+                    return false;
+                }
+                string_type location;
+                return detail::find_header(ex.response, "Location", location);
+            }
+
+            // Drops the connection from its origin and closes it
+            void shutdown(link_ptr l)
+            {
+                if(l->closed)
+                {
+                    return;
+                }
+                l->closed = true;
+                link_list & links = l->owner->links;
+                for(typename link_list::iterator it = links.begin(); it != links.end(); ++it)
+                {
+                    if(*it == l)
+                    {
+                        links.erase(it);
+                        break;
+                    }
+                }
+                error_code ignored;
+                l->client.socket().socket().close(ignored);
+
+                // The connection's own handlers, queued by the close, refer
+                // to it and have to run before it is destroyed
+                service_.post(boost::bind(&basic_http_client::release, l));
+            }
+
+            static void release(link_ptr)
+            {}
+
+            static void ignore()
+            {}
+
+            // Gives up the connection. Its requests complete with ec, unless
+            // they can be sent again on another connection.
+            void fail(link_ptr l, error_code const & ec)
+            {
+                shutdown(l);
+                exchange_queue pending;
+                pending.swap(l->pending);
+
+                exchange_queue failed;
+                exchange_queue & waiting = l->owner->waiting;
+                typename exchange_queue::iterator position = waiting.begin();
+                for(typename exchange_queue::iterator it = pending.begin(); it != pending.end(); ++it)
+                {
+                    exchange & ex = **it;
+                    if(replayable(ex, ec))
+                    {
+                        // Ahead of the requests which never left, in order
+                        --ex.replays;
+                        position = waiting.insert(position, *it) + 1;
+                    }
+                    else
+                    {
+                        failed.push_back(*it);
+                    }
+                }
+
+                for(typename exchange_queue::iterator it = failed.begin(); it != failed.end(); ++it)
+                {
+                    abandon(**it);
+                    (*it)->handler(ec, (*it)->response);
+                }
+                if(!l->owner->waiting.empty())
+                {
+                    dispatch(l->owner);
+                }
+            }
+
+            // A request may be sent again if repeating it has no side effects
+            // and the connection went away before any of its response arrived
+            static bool replayable(exchange const & ex, error_code const & ec)
+            {
+                if(!ex.replays || ex.started || !idempotent(ex.request) || (ex.upload && !ex.upload->repeatable()))
+                {
+                    return false;
+                }
+                return ec == net::error::http_connection_closed
+                    || ec == boost::asio::error::eof
+                    || ec == boost::asio::error::connection_reset
+                    || ec == boost::asio::error::connection_aborted
+                    || ec == boost::asio::error::broken_pipe;
+            }
+
+            void on_cancel(exchange_ptr ex)
+            {
+                for(exchange_ptr next = ex->redirect.lock(); next; next = ex->redirect.lock())
+                {
+                    ex = next;
+                }
+                typename origin_map::iterator o = origins_.find(ex->url.origin());
+                if(o == origins_.end())
+                {
+                    return;
+                }
+                origin & target = *o->second;
+
+                exchange_queue & waiting = target.waiting;
+                typename exchange_queue::iterator it = std::find(waiting.begin(), waiting.end(), ex);
+                if(it != waiting.end())
+                {
+                    waiting.erase(it);
+                    abandon(*ex);
+                    ex->handler(error_code(boost::asio::error::operation_aborted), ex->response);
+                    return;
+                }
+
+                for(typename link_list::iterator l = target.links.begin(); l != target.links.end(); ++l)
+                {
+                    exchange_queue & pending = (*l)->pending;
+                    it = std::find(pending.begin(), pending.end(), ex);
+                    if(it != pending.end())
+                    {
+                        pending.erase(it);
+                        fail(*l, net::error::http_connection_closed);
+                        abandon(*ex);
+                        ex->handler(error_code(boost::asio::error::operation_aborted), ex->response);
+                        return;
+                    }
+                }
+
+                // Also a session that is going away still carries its streams
+                session_ptr const session = ex->session.lock();
+                if(session)
+                {
+                    session->cancel(ex->stream_id);
+                }
+            }
+
+            // Completes requests with operation_aborted, without calling
+            // the handlers from within the caller's frame
+            void abort(exchange_queue & queue)
+            {
+                for(typename exchange_queue::iterator it = queue.begin(); it != queue.end(); ++it)
+                {
+                    service_.post(boost::bind((*it)->handler, error_code(boost::asio::error::operation_aborted), response_type()));
+                }
+                queue.clear();
+            }
+
+            void schedule_sweep()
+            {
+                if(sweeping_)
+                {
+                    return;
+                }
+                sweeping_ = true;
+                sweeper_.expires_from_now(idle_timeout_);
+                sweeper_.async_wait(
+                    boost::bind(
+                        &basic_http_client::on_sweep,
+                        this->shared_from_this(),
+                        boost::asio::placeholders::error
+                    )
+                );
+            }
+
+            // Closes connections idle for longer than the idle timeout
+            void on_sweep(error_code const & ec)
+            {
+                sweeping_ = false;
+                if(ec == boost::asio::error::operation_aborted)
+                {
+                    return;
+                }
+
+                time_type const oldest = now() - idle_timeout_;
+                bool idle_left = false;
+                for(typename origin_map::iterator o = origins_.begin(); o != origins_.end(); ++o)
+                {
+                    std::vector<link_ptr> expired;
+                    link_list & links = o->second->links;
+                    for(typename link_list::iterator it = links.begin(); it != links.end(); ++it)
+                    {
+                        if((*it)->pending.empty() && !(*it)->upload)
+                        {
+                            if((*it)->idle_since <= oldest)
+                            {
+                                expired.push_back(*it);
+                            }
+                            else
+                            {
+                                idle_left = true;
+                            }
+                        }
+                    }
+                    for(typename std::vector<link_ptr>::iterator it = expired.begin(); it != expired.end(); ++it)
+                    {
+                        shutdown(*it);
+                    }
+
+                    session_ptr & session = o->second->session;
+                    if(session && !session->active())
+                    {
+                        if(session->idle_since() <= oldest)
+                        {
+                            session->close();
+                            session.reset();
+                            o->second->negotiated = false;
+                        }
+                        else
+                        {
+                            idle_left = true;
+                        }
+                    }
+                }
+                if(idle_left)
+                {
+                    schedule_sweep();
+                }
+            }
+
+            static bool is_head(request_type const & request)
+            {
+                return request.method() == "HEAD";
+            }
+
+            // Requests which may be repeated without side effects
+            // (RFC 7231, 4.2.2), the default method is GET
+            static bool idempotent(request_type const & request)
+            {
+                string_type const & method = request.method();
+                return method.empty() || method == "GET" || method == "HEAD" || method == "OPTIONS"
+                    || method == "TRACE" || method == "PUT" || method == "DELETE";
+            }
+
+            static time_type now()
+            {
+                return boost::posix_time::microsec_clock::universal_time();
+            }
+
+        protected:
+            service_type &                  service_;
+            ssl_context_type *              context_;
+            proxy_base_ptr                  proxy_;
+            origin_map                      origins_;
+            std::vector<header_type>        defaults_;
+            std::size_t                     max_connections_;
+            std::size_t                     pipeline_depth_;
+            std::size_t                     max_redirects_;
+            std::size_t                     max_replays_;
+            duration_type                   idle_timeout_;
+            boost::asio::deadline_timer     sweeper_;
+            bool                            sweeping_;
+            bool                            http2_;
+            bool                            decode_content_;
+            std::size_t                     max_ratio_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_CLIENT_HPP_INCLUDED
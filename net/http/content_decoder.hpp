@@ -0,0 +1,406 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_CONTENT_DECODER_HPP_INCLUDED
+#define GUARD_NET_HTTP_CONTENT_DECODER_HPP_INCLUDED
+
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/http/detail/header_utils.hpp>
+#include <net/http/detail/traits.hpp>
+#include <net/error.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstring>
+#include <zlib.h>
+#ifdef NETPP_HAS_BROTLI
+#include <brotli/decode.h>
+#endif
+
+namespace net
+{
+    namespace http
+    {
+        // Streaming decoder for the Content-Encoding of a body (RFC 7231,
+        // 3.1.2): gzip and deflate, and br when built with NETPP_HAS_BROTLI
+        // (link brotlidec).
+        //
+        // The body is fed slice by slice as it arrives and read back in
+        // pieces of at most OUTPUT_SIZE, so memory use does not depend on
+        // the body size. Fed data is not copied, it has to stay valid until
+        // read_some consumed it (see pending) or detach_input was called.
+        // Beyond the first RATIO_GRACE bytes the output may not exceed
+        // max_ratio times the input, which stops decompression bombs.
+        template<typename Tag>
+        class basic_content_decoder
+            : boost::noncopyable
+        {
+        public:
+            typedef typename string_traits<Tag>::type       string_type;
+            typedef boost::system::error_code               error_code;
+
+            enum coding
+            {
+                IDENTITY,
+                GZIP,
+                DEFLATE,
+                BROTLI,
+                UNSUPPORTED
+            };
+
+            enum
+            {
+                OUTPUT_SIZE         = 0x4000,
+                DEFAULT_MAX_RATIO   = 100,
+                RATIO_GRACE         = 0x100000
+            };
+
+            basic_content_decoder()
+                : coding_(IDENTITY)
+                , max_ratio_(DEFAULT_MAX_RATIO)
+                , zlib_()
+                , zlib_ready_(false)
+                , running_(false)
+#ifdef NETPP_HAS_BROTLI
+                , brotli_(0)
+#endif
+                , input_(0)
+                , input_size_(0)
+                , total_in_(0)
+                , total_out_(0)
+                , started_(false)
+                , ended_(false)
+                , full_(false)
+                , saved_()
+                , output_()
+            {}
+
+            ~basic_content_decoder()
+            {
+                if(zlib_ready_)
+                {
+                    inflateEnd(&zlib_);
+                }
+#ifdef NETPP_HAS_BROTLI
+                if(brotli_)
+                {
+                    BrotliDecoderDestroyInstance(brotli_);
+                }
+#endif
+            }
+
+            // The codings this decoder handles, as sent in Accept-Encoding
+            static char const * accepted()
+            {
+#ifdef NETPP_HAS_BROTLI
+                return "gzip, deflate, br";
+#else
+                return "gzip, deflate";
+#endif
+            }
+
+            static coding parse(string_type const & content_encoding)
+            {
+                std::size_t first = 0;
+                std::size_t last = content_encoding.size();
+                while(first < last && (content_encoding[first] == ' ' || content_encoding[first] == '\t'))
+                {
+                    ++first;
+                }
+                while(last > first && (content_encoding[last - 1] == ' ' || content_encoding[last - 1] == '\t'))
+                {
+                    --last;
+                }
+                char const * name = content_encoding.data() + first;
+                std::size_t const length = last - first;
+                if(!length || is(name, length, "identity"))
+                {
+                    return IDENTITY;
+                }
+                if(is(name, length, "gzip") || is(name, length, "x-gzip"))
+                {
+                    return GZIP;
+                }
+                if(is(name, length, "deflate"))
+                {
+                    return DEFLATE;
+                }
+#ifdef NETPP_HAS_BROTLI
+                if(is(name, length, "br"))
+                {
+                    return BROTLI;
+                }
+#endif
+                // Unknown codings and more than one of them
+                return UNSUPPORTED;
+            }
+
+            // Prepares for a body with the given Content-Encoding, false if
+            // it is not supported. Identity and unsupported codings are
+            // passed through as they are, active is false then.
+            bool reset(string_type const & content_encoding)
+            {
+                coding const c = parse(content_encoding);
+                coding_     = c == UNSUPPORTED ? IDENTITY : c;
+                input_      = 0;
+                input_size_ = 0;
+                total_in_   = 0;
+                total_out_  = 0;
+                started_    = false;
+                ended_      = false;
+                full_       = false;
+                running_    = false;
+                saved_.clear();
+#ifdef NETPP_HAS_BROTLI
+                if(brotli_)
+                {
+                    BrotliDecoderDestroyInstance(brotli_);
+                    brotli_ = 0;
+                }
+#endif
+                return c != UNSUPPORTED;
+            }
+
+            bool active() const
+            {
+                return coding_ != IDENTITY;
+            }
+
+            // 0 disables the limit
+            void set_max_ratio(std::size_t ratio)
+            {
+                max_ratio_ = ratio;
+            }
+
+            void feed(char const * data, std::size_t size)
+            {
+                input_      = data;
+                input_size_ = size;
+                started_    = started_ || size;
+            }
+
+            // Input left or output not read yet, call read_some
+            bool pending() const
+            {
+                return input_size_ || full_;
+            }
+
+            // Decodes the next piece of output, data is valid until the next
+            // call. size is 0 once all input is used up.
+            error_code read_some(char const *& data, std::size_t & size)
+            {
+                data = 0;
+                size = 0;
+                full_ = false;
+                if(coding_ == IDENTITY)
+                {
+                    // Passed through
+                    data = input_;
+                    size = input_size_;
+                    input_size_ = 0;
+                    return error_code();
+                }
+                if(!input_size_ && ended_)
+                {
+                    return error_code();
+                }
+                if(output_.empty())
+                {
+                    output_ = util::lease_buffer(OUTPUT_SIZE);
+                }
+
+                error_code ec;
+#ifdef NETPP_HAS_BROTLI
+                if(coding_ == BROTLI)
+                {
+                    ec = read_brotli(size);
+                }
+                else
+#endif
+                {
+                    ec = read_zlib(size);
+                }
+                if(ec)
+                {
+                    size = 0;
+                    return ec;
+                }
+
+                total_out_ += size;
+                if(max_ratio_ && total_out_ > RATIO_GRACE && total_out_ / max_ratio_ > total_in_)
+                {
+                    size = 0;
+                    return net::error::http_content_ratio_exceeded;
+                }
+                data = output_.data();
+                return error_code();
+            }
+
+            // Copies the input not decoded yet, the fed buffer may go away
+            void detach_input()
+            {
+                if(input_size_ && input_ != saved_.data())
+                {
+                    saved_.assign(input_, input_size_);
+                    input_ = saved_.data();
+                }
+            }
+
+            // The body ended, false if the compressed data was cut short
+            bool finish() const
+            {
+                return !active() || !started_ || ended_;
+            }
+
+        protected:
+            static bool is(char const * name, std::size_t length, char const * coding)
+            {
+                return std::strlen(coding) == length && detail::equals_ignore_case(name, coding, length);
+            }
+
+            error_code read_zlib(std::size_t & size)
+            {
+                if(ended_)
+                {
+                    // Data behind the end, another gzip member or garbage
+                    if(coding_ != GZIP || static_cast<unsigned char>(*input_) != 0x1f)
+                    {
+                        input_size_ = 0;
+                        return error_code();
+                    }
+                    ended_ = false;
+                    if(inflateReset(&zlib_) != Z_OK)
+                    {
+                        return net::error::http_content_encoding_error;
+                    }
+                }
+                else if(!running_)
+                {
+                    if(!input_size_)
+                    {
+                        return error_code();
+                    }
+                    if(!start_zlib())
+                    {
+                        return net::error::http_content_encoding_error;
+                    }
+                    running_ = true;
+                }
+
+                zlib_.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(input_));
+                zlib_.avail_in  = static_cast<uInt>(input_size_);
+                zlib_.next_out  = reinterpret_cast<Bytef *>(output_.data());
+                zlib_.avail_out = OUTPUT_SIZE;
+                int const result = inflate(&zlib_, Z_NO_FLUSH);
+                if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                {
+                    return net::error::http_content_encoding_error;
+                }
+
+                std::size_t const consumed = input_size_ - zlib_.avail_in;
+                input_      += consumed;
+                input_size_ -= consumed;
+                total_in_   += consumed;
+                size  = OUTPUT_SIZE - zlib_.avail_out;
+                full_ = zlib_.avail_out == 0;
+                ended_ = result == Z_STREAM_END;
+                return error_code();
+            }
+
+            bool start_zlib()
+            {
+                int bits = 15 + 16;
+                if(coding_ == DEFLATE)
+                {
+                    // Meant to be zlib wrapped, some servers send raw deflate
+                    unsigned char const * head = reinterpret_cast<unsigned char const *>(input_);
+                    bool const wrapped = (head[0] & 0x0f) == 8 && (head[0] >> 4) <= 7
+                        && (input_size_ < 2 || ((head[0] << 8) | head[1]) % 31 == 0);
+                    bits = wrapped ? 15 : -15;
+                }
+                if(zlib_ready_)
+                {
+                    return inflateReset2(&zlib_, bits) == Z_OK;
+                }
+                std::memset(&zlib_, 0, sizeof(zlib_));
+                zlib_ready_ = inflateInit2(&zlib_, bits) == Z_OK;
+                return zlib_ready_;
+            }
+
+#ifdef NETPP_HAS_BROTLI
+            error_code read_brotli(std::size_t & size)
+            {
+                if(!brotli_ && !(brotli_ = BrotliDecoderCreateInstance(0, 0, 0)))
+                {
+                    return net::error::http_content_encoding_error;
+                }
+                std::size_t available_in  = input_size_;
+                std::size_t available_out = OUTPUT_SIZE;
+                uint8_t const * next_in = reinterpret_cast<uint8_t const *>(input_);
+                uint8_t * next_out = reinterpret_cast<uint8_t *>(output_.data());
+                BrotliDecoderResult const result = BrotliDecoderDecompressStream(brotli_, &available_in, &next_in, &available_out, &next_out, 0);
+                if(result == BROTLI_DECODER_RESULT_ERROR)
+                {
+                    return net::error::http_content_encoding_error;
+                }
+
+                std::size_t const consumed = input_size_ - available_in;
+                input_      += consumed;
+                input_size_ -= consumed;
+                total_in_   += consumed;
+                size  = OUTPUT_SIZE - available_out;
+                full_ = result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT;
+                if(result == BROTLI_DECODER_RESULT_SUCCESS)
+                {
+                    // Nothing may follow
+                    ended_ = true;
+                    input_size_ = 0;
+                }
+                return error_code();
+            }
+#endif
+
+        private:
+            coding              coding_;
+            std::size_t         max_ratio_;
+            z_stream            zlib_;
+            bool                zlib_ready_;    // initialized, kept for later bodies
+            bool                running_;       // started on this body
+#ifdef NETPP_HAS_BROTLI
+            BrotliDecoderState *brotli_;
+#endif
+            char const *        input_;         // fed, not decoded yet
+            std::size_t         input_size_;
+            std::size_t         total_in_;
+            std::size_t         total_out_;
+            bool                started_;       // any input was fed
+            bool                ended_;         // the compressed stream ended
+            bool                full_;          // the last piece filled the buffer
+            string_type         saved_;         // see detach_input
+            util::buffer_lease  output_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_CONTENT_DECODER_HPP_INCLUDED
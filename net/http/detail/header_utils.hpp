@@ -0,0 +1,206 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_DETAIL_HEADER_UTILS_HPP_INCLUDED
+#define GUARD_NET_HTTP_DETAIL_HEADER_UTILS_HPP_INCLUDED
+
+#include <net/http/basic_message.hpp>
+#include <cstddef>
+#include <cstring>
+
+namespace net
+{
+    namespace http
+    {
+        namespace detail
+        {
+            inline bool equals_ignore_case(char const * a, char const * b, std::size_t length)
+            {
+                for(std::size_t i = 0; i < length; ++i)
+                {
+                    char x = a[i];
+                    char y = b[i];
+                    if(x >= 'A' && x <= 'Z')
+                    {
+                        x = static_cast<char>(x - 'A' + 'a');
+                    }
+                    if(y >= 'A' && y <= 'Z')
+                    {
+                        y = static_cast<char>(y - 'A' + 'a');
+                    }
+                    if(x != y)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Case insensitive lookup of the first header called name
+            template<typename Tag>
+            bool find_header(net::basic_message<Tag> const & message, char const * name, typename string_traits<Tag>::type & value)
+            {
+                typedef typename header_collection_traits<Tag>::type headers_type;
+                std::size_t const length = std::strlen(name);
+                for(typename headers_type::const_iterator it = message.headers().begin(); it != message.headers().end(); ++it)
+                {
+                    if(it->first.size() == length && equals_ignore_case(it->first.data(), name, length))
+                    {
+                        value = it->second;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Case insensitive removal of all headers called name
+            template<typename Tag>
+            void remove_header(net::basic_message<Tag> & message, char const * name)
+            {
+                typedef typename header_collection_traits<Tag>::type headers_type;
+                std::size_t const length = std::strlen(name);
+                headers_type & headers = message.headers();
+                for(typename headers_type::iterator it = headers.begin(); it != headers.end();)
+                {
+                    if(it->first.size() == length && equals_ignore_case(it->first.data(), name, length))
+                    {
+                        headers.erase(it++);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            }
+
+            // Case insensitive comparison of the element [begin, end) of a
+            // comma separated list with token, surrounding whitespace ignored
+            template<typename String>
+            bool element_equals(String const & value, std::size_t begin, std::size_t end, char const * token)
+            {
+                while(begin < end && (value[begin] == ' ' || value[begin] == '\t'))
+                {
+                    ++begin;
+                }
+                while(end > begin && (value[end - 1] == ' ' || value[end - 1] == '\t'))
+                {
+                    --end;
+                }
+                std::size_t const length = std::strlen(token);
+                return end - begin == length && equals_ignore_case(value.data() + begin, token, length);
+            }
+
+            // True if one element of the comma separated list value is token
+            template<typename String>
+            bool contains_token(String const & value, char const * token)
+            {
+                std::size_t begin = 0;
+                for(std::size_t i = 0; i <= value.size(); ++i)
+                {
+                    if(i == value.size() || value[i] == ',')
+                    {
+                        if(element_equals(value, begin, i, token))
+                        {
+                            return true;
+                        }
+                        begin = i + 1;
+                    }
+                }
+                return false;
+            }
+
+            // True if the last non-empty element of the comma separated list
+            // value is token
+            template<typename String>
+            bool last_token_is(String const & value, char const * token)
+            {
+                std::size_t end = value.size();
+                for(std::size_t i = value.size(); i > 0; --i)
+                {
+                    if(value[i - 1] != ',')
+                    {
+                        continue;
+                    }
+                    if(!element_equals(value, i, end, ""))
+                    {
+                        return element_equals(value, i, end, token);
+                    }
+                    end = i - 1;
+                }
+                return element_equals(value, 0, end, token);
+            }
+
+            // Size of the header block including the empty line, 0 if incomplete
+            inline std::size_t find_header_end(char const * data, std::size_t size)
+            {
+                for(std::size_t i = 0; i + 1 < size; ++i)
+                {
+                    if(data[i] != '\n')
+                    {
+                        continue;
+                    }
+                    if(data[i + 1] == '\n')
+                    {
+                        return i + 2;
+                    }
+                    if(data[i + 1] == '\r' && i + 2 < size && data[i + 2] == '\n')
+                    {
+                        return i + 3;
+                    }
+                }
+                return 0;
+            }
+
+            // Parses a Content-Length value, false if it is malformed or
+            // does not fit into value
+            template<typename String, typename Integer>
+            bool parse_length(String const & text, Integer & value)
+            {
+                Integer const limit = static_cast<Integer>(~Integer(0));
+                value = 0;
+                if(text.empty())
+                {
+                    return false;
+                }
+                for(typename String::const_iterator it = text.begin(); it != text.end(); ++it)
+                {
+                    if(*it < '0' || *it > '9')
+                    {
+                        return false;
+                    }
+                    Integer const digit = static_cast<Integer>(*it - '0');
+                    if(value > (limit - digit) / 10)
+                    {
+                        return false;
+                    }
+                    value = value * 10 + digit;
+                }
+                return true;
+            }
+        }
+    }
+}
+
+#endif //GUARD_NET_HTTP_DETAIL_HEADER_UTILS_HPP_INCLUDED
@@ -122,6 +122,12 @@ namespace net
                 return( c >= '0' && c <= '9' );
             }
 
+            // returns true if the argument may appear in a token (RFC 7230, 3.2.6)
+            inline static bool is_token( char_type c )
+            {
+                return is_char( c ) && !is_control( c ) && !is_special( c );
+            }
+
             // returns true if the argument is a hexadecimal digit
             inline static bool is_hex_digit( char_type c )
             {
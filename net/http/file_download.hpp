@@ -0,0 +1,452 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_FILE_DOWNLOAD_HPP_INCLUDED
+#define GUARD_NET_HTTP_FILE_DOWNLOAD_HPP_INCLUDED
+
+#if !defined(WIN32) && !defined(WIN64)
+
+#include <net/http/client.hpp>
+#include <net/http/detail/header_utils.hpp>
+#include <net/client/utils/file_sync_service.hpp>
+#include <net/error.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace net
+{
+    namespace http
+    {
+        // Downloads a resource into a file as the body arrives, nothing of
+        // it is kept in memory. With a Content-Length the file is sized up
+        // front (posix_fallocate where available, so a full disk fails the
+        // download at the start rather than half way), the body is written
+        // with pwrite(2) at its offset.
+        //
+        // Should the connection break off during the body, the download
+        // goes on from the last byte written with a Range request, guarded
+        // by If-Range with the validator of the first response, up to
+        // max_resumes times. A server which answers with the whole resource
+        // again starts the file over. Resuming needs the bytes on the wire
+        // to be the bytes of the file, so the request asks for the identity
+        // coding unless it names codings itself.
+        //
+        // Every sync_interval bytes the written data is flushed by fsync on
+        // a background thread (see util::file_sync_service), so the final
+        // flush is short and the page cache does not fill up with dirty
+        // pages. The handler is called once the file is on disk, with the
+        // last response (206 after a resume) and the size of the file.
+        // The file is created, or truncated, once a 2xx response arrives;
+        // other responses complete without touching it. A failing write
+        // cancels the request instead of receiving the rest of the body.
+        template<typename Tag>
+        class basic_file_download
+            : public boost::enable_shared_from_this< basic_file_download<Tag> >
+            , boost::noncopyable
+        {
+        public:
+            typedef boost::shared_ptr<basic_file_download>                  self_ptr;
+            typedef basic_http_client<Tag>                                  client_type;
+            typedef typename client_type::self_ptr                          client_ptr;
+            typedef typename client_type::request_type                      request_type;
+            typedef typename client_type::response_type                     response_type;
+            typedef typename client_type::request_handle                    request_handle;
+            typedef typename string_traits<Tag>::type                       string_type;
+            typedef typename header_collection_traits<Tag>::type            headers_type;
+            typedef boost::system::error_code                               error_code;
+            typedef boost::uint64_t                                         size_type;
+            typedef boost::function< void(error_code const &, response_type const &, size_type) >  completion_handler;
+
+            enum { DEFAULT_SYNC_INTERVAL = 0x4000000 };
+
+            basic_file_download(client_ptr client, string_type const & path)
+                : client_(client)
+                , path_(path)
+                , file_(-1)
+                , url_()
+                , request_()
+                , pending_()
+                , response_()
+                , handler_()
+                , validator_()
+                , max_resumes_(3)
+                , sync_interval_(DEFAULT_SYNC_INTERVAL)
+                , written_(0)
+                , allocated_(0)
+                , unsynced_(0)
+                , error_()
+                , started_(false)
+                , accepted_(false)
+                , resumable_(false)
+                , syncing_(false)
+                , done_(false)
+            {}
+
+            ~basic_file_download()
+            {
+                if(file_ >= 0)
+                {
+                    ::close(file_);
+                }
+            }
+
+            // Attempts to go on after the connection broke off, default 3
+            void set_max_resumes(std::size_t resumes)
+            {
+                max_resumes_ = resumes;
+            }
+
+            // Bytes written between background flushes, 0 only flushes at the end
+            void set_sync_interval(size_type bytes)
+            {
+                sync_interval_ = bytes;
+            }
+
+            // Bytes in the file so far
+            size_type written() const
+            {
+                return written_;
+            }
+
+            // Resource and query of request are taken from url, see
+            // basic_http_client::async_request
+            void async_download(string_type const & url, request_type const & request, completion_handler handler)
+            {
+                url_     = url;
+                request_ = request;
+                handler_ = handler;
+                string_type ignored;
+                if(!detail::find_header(request_, "Accept-Encoding", ignored))
+                {
+                    request_.headers().insert(typename headers_type::value_type("Accept-Encoding", "identity"));
+                }
+                attempt();
+            }
+
+        protected:
+            void attempt()
+            {
+                started_  = false;
+                accepted_ = false;
+                request_type request(request_);
+                if(written_)
+                {
+                    char range[32];
+                    std::sprintf(range, "bytes=%llu-", static_cast<unsigned long long>(written_));
+                    detail::remove_header(request, "Range");
+                    detail::remove_header(request, "If-Range");
+                    request.headers().insert(typename headers_type::value_type("Range", range));
+                    if(!validator_.empty())
+                    {
+                        request.headers().insert(typename headers_type::value_type("If-Range", validator_));
+                    }
+                }
+                pending_ = client_->async_request(
+                    url_,
+                    request,
+                    boost::bind(&basic_file_download::on_complete, this->shared_from_this(), _1, _2),
+                    boost::bind(&basic_file_download::on_body, this->shared_from_this(), _1, _2, _3)
+                );
+            }
+
+            void on_body(response_type const & response, char const * data, std::size_t size)
+            {
+                if(!started_)
+                {
+                    start(response);
+                }
+                if(accepted_ && !error_)
+                {
+                    write(data, size);
+                }
+                if(error_)
+                {
+                    // The rest of the body has nowhere to go
+                    client_->cancel(pending_);
+                    pending_.reset();
+                }
+            }
+
+            void on_complete(error_code const & ec, response_type const & response)
+            {
+                response_ = response;
+                if(!ec && !started_)
+                {
+                    start(response);
+                }
+                if(ec && !error_ && resumable(ec) && max_resumes_)
+                {
+                    --max_resumes_;
+                    attempt();
+                    return;
+                }
+                if(ec && !error_)
+                {
+                    error_ = ec;
+                }
+                done_ = true;
+                // Drop what was allocated but not written, also after an
+                // error so the file can be resumed from its size
+                if(allocated_ > written_ && ::ftruncate(file_, static_cast<off_t>(written_)) != 0 && !error_)
+                {
+                    fail_errno();
+                }
+                if(error_ || !accepted_)
+                {
+                    finish();
+                }
+                else if(!syncing_)
+                {
+                    sync();
+                }
+            }
+
+            // The head of this attempt's response, decides whether its body
+            // goes into the file
+            void start(response_type const & response)
+            {
+                started_ = true;
+                unsigned const status = response.status_code();
+                if(written_)
+                {
+                    size_type first = 0;
+                    if(status == 206 && range_start(response, first) && first == written_)
+                    {
+                        accepted_ = true;
+                        return;
+                    }
+                    if(status != 200)
+                    {
+                        error_ = net::error::http_resume_failed;
+                        return;
+                    }
+                    // The resource changed, or the server ignored the range
+                    written_ = 0;
+                    unsynced_ = 0;
+                    if(::ftruncate(file_, 0) != 0)
+                    {
+                        fail_errno();
+                        return;
+                    }
+                    allocated_ = 0;
+                }
+                else if(status < 200 || status >= 300)
+                {
+                    return;
+                }
+                else if(file_ < 0)
+                {
+                    file_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                    if(file_ < 0)
+                    {
+                        fail_errno();
+                        return;
+                    }
+                }
+                accepted_ = true;
+                prepare(response);
+            }
+
+            void prepare(response_type const & response)
+            {
+                string_type value;
+                string_type coding;
+                bool const encoded = detail::find_header(response, "Content-Encoding", coding) && coding != "identity";
+                validator_.clear();
+                if(detail::find_header(response, "ETag", value) && value.compare(0, 2, "W/") != 0)
+                {
+                    validator_ = value;
+                }
+                else if(detail::find_header(response, "Last-Modified", value))
+                {
+                    validator_ = value;
+                }
+                bool const ranges = detail::find_header(response, "Accept-Ranges", value) && detail::contains_token(value, "bytes");
+                resumable_ = !encoded && response.status_code() == 200 && (ranges || !validator_.empty());
+
+                size_type length = 0;
+                if(!encoded && detail::find_header(response, "Content-Length", value) && detail::parse_length(value, length) && length)
+                {
+                    allocate(length);
+                }
+            }
+
+            void allocate(size_type length)
+            {
+#if defined(__linux__)
+                int const result = ::posix_fallocate(file_, 0, static_cast<off_t>(length));
+                if(!result)
+                {
+                    allocated_ = length;
+                    return;
+                }
+                if(result != EINVAL && result != EOPNOTSUPP)
+                {
+                    error_ = error_code(result, boost::asio::error::get_system_category());
+                    return;
+                }
+#endif
+                // Not supported by the file system, at least set the size
+                if(::ftruncate(file_, static_cast<off_t>(length)) != 0)
+                {
+                    fail_errno();
+                    return;
+                }
+                allocated_ = length;
+            }
+
+            void write(char const * data, std::size_t size)
+            {
+                while(size)
+                {
+                    ssize_t const bytes = ::pwrite(file_, data, size, static_cast<off_t>(written_));
+                    if(bytes < 0)
+                    {
+                        if(errno == EINTR)
+                        {
+                            continue;
+                        }
+                        fail_errno();
+                        return;
+                    }
+                    data     += bytes;
+                    size     -= static_cast<std::size_t>(bytes);
+                    written_ += static_cast<size_type>(bytes);
+                    unsynced_ += static_cast<size_type>(bytes);
+                }
+                if(sync_interval_ && unsynced_ >= sync_interval_ && !syncing_)
+                {
+                    sync();
+                }
+            }
+
+            void sync()
+            {
+                syncing_  = true;
+                unsynced_ = 0;
+                boost::asio::use_service< util::file_sync_service<Tag> >(client_->get_io_service()).async_sync(
+                    file_,
+                    boost::bind(&basic_file_download::on_synced, this->shared_from_this(), _1)
+                );
+            }
+
+            void on_synced(error_code const & ec)
+            {
+                syncing_ = false;
+                if(ec && !error_)
+                {
+                    error_ = ec;
+                }
+                if(!done_)
+                {
+                    return;
+                }
+                if(!error_ && unsynced_)
+                {
+                    // Written while the last flush ran
+                    sync();
+                    return;
+                }
+                finish();
+            }
+
+            void finish()
+            {
+                completion_handler handler;
+                handler.swap(handler_);
+                if(handler)
+                {
+                    handler(error_, response_, written_);
+                }
+            }
+
+            // A dropped connection, as opposed to the server's or the
+            // caller's doing
+            bool resumable(error_code const & ec) const
+            {
+                if(!accepted_ || !resumable_ || !written_ || ec == boost::asio::error::operation_aborted)
+                {
+                    return false;
+                }
+                return ec.category() != net::error::get_http_category() || ec == net::error::http_connection_closed;
+            }
+
+            // First byte of a 206 response, Content-Range: bytes first-last/length
+            static bool range_start(response_type const & response, size_type & first)
+            {
+                string_type value;
+                if(!detail::find_header(response, "Content-Range", value) || value.compare(0, 6, "bytes ") != 0)
+                {
+                    return false;
+                }
+                typename string_type::size_type const dash = value.find('-', 6);
+                return dash != string_type::npos && detail::parse_length(value.substr(6, dash - 6), first);
+            }
+
+            void fail_errno()
+            {
+                error_ = error_code(errno, boost::asio::error::get_system_category());
+            }
+
+        private:
+            client_ptr          client_;
+            string_type         path_;
+            int                 file_;
+            string_type         url_;
+            request_type        request_;
+            request_handle      pending_;       // the attempt in progress
+            response_type       response_;
+            completion_handler  handler_;
+            string_type         validator_;     // for If-Range
+            std::size_t         max_resumes_;
+            size_type           sync_interval_;
+            size_type           written_;
+            size_type           allocated_;
+            size_type           unsynced_;
+            error_code          error_;
+            bool                started_;       // the head of this attempt arrived
+            bool                accepted_;      // its body goes into the file
+            bool                resumable_;
+            bool                syncing_;
+            bool                done_;          // no more data, complete once flushed
+        };
+    }
+}
+
+#endif
+
+#endif //GUARD_NET_HTTP_FILE_DOWNLOAD_HPP_INCLUDED
@@ -0,0 +1,1118 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_HPACK_HPP_INCLUDED
+#define GUARD_NET_HTTP_HPACK_HPP_INCLUDED
+
+#include <net/http/detail/traits.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace net
+{
+    namespace http
+    {
+        namespace detail
+        {
+            enum
+            {
+                HPACK_STATIC_TABLE_SIZE = 61,
+                HPACK_ENTRY_OVERHEAD    = 32,   // per table entry, RFC 7541 4.1
+                HPACK_EOS               = 256
+            };
+
+            struct hpack_static_field
+            {
+                char const * name;
+                char const * value;
+            };
+
+            // RFC 7541, Appendix A. Index 1 is the first entry.
+            inline hpack_static_field const * hpack_static_table()
+            {
+                static hpack_static_field const table[HPACK_STATIC_TABLE_SIZE] =
+                {
+                { ":authority", "" },
+                { ":method", "GET" },
+                { ":method", "POST" },
+                { ":path", "/" },
+                { ":path", "/index.html" },
+                { ":scheme", "http" },
+                { ":scheme", "https" },
+                { ":status", "200" },
+                { ":status", "204" },
+                { ":status", "206" },
+                { ":status", "304" },
+                { ":status", "400" },
+                { ":status", "404" },
+                { ":status", "500" },
+                { "accept-charset", "" },
+                { "accept-encoding", "gzip, deflate" },
+                { "accept-language", "" },
+                { "accept-ranges", "" },
+                { "accept", "" },
+                { "access-control-allow-origin", "" },
+                { "age", "" },
+                { "allow", "" },
+                { "authorization", "" },
+                { "cache-control", "" },
+                { "content-disposition", "" },
+                { "content-encoding", "" },
+                { "content-language", "" },
+                { "content-length", "" },
+                { "content-location", "" },
+                { "content-range", "" },
+                { "content-type", "" },
+                { "cookie", "" },
+                { "date", "" },
+                { "etag", "" },
+                { "expect", "" },
+                { "expires", "" },
+                { "from", "" },
+                { "host", "" },
+                { "if-match", "" },
+                { "if-modified-since", "" },
+                { "if-none-match", "" },
+                { "if-range", "" },
+                { "if-unmodified-since", "" },
+                { "last-modified", "" },
+                { "link", "" },
+                { "location", "" },
+                { "max-forwards", "" },
+                { "proxy-authenticate", "" },
+                { "proxy-authorization", "" },
+                { "range", "" },
+                { "referer", "" },
+                { "refresh", "" },
+                { "retry-after", "" },
+                { "server", "" },
+                { "set-cookie", "" },
+                { "strict-transport-security", "" },
+                { "transfer-encoding", "" },
+                { "user-agent", "" },
+                { "vary", "" },
+                { "via", "" },
+                { "www-authenticate", "" },
+                };
+                return table;
+            }
+
+            struct huffman_symbol
+            {
+                boost::uint32_t code;
+                boost::uint8_t  bits;
+            };
+
+            // RFC 7541, Appendix B, indexed by octet, the last one is EOS
+            inline huffman_symbol const * huffman_codes()
+            {
+                static huffman_symbol const codes[HPACK_EOS + 1] =
+                {
+                { 0x00001ff8, 13 }, { 0x007fffd8, 23 }, { 0x0fffffe2, 28 }, { 0x0fffffe3, 28 },
+                { 0x0fffffe4, 28 }, { 0x0fffffe5, 28 }, { 0x0fffffe6, 28 }, { 0x0fffffe7, 28 },
+                { 0x0fffffe8, 28 }, { 0x00ffffea, 24 }, { 0x3ffffffc, 30 }, { 0x0fffffe9, 28 },
+                { 0x0fffffea, 28 }, { 0x3ffffffd, 30 }, { 0x0fffffeb, 28 }, { 0x0fffffec, 28 },
+                { 0x0fffffed, 28 }, { 0x0fffffee, 28 }, { 0x0fffffef, 28 }, { 0x0ffffff0, 28 },
+                { 0x0ffffff1, 28 }, { 0x0ffffff2, 28 }, { 0x3ffffffe, 30 }, { 0x0ffffff3, 28 },
+                { 0x0ffffff4, 28 }, { 0x0ffffff5, 28 }, { 0x0ffffff6, 28 }, { 0x0ffffff7, 28 },
+                { 0x0ffffff8, 28 }, { 0x0ffffff9, 28 }, { 0x0ffffffa, 28 }, { 0x0ffffffb, 28 },
+                { 0x00000014,  6 }, { 0x000003f8, 10 }, { 0x000003f9, 10 }, { 0x00000ffa, 12 },
+                { 0x00001ff9, 13 }, { 0x00000015,  6 }, { 0x000000f8,  8 }, { 0x000007fa, 11 },
+                { 0x000003fa, 10 }, { 0x000003fb, 10 }, { 0x000000f9,  8 }, { 0x000007fb, 11 },
+                { 0x000000fa,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+                { 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+                { 0x0000001a,  6 }, { 0x0000001b,  6 }, { 0x0000001c,  6 }, { 0x0000001d,  6 },
+                { 0x0000001e,  6 }, { 0x0000001f,  6 }, { 0x0000005c,  7 }, { 0x000000fb,  8 },
+                { 0x00007ffc, 15 }, { 0x00000020,  6 }, { 0x00000ffb, 12 }, { 0x000003fc, 10 },
+                { 0x00001ffa, 13 }, { 0x00000021,  6 }, { 0x0000005d,  7 }, { 0x0000005e,  7 },
+                { 0x0000005f,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+                { 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+                { 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006a,  7 },
+                { 0x0000006b,  7 }, { 0x0000006c,  7 }, { 0x0000006d,  7 }, { 0x0000006e,  7 },
+                { 0x0000006f,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+                { 0x000000fc,  8 }, { 0x00000073,  7 }, { 0x000000fd,  8 }, { 0x00001ffb, 13 },
+                { 0x0007fff0, 19 }, { 0x00001ffc, 13 }, { 0x00003ffc, 14 }, { 0x00000022,  6 },
+                { 0x00007ffd, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+                { 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+                { 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+                { 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002a,  6 }, { 0x00000007,  5 },
+                { 0x0000002b,  6 }, { 0x00000076,  7 }, { 0x0000002c,  6 }, { 0x00000008,  5 },
+                { 0x00000009,  5 }, { 0x0000002d,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+                { 0x00000079,  7 }, { 0x0000007a,  7 }, { 0x0000007b,  7 }, { 0x00007ffe, 15 },
+                { 0x000007fc, 11 }, { 0x00003ffd, 14 }, { 0x00001ffd, 13 }, { 0x0ffffffc, 28 },
+                { 0x000fffe6, 20 }, { 0x003fffd2, 22 }, { 0x000fffe7, 20 }, { 0x000fffe8, 20 },
+                { 0x003fffd3, 22 }, { 0x003fffd4, 22 }, { 0x003fffd5, 22 }, { 0x007fffd9, 23 },
+                { 0x003fffd6, 22 }, { 0x007fffda, 23 }, { 0x007fffdb, 23 }, { 0x007fffdc, 23 },
+                { 0x007fffdd, 23 }, { 0x007fffde, 23 }, { 0x00ffffeb, 24 }, { 0x007fffdf, 23 },
+                { 0x00ffffec, 24 }, { 0x00ffffed, 24 }, { 0x003fffd7, 22 }, { 0x007fffe0, 23 },
+                { 0x00ffffee, 24 }, { 0x007fffe1, 23 }, { 0x007fffe2, 23 }, { 0x007fffe3, 23 },
+                { 0x007fffe4, 23 }, { 0x001fffdc, 21 }, { 0x003fffd8, 22 }, { 0x007fffe5, 23 },
+                { 0x003fffd9, 22 }, { 0x007fffe6, 23 }, { 0x007fffe7, 23 }, { 0x00ffffef, 24 },
+                { 0x003fffda, 22 }, { 0x001fffdd, 21 }, { 0x000fffe9, 20 }, { 0x003fffdb, 22 },
+                { 0x003fffdc, 22 }, { 0x007fffe8, 23 }, { 0x007fffe9, 23 }, { 0x001fffde, 21 },
+                { 0x007fffea, 23 }, { 0x003fffdd, 22 }, { 0x003fffde, 22 }, { 0x00fffff0, 24 },
+                { 0x001fffdf, 21 }, { 0x003fffdf, 22 }, { 0x007fffeb, 23 }, { 0x007fffec, 23 },
+                { 0x001fffe0, 21 }, { 0x001fffe1, 21 }, { 0x003fffe0, 22 }, { 0x001fffe2, 21 },
+                { 0x007fffed, 23 }, { 0x003fffe1, 22 }, { 0x007fffee, 23 }, { 0x007fffef, 23 },
+                { 0x000fffea, 20 }, { 0x003fffe2, 22 }, { 0x003fffe3, 22 }, { 0x003fffe4, 22 },
+                { 0x007ffff0, 23 }, { 0x003fffe5, 22 }, { 0x003fffe6, 22 }, { 0x007ffff1, 23 },
+                { 0x03ffffe0, 26 }, { 0x03ffffe1, 26 }, { 0x000fffeb, 20 }, { 0x0007fff1, 19 },
+                { 0x003fffe7, 22 }, { 0x007ffff2, 23 }, { 0x003fffe8, 22 }, { 0x01ffffec, 25 },
+                { 0x03ffffe2, 26 }, { 0x03ffffe3, 26 }, { 0x03ffffe4, 26 }, { 0x07ffffde, 27 },
+                { 0x07ffffdf, 27 }, { 0x03ffffe5, 26 }, { 0x00fffff1, 24 }, { 0x01ffffed, 25 },
+                { 0x0007fff2, 19 }, { 0x001fffe3, 21 }, { 0x03ffffe6, 26 }, { 0x07ffffe0, 27 },
+                { 0x07ffffe1, 27 }, { 0x03ffffe7, 26 }, { 0x07ffffe2, 27 }, { 0x00fffff2, 24 },
+                { 0x001fffe4, 21 }, { 0x001fffe5, 21 }, { 0x03ffffe8, 26 }, { 0x03ffffe9, 26 },
+                { 0x0ffffffd, 28 }, { 0x07ffffe3, 27 }, { 0x07ffffe4, 27 }, { 0x07ffffe5, 27 },
+                { 0x000fffec, 20 }, { 0x00fffff3, 24 }, { 0x000fffed, 20 }, { 0x001fffe6, 21 },
+                { 0x003fffe9, 22 }, { 0x001fffe7, 21 }, { 0x001fffe8, 21 }, { 0x007ffff3, 23 },
+                { 0x003fffea, 22 }, { 0x003fffeb, 22 }, { 0x01ffffee, 25 }, { 0x01ffffef, 25 },
+                { 0x00fffff4, 24 }, { 0x00fffff5, 24 }, { 0x03ffffea, 26 }, { 0x007ffff4, 23 },
+                { 0x03ffffeb, 26 }, { 0x07ffffe6, 27 }, { 0x03ffffec, 26 }, { 0x03ffffed, 26 },
+                { 0x07ffffe7, 27 }, { 0x07ffffe8, 27 }, { 0x07ffffe9, 27 }, { 0x07ffffea, 27 },
+                { 0x07ffffeb, 27 }, { 0x0ffffffe, 28 }, { 0x07ffffec, 27 }, { 0x07ffffed, 27 },
+                { 0x07ffffee, 27 }, { 0x07ffffef, 27 }, { 0x07fffff0, 27 }, { 0x03ffffee, 26 },
+                { 0x3fffffff, 30 },
+                };
+                return codes;
+            }
+
+            // Huffman decoding four bits at a time, a state machine over the
+            // inner nodes of the code tree (256 of them, the root is state 0).
+            // The shortest code has five bits, so a step completes at most one
+            // symbol.
+            class huffman_decoder_table
+            {
+            public:
+                enum
+                {
+                    EMIT    = 1,    // the step completed symbol
+                    FAIL    = 2,    // EOS or no such code
+                    ACCEPT  = 4     // the string may end after this step
+                };
+
+                struct transition
+                {
+                    boost::uint8_t state;
+                    boost::uint8_t flags;
+                    boost::uint8_t symbol;
+                };
+
+                static huffman_decoder_table const & instance()
+                {
+                    static huffman_decoder_table table;
+                    return table;
+                }
+
+                transition const & next(unsigned state, unsigned nibble) const
+                {
+                    return transitions_[state][nibble];
+                }
+
+            private:
+                enum { NODES = 2 * HPACK_EOS + 1, STATES = HPACK_EOS };
+
+                huffman_decoder_table()
+                {
+                    // The code tree first, leaves are stored as the negated
+                    // symbol minus one
+                    std::vector<int> tree(2 * NODES, 0);
+                    std::vector<unsigned> depth(NODES, 0);
+                    std::vector<bool> ones(NODES, false);
+                    std::vector<int> state(NODES, -1);
+                    ones[0]  = true;
+                    state[0] = 0;
+                    int used = 1;
+                    int states = 1;
+                    huffman_symbol const * codes = huffman_codes();
+                    for(int symbol = 0; symbol <= HPACK_EOS; ++symbol)
+                    {
+                        int node = 0;
+                        for(int bit = codes[symbol].bits - 1; bit > 0; --bit)
+                        {
+                            unsigned const b = (codes[symbol].code >> bit) & 1;
+                            int & child = tree[2 * node + b];
+                            if(!child)
+                            {
+                                child = used++;
+                                depth[child] = depth[node] + 1;
+                                ones[child]  = ones[node] && b;
+                                state[child] = states++;
+                            }
+                            node = child;
+                        }
+                        tree[2 * node + (codes[symbol].code & 1)] = -(symbol + 1);
+                    }
+
+                    // Then every inner node fed every nibble. The padding at
+                    // the end is a prefix of EOS shorter than an octet.
+                    for(int node = 0; node < used; ++node)
+                    {
+                        for(unsigned nibble = 0; nibble < 16; ++nibble)
+                        {
+                            transition & t = transitions_[state[node]][nibble];
+                            t.state  = 0;
+                            t.flags  = 0;
+                            t.symbol = 0;
+                            int current = node;
+                            for(int bit = 3; bit >= 0; --bit)
+                            {
+                                int const child = tree[2 * current + ((nibble >> bit) & 1)];
+                                if(child < 0 && -child - 1 != HPACK_EOS)
+                                {
+                                    t.flags |= EMIT;
+                                    t.symbol = static_cast<boost::uint8_t>(-child - 1);
+                                    current  = 0;
+                                }
+                                else if(child <= 0)
+                                {
+                                    t.flags = FAIL;
+                                    break;
+                                }
+                                else
+                                {
+                                    current = child;
+                                }
+                            }
+                            if(!(t.flags & FAIL))
+                            {
+                                t.state = static_cast<boost::uint8_t>(state[current]);
+                                if(ones[current] && depth[current] < 8)
+                                {
+                                    t.flags |= ACCEPT;
+                                }
+                            }
+                        }
+                    }
+                }
+
+            private:
+                transition transitions_[STATES][16];
+            };
+
+            // Appends the decoded octets of a Huffman string to out
+            template<typename String>
+            bool huffman_decode(unsigned char const * data, std::size_t size, String & out)
+            {
+                typedef huffman_decoder_table table_type;
+                table_type const & table = table_type::instance();
+                unsigned state = 0;
+                unsigned flags = table_type::ACCEPT;
+                for(unsigned char const * end = data + size; data != end; ++data)
+                {
+                    table_type::transition const & high = table.next(state, *data >> 4);
+                    if(high.flags & table_type::FAIL)
+                    {
+                        return false;
+                    }
+                    if(high.flags & table_type::EMIT)
+                    {
+                        out += static_cast<char>(high.symbol);
+                    }
+                    table_type::transition const & low = table.next(high.state, *data & 0xf);
+                    if(low.flags & table_type::FAIL)
+                    {
+                        return false;
+                    }
+                    if(low.flags & table_type::EMIT)
+                    {
+                        out += static_cast<char>(low.symbol);
+                    }
+                    state = low.state;
+                    flags = low.flags;
+                }
+                return (flags & table_type::ACCEPT) != 0;
+            }
+
+            inline std::size_t huffman_encoded_size(char const * data, std::size_t size)
+            {
+                huffman_symbol const * codes = huffman_codes();
+                std::size_t bits = 0;
+                for(std::size_t i = 0; i < size; ++i)
+                {
+                    bits += codes[static_cast<unsigned char>(data[i])].bits;
+                }
+                return (bits + 7) / 8;
+            }
+
+            // Appends the Huffman string, padded with the start of EOS
+            template<typename String>
+            void huffman_encode(char const * data, std::size_t size, String & out)
+            {
+                huffman_symbol const * codes = huffman_codes();
+                boost::uint64_t pending = 0;
+                unsigned bits = 0;
+                for(std::size_t i = 0; i < size; ++i)
+                {
+                    huffman_symbol const & code = codes[static_cast<unsigned char>(data[i])];
+                    pending = (pending << code.bits) | code.code;
+                    bits += code.bits;
+                    while(bits >= 8)
+                    {
+                        bits -= 8;
+                        out += static_cast<char>(pending >> bits);
+                    }
+                }
+                if(bits)
+                {
+                    out += static_cast<char>((pending << (8 - bits)) | (0xff >> bits));
+                }
+            }
+
+            // Integer with an N bit prefix (RFC 7541, 5.1), flags are the
+            // bits above the prefix in the first octet
+            template<typename String>
+            void hpack_encode_integer(String & out, unsigned char flags, unsigned prefix, std::size_t value)
+            {
+                std::size_t const limit = (1u << prefix) - 1;
+                if(value < limit)
+                {
+                    out += static_cast<char>(flags | value);
+                    return;
+                }
+                out += static_cast<char>(flags | limit);
+                value -= limit;
+                while(value >= 0x80)
+                {
+                    out += static_cast<char>((value & 0x7f) | 0x80);
+                    value >>= 7;
+                }
+                out += static_cast<char>(value);
+            }
+
+            inline bool hpack_decode_integer(unsigned char const *& iter, unsigned char const * end, unsigned prefix, std::size_t & value)
+            {
+                if(iter == end)
+                {
+                    return false;
+                }
+                std::size_t const limit = (1u << prefix) - 1;
+                value = *iter++ & limit;
+                if(value < limit)
+                {
+                    return true;
+                }
+                for(unsigned shift = 0; iter != end; shift += 7)
+                {
+                    // No header block needs more than 28 bits
+                    if(shift > 21)
+                    {
+                        return false;
+                    }
+                    unsigned char const octet = *iter++;
+                    value += std::size_t(octet & 0x7f) << shift;
+                    if(!(octet & 0x80))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Name lookup in the static table, an open addressing hash of
+            // the distinct names. Entries with the same name are adjacent
+            // in the table.
+            class hpack_static_index
+            {
+            public:
+                static hpack_static_index const & instance()
+                {
+                    static hpack_static_index index;
+                    return index;
+                }
+
+                // First index (1 based) of name and the number of entries
+                // with it, 0 if the name is not in the table
+                std::size_t find(char const * name, std::size_t length, std::size_t & count) const
+                {
+                    for(std::size_t slot = hash(name, length) & (SLOTS - 1); slots_[slot].index; slot = (slot + 1) & (SLOTS - 1))
+                    {
+                        std::size_t const first = slots_[slot].index;
+                        if(name_length_[first - 1] == length && std::memcmp(hpack_static_table()[first - 1].name, name, length) == 0)
+                        {
+                            count = slots_[slot].count;
+                            return first;
+                        }
+                    }
+                    count = 0;
+                    return 0;
+                }
+
+                std::size_t name_length(std::size_t index) const
+                {
+                    return name_length_[index - 1];
+                }
+
+                std::size_t value_length(std::size_t index) const
+                {
+                    return value_length_[index - 1];
+                }
+
+                static std::size_t hash(char const * data, std::size_t length)
+                {
+                    // FNV-1a
+                    boost::uint32_t h = 2166136261u;
+                    for(std::size_t i = 0; i < length; ++i)
+                    {
+                        h = (h ^ static_cast<unsigned char>(data[i])) * 16777619u;
+                    }
+                    return h;
+                }
+
+            private:
+                enum { SLOTS = 128 };
+
+                struct slot
+                {
+                    boost::uint8_t index;
+                    boost::uint8_t count;
+                };
+
+                hpack_static_index()
+                {
+                    std::memset(slots_, 0, sizeof(slots_));
+                    hpack_static_field const * table = hpack_static_table();
+                    for(std::size_t i = 0; i < HPACK_STATIC_TABLE_SIZE; ++i)
+                    {
+                        name_length_[i]  = std::strlen(table[i].name);
+                        value_length_[i] = std::strlen(table[i].value);
+                    }
+                    for(std::size_t i = 0; i < HPACK_STATIC_TABLE_SIZE; ++i)
+                    {
+                        if(i && std::strcmp(table[i].name, table[i - 1].name) == 0)
+                        {
+                            continue;
+                        }
+                        std::size_t s = hash(table[i].name, name_length_[i]) & (SLOTS - 1);
+                        while(slots_[s].index)
+                        {
+                            s = (s + 1) & (SLOTS - 1);
+                        }
+                        slots_[s].index = static_cast<boost::uint8_t>(i + 1);
+                        slots_[s].count = 1;
+                        while(i + slots_[s].count < HPACK_STATIC_TABLE_SIZE
+                            && std::strcmp(table[i + slots_[s].count].name, table[i].name) == 0)
+                        {
+                            ++slots_[s].count;
+                        }
+                    }
+                }
+
+            private:
+                slot        slots_[SLOTS];
+                std::size_t name_length_[HPACK_STATIC_TABLE_SIZE];
+                std::size_t value_length_[HPACK_STATIC_TABLE_SIZE];
+            };
+
+            // The dynamic table (RFC 7541, 2.3.2). Names and values are kept
+            // in a ring of octets sized for the largest table allowed, the
+            // entries in a ring next to it, so inserting and evicting never
+            // allocate. Entry 0 is the newest.
+            class hpack_table
+            {
+            public:
+                explicit hpack_table(std::size_t max_size)
+                    : data_()
+                    , entries_()
+                    , first_(0)
+                    , count_(0)
+                    , head_(0)
+                    , size_(0)
+                    , capacity_(0)
+                {
+                    set_max_size(max_size);
+                }
+
+                // Reallocates the rings, the entries which fit are kept
+                void set_max_size(std::size_t max_size)
+                {
+                    hpack_table copy(*this);
+                    data_.assign(max_size, 0);
+                    entries_.assign(max_size / HPACK_ENTRY_OVERHEAD + 1, entry());
+                    first_    = 0;
+                    count_    = 0;
+                    head_     = 0;
+                    size_     = 0;
+                    capacity_ = std::min(copy.capacity_, max_size);
+                    std::string name, value;
+                    for(std::size_t i = copy.count_; i-- > 0;)
+                    {
+                        copy.name(i, name);
+                        copy.value(i, value);
+                        insert(name.data(), name.size(), value.data(), value.size());
+                    }
+                }
+
+                std::size_t max_size() const
+                {
+                    return data_.size();
+                }
+
+                // Table size updates, at most max_size
+                void resize(std::size_t capacity)
+                {
+                    capacity_ = std::min(capacity, max_size());
+                    evict(capacity_);
+                }
+
+                std::size_t capacity() const
+                {
+                    return capacity_;
+                }
+
+                std::size_t count() const
+                {
+                    return count_;
+                }
+
+                // Returns false if the entry is larger than the table, which
+                // empties the table
+                bool insert(char const * name, std::size_t name_length, char const * value, std::size_t value_length)
+                {
+                    std::size_t const size = name_length + value_length + HPACK_ENTRY_OVERHEAD;
+                    if(size > capacity_)
+                    {
+                        evict(0);
+                        return false;
+                    }
+                    evict(capacity_ - size);
+                    entry & e = entries_[(first_ + count_) % entries_.size()];
+                    e.offset       = head_;
+                    e.name_length  = name_length;
+                    e.value_length = value_length;
+                    write(name, name_length);
+                    write(value, value_length);
+                    ++count_;
+                    size_ += size;
+                    return true;
+                }
+
+                template<typename String>
+                void name(std::size_t index, String & out) const
+                {
+                    entry const & e = at(index);
+                    copy(e.offset, e.name_length, out);
+                }
+
+                template<typename String>
+                void value(std::size_t index, String & out) const
+                {
+                    entry const & e = at(index);
+                    copy(wrap(e.offset + e.name_length), e.value_length, out);
+                }
+
+                bool name_equals(std::size_t index, char const * name, std::size_t length) const
+                {
+                    entry const & e = at(index);
+                    return e.name_length == length && equals(e.offset, name, length);
+                }
+
+                bool value_equals(std::size_t index, char const * value, std::size_t length) const
+                {
+                    entry const & e = at(index);
+                    return e.value_length == length && equals(wrap(e.offset + e.name_length), value, length);
+                }
+
+            private:
+                struct entry
+                {
+                    entry()
+                        : offset(0)
+                        , name_length(0)
+                        , value_length(0)
+                    {}
+
+                    std::size_t offset;
+                    std::size_t name_length;
+                    std::size_t value_length;
+                };
+
+                entry const & at(std::size_t index) const
+                {
+                    return entries_[(first_ + count_ - 1 - index) % entries_.size()];
+                }
+
+                std::size_t wrap(std::size_t offset) const
+                {
+                    return offset < data_.size() ? offset : offset - data_.size();
+                }
+
+                void write(char const * data, std::size_t length)
+                {
+                    std::size_t const first = std::min(length, data_.size() - head_);
+                    std::memcpy(&data_[0] + head_, data, first);
+                    std::memcpy(&data_[0], data + first, length - first);
+                    head_ = wrap(head_ + length);
+                }
+
+                template<typename String>
+                void copy(std::size_t offset, std::size_t length, String & out) const
+                {
+                    std::size_t const first = std::min(length, data_.size() - offset);
+                    out.assign(&data_[0] + offset, first);
+                    out.append(&data_[0], length - first);
+                }
+
+                bool equals(std::size_t offset, char const * data, std::size_t length) const
+                {
+                    std::size_t const first = std::min(length, data_.size() - offset);
+                    return std::memcmp(&data_[0] + offset, data, first) == 0
+                        && std::memcmp(&data_[0], data + first, length - first) == 0;
+                }
+
+                void evict(std::size_t limit)
+                {
+                    while(size_ > limit)
+                    {
+                        entry const & e = entries_[first_];
+                        size_ -= e.name_length + e.value_length + HPACK_ENTRY_OVERHEAD;
+                        first_ = (first_ + 1) % entries_.size();
+                        --count_;
+                    }
+                    if(!count_)
+                    {
+                        head_ = 0;
+                    }
+                }
+
+            private:
+                std::vector<char>   data_;
+                std::vector<entry>  entries_;
+                std::size_t         first_;     // oldest entry
+                std::size_t         count_;
+                std::size_t         head_;      // where the next entry's octets go
+                std::size_t         size_;      // RFC 7541 size of the entries
+                std::size_t         capacity_;
+            };
+        }
+
+        // HPACK (RFC 7541) header block decoder. The dynamic table is kept
+        // between blocks, so one decoder belongs to one connection and
+        // decodes the blocks in the order they were received.
+        template<typename Tag>
+        class basic_hpack_decoder
+        {
+        public:
+            typedef typename string_traits<Tag>::type       string_type;
+            typedef std::pair<string_type, string_type>     field_type;
+            typedef std::vector<field_type>                 field_list;
+
+            enum { DEFAULT_TABLE_SIZE = 4096 };
+
+            explicit basic_hpack_decoder(std::size_t max_table_size = DEFAULT_TABLE_SIZE)
+                : table_(max_table_size)
+                , max_list_size_(0)
+                , list_size_(0)
+                , name_()
+                , value_()
+            {
+                table_.resize(max_table_size);
+            }
+
+            // The table size the peer was allowed to use (our
+            // SETTINGS_HEADER_TABLE_SIZE), bigger updates are errors
+            void set_max_table_size(std::size_t size)
+            {
+                table_.set_max_size(size);
+            }
+
+            // Fields beyond this size (RFC 7540 counting) are dropped, see
+            // list_size_exceeded. 0, the default, keeps all of them.
+            void set_max_list_size(std::size_t size)
+            {
+                max_list_size_ = size;
+            }
+
+            // The last block had more fields than allowed
+            bool list_size_exceeded() const
+            {
+                return max_list_size_ && list_size_ > max_list_size_;
+            }
+
+            // Appends the fields of a complete header block to fields, a
+            // field_list or a header_collection_traits container. Returns
+            // false on a malformed block, the decoder can't be used any
+            // further then (a connection error, COMPRESSION_ERROR).
+            template<typename Fields>
+            bool decode(char const * data, std::size_t size, Fields & fields)
+            {
+                unsigned char const * iter = reinterpret_cast<unsigned char const *>(data);
+                unsigned char const * const end = iter + size;
+                bool fields_seen = false;
+                list_size_ = 0;
+                while(iter != end)
+                {
+                    unsigned char const octet = *iter;
+                    std::size_t index = 0;
+                    if(octet & 0x80)
+                    {
+                        // Indexed field
+                        if(!detail::hpack_decode_integer(iter, end, 7, index) || !lookup(index, true))
+                        {
+                            return false;
+                        }
+                    }
+                    else if((octet & 0xe0) == 0x20)
+                    {
+                        // Table size updates come first in a block
+                        if(fields_seen || !detail::hpack_decode_integer(iter, end, 5, index) || index > table_.max_size())
+                        {
+                            return false;
+                        }
+                        table_.resize(index);
+                        continue;
+                    }
+                    else
+                    {
+                        // Literal, with incremental indexing (01), without
+                        // indexing (0000) or never indexed (0001)
+                        bool const indexing = (octet & 0xc0) == 0x40;
+                        if(!detail::hpack_decode_integer(iter, end, indexing ? 6 : 4, index))
+                        {
+                            return false;
+                        }
+                        if(index ? !lookup(index, false) : !read_string(iter, end, name_))
+                        {
+                            return false;
+                        }
+                        if(!read_string(iter, end, value_))
+                        {
+                            return false;
+                        }
+                        if(indexing)
+                        {
+                            table_.insert(name_.data(), name_.size(), value_.data(), value_.size());
+                        }
+                    }
+                    fields_seen = true;
+                    list_size_ += name_.size() + value_.size() + detail::HPACK_ENTRY_OVERHEAD;
+                    if(!list_size_exceeded())
+                    {
+                        fields.insert(fields.end(), typename Fields::value_type(name_, value_));
+                    }
+                }
+                return true;
+            }
+
+        protected:
+            // Loads the name and, for an indexed field, the value of index
+            bool lookup(std::size_t index, bool with_value)
+            {
+                if(index == 0)
+                {
+                    return false;
+                }
+                if(index <= detail::HPACK_STATIC_TABLE_SIZE)
+                {
+                    detail::hpack_static_index const & lengths = detail::hpack_static_index::instance();
+                    detail::hpack_static_field const & entry = detail::hpack_static_table()[index - 1];
+                    name_.assign(entry.name, lengths.name_length(index));
+                    if(with_value)
+                    {
+                        value_.assign(entry.value, lengths.value_length(index));
+                    }
+                    return true;
+                }
+                index -= detail::HPACK_STATIC_TABLE_SIZE + 1;
+                if(index >= table_.count())
+                {
+                    return false;
+                }
+                table_.name(index, name_);
+                if(with_value)
+                {
+                    table_.value(index, value_);
+                }
+                return true;
+            }
+
+            static bool read_string(unsigned char const *& iter, unsigned char const * end, string_type & out)
+            {
+                if(iter == end)
+                {
+                    return false;
+                }
+                bool const huffman = (*iter & 0x80) != 0;
+                std::size_t length = 0;
+                if(!detail::hpack_decode_integer(iter, end, 7, length) || std::size_t(end - iter) < length)
+                {
+                    return false;
+                }
+                if(huffman)
+                {
+                    out.clear();
+                    if(!detail::huffman_decode(iter, length, out))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    out.assign(reinterpret_cast<char const *>(iter), length);
+                }
+                iter += length;
+                return true;
+            }
+
+        private:
+            detail::hpack_table     table_;
+            std::size_t             max_list_size_;
+            std::size_t             list_size_;
+            string_type             name_;          // of the field being decoded
+            string_type             value_;
+        };
+
+        // HPACK header block encoder. Fields are indexed in the dynamic
+        // table so repeated ones go out as a single index, except for
+        // credentials (never indexed) and headers whose values usually
+        // change from message to message, which are indexed only once the
+        // same value was seen before. Strings are Huffman coded when that
+        // makes them shorter. Upper case in names is sent lower case.
+        template<typename Tag>
+        class basic_hpack_encoder
+        {
+        public:
+            typedef typename string_traits<Tag>::type       string_type;
+            typedef std::pair<string_type, string_type>     field_type;
+            typedef std::vector<field_type>                 field_list;
+
+            enum
+            {
+                DEFAULT_TABLE_SIZE  = 4096,
+                SEEN_FIELDS         = 64
+            };
+
+            // Tables bigger than max_table_size are never used, whatever the
+            // peer allows
+            explicit basic_hpack_encoder(std::size_t max_table_size = DEFAULT_TABLE_SIZE)
+                : table_(max_table_size)
+                , smallest_(0)
+                , update_(false)
+                , next_seen_(0)
+                , lower_()
+            {
+                table_.resize(max_table_size);
+                std::memset(seen_, 0, sizeof(seen_));
+            }
+
+            // The peer's SETTINGS_HEADER_TABLE_SIZE, the change is announced
+            // at the start of the next block
+            void set_max_table_size(std::size_t size)
+            {
+                size = std::min(size, table_.max_size());
+                if(size == table_.capacity())
+                {
+                    return;
+                }
+                smallest_ = update_ ? std::min(smallest_, size) : std::min(table_.capacity(), size);
+                update_ = true;
+                table_.resize(size);
+            }
+
+            // Appends the header block for fields, a field_list or a
+            // header_collection_traits container, to block
+            template<typename Fields>
+            void encode(Fields const & fields, string_type & block)
+            {
+                if(update_)
+                {
+                    if(smallest_ < table_.capacity())
+                    {
+                        detail::hpack_encode_integer(block, 0x20, 5, smallest_);
+                    }
+                    detail::hpack_encode_integer(block, 0x20, 5, table_.capacity());
+                    update_ = false;
+                }
+                for(typename Fields::const_iterator it = fields.begin(); it != fields.end(); ++it)
+                {
+                    encode_field(it->first, it->second, block);
+                }
+            }
+
+            void encode_field(string_type const & name, string_type const & value, string_type & block)
+            {
+                string_type const & lower = lower_case(name);
+                char const * const n = lower.data();
+                std::size_t const n_length = lower.size();
+
+                std::size_t name_index = 0;
+                std::size_t count = 0;
+                std::size_t const first = detail::hpack_static_index::instance().find(n, n_length, count);
+                for(std::size_t i = first; i < first + count; ++i)
+                {
+                    if(value == detail::hpack_static_table()[i - 1].value)
+                    {
+                        detail::hpack_encode_integer(block, 0x80, 7, i);
+                        return;
+                    }
+                }
+                name_index = first;
+
+                for(std::size_t i = 0; i < table_.count(); ++i)
+                {
+                    if(table_.name_equals(i, n, n_length))
+                    {
+                        std::size_t const index = detail::HPACK_STATIC_TABLE_SIZE + 1 + i;
+                        if(table_.value_equals(i, value.data(), value.size()))
+                        {
+                            detail::hpack_encode_integer(block, 0x80, 7, index);
+                            return;
+                        }
+                        if(!name_index)
+                        {
+                            name_index = index;
+                        }
+                    }
+                }
+
+                if(sensitive(n, n_length, value))
+                {
+                    // Never indexed, by intermediaries either
+                    detail::hpack_encode_integer(block, 0x10, 4, name_index);
+                }
+                else if(indexable(n, n_length, value))
+                {
+                    detail::hpack_encode_integer(block, 0x40, 6, name_index);
+                    table_.insert(n, n_length, value.data(), value.size());
+                }
+                else
+                {
+                    detail::hpack_encode_integer(block, 0x00, 4, name_index);
+                }
+                if(!name_index)
+                {
+                    write_string(n, n_length, block);
+                }
+                write_string(value.data(), value.size(), block);
+            }
+
+        protected:
+            string_type const & lower_case(string_type const & name)
+            {
+                typename string_type::const_iterator it = name.begin();
+                while(it != name.end() && !(*it >= 'A' && *it <= 'Z'))
+                {
+                    ++it;
+                }
+                if(it == name.end())
+                {
+                    return name;
+                }
+                lower_ = name;
+                for(typename string_type::iterator c = lower_.begin(); c != lower_.end(); ++c)
+                {
+                    if(*c >= 'A' && *c <= 'Z')
+                    {
+                        *c = static_cast<char>(*c - 'A' + 'a');
+                    }
+                }
+                return lower_;
+            }
+
+            static bool is(char const * name, std::size_t length, char const * other)
+            {
+                return std::strlen(other) == length && std::memcmp(name, other, length) == 0;
+            }
+
+            static bool sensitive(char const * name, std::size_t length, string_type const & value)
+            {
+                // Short cookies are easily guessed from the compressed size
+                return is(name, length, "authorization")
+                    || is(name, length, "proxy-authorization")
+                    || (is(name, length, "cookie") && value.size() < 20);
+            }
+
+            bool indexable(char const * name, std::size_t length, string_type const & value)
+            {
+                // Entries taking most of the table would flush everything else
+                if((length + value.size() + detail::HPACK_ENTRY_OVERHEAD) * 4 > table_.capacity() * 3)
+                {
+                    return false;
+                }
+                static char const * const volatile_names[] =
+                {
+                    ":path", "content-length", "date", "etag", "last-modified", "expires", "age",
+                    "if-modified-since", "if-none-match", "location", "set-cookie", "content-range", 0
+                };
+                for(char const * const * v = volatile_names; *v; ++v)
+                {
+                    if(is(name, length, *v))
+                    {
+                        return seen(name, length, value);
+                    }
+                }
+                return true;
+            }
+
+            // Remembers the last SEEN_FIELDS volatile fields by hash, true
+            // if this one is among them
+            bool seen(char const * name, std::size_t length, string_type const & value)
+            {
+                boost::uint32_t const h = static_cast<boost::uint32_t>(
+                    detail::hpack_static_index::hash(name, length) * 31 + detail::hpack_static_index::hash(value.data(), value.size())) | 1;
+                for(std::size_t i = 0; i < SEEN_FIELDS; ++i)
+                {
+                    if(seen_[i] == h)
+                    {
+                        return true;
+                    }
+                }
+                seen_[next_seen_] = h;
+                next_seen_ = (next_seen_ + 1) % SEEN_FIELDS;
+                return false;
+            }
+
+            static void write_string(char const * data, std::size_t size, string_type & block)
+            {
+                std::size_t const encoded = detail::huffman_encoded_size(data, size);
+                if(encoded < size)
+                {
+                    detail::hpack_encode_integer(block, 0x80, 7, encoded);
+                    detail::huffman_encode(data, size, block);
+                }
+                else
+                {
+                    detail::hpack_encode_integer(block, 0x00, 7, size);
+                    block.append(data, size);
+                }
+            }
+
+        private:
+            detail::hpack_table     table_;
+            std::size_t             smallest_;      // since the last block, if update_
+            bool                    update_;        // table size change to announce
+            boost::uint32_t         seen_[SEEN_FIELDS];
+            std::size_t             next_seen_;
+            string_type             lower_;         // scratch for names with upper case
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_HPACK_HPP_INCLUDED
@@ -27,7 +27,14 @@
 #define GUARD_NET_HTTP_PARSER_CONTENT_PARSER_HPP_INCLUDED
 
 #include <net/http/detail/traits.hpp>
+#include <net/http/basic_message.hpp>
+#include <net/http/detail/header_utils.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/foreach.hpp>
+#include <boost/logic/tribool.hpp>
+#include <cassert>
+#include <cstring>
+#include <utility>
 
 namespace net
 {
@@ -42,6 +49,17 @@ namespace net
             }
         };
 
+        // Chunked transfer coding (RFC 7230, 4.1):
+        //
+        //   chunked-body = *chunk last-chunk trailer-part CRLF
+        //   chunk        = chunk-size [ chunk-ext ] CRLF chunk-data CRLF
+        //   chunk-ext    = *( BWS ";" BWS name [ BWS "=" BWS ( token / quoted-string ) ] )
+        //
+        // Chunk extensions are checked and skipped. Trailer fields are merged
+        // into the headers of the message once the body is complete, except
+        // those which describe framing or the representation and have no
+        // business in a trailer. Chunk sizes are accumulated digit by digit
+        // and fail the parse rather than wrap around.
         template<typename Tag>
         class basic_chunked_content_parser
                     : public basic_content_parser<Tag>
@@ -50,29 +68,49 @@ namespace net
             {
                 FAIL_STATE,
                 PARSE_CHUNK_SIZE_START, PARSE_CHUNK_SIZE,
-                PARSE_EXPECTING_CR_AFTER_CHUNK_SIZE,
+                PARSE_CHUNK_EXT_SPACE, PARSE_CHUNK_EXT_NAME_START, PARSE_CHUNK_EXT_NAME,
+                PARSE_CHUNK_EXT_AFTER_NAME, PARSE_CHUNK_EXT_VALUE_START, PARSE_CHUNK_EXT_VALUE,
+                PARSE_CHUNK_EXT_QUOTED, PARSE_CHUNK_EXT_QUOTED_PAIR,
                 PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE, PARSE_CHUNK,
                 PARSE_EXPECTING_CR_AFTER_CHUNK, PARSE_EXPECTING_LF_AFTER_CHUNK,
-                PARSE_EXPECTING_FINAL_CR_AFTER_LAST_CHUNK,
+                PARSE_TRAILER_START, PARSE_TRAILER_NAME,
+                PARSE_TRAILER_VALUE_START, PARSE_TRAILER_VALUE,
+                PARSE_EXPECTING_LF_AFTER_TRAILER,
                 PARSE_EXPECTING_FINAL_LF_AFTER_LAST_CHUNK
             };
             typedef typename chunk_cache_traits<Tag>::type chunk_cache_type;
             typedef parser_traits<Tag> traits_type;
             typedef typename traits_type::char_type char_type;
+            typedef typename string_traits<Tag>::type string_type;
+            typedef typename header_collection_traits<Tag>::type headers_type;
+            typedef std::pair<string_type, string_type> header_pair_type;
 
             parse_state_t state_;
             chunk_cache_type chunk_cache_;
             typename chunk_cache_type::value_type current_chunk_;
-            std::string chunk_size_str_;
-            std::size_t chunk_size_;
+            boost::uint64_t chunk_size_;
+            std::size_t line_size_;
+            std::size_t trailer_size_;
+            header_pair_type trailer_;
+            headers_type trailers_;
 
         public:
+            enum
+            {
+                CHUNK_LINE_MAX  = 0x1000,   // size line with extensions
+                TRAILER_MAX     = 0x10000,  // all trailer fields
+                CHUNK_RESERVE   = 0x10000   // most parse() reserves up front
+            };
+
             basic_chunked_content_parser()
                     : state_( PARSE_CHUNK_SIZE_START )
                     , chunk_cache_()
                     , current_chunk_()
-                    , chunk_size_str_()
                     , chunk_size_(0)
+                    , line_size_(0)
+                    , trailer_size_(0)
+                    , trailer_()
+                    , trailers_()
             {
 
             }
@@ -87,8 +125,12 @@ namespace net
                 state_ = PARSE_CHUNK_SIZE_START;
                 chunk_cache_.clear();
                 current_chunk_.clear();
-                chunk_size_str_.clear();
                 chunk_size_ = 0;
+                line_size_ = 0;
+                trailer_size_ = 0;
+                trailer_.first.clear();
+                trailer_.second.clear();
+                trailers_.clear();
             }
 
 
@@ -103,9 +145,50 @@ namespace net
                     {
                         message.body().insert(message.body().end(), c.begin(), c.end());
                     }
+                    merge_trailers( message );
                 }
                 return result;
             }
+
+            // Streaming variant of parse: consumes input up to the end of the
+            // next run of chunk data and points data/size at it, inside
+            // [iter, end). Nothing is copied or cached, size is 0 if no chunk
+            // data was reached. Returns true after the last chunk, with the
+            // trailers merged into message, false on malformed input and
+            // indeterminate otherwise.
+            boost::tribool parse_some( char_type const *& iter, char_type const * end, char_type const *& data, std::size_t & size, basic_message<Tag> & message )
+            {
+                data = iter;
+                size = 0;
+                while ( iter != end )
+                {
+                    if ( state_ == PARSE_CHUNK )
+                    {
+                        std::size_t const available = static_cast<std::size_t>(end - iter);
+                        data = iter;
+                        size = available < chunk_size_ ? available : static_cast<std::size_t>(chunk_size_);
+                        iter += size;
+                        chunk_size_ -= size;
+                        if ( !chunk_size_ )
+                        {
+                            state_ = PARSE_EXPECTING_CR_AFTER_CHUNK;
+                        }
+                        return boost::indeterminate;
+                    }
+
+                    boost::tribool result = advance( *iter );
+                    ++iter;
+                    if ( !boost::indeterminate( result ) )
+                    {
+                        if ( result )
+                        {
+                            merge_trailers( message );
+                        }
+                        return result;
+                    }
+                }
+                return boost::indeterminate;
+            }
         private:
 
             template<parse_state_t TrueState>
@@ -122,105 +205,363 @@ namespace net
                 return condition;
             }
 
+            inline static bool is_space( char_type c )
+            {
+                return c == ' ' || c == '\t';
+            }
 
-            template<typename InputIterator>
-            boost::tribool parse_impl( InputIterator & iter, InputIterator end, basic_message<Tag> & )
+            inline static int hex_value( char_type c )
             {
-                while ( iter != end )
+                if ( c >= '0' && c <= '9' )
+                {
+                    return c - '0';
+                }
+                if ( c >= 'a' && c <= 'f' )
+                {
+                    return c - 'a' + 10;
+                }
+                if ( c >= 'A' && c <= 'F' )
+                {
+                    return c - 'A' + 10;
+                }
+                return -1;
+            }
+
+            // Shifts in one more digit of the chunk size, false on overflow
+            bool accumulate( int digit )
+            {
+                if ( chunk_size_ > ( ~boost::uint64_t(0) >> 4 ) )
+                {
+                    return false;
+                }
+                chunk_size_ = ( chunk_size_ << 4 ) | static_cast<boost::uint64_t>( digit );
+                return true;
+            }
+
+            // Fields a trailer must not carry (RFC 7230, 4.1.2)
+            static bool forbidden_trailer( string_type const & name )
+            {
+                static char const * const names[] =
+                {
+                    "transfer-encoding", "content-length", "content-encoding", "content-type",
+                    "content-range", "trailer", "host", "connection", "te"
+                };
+                for ( std::size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i )
+                {
+                    std::size_t const length = std::strlen( names[i] );
+                    if ( name.size() == length && detail::equals_ignore_case( name.data(), names[i], length ) )
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void end_trailer()
+            {
+                string_type & value = trailer_.second;
+                std::size_t length = value.size();
+                while ( length && is_space( value[length - 1] ) )
                 {
-                    char_type c = *iter;
-                    switch ( state_ )
+                    --length;
+                }
+                value.resize( length );
+                if ( !forbidden_trailer( trailer_.first ) )
+                {
+                    trailers_.insert( trailer_ );
+                }
+                trailer_.first.clear();
+                trailer_.second.clear();
+            }
+
+            void merge_trailers( basic_message<Tag> & message )
+            {
+                message.headers().insert( trailers_.begin(), trailers_.end() );
+                trailers_.clear();
+            }
+
+            // Size line: the size, then BWS and extensions up to CRLF
+            boost::tribool advance_chunk_line( char_type c )
+            {
+                if ( ++line_size_ > CHUNK_LINE_MAX )
+                {
+                    state_ = FAIL_STATE;
+                    return false;
+                }
+                switch ( state_ )
+                {
+                case PARSE_CHUNK_SIZE:
                     {
-                    case PARSE_CHUNK_SIZE_START:
+                        int const digit = hex_value( c );
+                        if ( digit >= 0 )
                         {
-                            if ( conditional_state<PARSE_CHUNK_SIZE>( traits_type::is_hex_digit( c ) ) )
-                            {
-                                chunk_size_str_.clear();
-                                chunk_size_str_.push_back( c );
-                            }
-                            else
-                            {
-                                conditional_state<PARSE_CHUNK_SIZE_START>( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
-                            }
+                            conditional_state<PARSE_CHUNK_SIZE>( accumulate( digit ) );
                         }
-                        break;
-                    case PARSE_CHUNK_SIZE:
-                        if ( !conditional_state<PARSE_CHUNK_SIZE>( traits_type::is_hex_digit( c ) ) )
+                        else if ( c == ';' )
                         {
-                            if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE>( c == '\r' ) )
-                            {
-                                conditional_state<PARSE_EXPECTING_CR_AFTER_CHUNK_SIZE>( c == ' ' || c == '\t' );
-                            }
+                            state_ = PARSE_CHUNK_EXT_NAME_START;
                         }
-                        else
+                        else if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE>( c == '\r' ) )
                         {
-                            chunk_size_str_.push_back(c);
+                            conditional_state<PARSE_CHUNK_EXT_SPACE>( is_space( c ) );
                         }
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_SPACE:
+                    if ( c == ';' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_NAME_START;
+                    }
+                    else if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE>( c == '\r' ) )
+                    {
+                        conditional_state<PARSE_CHUNK_EXT_SPACE>( is_space( c ) );
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_NAME_START:
+                    if ( !is_space( c ) )
+                    {
+                        conditional_state<PARSE_CHUNK_EXT_NAME>( traits_type::is_token( c ) );
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_NAME:
+                    if ( traits_type::is_token( c ) )
+                    {
+                        break;
+                    }
+                    // fall through
+                case PARSE_CHUNK_EXT_AFTER_NAME:
+                    if ( c == '=' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_VALUE_START;
+                    }
+                    else if ( c == ';' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_NAME_START;
+                    }
+                    else if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE>( c == '\r' ) )
+                    {
+                        conditional_state<PARSE_CHUNK_EXT_AFTER_NAME>( is_space( c ) );
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_VALUE_START:
+                    if ( c == '"' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_QUOTED;
+                    }
+                    else if ( !is_space( c ) )
+                    {
+                        conditional_state<PARSE_CHUNK_EXT_VALUE>( traits_type::is_token( c ) );
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_VALUE:
+                    if ( traits_type::is_token( c ) )
+                    {
                         break;
-                    case PARSE_EXPECTING_CR_AFTER_CHUNK_SIZE:
-                        if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE>( c == '\r' ) )
+                    }
+                    if ( c == ';' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_NAME_START;
+                    }
+                    else if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE>( c == '\r' ) )
+                    {
+                        conditional_state<PARSE_CHUNK_EXT_SPACE>( is_space( c ) );
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_QUOTED:
+                    if ( c == '"' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_SPACE;
+                    }
+                    else if ( c == '\\' )
+                    {
+                        state_ = PARSE_CHUNK_EXT_QUOTED_PAIR;
+                    }
+                    else
+                    {
+                        conditional_state<PARSE_CHUNK_EXT_QUOTED>( c == '\t' || !traits_type::is_control( c ) );
+                    }
+                    break;
+                case PARSE_CHUNK_EXT_QUOTED_PAIR:
+                    conditional_state<PARSE_CHUNK_EXT_QUOTED>( c == '\t' || !traits_type::is_control( c ) );
+                    break;
+                default:
+                    assert( false && "Unknown state received" );
+                    state_ = FAIL_STATE;
+                    break;
+                }
+                if ( state_ == FAIL_STATE )
+                {
+                    return false;
+                }
+                return boost::indeterminate;
+            }
+
+            // Trailer fields after the last chunk, name: value CRLF each
+            boost::tribool advance_trailer( char_type c )
+            {
+                if ( ++trailer_size_ > TRAILER_MAX )
+                {
+                    state_ = FAIL_STATE;
+                    return false;
+                }
+                switch ( state_ )
+                {
+                case PARSE_TRAILER_START:
+                    if ( !conditional_state<PARSE_EXPECTING_FINAL_LF_AFTER_LAST_CHUNK>( c == '\r' ) )
+                    {
+                        if ( conditional_state<PARSE_TRAILER_NAME>( traits_type::is_token( c ) ) )
                         {
-                            conditional_state<PARSE_EXPECTING_CR_AFTER_CHUNK_SIZE>( c == ' ' || c == '\t' );
+                            trailer_.first.push_back( c );
                         }
-                        break;
-                    case PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE:
-                        if ( conditional_state<PARSE_CHUNK>( c == '\n' ) )
+                    }
+                    break;
+                case PARSE_TRAILER_NAME:
+                    if ( !conditional_state<PARSE_TRAILER_VALUE_START>( c == ':' ) )
+                    {
+                        if ( conditional_state<PARSE_TRAILER_NAME>( traits_type::is_token( c ) && trailer_.first.size() < traits_type::HEADER_NAME_MAX ) )
                         {
-                            chunk_size_ = strtol( chunk_size_str_.c_str(), 0, 16 );
-                            if ( !chunk_size_ )
-                            {
-                                state_ = PARSE_EXPECTING_FINAL_CR_AFTER_LAST_CHUNK;
-                            }
-                            else
-                            {
-                                current_chunk_.clear();
-                                current_chunk_.reserve(chunk_size_);
-                            }
+                            trailer_.first.push_back( c );
                         }
+                    }
+                    break;
+                case PARSE_TRAILER_VALUE_START:
+                    if ( is_space( c ) )
+                    {
                         break;
-                    case PARSE_CHUNK:
-                        if(conditional_state<PARSE_CHUNK>(current_chunk_.size() < chunk_size_))
+                    }
+                    // fall through
+                case PARSE_TRAILER_VALUE:
+                    if ( !conditional_state<PARSE_EXPECTING_LF_AFTER_TRAILER>( c == '\r' ) )
+                    {
+                        if ( conditional_state<PARSE_TRAILER_VALUE>( ( c == '\t' || !traits_type::is_control( c ) ) && trailer_.second.size() < traits_type::HEADER_VALUE_MAX ) )
                         {
-                            current_chunk_.push_back(c);
+                            trailer_.second.push_back( c );
                         }
-                        if(current_chunk_.size() == chunk_size_)
+                    }
+                    break;
+                case PARSE_EXPECTING_LF_AFTER_TRAILER:
+                    if ( conditional_state<PARSE_TRAILER_START>( c == '\n' ) )
+                    {
+                        end_trailer();
+                    }
+                    break;
+                default:
+                    assert( false && "Unknown state received" );
+                    state_ = FAIL_STATE;
+                    break;
+                }
+                if ( state_ == FAIL_STATE )
+                {
+                    return false;
+                }
+                return boost::indeterminate;
+            }
+
+            // Feeds one character outside of chunk data through the state
+            // machine, true once the terminating empty chunk was read
+            boost::tribool advance( char_type c )
+            {
+                switch ( state_ )
+                {
+                case PARSE_CHUNK_SIZE_START:
+                    {
+                        int const digit = hex_value( c );
+                        if ( digit >= 0 )
                         {
-                            chunk_cache_.push_back(typename chunk_cache_type::value_type());
-                            chunk_cache_.back().swap(current_chunk_);
-                            state_ = PARSE_EXPECTING_CR_AFTER_CHUNK;
+                            state_ = PARSE_CHUNK_SIZE;
+                            chunk_size_ = static_cast<boost::uint64_t>( digit );
+                            line_size_ = 1;
                         }
-                        break;
-                    case PARSE_EXPECTING_CR_AFTER_CHUNK:
-                        conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK>(c == '\r');
-                        break;
-                    case PARSE_EXPECTING_LF_AFTER_CHUNK:
-                        conditional_state<PARSE_CHUNK_SIZE_START>(c == '\n');
-                        break;
-                    case PARSE_EXPECTING_FINAL_CR_AFTER_LAST_CHUNK:
-                        conditional_state<PARSE_EXPECTING_FINAL_LF_AFTER_LAST_CHUNK>(c == '\r');
-                        break;
-                    case PARSE_EXPECTING_FINAL_LF_AFTER_LAST_CHUNK:
-                        if(conditional_state<PARSE_CHUNK_SIZE_START>(c == '\n'))
+                        else
                         {
-                            ++iter;
-                            return true;
+                            conditional_state<PARSE_CHUNK_SIZE_START>( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
                         }
-                        break;
-                    case FAIL_STATE:
-                        return false;
-
-                    default:
-                        assert( false && "Unknown state received" );
-                        state_ = FAIL_STATE;
-                        return false;
                     }
+                    break;
+                case PARSE_CHUNK_SIZE:
+                case PARSE_CHUNK_EXT_SPACE:
+                case PARSE_CHUNK_EXT_NAME_START:
+                case PARSE_CHUNK_EXT_NAME:
+                case PARSE_CHUNK_EXT_AFTER_NAME:
+                case PARSE_CHUNK_EXT_VALUE_START:
+                case PARSE_CHUNK_EXT_VALUE:
+                case PARSE_CHUNK_EXT_QUOTED:
+                case PARSE_CHUNK_EXT_QUOTED_PAIR:
+                    return advance_chunk_line( c );
+                case PARSE_EXPECTING_LF_AFTER_CHUNK_SIZE:
+                    if ( conditional_state<PARSE_CHUNK>( c == '\n' ) )
+                    {
+                        if ( !chunk_size_ )
+                        {
+                            state_ = PARSE_TRAILER_START;
+                            trailer_size_ = 0;
+                        }
+                    }
+                    break;
+                case PARSE_EXPECTING_CR_AFTER_CHUNK:
+                    conditional_state<PARSE_EXPECTING_LF_AFTER_CHUNK>(c == '\r');
+                    break;
+                case PARSE_EXPECTING_LF_AFTER_CHUNK:
+                    conditional_state<PARSE_CHUNK_SIZE_START>(c == '\n');
+                    break;
+                case PARSE_TRAILER_START:
+                case PARSE_TRAILER_NAME:
+                case PARSE_TRAILER_VALUE_START:
+                case PARSE_TRAILER_VALUE:
+                case PARSE_EXPECTING_LF_AFTER_TRAILER:
+                    return advance_trailer( c );
+                case PARSE_EXPECTING_FINAL_LF_AFTER_LAST_CHUNK:
+                    if(conditional_state<PARSE_CHUNK_SIZE_START>(c == '\n'))
+                    {
+                        return true;
+                    }
+                    break;
+                case FAIL_STATE:
+                    return false;
+
+                default:
+                    assert( false && "Unknown state received" );
+                    state_ = FAIL_STATE;
+                    return false;
+                }
+
+                if ( state_ == FAIL_STATE )
+                {
+                    return false;
+                }
+                return boost::indeterminate;
+            }
 
-                    if ( state_ == FAIL_STATE )
+            template<typename InputIterator>
+            boost::tribool parse_impl( InputIterator & iter, InputIterator end, basic_message<Tag> & )
+            {
+                while ( iter != end )
+                {
+                    if ( state_ == PARSE_CHUNK )
                     {
-                        return false;
+                        if ( current_chunk_.empty() )
+                        {
+                            // The size is only announced, grow with the data beyond this
+                            boost::uint64_t const reserve = CHUNK_RESERVE;
+                            current_chunk_.reserve( static_cast<std::size_t>( chunk_size_ < reserve ? chunk_size_ : reserve ) );
+                        }
+                        current_chunk_.push_back(*iter);
+                        if(current_chunk_.size() == chunk_size_)
+                        {
+                            chunk_cache_.push_back(typename chunk_cache_type::value_type());
+                            chunk_cache_.back().swap(current_chunk_);
+                            state_ = PARSE_EXPECTING_CR_AFTER_CHUNK;
+                        }
+                        ++iter;
+                        continue;
                     }
 
+                    boost::tribool result = advance( *iter );
                     ++iter;
+                    if ( !boost::indeterminate( result ) )
+                    {
+                        return result;
+                    }
                 }
 
                 return boost::indeterminate;
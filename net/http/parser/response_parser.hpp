@@ -1,47 +1,319 @@
 /*
- * Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
- * All rights reserved.
- *
- * - Redistribution and use in source and binary forms, with or without
- *   modification, are permitted provided that the following conditions are met:
- *
- * - Redistributions of source code must retain the above copyright notice, this
- *   list of conditions and the following disclaimer.
- * - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
- *   of its contributors may be used to endorse or promote products derived from
- *   this software without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
- * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
- * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
- * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
- * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
- * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
- * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
- * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
- * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
- * POSSIBILITY OF SUCH DAMAGE.
- */
-
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
 #ifndef GUARD_NET_HTTP_PARSER_RESPONSE_PARSER_HPP_INCLUDED
 #define GUARD_NET_HTTP_PARSER_RESPONSE_PARSER_HPP_INCLUDED
 
+#include <net/http/parser/header_parser.hpp>
+#include <net/http/parser/content_parser.hpp>
+#include <net/http/detail/header_utils.hpp>
+#include <net/error.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/logic/tribool.hpp>
+
 namespace net
 {
     namespace http
     {
+        // Incremental parser for a stream of HTTP/1.x responses.
+        //
+        // parse_head collects the status line and headers, which may arrive
+        // split over any number of reads, and skips interim (1xx) responses.
+        // The head tells how the body is delimited, parse_body then hands out
+        // the body as slices of the input without copying it, chunked
+        // framing included; trailers end up with the headers. Input
+        // following the end of the body belongs to the next response; reset
+        // the parser before parsing it.
         template<typename Tag>
         class basic_response_parser
         {
         public:
+            typedef basic_response<Tag>                     message_type;
+            typedef typename string_traits<Tag>::type       string_type;
+            typedef typename char_traits<Tag>::type         char_type;
+
+            enum framing_type
+            {
+                FRAMING_NONE,       // no body (HEAD, 204, 304, 1xx)
+                FRAMING_LENGTH,     // Content-Length
+                FRAMING_CHUNKED,    // Transfer-Encoding: chunked
+                FRAMING_CLOSE       // the body ends with the connection
+            };
+
+            enum { HEADER_MAX = 0x10000 };
+
             basic_response_parser()
+                : head_parser_()
+                , chunked_()
+                , pending_()
+                , framing_(FRAMING_NONE)
+                , remaining_(0)
+                , head_request_(false)
+                , head_complete_(false)
+                , keep_alive_(false)
+                , error_(net::error::http_protocol_error)
+            {}
+
+            // Prepares for the next response, head_request tells that it
+            // answers a HEAD request and therefore has no body
+            void reset(bool head_request = false)
+            {
+                head_parser_.clear();
+                chunked_.clear();
+                pending_.clear();
+                framing_       = FRAMING_NONE;
+                remaining_     = 0;
+                head_request_  = head_request;
+                head_complete_ = false;
+                keep_alive_    = false;
+                error_         = net::error::http_protocol_error;
+            }
+
+            bool head_complete() const
+            {
+                return head_complete_;
+            }
+
+            framing_type framing() const
+            {
+                return framing_;
+            }
+
+            // true if the connection can carry another request after this
+            // response, valid once the head is complete
+            bool keep_alive() const
+            {
+                return keep_alive_;
+            }
+
+            // Why the last parse call returned false
+            net::error::http_errors error() const
+            {
+                return error_;
+            }
+
+            boost::tribool parse_head(char_type const *& iter, char_type const * end, message_type & response)
+            {
+                while(iter != end)
+                {
+                    char_type const * block = 0;
+                    std::size_t header_size = 0;
+                    if(pending_.empty())
+                    {
+                        // Usually the head arrives in one piece and is parsed in place
+                        header_size = detail::find_header_end(iter, end - iter);
+                        if(!header_size)
+                        {
+                            return keep(iter, end);
+                        }
+                        block = iter;
+                        iter += header_size;
+                    }
+                    else
+                    {
+                        std::size_t const before = pending_.size();
+                        std::size_t const from = before > 2 ? before - 2 : 0;
+                        pending_.append(iter, end);
+                        header_size = detail::find_header_end(pending_.data() + from, pending_.size() - from);
+                        if(!header_size)
+                        {
+                            if(pending_.size() > HEADER_MAX)
+                            {
+                                return fail(net::error::http_header_too_large);
+                            }
+                            iter = end;
+                            return boost::indeterminate;
+                        }
+                        header_size += from;
+                        iter += header_size - before;
+                        pending_.resize(header_size);
+                        block = pending_.data();
+                    }
+
+                    if(header_size > HEADER_MAX)
+                    {
+                        return fail(net::error::http_header_too_large);
+                    }
+
+                    message_type head;
+                    char_type const * position = block;
+                    boost::tribool parsed = head_parser_.parse(position, block + header_size, head);
+                    pending_.clear();
+                    head_parser_.clear();
+                    if(!parsed)
+                    {
+                        return fail(net::error::http_protocol_error);
+                    }
+
+                    unsigned const status = head.status_code();
+                    if(status >= 100 && status < 200 && status != 101)
+                    {
+                        // 100 Continue and friends precede the actual response
+                        continue;
+                    }
+
+                    if(!frame(head))
+                    {
+                        return fail(net::error::http_protocol_error);
+                    }
+                    response.swap(head);
+                    head_complete_ = true;
+                    return true;
+                }
+                return boost::indeterminate;
+            }
+
+            // Points data/size at the next piece of the body within
+            // [iter, end), size may be 0. Returns true once the body is
+            // complete, false if it is malformed. Trailers of a chunked body
+            // are added to the headers of response.
+            boost::tribool parse_body(char_type const *& iter, char_type const * end, char_type const *& data, std::size_t & size, message_type & response)
+            {
+                data = iter;
+                size = 0;
+                switch(framing_)
+                {
+                case FRAMING_NONE:
+                    return true;
+                case FRAMING_LENGTH:
+                    {
+                        std::size_t const available = static_cast<std::size_t>(end - iter);
+                        size = remaining_ < available ? static_cast<std::size_t>(remaining_) : available;
+                        iter      += size;
+                        remaining_ -= size;
+                        if(!remaining_)
+                        {
+                            return true;
+                        }
+                        return boost::indeterminate;
+                    }
+                case FRAMING_CHUNKED:
+                    {
+                        boost::tribool result = chunked_.parse_some(iter, end, data, size, response);
+                        if(!result)
+                        {
+                            return fail(net::error::http_protocol_error);
+                        }
+                        return result;
+                    }
+                case FRAMING_CLOSE:
+                default:
+                    size = static_cast<std::size_t>(end - iter);
+                    iter = end;
+                    return boost::indeterminate;
+                }
+            }
+
+            // The connection was closed: true if that legitimately ends the
+            // body of the current response
+            bool finish() const
+            {
+                return head_complete_ && framing_ == FRAMING_CLOSE;
+            }
+
+        private:
+            boost::tribool keep(char_type const *& iter, char_type const * end)
+            {
+                if(static_cast<std::size_t>(end - iter) > HEADER_MAX)
+                {
+                    return fail(net::error::http_header_too_large);
+                }
+                pending_.assign(iter, end);
+                iter = end;
+                return boost::indeterminate;
+            }
+
+            boost::tribool fail(net::error::http_errors error)
+            {
+                error_ = error;
+                return false;
+            }
+
+            // Determines how the body is delimited and whether the connection
+            // stays open (RFC 7230, 3.3.3 and 6.3)
+            bool frame(message_type const & head)
             {
+                string_type value;
+                bool const http11 = head.version().first > 1 || (head.version().first == 1 && head.version().second >= 1);
+                if(detail::find_header(head, "Connection", value))
+                {
+                    keep_alive_ = http11 ? !detail::contains_token(value, "close") : detail::contains_token(value, "keep-alive");
+                }
+                else
+                {
+                    keep_alive_ = http11;
+                }
 
+                unsigned const status = head.status_code();
+                if(status == 101)
+                {
+                    // The connection now speaks another protocol
+                    framing_    = FRAMING_NONE;
+                    keep_alive_ = false;
+                    return true;
+                }
+                if(head_request_ || status == 204 || status == 304)
+                {
+                    framing_ = FRAMING_NONE;
+                    return true;
+                }
+                if(detail::find_header(head, "Transfer-Encoding", value))
+                {
+                    // chunked has to be the final coding, otherwise the
+                    // body runs until the connection closes
+                    if(detail::last_token_is(value, "chunked"))
+                    {
+                        framing_ = FRAMING_CHUNKED;
+                        return true;
+                    }
+                    framing_    = FRAMING_CLOSE;
+                    keep_alive_ = false;
+                    return true;
+                }
+                if(detail::find_header(head, "Content-Length", value))
+                {
+                    framing_ = FRAMING_LENGTH;
+                    return detail::parse_length(value, remaining_);
+                }
+                framing_    = FRAMING_CLOSE;
+                keep_alive_ = false;
+                return true;
             }
 
+        private:
+            basic_header_parser<Tag, false>     head_parser_;
+            basic_chunked_content_parser<Tag>   chunked_;
+            string_type                         pending_;
+            framing_type                        framing_;
+            boost::uint64_t                     remaining_;
+            bool                                head_request_;
+            bool                                head_complete_;
+            bool                                keep_alive_;
+            net::error::http_errors             error_;
         };
     }
 }
 
-#endif //GUARD_NET_HTTP_PARSER_PARSER_HPP_INCLUDED
+#endif //GUARD_NET_HTTP_PARSER_RESPONSE_PARSER_HPP_INCLUDED
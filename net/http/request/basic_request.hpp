@@ -36,7 +36,10 @@ namespace net
         class basic_request : public http::basic_message<Tag>
         {
             typedef http::basic_message<Tag> base_type;
+        public:
             typedef typename string_traits<Tag>::type string_type;
+
+        private:
             string_type method_;
             string_type resource_;
             string_type query_;
@@ -44,13 +47,17 @@ namespace net
             basic_request()
             : base_type()
             , method_()
+            , resource_()
+            , query_()
             {
-
+                this->version() = typename base_type::version_type(1, 1);
             }
 
             basic_request(basic_request const & other)
             : base_type(other)
             , method_(other.method_)
+            , resource_(other.resource_)
+            , query_(other.query_)
             {
 
             }
@@ -96,6 +103,9 @@ namespace net
                 base_type & other_(other);
                 base_type & this_(*this);
                 other_.swap(this_);
+                std::swap(other.method_, method_);
+                std::swap(other.resource_, resource_);
+                std::swap(other.query_, query_);
             }
         };
     }
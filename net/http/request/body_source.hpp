@@ -0,0 +1,487 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_REQUEST_BODY_SOURCE_HPP_INCLUDED
+#define GUARD_NET_HTTP_REQUEST_BODY_SOURCE_HPP_INCLUDED
+
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/http/detail/traits.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#if !defined(WIN32) && !defined(WIN64)
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <sys/stat.h>
+#    include <sys/types.h>
+#    include <unistd.h>
+#endif
+
+namespace net
+{
+    namespace http
+    {
+        // Produces the body of an upload piece by piece.
+        //
+        // async_read_some fills up to size bytes of data with the next part
+        // of the body and completes with the number of bytes, 0 at the end of
+        // the body. The handler may be called from within async_read_some or
+        // later from a handler running on the io_service. No further read is
+        // started before the previous one completed.
+        template<typename Tag>
+        class basic_body_source
+            : boost::noncopyable
+        {
+        public:
+            typedef typename string_traits<Tag>::type                               string_type;
+            typedef typename header_collection_traits<Tag>::type                    headers_type;
+            typedef boost::system::error_code                                       error_code;
+            typedef boost::uint64_t                                                 size_type;
+            typedef boost::function< void(error_code const &, std::size_t) >        read_handler;
+
+            virtual ~basic_body_source()
+            {}
+
+            // Sent as Content-Length, a body of unknown size is sent chunked
+            static size_type unknown_size()
+            {
+                return size_type(-1);
+            }
+
+            virtual size_type size() const = 0;
+
+            // Sent as Content-Encoding if not empty
+            virtual string_type content_encoding() const
+            {
+                return string_type();
+            }
+
+            // true if the body can be produced again after rewind, which
+            // requests sent again (replays, 307 and 308 redirects) need
+            virtual bool repeatable() const = 0;
+
+            // Starts over from the beginning of the body
+            virtual void rewind() = 0;
+
+            // Fields sent after a chunked body, asked for once the body was
+            // read to its end. Only bodies of unknown size carry trailers.
+            virtual void trailers(headers_type &) const
+            {}
+
+            virtual void async_read_some(char * data, std::size_t size, read_handler const & handler) = 0;
+        };
+
+        // A body in memory. The data is copied unless it is passed as pointer
+        // and size, which then have to stay valid while the source is used.
+        template<typename Tag>
+        class basic_memory_source
+            : public basic_body_source<Tag>
+        {
+        public:
+            typedef basic_body_source<Tag>                  base_type;
+            typedef typename base_type::string_type         string_type;
+            typedef typename base_type::size_type           size_type;
+            typedef typename base_type::read_handler        read_handler;
+            typedef typename base_type::error_code          error_code;
+
+            explicit basic_memory_source(string_type const & data)
+                : copy_(data)
+                , data_(copy_.data())
+                , size_(copy_.size())
+                , offset_(0)
+            {}
+
+            basic_memory_source(char const * data, std::size_t size)
+                : copy_()
+                , data_(data)
+                , size_(size)
+                , offset_(0)
+            {}
+
+            size_type size() const
+            {
+                return size_;
+            }
+
+            bool repeatable() const
+            {
+                return true;
+            }
+
+            void rewind()
+            {
+                offset_ = 0;
+            }
+
+            void async_read_some(char * data, std::size_t size, read_handler const & handler)
+            {
+                std::size_t const count = (std::min)(size, size_ - offset_);
+                std::memcpy(data, data_ + offset_, count);
+                offset_ += count;
+                handler(error_code(), count);
+            }
+
+        private:
+            string_type     copy_;
+            char const *    data_;
+            std::size_t     size_;
+            std::size_t     offset_;
+        };
+
+#if !defined(WIN32) && !defined(WIN64)
+        // A range of a file, read with pread(2) as the upload goes. Disk reads
+        // block the calling thread, as they are served from the page cache
+        // for files written recently that is usually not noticeable.
+        template<typename Tag>
+        class basic_file_source
+            : public basic_body_source<Tag>
+        {
+        public:
+            typedef basic_body_source<Tag>                  base_type;
+            typedef typename base_type::size_type           size_type;
+            typedef typename base_type::read_handler        read_handler;
+            typedef typename base_type::error_code          error_code;
+            typedef int                                     native_file_type;
+
+            // The whole file, errors opening it are reported by the first read
+            explicit basic_file_source(char const * path)
+                : file_(::open(path, O_RDONLY))
+                , owned_(true)
+                , begin_(0)
+                , size_(0)
+                , offset_(0)
+                , error_()
+            {
+                struct stat info;
+                if(file_ < 0 || ::fstat(file_, &info) != 0)
+                {
+                    error_ = error_code(errno, boost::asio::error::get_system_category());
+                    return;
+                }
+                size_ = static_cast<size_type>(info.st_size);
+            }
+
+            // count bytes from offset of a file which stays open while the
+            // source is used
+            basic_file_source(native_file_type file, off_t offset, size_type count)
+                : file_(file)
+                , owned_(false)
+                , begin_(offset)
+                , size_(count)
+                , offset_(0)
+                , error_()
+            {}
+
+            ~basic_file_source()
+            {
+                if(owned_ && file_ >= 0)
+                {
+                    ::close(file_);
+                }
+            }
+
+            size_type size() const
+            {
+                return size_;
+            }
+
+            bool repeatable() const
+            {
+                return true;
+            }
+
+            void rewind()
+            {
+                offset_ = 0;
+            }
+
+            void async_read_some(char * data, std::size_t size, read_handler const & handler)
+            {
+                if(error_)
+                {
+                    handler(error_, 0);
+                    return;
+                }
+                size_type const left = size_ - offset_;
+                if(left < size)
+                {
+                    size = static_cast<std::size_t>(left);
+                }
+                ssize_t bytes = 0;
+                if(size)
+                {
+                    do
+                    {
+                        bytes = ::pread(file_, data, size, begin_ + static_cast<off_t>(offset_));
+                    }
+                    while(bytes < 0 && errno == EINTR);
+                    if(bytes <= 0)
+                    {
+                        // A file which shrank would leave the body short
+                        handler(bytes < 0 ? error_code(errno, boost::asio::error::get_system_category()) : error_code(boost::asio::error::eof), 0);
+                        return;
+                    }
+                    offset_ += static_cast<size_type>(bytes);
+                }
+                handler(error_code(), static_cast<std::size_t>(bytes));
+            }
+
+        private:
+            native_file_type    file_;
+            bool                owned_;
+            off_t               begin_;
+            size_type           size_;
+            size_type           offset_;
+            error_code          error_;
+        };
+#endif
+
+        // A body produced by a callback, which gets the same arguments as
+        // async_read_some. Produced once, it can not be sent again.
+        template<typename Tag>
+        class basic_generator_source
+            : public basic_body_source<Tag>
+        {
+        public:
+            typedef basic_body_source<Tag>                  base_type;
+            typedef typename base_type::size_type           size_type;
+            typedef typename base_type::read_handler        read_handler;
+            typedef boost::function< void(char *, std::size_t, read_handler const &) >  generator;
+
+            explicit basic_generator_source(generator const & generate, size_type size = base_type::unknown_size())
+                : generate_(generate)
+                , size_(size)
+            {}
+
+            size_type size() const
+            {
+                return size_;
+            }
+
+            bool repeatable() const
+            {
+                return false;
+            }
+
+            void rewind()
+            {}
+
+            void async_read_some(char * data, std::size_t size, read_handler const & handler)
+            {
+                generate_(data, size, handler);
+            }
+
+        private:
+            generator   generate_;
+            size_type   size_;
+        };
+
+        // Compresses another source with gzip while it is read. The
+        // compressed size is not known up front, the body is sent chunked.
+        // Input is read in pieces of INPUT_SIZE, so memory use stays at that
+        // plus the deflate state whatever the size of the body.
+        template<typename Tag>
+        class basic_gzip_source
+            : public basic_body_source<Tag>
+        {
+        public:
+            typedef basic_body_source<Tag>                  base_type;
+            typedef boost::shared_ptr<base_type>            source_ptr;
+            typedef typename base_type::string_type         string_type;
+            typedef typename base_type::headers_type        headers_type;
+            typedef typename base_type::size_type           size_type;
+            typedef typename base_type::read_handler        read_handler;
+            typedef typename base_type::error_code          error_code;
+
+            enum { INPUT_SIZE = 0x4000 };
+
+            explicit basic_gzip_source(source_ptr source, int level = Z_DEFAULT_COMPRESSION)
+                : source_(source)
+                , ready_(false)
+                , input_()
+                , input_begin_(0)
+                , input_end_(0)
+                , eof_(false)
+                , ended_(false)
+                , reading_(false)
+                , inline_(false)
+                , read_error_()
+                , read_size_(0)
+            {
+                std::memset(&zlib_, 0, sizeof(zlib_));
+                ready_ = deflateInit2(&zlib_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+            }
+
+            ~basic_gzip_source()
+            {
+                if(ready_)
+                {
+                    deflateEnd(&zlib_);
+                }
+            }
+
+            size_type size() const
+            {
+                return base_type::unknown_size();
+            }
+
+            string_type content_encoding() const
+            {
+                return "gzip";
+            }
+
+            bool repeatable() const
+            {
+                return source_->repeatable();
+            }
+
+            void rewind()
+            {
+                source_->rewind();
+                if(ready_)
+                {
+                    deflateReset(&zlib_);
+                }
+                input_begin_ = input_end_ = 0;
+                eof_   = false;
+                ended_ = false;
+            }
+
+            void trailers(headers_type & fields) const
+            {
+                source_->trailers(fields);
+            }
+
+            void async_read_some(char * data, std::size_t size, read_handler const & handler)
+            {
+                if(!ready_)
+                {
+                    handler(error_code(boost::asio::error::no_memory), 0);
+                    return;
+                }
+                for(;;)
+                {
+                    if(ended_ || !size)
+                    {
+                        handler(error_code(), 0);
+                        return;
+                    }
+                    if(input_begin_ != input_end_ || eof_)
+                    {
+                        zlib_.next_in   = reinterpret_cast<Bytef*>(input_.data() + input_begin_);
+                        zlib_.avail_in  = static_cast<uInt>(input_end_ - input_begin_);
+                        zlib_.next_out  = reinterpret_cast<Bytef*>(data);
+                        zlib_.avail_out = static_cast<uInt>(size);
+                        int const result = deflate(&zlib_, eof_ ? Z_FINISH : Z_NO_FLUSH);
+                        input_begin_ = input_end_ - zlib_.avail_in;
+                        ended_ = result == Z_STREAM_END;
+                        std::size_t const produced = size - zlib_.avail_out;
+                        if(produced)
+                        {
+                            handler(error_code(), produced);
+                            return;
+                        }
+                        if(input_begin_ != input_end_ || ended_)
+                        {
+                            continue;
+                        }
+                    }
+
+                    // Everything read so far is in the deflate state
+                    if(input_.empty())
+                    {
+                        input_ = util::lease_buffer(INPUT_SIZE);
+                    }
+                    input_begin_ = input_end_ = 0;
+                    reading_ = true;
+                    inline_  = true;
+                    source_->async_read_some(
+                        input_.data(),
+                        input_.size(),
+                        boost::bind(&basic_gzip_source::on_input, this, data, size, handler, _1, _2)
+                    );
+                    inline_ = false;
+                    if(reading_)
+                    {
+                        // Continues in on_input
+                        return;
+                    }
+                    if(!take_input(handler))
+                    {
+                        return;
+                    }
+                }
+            }
+
+        private:
+            void on_input(char * data, std::size_t size, read_handler handler, error_code const & ec, std::size_t bytes)
+            {
+                reading_    = false;
+                read_error_ = ec;
+                read_size_  = bytes;
+                if(!inline_ && take_input(handler))
+                {
+                    async_read_some(data, size, handler);
+                }
+            }
+
+            bool take_input(read_handler const & handler)
+            {
+                if(read_error_)
+                {
+                    handler(read_error_, 0);
+                    return false;
+                }
+                input_end_ = read_size_;
+                eof_       = read_size_ == 0;
+                return true;
+            }
+
+        private:
+            source_ptr          source_;
+            z_stream            zlib_;
+            bool                ready_;
+            util::buffer_lease  input_;
+            std::size_t         input_begin_;
+            std::size_t         input_end_;
+            bool                eof_;           // the source is used up
+            bool                ended_;         // the gzip trailer is out
+            bool                reading_;
+            bool                inline_;        // inside the source's async_read_some
+            error_code          read_error_;
+            std::size_t         read_size_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_REQUEST_BODY_SOURCE_HPP_INCLUDED
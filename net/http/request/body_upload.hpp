@@ -0,0 +1,320 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_REQUEST_BODY_UPLOAD_HPP_INCLUDED
+#define GUARD_NET_HTTP_REQUEST_BODY_UPLOAD_HPP_INCLUDED
+
+#include <net/http/request/body_source.hpp>
+#include <net/http/chunked_encoder.hpp>
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/error.hpp>
+#include <boost/array.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace net
+{
+    namespace http
+    {
+        // Writes a request body from a body source onto a stream once the
+        // head is out. A source of known size is sent as is, its size was
+        // announced as Content-Length; otherwise the body is framed as chunks,
+        // the framing is gathered around the block on the write, and the
+        // source's trailers follow the last chunk. Trailers of a body with a
+        // Content-Length have no place on the wire and are not asked for.
+        //
+        // Two blocks of BLOCK_SIZE are used whatever the size of the body:
+        // the next block is read from the source while the previous one is
+        // on the wire, and no further block is read before the stream took
+        // the one written, so a slow connection holds back the source.
+        // The handler gets the number of body bytes written and is never
+        // called from within async_send.
+        template<typename Tag>
+        struct body_upload
+        {
+            typedef basic_body_source<Tag>                                          source_type;
+            typedef boost::shared_ptr<source_type>                                  source_ptr;
+            typedef typename source_type::size_type                                 size_type;
+            typedef typename source_type::headers_type                              headers_type;
+            typedef boost::system::error_code                                       error_code;
+            typedef boost::function< void(error_code const &, size_type) >          completion_handler;
+
+            enum { BLOCK_SIZE = 0x4000 };
+
+            static bool chunked(source_type const & source)
+            {
+                return source.size() == source_type::unknown_size();
+            }
+
+            template<typename Stream>
+            static void async_send(Stream & stream, source_ptr source, completion_handler handler)
+            {
+                session_ptr sess(new session(source, handler));
+                sess->blocks[0] = util::lease_buffer(BLOCK_SIZE);
+                sess->blocks[1] = util::lease_buffer(BLOCK_SIZE);
+                sess->starting  = true;
+                pump(stream, sess);
+                sess->starting  = false;
+                if(sess->done)
+                {
+                    stream.get_io_service().post(boost::bind(sess->handler, sess->error, sess->written));
+                }
+            }
+
+        protected:
+            enum block_state
+            {
+                FREE,
+                READING,
+                FULL
+            };
+
+            struct session
+            {
+                session(source_ptr source, completion_handler const & handler)
+                    : source(source)
+                    , handler(handler)
+                    , size(source->size())
+                    , chunked(body_upload::chunked(*source))
+                    , blocks()
+                    , read(0)
+                    , written(0)
+                    , read_index(0)
+                    , write_index(0)
+                    , error()
+                    , reading(false)
+                    , writing(false)
+                    , ended(false)
+                    , terminated(false)
+                    , starting(false)
+                    , done(false)
+                {
+                    for(std::size_t i = 0; i < 2; ++i)
+                    {
+                        state[i]  = FREE;
+                        length[i] = 0;
+                    }
+                }
+
+                source_ptr                              source;
+                completion_handler                      handler;
+                size_type                               size;
+                bool                                    chunked;
+                boost::array<util::buffer_lease, 2>     blocks;
+                block_state                             state[2];
+                std::size_t                             length[2];
+                chunk_head                              heads[2];
+                basic_last_chunk<Tag>                   last_chunk;
+                size_type                               read;
+                size_type                               written;
+                std::size_t                             read_index;
+                std::size_t                             write_index;
+                error_code                              error;
+                bool                                    reading;
+                bool                                    writing;
+                bool                                    ended;          // the source is used up
+                bool                                    terminated;     // last chunk written
+                bool                                    starting;       // inside async_send
+                bool                                    done;
+            };
+
+            typedef boost::shared_ptr<session> session_ptr;
+
+            // Starts whatever can run now, reads may complete from within
+            template<typename Stream>
+            static void pump(Stream & stream, session_ptr sess)
+            {
+                if(sess->done)
+                {
+                    return;
+                }
+                std::size_t const next = sess->read_index;
+                if(!sess->reading && !sess->ended && sess->state[next] == FREE)
+                {
+                    sess->state[next] = READING;
+                    sess->reading = true;
+                    sess->source->async_read_some(
+                        sess->blocks[next].data(),
+                        BLOCK_SIZE,
+                        boost::bind(
+                            &body_upload::template on_read<Stream>,
+                            boost::ref(stream),
+                            sess,
+                            next,
+                            _1,
+                            _2
+                        )
+                    );
+                    if(sess->done)
+                    {
+                        return;
+                    }
+                }
+                if(sess->writing)
+                {
+                    return;
+                }
+                std::size_t const current = sess->write_index;
+                if(sess->state[current] == FULL)
+                {
+                    sess->writing = true;
+                    boost::asio::const_buffers_1 data(sess->blocks[current].data(), sess->length[current]);
+                    if(sess->chunked)
+                    {
+                        boost::asio::async_write(
+                            stream,
+                            make_chunk(sess->heads[current], data),
+                            boost::bind(
+                                &body_upload::template on_written<Stream>,
+                                boost::ref(stream),
+                                sess,
+                                current,
+                                boost::asio::placeholders::error
+                            )
+                        );
+                    }
+                    else
+                    {
+                        boost::asio::async_write(
+                            stream,
+                            data,
+                            boost::bind(
+                                &body_upload::template on_written<Stream>,
+                                boost::ref(stream),
+                                sess,
+                                current,
+                                boost::asio::placeholders::error
+                            )
+                        );
+                    }
+                }
+                else if(sess->ended && !sess->reading)
+                {
+                    if(!sess->chunked && sess->read != sess->size)
+                    {
+                        finish(stream, sess, net::error::http_body_size_mismatch);
+                    }
+                    else if(sess->chunked && !sess->terminated)
+                    {
+                        headers_type trailers;
+                        sess->source->trailers(trailers);
+                        sess->last_chunk = basic_last_chunk<Tag>(trailers);
+                        sess->terminated = true;
+                        sess->writing    = true;
+                        boost::asio::async_write(
+                            stream,
+                            sess->last_chunk.buffers(),
+                            boost::bind(
+                                &body_upload::template on_written<Stream>,
+                                boost::ref(stream),
+                                sess,
+                                std::size_t(2),
+                                boost::asio::placeholders::error
+                            )
+                        );
+                    }
+                    else
+                    {
+                        finish(stream, sess, error_code());
+                    }
+                }
+            }
+
+            template<typename Stream>
+            static void on_read(Stream & stream, session_ptr sess, std::size_t index, error_code const & ec, std::size_t bytes)
+            {
+                sess->reading = false;
+                if(sess->done)
+                {
+                    return;
+                }
+                if(ec)
+                {
+                    finish(stream, sess, ec);
+                    return;
+                }
+                if(!bytes)
+                {
+                    sess->state[index] = FREE;
+                    sess->ended = true;
+                }
+                else
+                {
+                    sess->read += bytes;
+                    if(!sess->chunked && sess->read > sess->size)
+                    {
+                        finish(stream, sess, net::error::http_body_size_mismatch);
+                        return;
+                    }
+                    sess->length[index] = bytes;
+                    sess->state[index]  = FULL;
+                    sess->read_index ^= 1;
+                }
+                pump(stream, sess);
+            }
+
+            template<typename Stream>
+            static void on_written(Stream & stream, session_ptr sess, std::size_t index, error_code const & ec)
+            {
+                sess->writing = false;
+                if(sess->done)
+                {
+                    return;
+                }
+                if(ec)
+                {
+                    finish(stream, sess, ec);
+                    return;
+                }
+                if(index < 2)
+                {
+                    sess->written += sess->length[index];
+                    sess->state[index] = FREE;
+                    sess->write_index ^= 1;
+                }
+                pump(stream, sess);
+            }
+
+            template<typename Stream>
+            static void finish(Stream & stream, session_ptr sess, error_code const & ec)
+            {
+                sess->done  = true;
+                sess->error = ec;
+                if(!sess->starting)
+                {
+                    stream.get_io_service().post(boost::bind(sess->handler, sess->error, sess->written));
+                }
+            }
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_REQUEST_BODY_UPLOAD_HPP_INCLUDED
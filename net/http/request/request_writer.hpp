@@ -0,0 +1,323 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_REQUEST_REQUEST_WRITER_HPP_INCLUDED
+#define GUARD_NET_HTTP_REQUEST_REQUEST_WRITER_HPP_INCLUDED
+
+#include <net/http/request/basic_request.hpp>
+#include <net/http/request/body_source.hpp>
+#include <net/client/utils/output_buffer.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstring>
+#include <vector>
+
+namespace net
+{
+    namespace http
+    {
+        // Headers sent with every request of a client (Host, User-Agent,
+        // Accept, ...), serialized once and copied as a block afterwards.
+        // Headers of the request itself take precedence over the block.
+        // The block is immutable once shared between threads.
+        template<typename Tag>
+        class basic_header_block
+        {
+        public:
+            typedef typename string_traits<Tag>::type string_type;
+
+            basic_header_block()
+                : text_()
+                , lines_()
+            {}
+
+            basic_header_block & add(string_type const & name, string_type const & value)
+            {
+                line l;
+                l.begin     = text_.size();
+                l.name_size = name.size();
+                text_.append(name);
+                text_.append(": ", 2);
+                text_.append(value);
+                text_.append("\r\n", 2);
+                l.size      = text_.size() - l.begin;
+                lines_.push_back(l);
+                return *this;
+            }
+
+            bool empty() const
+            {
+                return lines_.empty();
+            }
+
+            string_type const & text() const
+            {
+                return text_;
+            }
+
+            template<typename Headers>
+            void write(util::output_buffer & out, Headers const & overrides) const
+            {
+                if(overrides.empty())
+                {
+                    out.append(text_.data(), text_.size());
+                    return;
+                }
+                for(typename std::vector<line>::const_iterator it = lines_.begin(); it != lines_.end(); ++it)
+                {
+                    if(!contains(overrides, text_.data() + it->begin, it->name_size))
+                    {
+                        out.append(text_.data() + it->begin, it->size);
+                    }
+                }
+            }
+
+        private:
+            struct line
+            {
+                std::size_t begin;
+                std::size_t name_size;
+                std::size_t size;       // including the line break
+            };
+
+            template<typename Headers>
+            static bool contains(Headers const & headers, char const * name, std::size_t size)
+            {
+                for(typename Headers::const_iterator it = headers.begin(); it != headers.end(); ++it)
+                {
+                    if(equals_ignore_case(it->first, name, size))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            static bool equals_ignore_case(string_type const & a, char const * b, std::size_t size)
+            {
+                if(a.size() != size)
+                {
+                    return false;
+                }
+                for(std::size_t i = 0; i < size; ++i)
+                {
+                    if(to_lower(a[i]) != to_lower(b[i]))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            static char to_lower(char c)
+            {
+                return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+            }
+
+        private:
+            string_type         text_;
+            std::vector<line>   lines_;
+        };
+
+        // Serializes requests as HTTP/1.x into an output buffer:
+        //   method SP resource [? query] SP HTTP/major.minor CRLF
+        //   headers of the request, the shared header block,
+        //   Content-Length for a body without one or a Transfer-Encoding,
+        //   CRLF, body
+        // Bodies read from a body source are written by body_upload, the
+        // head announces them by the source's size and coding.
+        template<typename Tag>
+        struct basic_request_writer
+        {
+            typedef basic_request<Tag>                      request_type;
+            typedef basic_body_source<Tag>                  body_source;
+            typedef basic_header_block<Tag>                 header_block;
+            typedef boost::shared_ptr<header_block const>   header_block_ptr;
+            typedef typename string_traits<Tag>::type       string_type;
+
+            basic_request_writer()
+                : common_()
+            {}
+
+            explicit basic_request_writer(header_block_ptr common)
+                : common_(common)
+            {}
+
+            void set_common_headers(header_block_ptr common)
+            {
+                common_ = common;
+            }
+
+            header_block_ptr common_headers() const
+            {
+                return common_;
+            }
+
+            // Request line and headers, the body is left to the caller
+            void write_head(util::output_buffer & out, request_type const & request) const
+            {
+                write_request_line(out, request);
+
+                typedef typename request_type::headers_type headers_type;
+                headers_type const & headers = request.headers();
+                // A message must not carry both Content-Length and Transfer-Encoding
+                bool has_framing = false;
+                for(typename headers_type::const_iterator it = headers.begin(); it != headers.end(); ++it)
+                {
+                    out << it->first << ": " << it->second << "\r\n";
+                    has_framing = has_framing || is_content_length(it->first) || equals_name(it->first, "transfer-encoding");
+                }
+                if(common_)
+                {
+                    common_->write(out, headers);
+                }
+                if(!has_framing && !request.body().empty())
+                {
+                    out << "Content-Length: " << static_cast<unsigned long>(request.body().size()) << "\r\n";
+                }
+                out << "\r\n";
+            }
+
+            // Head for a body read from source: Content-Length if the source
+            // knows its size, chunked otherwise, and its Content-Encoding.
+            // Such headers of the request itself are left out.
+            void write_head(util::output_buffer & out, request_type const & request, body_source const & source) const
+            {
+                write_request_line(out, request);
+
+                string_type const coding = source.content_encoding();
+                typedef typename request_type::headers_type headers_type;
+                headers_type const & headers = request.headers();
+                for(typename headers_type::const_iterator it = headers.begin(); it != headers.end(); ++it)
+                {
+                    if(!is_content_length(it->first) && !equals_name(it->first, "transfer-encoding")
+                        && (coding.empty() || !equals_name(it->first, "content-encoding")))
+                    {
+                        out << it->first << ": " << it->second << "\r\n";
+                    }
+                }
+                if(common_)
+                {
+                    common_->write(out, headers);
+                }
+                if(source.size() == body_source::unknown_size())
+                {
+                    out << "Transfer-Encoding: chunked\r\n";
+                }
+                else
+                {
+                    out << "Content-Length: ";
+                    write_decimal(out, source.size());
+                    out << "\r\n";
+                }
+                if(!coding.empty())
+                {
+                    out << "Content-Encoding: " << coding << "\r\n";
+                }
+                out << "\r\n";
+            }
+
+            void write(util::output_buffer & out, request_type const & request) const
+            {
+                write_head(out, request);
+                out << request.body();
+            }
+
+        protected:
+            static void write_request_line(util::output_buffer & out, request_type const & request)
+            {
+                if(request.method().empty())
+                {
+                    out << "GET";
+                }
+                else
+                {
+                    out << request.method();
+                }
+                out << ' ';
+                if(request.resource().empty())
+                {
+                    out << '/';
+                }
+                else
+                {
+                    out << request.resource();
+                }
+                if(!request.query().empty())
+                {
+                    out << '?' << request.query();
+                }
+
+                char * version = out.prepare(11);
+                std::memcpy(version, " HTTP/1.1\r\n", 11);
+                version[6]  = static_cast<char>('0' + request.version().first % 10);
+                version[8]  = static_cast<char>('0' + request.version().second % 10);
+                out.commit(11);
+            }
+
+            static bool is_content_length(string_type const & name)
+            {
+                return equals_name(name, "content-length");
+            }
+
+            // lower_name has to be lower case
+            static bool equals_name(string_type const & name, char const * lower_name)
+            {
+                std::size_t const size = std::strlen(lower_name);
+                if(name.size() != size)
+                {
+                    return false;
+                }
+                for(std::size_t i = 0; i < size; ++i)
+                {
+                    char const c = (name[i] >= 'A' && name[i] <= 'Z') ? static_cast<char>(name[i] + ('a' - 'A')) : name[i];
+                    if(c != lower_name[i])
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // unsigned long is 32 bits on some platforms
+            static void write_decimal(util::output_buffer & out, boost::uint64_t value)
+            {
+                char digits[20];
+                std::size_t count = 0;
+                do
+                {
+                    digits[sizeof(digits) - ++count] = static_cast<char>('0' + value % 10);
+                    value /= 10;
+                }
+                while(value);
+                out.append(digits + sizeof(digits) - count, count);
+            }
+
+        private:
+            header_block_ptr common_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_REQUEST_REQUEST_WRITER_HPP_INCLUDED
@@ -0,0 +1,296 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_RESPONSE_STREAM_HPP_INCLUDED
+#define GUARD_NET_HTTP_RESPONSE_STREAM_HPP_INCLUDED
+
+#include <net/http/client.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstring>
+#include <vector>
+
+namespace net
+{
+    namespace http
+    {
+        // Pull interface for a response body. async_open sends the request
+        // and completes once the head of the final response is in, then the
+        // caller reads the body with async_read_body_some as it would read
+        // from a socket: each read completes with at least one byte of the
+        // decoded body (framing and content coding removed), or with eof
+        // after the last one. The trailers, if any, are in response() by
+        // then.
+        //
+        // The body is never collected. It goes from the connection's read
+        // buffer straight into the caller's buffers, and the connection is
+        // not read from while the caller holds back with the next read, so
+        // a download takes the caller's buffer plus the connection's, not
+        // the size of the body. Only what is left of the last piece when
+        // the response completes is kept until it was read.
+        //
+        // Handlers are never called from within the initiating function.
+        // close() gives up on the body; the rest of it is still received
+        // but dropped, and the connection stays usable.
+        template<typename Tag>
+        class basic_response_stream
+            : public boost::enable_shared_from_this< basic_response_stream<Tag> >
+            , boost::noncopyable
+        {
+        public:
+            typedef boost::shared_ptr<basic_response_stream>                        self_ptr;
+            typedef basic_http_client<Tag>                                          client_type;
+            typedef typename client_type::self_ptr                                  client_ptr;
+            typedef typename client_type::service_type                              service_type;
+            typedef typename client_type::request_type                              request_type;
+            typedef typename client_type::response_type                             response_type;
+            typedef typename client_type::resume_handler                            resume_handler;
+            typedef typename string_traits<Tag>::type                               string_type;
+            typedef boost::system::error_code                                       error_code;
+            typedef boost::function< void(error_code const &, self_ptr) >           open_handler;
+            typedef boost::function< void(error_code const &, std::size_t) >        read_handler;
+
+            // The handler gets the stream in any case, on failure reads
+            // complete with the same error
+            static void async_open(client_ptr client, string_type const & url, request_type const & request, open_handler handler)
+            {
+                self_ptr self(new basic_response_stream(client->get_io_service()));
+                self->opening_ = handler;
+                client->async_stream(
+                    url,
+                    request,
+                    boost::bind(&basic_response_stream::on_complete, self, _1, _2),
+                    boost::bind(&basic_response_stream::on_piece, self, _1, _2, _3, _4),
+                    boost::bind(&basic_response_stream::on_head, self, _1)
+                );
+            }
+
+            // Status and headers of the final response
+            response_type const & response() const
+            {
+                return response_;
+            }
+
+            // true once the whole body was read or the request failed
+            bool eof() const
+            {
+                return ended_ && !size_;
+            }
+
+            template<typename MutableBufferSequence>
+            void async_read_body_some(MutableBufferSequence const & buffers, read_handler handler)
+            {
+                if(reading_)
+                {
+                    service_.post(boost::bind(handler, error_code(boost::asio::error::already_started), std::size_t(0)));
+                    return;
+                }
+                std::size_t const copied = fill(buffers);
+                if(copied || !capacity(buffers))
+                {
+                    service_.post(boost::bind(handler, error_code(), copied));
+                    release();
+                    return;
+                }
+                if(ended_)
+                {
+                    service_.post(boost::bind(handler, error_, std::size_t(0)));
+                    return;
+                }
+                buffers_.assign(buffers.begin(), buffers.end());
+                handler_ = handler;
+                reading_ = true;
+            }
+
+            // Drops the rest of the body, a pending read completes with
+            // operation_aborted
+            void close()
+            {
+                if(closed_)
+                {
+                    return;
+                }
+                closed_ = true;
+                size_   = 0;
+                if(reading_)
+                {
+                    complete_read(error_code(boost::asio::error::operation_aborted), 0);
+                }
+                if(!ended_)
+                {
+                    error_ = boost::asio::error::operation_aborted;
+                }
+                release();
+            }
+
+        protected:
+            explicit basic_response_stream(service_type & service)
+                : service_(service)
+                , opening_()
+                , response_()
+                , data_(0)
+                , size_(0)
+                , resume_()
+                , rest_()
+                , buffers_()
+                , handler_()
+                , error_()
+                , reading_(false)
+                , ended_(false)
+                , closed_(false)
+            {}
+
+            void open(error_code const & ec)
+            {
+                open_handler handler;
+                handler.swap(opening_);
+                if(handler)
+                {
+                    service_.post(boost::bind(handler, ec, this->shared_from_this()));
+                }
+            }
+
+            void on_head(response_type const & response)
+            {
+                response_ = response;
+                open(error_code());
+            }
+
+            void on_piece(response_type const &, char const * data, std::size_t size, resume_handler const & resume)
+            {
+                resume_ = resume;
+                if(closed_)
+                {
+                    release();
+                    return;
+                }
+                data_ = data;
+                size_ = size;
+                if(reading_)
+                {
+                    complete_read(error_code(), fill(buffers_));
+                }
+                release();
+            }
+
+            void on_complete(error_code const & ec, response_type const & response)
+            {
+                ended_ = true;
+                if(!ec || opening_)
+                {
+                    // Has the trailers now
+                    response_ = response;
+                }
+                if(!closed_)
+                {
+                    error_ = ec ? ec : error_code(boost::asio::error::eof);
+                }
+                resume_ = resume_handler();
+                if(size_)
+                {
+                    // The last piece is only valid during the call
+                    rest_.assign(data_, size_);
+                    data_ = rest_.data();
+                }
+                open(ec);
+                if(reading_)
+                {
+                    complete_read(error_, 0);
+                }
+            }
+
+            // Hands the piece back to the client once it is used up
+            void release()
+            {
+                if(size_ || !resume_)
+                {
+                    return;
+                }
+                resume_handler resume;
+                resume.swap(resume_);
+                resume();
+            }
+
+            void complete_read(error_code const & ec, std::size_t bytes)
+            {
+                read_handler handler;
+                handler.swap(handler_);
+                reading_ = false;
+                buffers_.clear();
+                service_.post(boost::bind(handler, ec, bytes));
+            }
+
+            template<typename MutableBufferSequence>
+            static std::size_t capacity(MutableBufferSequence const & buffers)
+            {
+                std::size_t total = 0;
+                for(typename MutableBufferSequence::const_iterator it = buffers.begin(); it != buffers.end(); ++it)
+                {
+                    total += boost::asio::buffer_size(boost::asio::mutable_buffer(*it));
+                }
+                return total;
+            }
+
+            template<typename MutableBufferSequence>
+            std::size_t fill(MutableBufferSequence const & buffers)
+            {
+                std::size_t copied = 0;
+                for(typename MutableBufferSequence::const_iterator it = buffers.begin(); it != buffers.end() && size_; ++it)
+                {
+                    boost::asio::mutable_buffer const target(*it);
+                    std::size_t const room = boost::asio::buffer_size(target);
+                    std::size_t const length = room < size_ ? room : size_;
+                    std::memcpy(boost::asio::buffer_cast<void*>(target), data_, length);
+                    data_  += length;
+                    size_  -= length;
+                    copied += length;
+                }
+                return copied;
+            }
+
+        private:
+            service_type &                              service_;
+            open_handler                                opening_;
+            response_type                               response_;
+            char const *                                data_;      // unread part of the current piece
+            std::size_t                                 size_;
+            resume_handler                              resume_;    // gives the piece back
+            string_type                                 rest_;      // the last piece, if not read in time
+            std::vector<boost::asio::mutable_buffer>    buffers_;   // of the pending read
+            read_handler                                handler_;
+            error_code                                  error_;
+            bool                                        reading_;
+            bool                                        ended_;
+            bool                                        closed_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_RESPONSE_STREAM_HPP_INCLUDED
@@ -0,0 +1,230 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_URL_HPP_INCLUDED
+#define GUARD_NET_HTTP_URL_HPP_INCLUDED
+
+#include <net/http/detail/traits.hpp>
+
+namespace net
+{
+    namespace http
+    {
+        // The parts of an absolute http or https URL a client needs:
+        //   scheme://[userinfo@]host[:port][/resource][?query][#fragment]
+        // User info and fragment are dropped, IPv6 hosts are stored without
+        // the brackets and the port defaults to the scheme's.
+        template<typename Tag>
+        struct basic_url
+        {
+            typedef typename string_traits<Tag>::type string_type;
+
+            basic_url()
+                : scheme()
+                , host()
+                , port()
+                , resource()
+                , query()
+            {}
+
+            bool parse(string_type const & text)
+            {
+                typename string_type::size_type const colon = text.find("://");
+                if(colon == string_type::npos || colon == 0)
+                {
+                    return false;
+                }
+
+                scheme.clear();
+                for(typename string_type::size_type i = 0; i < colon; ++i)
+                {
+                    char const c = text[i];
+                    scheme.push_back((c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c);
+                }
+                if(scheme != "http" && scheme != "https")
+                {
+                    return false;
+                }
+
+                typename string_type::size_type const authority = colon + 3;
+                typename string_type::size_type path = text.find_first_of("/?#", authority);
+                if(path == string_type::npos)
+                {
+                    path = text.size();
+                }
+                if(!parse_authority(text.substr(authority, path - authority)))
+                {
+                    return false;
+                }
+                set_target(text.substr(path));
+                return true;
+            }
+
+            bool secure() const
+            {
+                return scheme == "https";
+            }
+
+            // host[:port] as sent in the Host header, the port is left out
+            // if it is the scheme's default
+            string_type authority() const
+            {
+                string_type result;
+                if(host.find(':') != string_type::npos)
+                {
+                    result += '[';
+                    result += host;
+                    result += ']';
+                }
+                else
+                {
+                    result += host;
+                }
+                if(port != default_port())
+                {
+                    result += ':';
+                    result += port;
+                }
+                return result;
+            }
+
+            // Scheme, host and port, identifies the server
+            string_type origin() const
+            {
+                return scheme + "://" + authority();
+            }
+
+            // Resolves reference (e.g. a Location header) against this URL
+            bool resolve(string_type const & reference, basic_url & result) const
+            {
+                typename string_type::size_type const colon = reference.find("://");
+                if(colon != string_type::npos && reference.find_first_of("/?#") > colon)
+                {
+                    return result.parse(reference);
+                }
+                if(reference.size() > 1 && reference[0] == '/' && reference[1] == '/')
+                {
+                    return result.parse(scheme + ":" + reference);
+                }
+
+                result = *this;
+                if(reference.empty() || reference[0] == '#')
+                {
+                    return true;
+                }
+                if(reference[0] == '?')
+                {
+                    result.set_target(resource + reference);
+                }
+                else if(reference[0] == '/')
+                {
+                    result.set_target(reference);
+                }
+                else
+                {
+                    // Relative to the directory of the current resource
+                    result.set_target(resource.substr(0, resource.rfind('/') + 1) + reference);
+                }
+                return true;
+            }
+
+            string_type scheme;
+            string_type host;
+            string_type port;
+            string_type resource;
+            string_type query;
+
+        private:
+            string_type default_port() const
+            {
+                return secure() ? "443" : "80";
+            }
+
+            bool parse_authority(string_type authority)
+            {
+                typename string_type::size_type const at = authority.rfind('@');
+                if(at != string_type::npos)
+                {
+                    authority.erase(0, at + 1);
+                }
+
+                typename string_type::size_type port_start = string_type::npos;
+                if(!authority.empty() && authority[0] == '[')
+                {
+                    typename string_type::size_type const close = authority.find(']');
+                    if(close == string_type::npos)
+                    {
+                        return false;
+                    }
+                    host = authority.substr(1, close - 1);
+                    if(close + 1 < authority.size())
+                    {
+                        if(authority[close + 1] != ':')
+                        {
+                            return false;
+                        }
+                        port_start = close + 2;
+                    }
+                }
+                else
+                {
+                    typename string_type::size_type const colon = authority.find(':');
+                    host = authority.substr(0, colon);
+                    if(colon != string_type::npos)
+                    {
+                        port_start = colon + 1;
+                    }
+                }
+
+                port = default_port();
+                if(port_start != string_type::npos && port_start < authority.size())
+                {
+                    port = authority.substr(port_start);
+                    if(port.size() > 5 || port.find_first_not_of("0123456789") != string_type::npos)
+                    {
+                        return false;
+                    }
+                }
+                return !host.empty();
+            }
+
+            // Splits path, query and fragment
+            void set_target(string_type const & target)
+            {
+                typename string_type::size_type const fragment = target.find('#');
+                string_type const path = target.substr(0, fragment);
+                typename string_type::size_type const question = path.find('?');
+                resource = path.substr(0, question);
+                query = question == string_type::npos ? string_type() : path.substr(question + 1);
+                if(resource.empty())
+                {
+                    resource = "/";
+                }
+            }
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_URL_HPP_INCLUDED
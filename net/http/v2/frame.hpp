@@ -0,0 +1,235 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_V2_FRAME_HPP_INCLUDED
+#define GUARD_NET_HTTP_V2_FRAME_HPP_INCLUDED
+
+#include <net/client/utils/output_buffer.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+
+namespace net
+{
+    namespace http
+    {
+        // HTTP/2 framing layer (RFC 7540, 4 and 6)
+        namespace v2
+        {
+            enum frame_type
+            {
+                FRAME_DATA          = 0x0,
+                FRAME_HEADERS       = 0x1,
+                FRAME_PRIORITY      = 0x2,
+                FRAME_RST_STREAM    = 0x3,
+                FRAME_SETTINGS      = 0x4,
+                FRAME_PUSH_PROMISE  = 0x5,
+                FRAME_PING          = 0x6,
+                FRAME_GOAWAY        = 0x7,
+                FRAME_WINDOW_UPDATE = 0x8,
+                FRAME_CONTINUATION  = 0x9
+            };
+
+            enum frame_flags
+            {
+                FLAG_END_STREAM     = 0x01,
+                FLAG_ACK            = 0x01,
+                FLAG_END_HEADERS    = 0x04,
+                FLAG_PADDED         = 0x08,
+                FLAG_PRIORITY       = 0x20
+            };
+
+            enum settings_parameter
+            {
+                SETTINGS_HEADER_TABLE_SIZE      = 0x1,
+                SETTINGS_ENABLE_PUSH            = 0x2,
+                SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+                SETTINGS_INITIAL_WINDOW_SIZE    = 0x4,
+                SETTINGS_MAX_FRAME_SIZE         = 0x5,
+                SETTINGS_MAX_HEADER_LIST_SIZE   = 0x6
+            };
+
+            enum
+            {
+                FRAME_HEADER_SIZE       = 9,
+                SETTING_SIZE            = 6,
+                CLIENT_PREFACE_SIZE     = 24,
+                DEFAULT_WINDOW_SIZE     = 0xffff,
+                DEFAULT_MAX_FRAME_SIZE  = 0x4000,
+                MAX_FRAME_SIZE_LIMIT    = 0xffffff,
+                MAX_WINDOW_SIZE         = 0x7fffffff,
+                NO_ERROR_CODE           = 0x0       // GOAWAY and RST_STREAM
+            };
+
+            // Sent by the client before anything else
+            inline char const * client_preface()
+            {
+                return "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+            }
+
+            inline boost::uint32_t read_uint32(unsigned char const * data)
+            {
+                return (boost::uint32_t(data[0]) << 24)
+                     | (boost::uint32_t(data[1]) << 16)
+                     | (boost::uint32_t(data[2]) << 8)
+                     |  boost::uint32_t(data[3]);
+            }
+
+            inline void put_uint32(char * out, boost::uint32_t value)
+            {
+                out[0] = static_cast<char>(value >> 24);
+                out[1] = static_cast<char>(value >> 16);
+                out[2] = static_cast<char>(value >> 8);
+                out[3] = static_cast<char>(value);
+            }
+
+            struct frame_header
+            {
+                frame_header()
+                    : length(0)
+                    , type(0)
+                    , flags(0)
+                    , stream(0)
+                {}
+
+                // Reads the FRAME_HEADER_SIZE octets at data
+                void read(unsigned char const * data)
+                {
+                    length = (boost::uint32_t(data[0]) << 16) | (boost::uint32_t(data[1]) << 8) | data[2];
+                    type   = data[3];
+                    flags  = data[4];
+                    stream = read_uint32(data + 5) & MAX_WINDOW_SIZE;
+                }
+
+                bool has(unsigned flag) const
+                {
+                    return (flags & flag) != 0;
+                }
+
+                boost::uint32_t length;
+                boost::uint8_t  type;
+                boost::uint8_t  flags;
+                boost::uint32_t stream;
+            };
+
+            template<std::size_t N>
+            void write_frame_header(util::basic_output_buffer<N> & out, std::size_t length, unsigned type, unsigned flags, boost::uint32_t stream)
+            {
+                char * header = out.prepare(FRAME_HEADER_SIZE);
+                header[0] = static_cast<char>(length >> 16);
+                header[1] = static_cast<char>(length >> 8);
+                header[2] = static_cast<char>(length);
+                header[3] = static_cast<char>(type);
+                header[4] = static_cast<char>(flags);
+                put_uint32(header + 5, stream);
+                out.commit(FRAME_HEADER_SIZE);
+            }
+
+            template<std::size_t N>
+            void write_uint32(util::basic_output_buffer<N> & out, boost::uint32_t value)
+            {
+                put_uint32(out.prepare(4), value);
+                out.commit(4);
+            }
+
+            template<std::size_t N>
+            void write_setting(util::basic_output_buffer<N> & out, unsigned id, boost::uint32_t value)
+            {
+                char * setting = out.prepare(SETTING_SIZE);
+                setting[0] = static_cast<char>(id >> 8);
+                setting[1] = static_cast<char>(id);
+                put_uint32(setting + 2, value);
+                out.commit(SETTING_SIZE);
+            }
+
+            template<std::size_t N>
+            void write_settings_ack(util::basic_output_buffer<N> & out)
+            {
+                write_frame_header(out, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+            }
+
+            template<std::size_t N>
+            void write_ping(util::basic_output_buffer<N> & out, char const * payload, bool ack)
+            {
+                write_frame_header(out, 8, FRAME_PING, ack ? FLAG_ACK : 0, 0);
+                out.append(payload, 8);
+            }
+
+            template<std::size_t N>
+            void write_window_update(util::basic_output_buffer<N> & out, boost::uint32_t stream, boost::uint32_t increment)
+            {
+                write_frame_header(out, 4, FRAME_WINDOW_UPDATE, 0, stream);
+                write_uint32(out, increment);
+            }
+
+            template<std::size_t N>
+            void write_rst_stream(util::basic_output_buffer<N> & out, boost::uint32_t stream, boost::uint32_t code)
+            {
+                write_frame_header(out, 4, FRAME_RST_STREAM, 0, stream);
+                write_uint32(out, code);
+            }
+
+            template<std::size_t N>
+            void write_goaway(util::basic_output_buffer<N> & out, boost::uint32_t last_stream, boost::uint32_t code)
+            {
+                write_frame_header(out, 8, FRAME_GOAWAY, 0, 0);
+                write_uint32(out, last_stream);
+                write_uint32(out, code);
+            }
+
+            template<std::size_t N>
+            void write_data(util::basic_output_buffer<N> & out, boost::uint32_t stream, char const * data, std::size_t size, bool end_stream)
+            {
+                write_frame_header(out, size, FRAME_DATA, end_stream ? FLAG_END_STREAM : 0, stream);
+                out.append(data, size);
+            }
+
+            // A HEADERS frame followed by as many CONTINUATION frames as the
+            // header block needs with frames of at most max_frame_size
+            template<std::size_t N>
+            void write_headers(util::basic_output_buffer<N> & out, boost::uint32_t stream, char const * block, std::size_t size, std::size_t max_frame_size, bool end_stream)
+            {
+                unsigned type  = FRAME_HEADERS;
+                unsigned flags = end_stream ? FLAG_END_STREAM : 0;
+                do
+                {
+                    std::size_t const length = size < max_frame_size ? size : max_frame_size;
+                    if(length == size)
+                    {
+                        flags |= FLAG_END_HEADERS;
+                    }
+                    write_frame_header(out, length, type, flags, stream);
+                    out.append(block, length);
+                    block += length;
+                    size  -= length;
+                    type   = FRAME_CONTINUATION;
+                    flags  = 0;
+                }
+                while(size);
+            }
+        }
+    }
+}
+
+#endif //GUARD_NET_HTTP_V2_FRAME_HPP_INCLUDED
@@ -0,0 +1,1435 @@
+/*
+* Copyright (c) 2008-2014 by Vinzenz 'evilissimo' Feenstra
+* All rights reserved.
+*
+* - Redistribution and use in source and binary forms, with or without
+*   modification, are permitted provided that the following conditions are met:
+*
+* - Redistributions of source code must retain the above copyright notice, this
+*   list of conditions and the following disclaimer.
+* - Neither the name of the Vinzenz 'evilissimo' Feenstra nor the names
+*   of its contributors may be used to endorse or promote products derived from
+*   this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+* ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+* LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+* INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+* CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+* ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef GUARD_NET_HTTP_V2_SESSION_HPP_INCLUDED
+#define GUARD_NET_HTTP_V2_SESSION_HPP_INCLUDED
+
+#include <net/client/socket_adapter.hpp>
+#include <net/client/utils/buffer_pool.hpp>
+#include <net/client/utils/output_buffer.hpp>
+#include <net/http/detail/header_utils.hpp>
+#include <net/http/request/basic_request.hpp>
+#include <net/http/request/body_source.hpp>
+#include <net/http/response/basic_response.hpp>
+#include <net/http/hpack.hpp>
+#include <net/http/v2/frame.hpp>
+#include <net/error.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace net
+{
+    namespace http
+    {
+        // Client side of one HTTP/2 connection (RFC 7540). Every request
+        // becomes a stream, any number of them run concurrently up to the
+        // limit the server announces.
+        //
+        // The connection has to be established already, over TLS with "h2"
+        // selected by ALPN (see ssl_connection::set_alpn_protocols).
+        // Responses are received into a window of STREAM_WINDOW_SIZE per
+        // stream and CONNECTION_WINDOW_SIZE for the connection, the windows
+        // are opened again as the data is consumed. Request bodies are sent
+        // as the server's windows allow; bodies from a body source are read
+        // as they are sent, and not faster than the connection takes them.
+        //
+        // Create the session with new and hold it in a self_ptr, pending
+        // operations keep it alive. Not thread safe, run the io_service on
+        // one thread.
+        template<typename Tag>
+        class basic_http2_session
+            : public boost::enable_shared_from_this< basic_http2_session<Tag> >
+            , boost::noncopyable
+        {
+        public:
+            typedef boost::shared_ptr<basic_http2_session>  self_ptr;
+            typedef socket_adapter<Tag>                     socket_type;
+            typedef typename socket_type::service_type      service_type;
+            typedef basic_request<Tag>                      request_type;
+            typedef basic_response<Tag>                     response_type;
+            typedef typename string_traits<Tag>::type       string_type;
+            typedef boost::system::error_code               error_code;
+            typedef boost::posix_time::ptime                time_type;
+            typedef basic_body_source<Tag>                  body_source;
+            typedef boost::shared_ptr<body_source>          body_source_ptr;
+
+            // See basic_http_client for the handler types
+            typedef boost::function< void(error_code const &, response_type const &) >              response_handler;
+            typedef boost::function< void(response_type const &, char const *, std::size_t) >      body_handler;
+            typedef boost::function< void() >                                                       resume_handler;
+            typedef boost::function< void(response_type const &, char const *, std::size_t, resume_handler const &) >  paced_body_handler;
+            typedef boost::function< void(response_type const &) >                                 head_handler;
+
+            enum
+            {
+                INPUT_BUFFER_SIZE       = 0x10000,
+                STREAM_WINDOW_SIZE      = 0x100000,
+                CONNECTION_WINDOW_SIZE  = 0x1000000,
+                DEFAULT_MAX_STREAMS     = 100,      // until the server's SETTINGS arrive
+                HEADER_LIST_MAX         = 0x10000,
+                UPLOAD_BLOCK_SIZE       = 0x4000,
+                OUTPUT_HIGH_WATER       = 0x10000,  // no more body data is queued above it
+                MAX_STREAM_ID           = 0x7fffffff
+            };
+
+            // scheme and authority are sent with every request, unless the
+            // request has its own Host header
+            basic_http2_session(socket_type const & socket, string_type const & scheme, string_type const & authority)
+                : socket_(socket)
+                , scheme_(scheme)
+                , authority_(authority)
+                , streams_()
+                , uploads_()
+                , encoder_()
+                , decoder_()
+                , filling_(0)
+                , input_()
+                , input_begin_(0)
+                , input_end_(0)
+                , fragment_()
+                , fragment_stream_(0)
+                , fragment_end_stream_(false)
+                , send_window_(v2::DEFAULT_WINDOW_SIZE)
+                , receive_window_(CONNECTION_WINDOW_SIZE)
+                , unacked_(0)
+                , initial_send_window_(v2::DEFAULT_WINDOW_SIZE)
+                , peer_max_frame_(v2::DEFAULT_MAX_FRAME_SIZE)
+                , max_streams_(DEFAULT_MAX_STREAMS)
+                , next_stream_(1)
+                , idle_since_(now())
+                , writing_(false)
+                , reading_(false)
+                , goaway_(false)
+                , closing_(false)
+                , closed_(false)
+            {
+                decoder_.set_max_list_size(HEADER_LIST_MAX);
+            }
+
+            // Sends the connection preface and our settings
+            void start()
+            {
+                util::output_buffer & out = output();
+                out.append(v2::client_preface(), v2::CLIENT_PREFACE_SIZE);
+                v2::write_frame_header(out, 3 * v2::SETTING_SIZE, v2::FRAME_SETTINGS, 0, 0);
+                v2::write_setting(out, v2::SETTINGS_ENABLE_PUSH, 0);
+                v2::write_setting(out, v2::SETTINGS_INITIAL_WINDOW_SIZE, STREAM_WINDOW_SIZE);
+                v2::write_setting(out, v2::SETTINGS_MAX_HEADER_LIST_SIZE, HEADER_LIST_MAX);
+                v2::write_window_update(out, 0, CONNECTION_WINDOW_SIZE - v2::DEFAULT_WINDOW_SIZE);
+                start_write();
+                start_read();
+            }
+
+            // true if another request can be submitted right away
+            bool available() const
+            {
+                return !closed() && !goaway_ && streams_.size() < max_streams_ && next_stream_ <= MAX_STREAM_ID;
+            }
+
+            bool closed() const
+            {
+                return closed_ || closing_;
+            }
+
+            // Streams not complete yet
+            std::size_t active() const
+            {
+                return streams_.size();
+            }
+
+            // When the last stream completed
+            time_type idle_since() const
+            {
+                return idle_since_;
+            }
+
+            // The request's method, resource, query, headers and body are
+            // sent, connection specific headers are left out. Returns the
+            // stream's id, 0 if the request was refused.
+            boost::uint32_t submit(request_type const & request, response_handler handler, body_handler body = body_handler())
+            {
+                return open(request, handler, body, paced_body_handler(), body_source_ptr());
+            }
+
+            // head is called once the final response head arrived
+            boost::uint32_t submit_paced(request_type const & request, response_handler handler, paced_body_handler body, head_handler head = head_handler())
+            {
+                return open(request, handler, body_handler(), body, body_source_ptr(), head);
+            }
+
+            // The body is read from source instead of the request, see
+            // basic_body_source
+            boost::uint32_t submit_upload(request_type const & request, body_source_ptr source, response_handler handler, body_handler body = body_handler())
+            {
+                return open(request, handler, body, paced_body_handler(), source);
+            }
+
+            // Resets the stream with CANCEL, its handler completes with
+            // operation_aborted. Not from within the stream's handlers.
+            void cancel(boost::uint32_t id)
+            {
+                stream_ptr s = find(id);
+                if(!s || s->finished || closed())
+                {
+                    return;
+                }
+                reset(s, net::error::http2_cancel, error_code(boost::asio::error::operation_aborted));
+                start_write();
+            }
+
+            // Closes the connection, pending requests complete with
+            // operation_aborted
+            void close()
+            {
+                if(closed_)
+                {
+                    return;
+                }
+                stream_map streams;
+                streams.swap(streams_);
+                uploads_.clear();
+                shutdown();
+                for(typename stream_map::iterator it = streams.begin(); it != streams.end(); ++it)
+                {
+                    it->second->finished = true;
+                    socket_.get_io_service().post(boost::bind(it->second->handler, error_code(boost::asio::error::operation_aborted), response_type()));
+                }
+            }
+
+        protected:
+            typedef basic_hpack_encoder<Tag>                encoder_type;
+            typedef basic_hpack_decoder<Tag>                decoder_type;
+            typedef typename encoder_type::field_type       field_type;
+            typedef typename encoder_type::field_list       field_list;
+            typedef typename header_collection_traits<Tag>::type headers_type;
+
+            struct stream
+            {
+                stream(boost::uint32_t id, boost::int64_t send_window)
+                    : id(id)
+                    , response()
+                    , handler()
+                    , body()
+                    , paced()
+                    , head()
+                    , upload()
+                    , uploaded(0)
+                    , source()
+                    , staged()
+                    , staged_begin(0)
+                    , staged_end(0)
+                    , source_read(0)
+                    , send_window(send_window)
+                    , receive_window(STREAM_WINDOW_SIZE)
+                    , unacked(0)
+                    , backlog()
+                    , piece()
+                    , head_done(false)
+                    , remote_closed(false)
+                    , busy(false)
+                    , delivering(false)
+                    , finished(false)
+                    , source_reading(false)
+                    , source_inline(false)
+                    , source_ended(false)
+                    , source_failed(false)
+                    , upload_done(false)
+                {}
+
+                boost::uint32_t     id;
+                response_type       response;
+                response_handler    handler;
+                body_handler        body;
+                paced_body_handler  paced;
+                head_handler        head;
+                string_type         upload;         // request body
+                std::size_t         uploaded;
+                body_source_ptr     source;         // or where it is read from
+                util::buffer_lease  staged;         // read from the source, not sent yet
+                std::size_t         staged_begin;
+                std::size_t         staged_end;
+                boost::uint64_t     source_read;
+                boost::int64_t      send_window;
+                boost::int64_t      receive_window;
+                std::size_t         unacked;        // consumed, the server wasn't told yet
+                string_type         backlog;        // paced: received, not delivered yet
+                string_type         piece;          // paced: held by the consumer
+                bool                head_done;      // final response head received
+                bool                remote_closed;  // END_STREAM received
+                bool                busy;           // paced: piece not resumed yet
+                bool                delivering;     // paced: inside the body handler
+                bool                finished;       // handler called or about to be
+                bool                source_reading;
+                bool                source_inline;  // inside the source's async_read_some
+                bool                source_ended;   // the source is used up
+                bool                source_failed;
+                bool                upload_done;    // END_STREAM sent
+            };
+
+            typedef boost::shared_ptr<stream>               stream_ptr;
+            typedef std::map<boost::uint32_t, stream_ptr>   stream_map;
+            typedef std::list<stream_ptr>                   stream_list;
+
+            boost::uint32_t open(request_type const & request, response_handler handler, body_handler body, paced_body_handler paced, body_source_ptr source, head_handler head = head_handler())
+            {
+                if(!available())
+                {
+                    error_code const ec = closed() ? error_code(net::error::http_connection_closed) : error_code(net::error::http2_refused_stream);
+                    socket_.get_io_service().post(boost::bind(handler, ec, response_type()));
+                    return 0;
+                }
+
+                stream_ptr s(new stream(next_stream_, initial_send_window_));
+                next_stream_ += 2;
+                s->handler = handler;
+                s->body    = body;
+                s->paced   = paced;
+                s->head    = head;
+                streams_[s->id] = s;
+
+                string_type block;
+                encoder_.encode(request_fields(request, source.get()), block);
+                bool const has_body = source || !request.body().empty();
+                v2::write_headers(output(), s->id, block.data(), block.size(), peer_max_frame_, !has_body);
+                if(source)
+                {
+                    if(source->repeatable())
+                    {
+                        source->rewind();
+                    }
+                    s->source = source;
+                    uploads_.push_back(s);
+                    pump();
+                }
+                else if(has_body)
+                {
+                    s->upload = request.body();
+                    uploads_.push_back(s);
+                    pump();
+                }
+                start_write();
+                return s->id;
+            }
+
+            field_list request_fields(request_type const & request, body_source const * source) const
+            {
+                field_list fields;
+                string_type authority;
+                if(!detail::find_header(request, "Host", authority))
+                {
+                    authority = authority_;
+                }
+                string_type path = request.resource().empty() ? string_type("/") : request.resource();
+                if(!request.query().empty())
+                {
+                    path += '?';
+                    path += request.query();
+                }
+                fields.push_back(field_type(":method", request.method().empty() ? string_type("GET") : request.method()));
+                fields.push_back(field_type(":scheme", scheme_));
+                fields.push_back(field_type(":authority", authority));
+                fields.push_back(field_type(":path", path));
+
+                bool has_length = false;
+                string_type const coding = source ? source->content_encoding() : string_type();
+                headers_type const & headers = request.headers();
+                for(typename headers_type::const_iterator it = headers.begin(); it != headers.end(); ++it)
+                {
+                    string_type const name = lower(it->first);
+                    if(name == "host" || name == "connection" || name == "keep-alive" || name == "proxy-connection"
+                        || name == "transfer-encoding" || name == "upgrade" || (name == "te" && it->second != "trailers"))
+                    {
+                        continue;
+                    }
+                    if(source && (name == "content-length" || (name == "content-encoding" && !coding.empty())))
+                    {
+                        // Described by the source
+                        continue;
+                    }
+                    has_length = has_length || name == "content-length";
+                    fields.push_back(field_type(name, it->second));
+                }
+                if(source)
+                {
+                    if(source->size() != body_source::unknown_size())
+                    {
+                        char length[24];
+                        std::sprintf(length, "%llu", static_cast<unsigned long long>(source->size()));
+                        fields.push_back(field_type("content-length", length));
+                    }
+                    if(!coding.empty())
+                    {
+                        fields.push_back(field_type("content-encoding", coding));
+                    }
+                }
+                else if(!request.body().empty() && !has_length)
+                {
+                    char length[24];
+                    std::sprintf(length, "%lu", static_cast<unsigned long>(request.body().size()));
+                    fields.push_back(field_type("content-length", length));
+                }
+                return fields;
+            }
+
+            static string_type lower(string_type text)
+            {
+                for(typename string_type::iterator it = text.begin(); it != text.end(); ++it)
+                {
+                    if(*it >= 'A' && *it <= 'Z')
+                    {
+                        *it = static_cast<char>(*it - 'A' + 'a');
+                    }
+                }
+                return text;
+            }
+
+            // Sends request bodies as far as the flow control windows allow
+            void pump()
+            {
+                typename stream_list::iterator it = uploads_.begin();
+                while(it != uploads_.end())
+                {
+                    if((*it)->source)
+                    {
+                        if(pump_source(*it))
+                        {
+                            it = uploads_.erase(it);
+                        }
+                        else
+                        {
+                            ++it;
+                        }
+                        continue;
+                    }
+                    stream & s = **it;
+                    while(!s.finished && s.uploaded < s.upload.size() && s.send_window > 0 && send_window_ > 0)
+                    {
+                        std::size_t chunk = s.upload.size() - s.uploaded;
+                        chunk = (std::min)(chunk, peer_max_frame_);
+                        chunk = (std::min)(chunk, static_cast<std::size_t>(s.send_window));
+                        chunk = (std::min)(chunk, static_cast<std::size_t>(send_window_));
+                        bool const last = s.uploaded + chunk == s.upload.size();
+                        v2::write_data(output(), s.id, s.upload.data() + s.uploaded, chunk, last);
+                        s.uploaded    += chunk;
+                        s.send_window -= chunk;
+                        send_window_  -= chunk;
+                    }
+                    if(s.finished || s.uploaded == s.upload.size())
+                    {
+                        string_type().swap(s.upload);
+                        it = uploads_.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            }
+
+            // Sends what was read from the source and reads on, true once
+            // the body is out or the stream is gone
+            bool pump_source(stream_ptr s)
+            {
+                for(;;)
+                {
+                    if(s->finished)
+                    {
+                        return true;
+                    }
+                    if(s->source_failed)
+                    {
+                        return false;
+                    }
+                    if(s->staged_begin == s->staged_end)
+                    {
+                        if(s->source_ended)
+                        {
+                            field_list const trailers = trailer_fields(*s->source);
+                            if(trailers.empty())
+                            {
+                                v2::write_data(output(), s->id, 0, 0, true);
+                            }
+                            else
+                            {
+                                string_type block;
+                                encoder_.encode(trailers, block);
+                                v2::write_headers(output(), s->id, block.data(), block.size(), peer_max_frame_, true);
+                            }
+                            s->upload_done = true;
+                            s->source.reset();
+                            s->staged.reset();
+                            return true;
+                        }
+                        if(s->source_reading || output().size() >= OUTPUT_HIGH_WATER)
+                        {
+                            return false;
+                        }
+                        read_source(s);
+                        continue;
+                    }
+                    if(s->send_window <= 0 || send_window_ <= 0 || output().size() >= OUTPUT_HIGH_WATER)
+                    {
+                        return false;
+                    }
+                    std::size_t chunk = s->staged_end - s->staged_begin;
+                    chunk = (std::min)(chunk, peer_max_frame_);
+                    chunk = (std::min)(chunk, static_cast<std::size_t>(s->send_window));
+                    chunk = (std::min)(chunk, static_cast<std::size_t>(send_window_));
+                    v2::write_data(output(), s->id, s->staged.data() + s->staged_begin, chunk, false);
+                    s->staged_begin += chunk;
+                    s->send_window  -= chunk;
+                    send_window_    -= chunk;
+                }
+            }
+
+            // Trailers end the stream in a HEADERS frame instead of an empty DATA
+            field_list trailer_fields(body_source const & source) const
+            {
+                field_list fields;
+                if(source.size() == body_source::unknown_size())
+                {
+                    headers_type trailers;
+                    source.trailers(trailers);
+                    for(typename headers_type::const_iterator it = trailers.begin(); it != trailers.end(); ++it)
+                    {
+                        fields.push_back(field_type(lower(it->first), it->second));
+                    }
+                }
+                return fields;
+            }
+
+            void read_source(stream_ptr s)
+            {
+                if(s->staged.empty())
+                {
+                    s->staged = util::lease_buffer(UPLOAD_BLOCK_SIZE);
+                }
+                s->staged_begin = s->staged_end = 0;
+                s->source_reading = true;
+                s->source_inline  = true;
+                s->source->async_read_some(
+                    s->staged.data(),
+                    s->staged.size(),
+                    boost::bind(&basic_http2_session::on_source, this->shared_from_this(), s, _1, _2)
+                );
+                s->source_inline = false;
+            }
+
+            void on_source(stream_ptr s, error_code ec, std::size_t bytes)
+            {
+                s->source_reading = false;
+                if(s->finished || closed())
+                {
+                    return;
+                }
+                s->source_read += bytes;
+                boost::uint64_t const size = s->source->size();
+                if(!ec && size != body_source::unknown_size() && (s->source_read > size || (!bytes && s->source_read != size)))
+                {
+                    ec = net::error::http_body_size_mismatch;
+                }
+                if(ec)
+                {
+                    // Not from within submit or pump
+                    s->source_failed = true;
+                    socket_.get_io_service().post(boost::bind(&basic_http2_session::cancel_upload, this->shared_from_this(), s, ec));
+                    return;
+                }
+                s->staged_end   = bytes;
+                s->source_ended = !bytes;
+                if(!s->source_inline)
+                {
+                    pump();
+                    start_write();
+                }
+            }
+
+            void cancel_upload(stream_ptr s, error_code const & ec)
+            {
+                if(s->finished || closed())
+                {
+                    return;
+                }
+                reset(s, net::error::http2_cancel, ec);
+                start_write();
+            }
+
+            static bool uploading(stream const & s)
+            {
+                return s.uploaded < s.upload.size() || (s.source && !s.upload_done);
+            }
+
+            util::output_buffer & output()
+            {
+                return output_[filling_];
+            }
+
+            // Frames are collected in one buffer while the other one is
+            // being written
+            void start_write()
+            {
+                if(writing_ || closed_ || output_[filling_].empty())
+                {
+                    return;
+                }
+                std::size_t const sending = filling_;
+                filling_ ^= 1;
+                writing_ = true;
+                boost::asio::async_write(
+                    socket_,
+                    output_[sending].data(),
+                    boost::bind(
+                        &basic_http2_session::on_written,
+                        this->shared_from_this(),
+                        sending,
+                        boost::asio::placeholders::error
+                    )
+                );
+            }
+
+            void on_written(std::size_t index, error_code const & ec)
+            {
+                writing_ = false;
+                output_[index].clear();
+                if(closed_)
+                {
+                    return;
+                }
+                if(ec)
+                {
+                    terminate(ec);
+                    return;
+                }
+                if(closing_ && output_[filling_].empty())
+                {
+                    // The GOAWAY is out
+                    shutdown();
+                    return;
+                }
+                if(!closing_)
+                {
+                    // Bodies held back by OUTPUT_HIGH_WATER
+                    pump();
+                }
+                start_write();
+            }
+
+            void start_read()
+            {
+                if(reading_ || closed())
+                {
+                    return;
+                }
+                if(input_.empty())
+                {
+                    input_ = util::lease_buffer(INPUT_BUFFER_SIZE);
+                }
+                reading_ = true;
+                socket_.async_read_some(
+                    boost::asio::buffer(input_.data() + input_end_, input_.size() - input_end_),
+                    boost::bind(
+                        &basic_http2_session::on_read,
+                        this->shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred
+                    )
+                );
+            }
+
+            void on_read(error_code const & ec, std::size_t bytes)
+            {
+                reading_ = false;
+                if(closed())
+                {
+                    return;
+                }
+                if(ec)
+                {
+                    terminate(ec == boost::asio::error::eof ? error_code(net::error::http_connection_closed) : ec);
+                    return;
+                }
+
+                input_end_ += bytes;
+                unsigned char const * data = reinterpret_cast<unsigned char const *>(input_.data());
+                while(!closed() && input_end_ - input_begin_ >= v2::FRAME_HEADER_SIZE)
+                {
+                    v2::frame_header header;
+                    header.read(data + input_begin_);
+                    if(header.length > v2::DEFAULT_MAX_FRAME_SIZE)
+                    {
+                        // Bigger than the default we never raised
+                        connection_error(net::error::http2_frame_size_error);
+                        break;
+                    }
+                    if(input_end_ - input_begin_ < v2::FRAME_HEADER_SIZE + header.length)
+                    {
+                        break;
+                    }
+                    unsigned char const * payload = data + input_begin_ + v2::FRAME_HEADER_SIZE;
+                    input_begin_ += v2::FRAME_HEADER_SIZE + header.length;
+                    handle(header, payload);
+                }
+                if(closed_)
+                {
+                    return;
+                }
+
+                // The incomplete frame moves to the front
+                std::memmove(input_.data(), input_.data() + input_begin_, input_end_ - input_begin_);
+                input_end_  -= input_begin_;
+                input_begin_ = 0;
+                start_write();
+                start_read();
+            }
+
+            void handle(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(fragment_stream_ && header.type != v2::FRAME_CONTINUATION)
+                {
+                    // A header block must not be interrupted
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                switch(header.type)
+                {
+                case v2::FRAME_DATA:
+                    on_data(header, payload);
+                    break;
+                case v2::FRAME_HEADERS:
+                    on_headers(header, payload);
+                    break;
+                case v2::FRAME_PRIORITY:
+                    if(header.length != 5)
+                    {
+                        connection_error(net::error::http2_frame_size_error);
+                    }
+                    break;
+                case v2::FRAME_RST_STREAM:
+                    on_rst_stream(header, payload);
+                    break;
+                case v2::FRAME_SETTINGS:
+                    on_settings(header, payload);
+                    break;
+                case v2::FRAME_PUSH_PROMISE:
+                    // Push was disabled in our settings
+                    connection_error(net::error::http2_protocol_error);
+                    break;
+                case v2::FRAME_PING:
+                    on_ping(header, payload);
+                    break;
+                case v2::FRAME_GOAWAY:
+                    on_goaway(header, payload);
+                    break;
+                case v2::FRAME_WINDOW_UPDATE:
+                    on_window_update(header, payload);
+                    break;
+                case v2::FRAME_CONTINUATION:
+                    on_continuation(header, payload);
+                    break;
+                default:
+                    // Unknown frame types are ignored
+                    break;
+                }
+            }
+
+            // Removes the padding of DATA and HEADERS frames
+            static bool strip_padding(v2::frame_header const & header, unsigned char const *& payload, std::size_t & length)
+            {
+                length = header.length;
+                if(!header.has(v2::FLAG_PADDED))
+                {
+                    return true;
+                }
+                if(!length)
+                {
+                    return false;
+                }
+                std::size_t const padding = *payload++;
+                --length;
+                if(padding > length)
+                {
+                    return false;
+                }
+                length -= padding;
+                return true;
+            }
+
+            // Streams we never opened, or which the server pushed
+            bool idle(boost::uint32_t id) const
+            {
+                return id >= next_stream_ || !(id & 1);
+            }
+
+            stream_ptr find(boost::uint32_t id) const
+            {
+                typename stream_map::const_iterator it = streams_.find(id);
+                return it != streams_.end() ? it->second : stream_ptr();
+            }
+
+            void on_data(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(!header.stream || idle(header.stream))
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                if(header.length > receive_window_)
+                {
+                    connection_error(net::error::http2_flow_control_error);
+                    return;
+                }
+                receive_window_ -= header.length;
+                acknowledge(header.length);
+
+                unsigned char const * data = payload;
+                std::size_t length = 0;
+                if(!strip_padding(header, data, length))
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+
+                stream_ptr s = find(header.stream);
+                if(!s)
+                {
+                    // Reset by us, frames in flight are dropped
+                    return;
+                }
+                if(header.length > s->receive_window)
+                {
+                    reset(s, net::error::http2_flow_control_error);
+                    return;
+                }
+                s->receive_window -= header.length;
+                if(!s->head_done || s->remote_closed)
+                {
+                    reset(s, net::error::http2_protocol_error);
+                    return;
+                }
+                s->remote_closed = header.has(v2::FLAG_END_STREAM);
+                credit(*s, header.length - length);
+
+                if(s->paced)
+                {
+                    s->backlog.append(reinterpret_cast<char const *>(data), length);
+                    pace(s);
+                    return;
+                }
+                if(length)
+                {
+                    if(s->body)
+                    {
+                        s->body(s->response, reinterpret_cast<char const *>(data), length);
+                    }
+                    else
+                    {
+                        s->response.body().append(reinterpret_cast<char const *>(data), length);
+                    }
+                }
+                if(s->finished)
+                {
+                    return;
+                }
+                credit(*s, length);
+                if(s->remote_closed)
+                {
+                    finish(s);
+                }
+            }
+
+            // Hands the received data to a paced consumer, one piece at a time
+            void pace(stream_ptr s)
+            {
+                while(!s->busy && !s->finished && !closed_)
+                {
+                    if(s->backlog.empty())
+                    {
+                        if(s->remote_closed)
+                        {
+                            finish(s);
+                        }
+                        return;
+                    }
+                    s->piece.clear();
+                    s->piece.swap(s->backlog);
+                    if(s->remote_closed)
+                    {
+                        // The last piece, nothing left to hold back
+                        s->paced(s->response, s->piece.data(), s->piece.size(), resume_handler(&basic_http2_session::ignore));
+                        if(!s->finished)
+                        {
+                            finish(s);
+                        }
+                        return;
+                    }
+                    s->busy       = true;
+                    s->delivering = true;
+                    s->paced(
+                        s->response,
+                        s->piece.data(),
+                        s->piece.size(),
+                        resume_handler(boost::bind(&basic_http2_session::resume, this->shared_from_this(), s))
+                    );
+                    s->delivering = false;
+                }
+            }
+
+            // The paced consumer is done with its piece, the server may
+            // send that much more
+            void resume(stream_ptr s)
+            {
+                if(!s->busy || s->finished)
+                {
+                    return;
+                }
+                s->busy = false;
+                credit(*s, s->piece.size());
+                if(!s->delivering)
+                {
+                    pace(s);
+                    start_write();
+                }
+            }
+
+            static void ignore()
+            {}
+
+            // Consumed data of a stream, the window is opened again once half
+            // of it is used up
+            void credit(stream & s, std::size_t size)
+            {
+                if(!size || s.remote_closed)
+                {
+                    return;
+                }
+                s.unacked += size;
+                if(s.unacked >= STREAM_WINDOW_SIZE / 2)
+                {
+                    v2::write_window_update(output(), s.id, static_cast<boost::uint32_t>(s.unacked));
+                    s.receive_window += s.unacked;
+                    s.unacked = 0;
+                }
+            }
+
+            // Same for the connection window, all data counts as consumed
+            // right away
+            void acknowledge(std::size_t size)
+            {
+                unacked_ += size;
+                if(unacked_ >= CONNECTION_WINDOW_SIZE / 2)
+                {
+                    v2::write_window_update(output(), 0, static_cast<boost::uint32_t>(unacked_));
+                    receive_window_ += unacked_;
+                    unacked_ = 0;
+                }
+            }
+
+            void on_headers(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(!header.stream)
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                unsigned char const * data = payload;
+                std::size_t length = 0;
+                if(!strip_padding(header, data, length))
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                if(header.has(v2::FLAG_PRIORITY))
+                {
+                    if(length < 5)
+                    {
+                        connection_error(net::error::http2_frame_size_error);
+                        return;
+                    }
+                    data   += 5;
+                    length -= 5;
+                }
+                fragment_.assign(reinterpret_cast<char const *>(data), length);
+                fragment_stream_     = header.stream;
+                fragment_end_stream_ = header.has(v2::FLAG_END_STREAM);
+                if(header.has(v2::FLAG_END_HEADERS))
+                {
+                    end_headers();
+                }
+            }
+
+            void on_continuation(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(!fragment_stream_ || header.stream != fragment_stream_)
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                if(fragment_.size() + header.length > HEADER_LIST_MAX)
+                {
+                    connection_error(net::error::http2_enhance_your_calm, net::error::http_header_too_large);
+                    return;
+                }
+                fragment_.append(reinterpret_cast<char const *>(payload), header.length);
+                if(header.has(v2::FLAG_END_HEADERS))
+                {
+                    end_headers();
+                }
+            }
+
+            // A complete header block arrived
+            void end_headers()
+            {
+                boost::uint32_t const id = fragment_stream_;
+                bool const end_stream = fragment_end_stream_;
+                fragment_stream_ = 0;
+
+                // Decoded even for streams we dropped, the table is shared
+                typename decoder_type::field_list fields;
+                bool const decoded = decoder_.decode(fragment_.data(), fragment_.size(), fields);
+                fragment_.clear();
+                if(!decoded)
+                {
+                    connection_error(net::error::http2_compression_error);
+                    return;
+                }
+
+                stream_ptr s = find(id);
+                if(!s)
+                {
+                    if(idle(id))
+                    {
+                        connection_error(net::error::http2_protocol_error);
+                    }
+                    return;
+                }
+                if(s->remote_closed)
+                {
+                    reset(s, net::error::http2_stream_closed);
+                    return;
+                }
+
+                if(decoder_.list_size_exceeded())
+                {
+                    reset(s, net::error::http2_cancel, net::error::http_header_too_large);
+                    return;
+                }
+
+                if(!s->head_done)
+                {
+                    unsigned status = 0;
+                    for(typename field_list::const_iterator it = fields.begin(); it != fields.end(); ++it)
+                    {
+                        if(it->first == ":status")
+                        {
+                            status = parse_status(it->second);
+                        }
+                    }
+                    if(!status)
+                    {
+                        reset(s, net::error::http2_protocol_error);
+                        return;
+                    }
+                    if(status < 200)
+                    {
+                        // Informational, the final head follows
+                        if(end_stream)
+                        {
+                            reset(s, net::error::http2_protocol_error);
+                        }
+                        return;
+                    }
+                    s->response.status_code() = static_cast<typename response_type::status_code_type>(status);
+                    s->response.version() = typename response_type::version_type(2, 0);
+                    s->head_done = true;
+                }
+                else if(!end_stream)
+                {
+                    // Trailers have to end the stream
+                    reset(s, net::error::http2_protocol_error);
+                    return;
+                }
+
+                headers_type & headers = s->response.headers();
+                for(typename field_list::const_iterator it = fields.begin(); it != fields.end(); ++it)
+                {
+                    if(!it->first.empty() && it->first[0] != ':')
+                    {
+                        headers.insert(typename headers_type::value_type(it->first, it->second));
+                    }
+                }
+                if(s->head)
+                {
+                    head_handler head;
+                    head.swap(s->head);
+                    head(s->response);
+                }
+
+                if(end_stream)
+                {
+                    s->remote_closed = true;
+                    if(s->paced)
+                    {
+                        pace(s);
+                    }
+                    else
+                    {
+                        finish(s);
+                    }
+                }
+            }
+
+            static unsigned parse_status(string_type const & text)
+            {
+                if(text.size() != 3)
+                {
+                    return 0;
+                }
+                unsigned status = 0;
+                for(std::size_t i = 0; i < 3; ++i)
+                {
+                    if(text[i] < '0' || text[i] > '9')
+                    {
+                        return 0;
+                    }
+                    status = status * 10 + (text[i] - '0');
+                }
+                return status >= 100 ? status : 0;
+            }
+
+            void on_rst_stream(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(header.length != 4)
+                {
+                    connection_error(net::error::http2_frame_size_error);
+                    return;
+                }
+                if(!header.stream || idle(header.stream))
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                stream_ptr s = find(header.stream);
+                if(!s)
+                {
+                    return;
+                }
+                boost::uint32_t const code = v2::read_uint32(payload);
+                remove(s);
+                s->handler(code == v2::NO_ERROR_CODE ? error_code(net::error::http_connection_closed) : error_code(code, net::error::get_http2_category()), s->response);
+            }
+
+            void on_settings(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(header.stream)
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                if(header.has(v2::FLAG_ACK))
+                {
+                    if(header.length)
+                    {
+                        connection_error(net::error::http2_frame_size_error);
+                    }
+                    return;
+                }
+                if(header.length % v2::SETTING_SIZE)
+                {
+                    connection_error(net::error::http2_frame_size_error);
+                    return;
+                }
+                for(unsigned char const * setting = payload; setting != payload + header.length; setting += v2::SETTING_SIZE)
+                {
+                    unsigned const id = (unsigned(setting[0]) << 8) | setting[1];
+                    boost::uint32_t const value = v2::read_uint32(setting + 2);
+                    switch(id)
+                    {
+                    case v2::SETTINGS_ENABLE_PUSH:
+                        if(value > 1)
+                        {
+                            connection_error(net::error::http2_protocol_error);
+                            return;
+                        }
+                        break;
+                    case v2::SETTINGS_MAX_CONCURRENT_STREAMS:
+                        max_streams_ = value;
+                        break;
+                    case v2::SETTINGS_INITIAL_WINDOW_SIZE:
+                        if(value > v2::MAX_WINDOW_SIZE)
+                        {
+                            connection_error(net::error::http2_flow_control_error);
+                            return;
+                        }
+                        // Applies to the open streams as well
+                        for(typename stream_map::iterator it = streams_.begin(); it != streams_.end(); ++it)
+                        {
+                            it->second->send_window += boost::int64_t(value) - initial_send_window_;
+                        }
+                        initial_send_window_ = value;
+                        break;
+                    case v2::SETTINGS_MAX_FRAME_SIZE:
+                        if(value < v2::DEFAULT_MAX_FRAME_SIZE || value > v2::MAX_FRAME_SIZE_LIMIT)
+                        {
+                            connection_error(net::error::http2_protocol_error);
+                            return;
+                        }
+                        peer_max_frame_ = value;
+                        break;
+                    case v2::SETTINGS_HEADER_TABLE_SIZE:
+                        encoder_.set_max_table_size(value);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                v2::write_settings_ack(output());
+                pump();
+            }
+
+            void on_ping(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(header.length != 8)
+                {
+                    connection_error(net::error::http2_frame_size_error);
+                    return;
+                }
+                if(header.stream)
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                if(!header.has(v2::FLAG_ACK))
+                {
+                    v2::write_ping(output(), reinterpret_cast<char const *>(payload), true);
+                }
+            }
+
+            void on_goaway(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(header.length < 8)
+                {
+                    connection_error(net::error::http2_frame_size_error);
+                    return;
+                }
+                if(header.stream)
+                {
+                    connection_error(net::error::http2_protocol_error);
+                    return;
+                }
+                goaway_ = true;
+
+                // Streams above the last one were not processed
+                boost::uint32_t const last = v2::read_uint32(payload) & v2::MAX_WINDOW_SIZE;
+                std::vector<stream_ptr> refused;
+                for(typename stream_map::iterator it = streams_.upper_bound(last); it != streams_.end(); ++it)
+                {
+                    refused.push_back(it->second);
+                }
+                for(typename std::vector<stream_ptr>::iterator it = refused.begin(); it != refused.end(); ++it)
+                {
+                    remove(*it);
+                }
+                if(streams_.empty())
+                {
+                    shutdown();
+                }
+                for(typename std::vector<stream_ptr>::iterator it = refused.begin(); it != refused.end(); ++it)
+                {
+                    (*it)->handler(net::error::http2_refused_stream, (*it)->response);
+                }
+            }
+
+            void on_window_update(v2::frame_header const & header, unsigned char const * payload)
+            {
+                if(header.length != 4)
+                {
+                    connection_error(net::error::http2_frame_size_error);
+                    return;
+                }
+                boost::uint32_t const increment = v2::read_uint32(payload) & v2::MAX_WINDOW_SIZE;
+                if(!header.stream)
+                {
+                    if(!increment || send_window_ + increment > v2::MAX_WINDOW_SIZE)
+                    {
+                        connection_error(increment ? net::error::http2_flow_control_error : net::error::http2_protocol_error);
+                        return;
+                    }
+                    send_window_ += increment;
+                }
+                else
+                {
+                    stream_ptr s = find(header.stream);
+                    if(!s)
+                    {
+                        return;
+                    }
+                    if(!increment || s->send_window + increment > v2::MAX_WINDOW_SIZE)
+                    {
+                        reset(s, increment ? net::error::http2_flow_control_error : net::error::http2_protocol_error);
+                        return;
+                    }
+                    s->send_window += increment;
+                }
+                pump();
+            }
+
+            // The response is complete
+            void finish(stream_ptr s)
+            {
+                if(uploading(*s))
+                {
+                    // The server answered without reading the whole body
+                    v2::write_rst_stream(output(), s->id, net::error::http2_cancel);
+                }
+                remove(s);
+                if(goaway_ && streams_.empty())
+                {
+                    shutdown();
+                }
+                s->handler(error_code(), s->response);
+            }
+
+            // Stream error, the stream is reset and its request fails
+            void reset(stream_ptr s, net::error::http2_errors code)
+            {
+                reset(s, code, code);
+            }
+
+            void reset(stream_ptr s, boost::uint32_t code, error_code const & ec)
+            {
+                v2::write_rst_stream(output(), s->id, code);
+                remove(s);
+                s->handler(ec, s->response);
+            }
+
+            void remove(stream_ptr s)
+            {
+                s->finished = true;
+                streams_.erase(s->id);
+                if(streams_.empty())
+                {
+                    idle_since_ = now();
+                }
+            }
+
+            // Connection error, the server is told why with GOAWAY and the
+            // connection closes once that is written
+            void connection_error(net::error::http2_errors code)
+            {
+                connection_error(code, code);
+            }
+
+            void connection_error(boost::uint32_t code, error_code const & ec)
+            {
+                if(closed())
+                {
+                    return;
+                }
+                v2::write_goaway(output(), 0, code);
+                closing_ = true;
+                start_write();
+                fail(ec);
+            }
+
+            // The connection is gone
+            void terminate(error_code const & ec)
+            {
+                shutdown();
+                fail(ec);
+            }
+
+            void fail(error_code const & ec)
+            {
+                stream_map streams;
+                streams.swap(streams_);
+                uploads_.clear();
+                idle_since_ = now();
+                for(typename stream_map::iterator it = streams.begin(); it != streams.end(); ++it)
+                {
+                    it->second->finished = true;
+                    it->second->handler(ec, it->second->response);
+                }
+            }
+
+            void shutdown()
+            {
+                if(closed_)
+                {
+                    return;
+                }
+                closed_ = true;
+                error_code ignored;
+                socket_.socket().close(ignored);
+            }
+
+            static time_type now()
+            {
+                return boost::posix_time::microsec_clock::universal_time();
+            }
+
+        private:
+            socket_type             socket_;
+            string_type             scheme_;
+            string_type             authority_;
+            stream_map              streams_;
+            stream_list             uploads_;           // request bodies still being sent
+            encoder_type            encoder_;
+            decoder_type            decoder_;
+            util::output_buffer     output_[2];         // one on the wire, one collecting
+            std::size_t             filling_;
+            util::buffer_lease      input_;
+            std::size_t             input_begin_;
+            std::size_t             input_end_;
+            string_type             fragment_;          // header block in progress
+            boost::uint32_t         fragment_stream_;   // 0 unless CONTINUATION is expected
+            bool                    fragment_end_stream_;
+            boost::int64_t          send_window_;
+            boost::int64_t          receive_window_;
+            std::size_t             unacked_;
+            boost::int64_t          initial_send_window_;
+            std::size_t             peer_max_frame_;
+            std::size_t             max_streams_;
+            boost::uint32_t         next_stream_;
+            time_type               idle_since_;
+            bool                    writing_;
+            bool                    reading_;
+            bool                    goaway_;            // no new streams
+            bool                    closing_;           // GOAWAY sent after an error
+            bool                    closed_;
+        };
+    }
+}
+
+#endif //GUARD_NET_HTTP_V2_SESSION_HPP_INCLUDED
@@ -83,4 +83,111 @@ solution "libnetpp"
             flags { "Optimize" }         
 
 
+    project "bench_ktls"
+        kind "ConsoleApp"
+        language "C++"
+        uuid "8E0C5C8B-3F0A-4C55-9E59-6C1A4E37B1D2"
+        basedir "."
+        files { "bench/ktls/**.cpp" }
+        includedirs { "." }
+
+        configuration "linux"
+            buildoptions { "-W", "-Wall", "-Wno-long-long", "-std=c++98", "-pedantic"}
+            links { "boost_system", "ssl", "crypto" }
 
+        configuration "Debug"
+            targetdir "bin/debug"
+            defines { "DEBUG" }
+            flags { "Symbols" }
+ 
+        configuration "Release"
+            targetdir "bin/release"
+            defines { "NDEBUG" }
+            flags { "Optimize" }         
+
+
+    project "bench_request_writer"
+        kind "ConsoleApp"
+        language "C++"
+        uuid "2B7A4E61-95C3-4F0E-8D2A-7C1E5B9F3A64"
+        basedir "."
+        files { "bench/request_writer/**.cpp" }
+        includedirs { "." }
+
+        configuration "linux"
+            buildoptions { "-W", "-Wall", "-Wno-long-long", "-std=c++98", "-pedantic"}
+            links { "boost_system" }
+
+        configuration "Debug"
+            targetdir "bin/debug"
+            defines { "DEBUG" }
+            flags { "Symbols" }
+ 
+        configuration "Release"
+            targetdir "bin/release"
+            defines { "NDEBUG" }
+            flags { "Optimize" }
+
+    project "bench_pipeline"
+        kind "ConsoleApp"
+        language "C++"
+        uuid "5D3F8A27-1C64-4B9E-A0F2-6E8B3D71C945"
+        basedir "."
+        files { "bench/pipeline/**.cpp" }
+        includedirs { "." }
+
+        configuration "linux"
+            buildoptions { "-W", "-Wall", "-Wno-long-long", "-std=c++98", "-pedantic"}
+            links { "boost_system", "ssl", "crypto", "z" }
+
+        configuration "Debug"
+            targetdir "bin/debug"
+            defines { "DEBUG" }
+            flags { "Symbols" }
+ 
+        configuration "Release"
+            targetdir "bin/release"
+            defines { "NDEBUG" }
+            flags { "Optimize" }         
+
+    project "bench_chunked"
+        kind "ConsoleApp"
+        language "C++"
+        uuid "E3A96C15-4B7D-4F28-9D60-1B8C2F57A4E9"
+        basedir "."
+        files { "bench/chunked/**.cpp" }
+        includedirs { "." }
+
+        configuration "linux"
+            buildoptions { "-W", "-Wall", "-Wno-long-long", "-std=c++98", "-pedantic"}
+
+        configuration "Debug"
+            targetdir "bin/debug"
+            defines { "DEBUG" }
+            flags { "Symbols" }
+ 
+        configuration "Release"
+            targetdir "bin/release"
+            defines { "NDEBUG" }
+            flags { "Optimize" }         
+
+    project "bench_hpack"
+        kind "ConsoleApp"
+        language "C++"
+        uuid "9C41E6B2-7A08-4D35-B1F9-3E2A5C8D0F76"
+        basedir "."
+        files { "bench/hpack/**.cpp" }
+        includedirs { "." }
+
+        configuration "linux"
+            buildoptions { "-W", "-Wall", "-Wno-long-long", "-std=c++98", "-pedantic"}
+
+        configuration "Debug"
+            targetdir "bin/debug"
+            defines { "DEBUG" }
+            flags { "Symbols" }
+ 
+        configuration "Release"
+            targetdir "bin/release"
+            defines { "NDEBUG" }
+            flags { "Optimize" }         
@@ -26,6 +26,8 @@
 #include <iostream>
 #include <net/client/client.hpp>
 #include <net/detail/tags.hpp>
+#include <net/detail/log.hpp>
+#include <net/http/request/request_writer.hpp>
 
 #include <net/client/proxy/socks5.hpp>
 #include <net/client/proxy/socks4.hpp>
@@ -35,31 +37,27 @@
 
 typedef net::basic_client<net::default_tag> client;
 typedef net::socket_adapter<net::default_tag> socket_type;
-char SSL_REQUEST[] =
-"GET / HTTP/1.1\r\n"
-"Host: encrypted.google.com\r\n"
-"Connection: Close\r\n"
-"User-Agent: libnetpp 0.0.9alpha\r\n"
-"\r\n";
-
-char REQUEST[] =
-"GET / HTTP/1.1\r\n"
-"Host: www.google.cz\r\n"
-"Connection: Close\r\n"
-"User-Agent: libnetpp 0.0.9alpha\r\n"
-"\r\n";
-
-char HTTPS_REQUEST[] =
-"GET /mail HTTP/1.1\r\n"
-"Host: mail.google.com\r\n"
-"Connection: Close\r\n"
-"User-Agent: libnetpp 0.0.9alpha\r\n"
-"\r\n";
-
-typedef boost::array<char, 0x10000> buffer_t;
-
-void read_buffer(socket_type & s, buffer_t * buffer, std::string const & name);
-void response_received(socket_type & s, buffer_t * buffer, boost::system::error_code const & ec, size_t bytes_received, std::string const & name)
+typedef net::http::basic_request<net::default_tag> request_type;
+typedef net::http::basic_request_writer<net::default_tag> request_writer;
+typedef boost::shared_ptr<net::util::output_buffer> output_ptr;
+
+output_ptr make_request(std::string const & host, std::string const & resource)
+{
+    boost::shared_ptr<net::http::basic_header_block<net::default_tag> > common(new net::http::basic_header_block<net::default_tag>());
+    common->add("Host", host)
+           .add("Connection", "Close")
+           .add("User-Agent", "libnetpp 0.0.9alpha");
+
+    request_type request;
+    request.resource() = resource;
+
+    output_ptr out(new net::util::output_buffer());
+    request_writer(common).write(*out, request);
+    return out;
+}
+
+void read_buffer(socket_type & s, std::string const & name);
+void response_received(socket_type & s, boost::system::error_code const & ec, net::util::buffer_lease buffer, size_t bytes_received, std::string const & name)
 {
     std::cout << "[" << name << "]: Received ("
               << "Error code: " << ec << " message: " << ec.message() << "):\n";
@@ -68,12 +66,12 @@ void response_received(socket_type & s, buffer_t * buffer, boost::system::error_
         std::cout << "NO DATA\n\n";
         return;
     }
-    std::cout << std::string(buffer->data(), buffer->data() + bytes_received);
-    read_buffer(s, buffer, name);
+    std::cout << std::string(buffer.data(), buffer.data() + bytes_received);
+    read_buffer(s, name);
 
 }
 
-void request_sent(socket_type & s, boost::system::error_code const & ec, size_t, std::string const & name)
+void request_sent(socket_type & s, boost::system::error_code const & ec, size_t, std::string const & name, output_ptr)
 {
     if(ec)
     {
@@ -81,16 +79,14 @@ void request_sent(socket_type & s, boost::system::error_code const & ec, size_t,
         return;
     }
     std::cout << "[" << name << "]: Request sent waiting for reply:\n";
-    read_buffer(s, new buffer_t(), name);
+    read_buffer(s, name);
 }
 
-void read_buffer(socket_type & s, buffer_t * buffer, std::string const & name)
+void read_buffer(socket_type & s, std::string const & name)
 {
-    boost::asio::async_read(
-        s,
-        boost::asio::buffer(*buffer),
-        boost::asio::transfer_at_least(1),
-        boost::bind(response_received,boost::ref(s),buffer,_1,_2,name)
+    s.async_read_leased(
+        0x10000,
+        boost::bind(response_received,boost::ref(s),_1,_2,_3,name)
     );
 }
 
@@ -98,17 +94,19 @@ void read_buffer(socket_type & s, buffer_t * buffer, std::string const & name)
 void send_request(socket_type & s, std::string const & name)
 {
     std::cout << "[" << name << "]: Sending request:\n";
+    output_ptr request = name == "Plain"
+        ? make_request("www.google.cz", "/")
+        : make_request("encrypted.google.com", "/");
     boost::asio::async_write(
         s,
-        (name == "Plain"
-         ?   boost::asio::buffer(REQUEST, strlen(REQUEST))
-         :   boost::asio::buffer(SSL_REQUEST, strlen(SSL_REQUEST))),
+        request->data(),
         boost::bind(
             request_sent,
             boost::ref(s),
             boost::asio::placeholders::error,
             boost::asio::placeholders::bytes_transferred,
-            name
+            name,
+            request
         )
     );
 }
@@ -131,6 +129,12 @@ int main(int argc, char const **argv)
 {
     try
     {
+        // Library diagnostics go to the console through a background thread
+        net::log::set_sink(
+            net::log::sink_ptr(new net::log::async_sink(net::log::sink_ptr(new net::log::ostream_sink(std::cout)))),
+            net::log::debug
+        );
+
         boost::asio::io_service service;
 
         boost::asio::ssl::context ctx(service, boost::asio::ssl::context::sslv23);
@@ -166,7 +170,7 @@ int main(int argc, char const **argv)
         {
             throw boost::system::system_error(ec);
         }
-        c.socket().write_some(boost::asio::buffer(REQUEST, strlen(REQUEST)));
+        boost::asio::write(c.socket(), make_request("www.google.cz", "/")->data());
 
         while((count = boost::asio::read(c.socket(), boost::asio::buffer(buffer), boost::asio::transfer_at_least(1), ec)) > 0)
         {
@@ -178,7 +182,7 @@ int main(int argc, char const **argv)
         ssl_c.set_proxy(socks4_proxy_ptr);
 
         ssl_c.connect("mail.google.com", "443", ec); // , boost::bind(say, boost::ref(ssl_c.socket()), _1, "SSL"));
-        boost::asio::write(ssl_c.socket(), boost::asio::buffer(HTTPS_REQUEST, strlen(HTTPS_REQUEST)));
+        boost::asio::write(ssl_c.socket(), make_request("mail.google.com", "/mail")->data());
         while((count = boost::asio::read(ssl_c.socket(), boost::asio::buffer(buffer), boost::asio::transfer_at_least(1), ec)) > 0)
         {
             std::cout << std::string(buffer.data(), buffer.data()+count) << std::endl;